@@ -0,0 +1,84 @@
+#include "BufferPool.h"
+
+BufferPoolStats& BufferPoolStats::operator+=(const BufferPoolStats& other) {
+    inUseBytes += other.inUseBytes;
+    highWaterBytes += other.highWaterBytes;
+    cachedBytes += other.cachedBytes;
+    acquires += other.acquires;
+    allocations += other.allocations;
+    return *this;
+}
+
+BufferPool::BufferPool(size_t minSize, size_t maxSize, size_t maxCachedBytes)
+    : _minSize(1024), _maxCachedBytes(maxCachedBytes) {
+    // 最小等级向上取整到2的幂，至少1KB
+    while (_minSize < minSize) {
+        _minSize <<= 1;
+    }
+    size_t classes = 1;
+    while ((_minSize << classes) <= maxSize) {
+        ++classes;
+    }
+    _free.resize(classes);
+}
+
+BufferPool::~BufferPool() {
+    for (auto& list : _free) {
+        for (char* buffer : list) {
+            delete[] buffer;
+        }
+    }
+}
+
+char* BufferPool::Acquire(size_t sizeClass) {
+    if (sizeClass >= _free.size()) {
+        sizeClass = _free.size() - 1;
+    }
+    size_t size = ClassSize(sizeClass);
+    char* buffer;
+    auto& list = _free[sizeClass];
+    if (!list.empty()) {
+        buffer = list.back();  // 优先复用空闲缓冲区
+        list.pop_back();
+        Sub(_cachedBytes, size);
+    }
+    else {
+        buffer = new char[size];
+        Add(_allocations, 1);
+    }
+
+    Add(_acquires, 1);
+    Add(_inUseBytes, size);
+    size_t inUse = _inUseBytes.load(std::memory_order_relaxed);
+    if (inUse > _highWaterBytes.load(std::memory_order_relaxed)) {
+        _highWaterBytes.store(inUse, std::memory_order_relaxed);
+    }
+    return buffer;
+}
+
+void BufferPool::Release(char* buffer, size_t sizeClass) {
+    if (buffer == nullptr) {
+        return;
+    }
+    if (sizeClass >= _free.size()) {
+        sizeClass = _free.size() - 1;
+    }
+    size_t size = ClassSize(sizeClass);
+    Sub(_inUseBytes, size);
+    if (_cachedBytes.load(std::memory_order_relaxed) + size > _maxCachedBytes) {
+        delete[] buffer;  // 缓存已满，直接还给系统
+        return;
+    }
+    _free[sizeClass].push_back(buffer);
+    Add(_cachedBytes, size);
+}
+
+BufferPoolStats BufferPool::Stats() const {
+    BufferPoolStats stats;
+    stats.inUseBytes = _inUseBytes.load(std::memory_order_relaxed);
+    stats.highWaterBytes = _highWaterBytes.load(std::memory_order_relaxed);
+    stats.cachedBytes = _cachedBytes.load(std::memory_order_relaxed);
+    stats.acquires = _acquires.load(std::memory_order_relaxed);
+    stats.allocations = _allocations.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 缓冲池的统计信息
+struct BufferPoolStats {
+    size_t inUseBytes = 0;      // 当前被连接占用的字节数
+    size_t highWaterBytes = 0;  // 占用字节数的历史最高值
+    size_t cachedBytes = 0;     // 空闲链表中缓存的字节数
+    uint64_t acquires = 0;      // 取出缓冲区的次数
+    uint64_t allocations = 0;   // 实际向系统申请内存的次数
+
+    BufferPoolStats& operator+=(const BufferPoolStats& other);
+};
+
+// 中继缓冲区的分级缓冲池：按2的幂划分为若干大小等级，每级一个空闲链表，
+// 归还的缓冲区优先复用，超过缓存上限的部分才释放给系统。
+// 每个工作线程拥有自己的缓冲池，Acquire/Release只能在该线程调用，Stats可以在任意线程读取
+class BufferPool {
+public:
+    BufferPool(size_t minSize, size_t maxSize, size_t maxCachedBytes);
+    ~BufferPool();
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    char* Acquire(size_t sizeClass);
+    void Release(char* buffer, size_t sizeClass);
+
+    size_t ClassSize(size_t sizeClass) const { return _minSize << sizeClass; }
+    size_t ClassCount() const { return _free.size(); }
+
+    BufferPoolStats Stats() const;
+
+private:
+    // 只有所属线程会写入，其他线程只读取，因此不需要原子的读-改-写操作
+    static void Add(std::atomic<size_t>& counter, size_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+    static void Sub(std::atomic<size_t>& counter, size_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) - value, std::memory_order_relaxed);
+    }
+
+    size_t _minSize;
+    size_t _maxCachedBytes;
+    std::vector<std::vector<char*>> _free;  // 每个大小等级的空闲链表
+
+    std::atomic<size_t> _inUseBytes{ 0 };
+    std::atomic<size_t> _highWaterBytes{ 0 };
+    std::atomic<size_t> _cachedBytes{ 0 };
+    std::atomic<size_t> _acquires{ 0 };
+    std::atomic<size_t> _allocations{ 0 };
+};
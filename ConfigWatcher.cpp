@@ -0,0 +1,147 @@
+#include "ConfigWatcher.h"
+#include "TimerWheel.h"
+#include "conlog.h"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+ConfigWatcher::~ConfigWatcher() {
+    Stop();
+}
+
+bool ConfigWatcher::Start(const std::string& filePath, std::function<void()> onChange) {
+    _filePath = std::filesystem::absolute(filePath);
+    _onChange = std::move(onChange);
+    std::error_code error;
+    _lastWrite = std::filesystem::last_write_time(_filePath, error);
+
+#ifdef __linux__
+    _stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_stopFd < 0) {
+        LOG_ERROR("Failed to create eventfd for config watcher: %d", errno);
+        return false;
+    }
+    _inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_inotifyFd >= 0 && inotify_add_watch(_inotifyFd, _filePath.parent_path().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+        close(_inotifyFd);
+        _inotifyFd = -1;
+    }
+    if (_inotifyFd < 0) {
+        LOG_WARN("inotify is unavailable (%d), polling %s for changes", errno, _filePath.string().c_str());
+    }
+#endif
+
+    _running = true;
+    _thread = std::thread(&ConfigWatcher::Run, this);
+    return true;
+}
+
+void ConfigWatcher::Stop() {
+    if (_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _running = false;
+        }
+        _stopSignal.notify_one();
+#ifdef __linux__
+        uint64_t value = 1;
+        (void)!write(_stopFd, &value, sizeof(value));
+#endif
+        _thread.join();
+    }
+#ifdef __linux__
+    if (_inotifyFd >= 0) {
+        close(_inotifyFd);
+        _inotifyFd = -1;
+    }
+    if (_stopFd >= 0) {
+        close(_stopFd);
+        _stopFd = -1;
+    }
+#endif
+}
+
+void ConfigWatcher::Run() {
+    bool pending = false;
+    uint64_t changedMs = 0;
+    for (;;) {
+        int timeoutMs = -1;
+        if (pending) {
+            uint64_t elapsed = TimerWheel::NowMs() - changedMs;
+            timeoutMs = elapsed >= kDebounceMs ? 0 : (int)(kDebounceMs - elapsed);
+        }
+        int result = Wait(timeoutMs);
+        if (result < 0) {
+            return;
+        }
+        if (result > 0) {
+            pending = true;  // 每次变化都重新计时，文件写完后才回调
+            changedMs = TimerWheel::NowMs();
+            continue;
+        }
+        if (pending && TimerWheel::NowMs() - changedMs >= kDebounceMs) {
+            pending = false;
+            CheckModified();  // 同步修改时间，inotify失效后改为轮询时不会重复触发
+            _onChange();
+        }
+    }
+}
+
+int ConfigWatcher::Wait(int timeoutMs) {
+#ifdef __linux__
+    if (_inotifyFd >= 0) {
+        pollfd fds[2] = { { _stopFd, POLLIN, 0 }, { _inotifyFd, POLLIN, 0 } };
+        if (poll(fds, 2, timeoutMs) < 0 && errno != EINTR) {
+            LOG_ERROR("Config watcher poll failed: %d", errno);
+            return -1;
+        }
+        if (fds[0].revents != 0) {
+            return -1;
+        }
+        return fds[1].revents != 0 && ReadEvents() ? 1 : 0;
+    }
+#endif
+    std::unique_lock<std::mutex> lock(_mutex);
+    uint64_t waitMs = timeoutMs < 0 ? kPollIntervalMs : (uint64_t)timeoutMs;
+    if (_stopSignal.wait_for(lock, std::chrono::milliseconds(waitMs), [this] { return !_running; })) {
+        return -1;
+    }
+    lock.unlock();
+    return CheckModified() ? 1 : 0;
+}
+
+bool ConfigWatcher::CheckModified() {
+    std::error_code error;
+    auto lastWrite = std::filesystem::last_write_time(_filePath, error);
+    if (error || lastWrite == _lastWrite) {
+        return false;  // 替换文件的过程中可能暂时不存在
+    }
+    _lastWrite = lastWrite;
+    return true;
+}
+
+#ifdef __linux__
+bool ConfigWatcher::ReadEvents() {
+    bool changed = false;
+    std::string fileName = _filePath.filename().string();
+    alignas(inotify_event) char buffer[4096];
+    for (;;) {
+        ssize_t len = read(_inotifyFd, buffer, sizeof(buffer));
+        if (len <= 0) {
+            return changed;
+        }
+        for (ssize_t offset = 0; offset < len;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            if ((event->mask & IN_Q_OVERFLOW) || (event->len > 0 && fileName == event->name)) {
+                changed = true;  // 事件队列溢出时无法确定，按变化处理
+            }
+            offset += (ssize_t)(sizeof(inotify_event) + event->len);
+        }
+    }
+}
+#endif
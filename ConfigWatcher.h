@@ -0,0 +1,47 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// 监视配置文件的变化：Linux上用inotify监视所在目录（编辑器常以改名替换的方式保存），
+// 其他平台或inotify不可用时每秒检查一次修改时间。文件停止变化一小段时间后才回调，
+// 避免读到写了一半的内容。回调在监视线程中执行，不能在回调里调用Stop
+class ConfigWatcher {
+public:
+    ConfigWatcher() = default;
+    ~ConfigWatcher();
+    ConfigWatcher(const ConfigWatcher&) = delete;
+    ConfigWatcher& operator=(const ConfigWatcher&) = delete;
+
+    bool Start(const std::string& filePath, std::function<void()> onChange);
+    void Stop();
+
+private:
+    static constexpr uint64_t kDebounceMs = 300;       // 最后一次变化之后等待的时间
+    static constexpr uint64_t kPollIntervalMs = 1000;  // 不使用inotify时检查修改时间的间隔
+
+    void Run();
+    // 等待文件变化，timeoutMs为-1时一直等待（轮询方式下按检查间隔返回）；
+    // 返回1表示文件有变化，0表示超时，-1表示已停止
+    int Wait(int timeoutMs);
+    bool CheckModified();  // 比较修改时间
+
+    std::filesystem::path _filePath;
+    std::function<void()> _onChange;
+    std::filesystem::file_time_type _lastWrite{};
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _stopSignal;
+    bool _running = false;
+#ifdef __linux__
+    bool ReadEvents();  // 读出所有inotify事件，返回其中是否有配置文件的变化
+
+    int _inotifyFd = -1;
+    int _stopFd = -1;  // eventfd，Stop时写入以唤醒监视线程
+#endif
+};
@@ -0,0 +1,110 @@
+#include "ForwardRule.h"
+#include <cstring>
+#include "conlog.h"
+
+bool SplitListenAddress(const std::string& address, std::string& host, PortRange& ports) {
+    if (!SplitHostPorts(address, host, ports)) {
+        return false;
+    }
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+        host = host.substr(1, host.size() - 2);  // getaddrinfo不接受带方括号的IPv6地址
+    }
+    return true;
+}
+
+bool ParseListen(const ForwardRule& rule, RouteTable::Route& route) {
+    std::string listen_Address;
+    if (!SplitListenAddress(rule.listen, listen_Address, route.listen)) {
+        LOG_ERROR("Invalid listen address %s in rule %s.", rule.listen.c_str(), rule.name.c_str());  // 端口或端口范围格式错误
+        return false;
+    }
+
+    addrinfo hints{}, * listenInfo = nullptr;  // 定义addrinfo结构体变量
+    hints.ai_flags = AI_PASSIVE;  // 设置AI_PASSIVE标志，用于绑定套接字
+    hints.ai_family = AF_UNSPEC;  // 设置地址族为未指定，自动选择IPv4或IPv6
+    hints.ai_socktype = SockType(rule.protocol);  // 根据协议类型设置套接字类型
+
+    // 解析监听地址；热加载时每条规则都会重新编译，只在调试级别记录
+    LOG_DEBUG("Resolving listen address: %s", rule.listen.c_str());
+    int resolveError = getaddrinfo(listen_Address.empty() ? nullptr : listen_Address.c_str(), "0", &hints, &listenInfo);
+    if (resolveError != 0) {
+#ifdef _WIN32
+        LogSocketError(GetLastSocketError());  // 记录解析地址失败的错误信息
+#else
+        LOG_WARN("Failed to resolve listen address %s: %s", rule.listen.c_str(), gai_strerror(resolveError));  // getaddrinfo的错误码不是errno
+#endif
+        return false;
+    }
+    memcpy(&route.listenAddr, listenInfo->ai_addr, listenInfo->ai_addrlen);
+    freeaddrinfo(listenInfo);  // 释放监听地址信息
+    route.protocol = rule.protocol;
+    return true;
+}
+
+bool SameListeners(const ForwardRule& a, const ForwardRule& b) {
+    return a.listen == b.listen && a.protocol == b.protocol && a.listenShards == b.listenShards;
+}
+
+RulePlan PlanRules(const std::vector<ForwardRule>& rules, const std::map<std::string, RunningRule>& running) {
+    RulePlan plan;
+    std::map<std::string, const ForwardRule*> wanted;
+    for (const auto& rule : rules) {
+        if (!wanted.emplace(rule.name, &rule).second) {
+            LOG_WARN("Duplicate rule name %s in config file, only the first one is used.", rule.name.c_str());  // 规则按名称区分，名称必须唯一
+        }
+    }
+    std::map<std::string, size_t> routeOf;  // 规则名称到routes中的序号
+    for (size_t i = 0; i < rules.size(); ++i) {
+        const ForwardRule& rule = rules[i];
+        if (wanted[rule.name] != &rule) {
+            continue;  // 重名的规则
+        }
+        RouteTable::Route route;
+        route.rule = (uint32_t)i;
+        const RouteTable::Route* conflict = nullptr;
+        if (!ParseListen(rule, route)) {
+            continue;
+        }
+        if (!plan.routes.Add(route, &conflict)) {
+            LOG_ERROR("Listen ports of rule %s overlap with rule %s, skipped.", rule.name.c_str(),
+                conflict != nullptr ? rules[conflict->rule].name.c_str() : "(too many rules)");
+            continue;
+        }
+        routeOf[rule.name] = plan.routes.Routes().size() - 1;
+    }
+
+    for (const auto& [name, current] : running) {
+        RulePlan::Step step{ name };
+        auto found = wanted.find(name);
+        auto compiled = routeOf.find(name);
+        if (found == wanted.end()) {
+            step.action = RuleAction::Remove;
+        }
+        else if (compiled == routeOf.end()) {
+            LOG_WARN("Keeping rule %s with its previous settings, the new entry is invalid.", name.c_str());
+        }
+        else {
+            step.route = compiled->second;
+            const ForwardRule& rule = *found->second;
+            if (SameListeners(rule, current.config)) {
+                step.action = rule == current.config ? RuleAction::Keep : RuleAction::Update;
+            }
+            else {
+                // 新配置（这条规则自己或其他规则）要监听旧规则占用的端口时，只能先释放它们
+                bool overlaps = false;
+                const PortRange& oldPorts = current.listenPorts;
+                for (uint32_t port = oldPorts.first; port <= oldPorts.last && !overlaps; ++port) {
+                    overlaps = plan.routes.Find(current.config.protocol, (uint16_t)port) != nullptr;
+                }
+                step.action = overlaps ? RuleAction::Replace : RuleAction::Rebind;
+            }
+        }
+        plan.steps.push_back(step);
+    }
+    for (const auto& [name, index] : routeOf) {
+        if (running.count(name) == 0) {
+            plan.steps.push_back({ name, RuleAction::Start, index });
+        }
+    }
+    return plan;
+}
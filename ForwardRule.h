@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "PortRoutes.h"
+#include "RateLimiter.h"
+#include "TcpConnection.h"
+#include "UpstreamPool.h"
+
+// 转发规则的配置，以及热加载时新配置与正在运行的规则的比较。
+// 这里只做决定，不创建套接字也不改动中继引擎，由入口程序按RulePlan执行
+struct RelayRule;
+
+// 配置文件中的一条转发规则，包含规则名称、监听地址、目标地址和协议类型
+struct ForwardRule {
+    std::string name;  // 转发规则的名称
+    std::string listen;  // 监听地址和端口，格式为 "IP:Port" 或 "IP:起始端口-结束端口"
+    std::string target;  // 目标地址和端口，格式为 "IP:Port"；监听端口范围时也可以是同样长度的端口范围
+    Protocol protocol = Protocol::Tcp;  // 协议类型，配置中为 "tcp" 或 "udp"
+    uint32_t udpIdleTimeout = 60;  // UDP会话的空闲超时（秒），0表示不回收
+    uint32_t udpBatch = 32;  // Linux上每次系统调用批量收发的UDP数据报数量，1表示逐包收发
+    bool udpGso = false;  // Linux上是否启用UDP GSO/GRO
+    uint32_t listenShards = 1;  // SO_REUSEPORT监听分片数，0表示每个工作线程一个
+    BalanceMode balance = BalanceMode::RoundRobin;  // 多个目标地址之间的选择策略
+    uint32_t resolveInterval = 30;  // 重新解析目标域名的间隔（秒），0表示不重新解析
+    uint32_t maxFails = 3;  // 连续连接失败多少次后暂时摘除目标地址
+    uint32_t failTimeout = 10;  // 目标地址被摘除的时长（秒）
+    uint32_t prewarm = 0;  // 每个工作线程预先建立的空闲上游连接数（仅TCP）
+    uint32_t prewarmMaxAge = 30;  // 预连接的最长空闲时间（秒）
+    uint32_t drainTimeout = 60;  // 热加载删除或修改规则后，旧连接最多保留的时间（秒），0表示等到连接自然结束
+    RateLimits limits;  // 整条规则的连接数和速率限制
+    RateLimits clientLimits;  // 每个客户端IP的连接数和速率限制
+    TcpOptions tcp;  // TCP连接的超时和keepalive设置
+
+    bool operator==(const ForwardRule&) const = default;
+};
+
+// 正在运行的转发规则：读取时的配置和中继引擎中的运行时对象，热加载时按名称与新配置比较
+struct RunningRule {
+    ForwardRule config;
+    std::shared_ptr<RelayRule> relayRule;
+    PortRange listenPorts;  // 已绑定的监听端口范围
+};
+
+// 把监听地址 "主机:端口" 或 "主机:起始-结束" 拆分为主机和端口范围，主机为空表示所有地址
+bool SplitListenAddress(const std::string& address, std::string& host, PortRange& ports);
+// 解析规则的监听地址和端口范围，得到路由表中的一项；地址只解析一次，绑定时逐个填入端口
+bool ParseListen(const ForwardRule& rule, RouteTable::Route& route);
+// 监听地址、协议和分片数都相同时，修改规则不需要重新绑定监听套接字
+bool SameListeners(const ForwardRule& a, const ForwardRule& b);
+
+// 热加载时对一条规则的处理
+enum class RuleAction {
+    Keep,     // 配置没有变化，或新的条目无法编译，保持正在运行的规则
+    Update,   // 监听不变：原地切换到新的目标和选项
+    Rebind,   // 监听改变：新的监听套接字绑定成功后再删除旧规则，失败时保持旧规则
+    Replace,  // 监听改变且新配置要占用旧规则的端口：只能先删除旧规则再绑定
+    Remove,   // 配置中已删除
+    Start,    // 新增的规则
+};
+
+// 新配置与正在运行的规则比较的结果
+struct RulePlan {
+    struct Step {
+        std::string name;
+        RuleAction action = RuleAction::Keep;
+        size_t route = 0;  // 新配置在routes中的序号，Keep和Remove不使用
+    };
+    RouteTable routes;  // 新配置中能够编译的规则
+    std::vector<Step> steps;
+};
+
+// 把新配置编译为路由表并与正在运行的规则逐条比较。监听地址格式错误、无法解析或与前面的规则端口冲突的条目不会启动；
+// 同名的规则正在运行时保持原样，配置中的笔误不会停掉正在使用的监听端口
+RulePlan PlanRules(const std::vector<ForwardRule>& rules, const std::map<std::string, RunningRule>& running);
@@ -0,0 +1,463 @@
+#include "IoUring.h"
+
+#ifdef __linux__
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "conlog.h"
+
+// user_data的布局：代数(20位) | 句柄表位置(20位) | 操作编号(8位) | 缓冲区编号(16位)
+static constexpr int kSlotShift = 24;
+static constexpr int kGenerationShift = 44;
+static constexpr uint64_t kSlotMask = (1u << 20) - 1;
+static constexpr uint64_t kGenerationMask = (1u << 20) - 1;
+static constexpr uint16_t kBufferGroup = 0;  // 本线程唯一的提供缓冲区组
+static constexpr uint16_t kNoBufferBits = 0xFFFF;
+static constexpr unsigned kMaxDispatch = 4096;  // 每次Dispatch最多处理的完成事件，避免饿死定时器和其他任务
+
+static int SysSetup(unsigned entries, io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int SysRegister(int fd, unsigned opcode, const void* arg, unsigned count) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+static uint64_t MakeUserData(uint64_t token, uint8_t op, int buffer) {
+    return token | ((uint64_t)op << 16) | (buffer < 0 ? kNoBufferBits : (uint16_t)buffer);
+}
+
+static bool bufferRingUsable = true;  // 由Supported()探测
+
+bool IoUring::ProbeMultishotRecv(bool useRing) {
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, pair) != 0) {
+        return false;
+    }
+    struct Probe : CompletionHandler {
+        int result = 0;
+        bool done = false;
+        void HandleCompletion(const UringCompletion& completion) override {
+            result = completion.buffer >= 0 ? completion.result : -EINVAL;
+            done = true;
+        }
+    } probe;
+    bool supported = false;
+    {
+        IoUring ring;
+        if (ring.InitRing(8) && ring.InitBuffers(1, 64, useRing)) {
+            uint64_t token = ring.Register(&probe);
+            ring.RecvMultishot(pair[0], token, 0);
+            ring.Submit();
+            if (write(pair[1], "x", 1) == 1 && ring.Wait(1000) >= 0) {
+                ring.Dispatch();
+                supported = probe.done && probe.result == 1;
+            }
+            ring.CancelFd(pair[0]);
+            ring.Submit();
+            ring.Unregister(token);
+        }
+    }
+    close(pair[0]);
+    close(pair[1]);
+    return supported;
+}
+
+bool IoUring::Supported() {
+    static const bool supported = [] {
+        if (ProbeMultishotRecv(true)) {
+            return true;
+        }
+        // 有的内核能注册缓冲区环，接收时却总是返回ENOBUFS，此时退回到逐批提供缓冲区
+        bufferRingUsable = false;
+        if (ProbeMultishotRecv(false)) {
+            LOG_INFO("io_uring: provided buffer ring unusable, using IORING_OP_PROVIDE_BUFFERS");
+            return true;
+        }
+        return false;
+    }();
+    return supported;
+}
+
+IoUring::~IoUring() {
+    if (_bufRing != nullptr) {
+        munmap(_bufRing, _bufRingSize);
+    }
+    if (_sqes != nullptr) {
+        munmap(_sqes, _sqesSize);
+    }
+    if (_cqRing != nullptr && _cqRing != _sqRing) {
+        munmap(_cqRing, _cqRingSize);
+    }
+    if (_sqRing != nullptr) {
+        munmap(_sqRing, _sqRingSize);
+    }
+    if (_fd >= 0) {
+        close(_fd);  // 关闭后内核取消所有未完成的请求
+    }
+}
+
+bool IoUring::Init(unsigned entries, unsigned bufferCount, size_t bufferSize) {
+    return InitRing(entries) && InitBuffers(bufferCount, bufferSize, bufferRingUsable);
+}
+
+bool IoUring::InitRing(unsigned entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // 多发请求会产生大量完成事件，完成队列比提交队列大得多
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SINGLE_ISSUER;
+    params.cq_entries = entries * 8;
+    _fd = SysSetup(entries, &params);
+    if (_fd < 0 && errno == EINVAL) {
+        memset(&params, 0, sizeof(params));  // 较旧的内核不认识部分标志
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = entries * 8;
+        _fd = SysSetup(entries, &params);
+    }
+    if (_fd < 0) {
+        return false;
+    }
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP)) {
+        return false;  // 需要带超时的等待（5.11），以及完成队列满时不丢弃事件
+    }
+
+    _sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        _sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+    }
+    _sqRing = mmap(nullptr, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+    if (_sqRing == MAP_FAILED) {
+        _sqRing = nullptr;
+        return false;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        _cqRing = _sqRing;
+    }
+    else {
+        _cqRing = mmap(nullptr, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+        if (_cqRing == MAP_FAILED) {
+            _cqRing = nullptr;
+            return false;
+        }
+    }
+    _sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        return false;
+    }
+    _sqes = (io_uring_sqe*)sqes;
+
+    char* sq = (char*)_sqRing;
+    _sqHead = (std::atomic<unsigned>*)(sq + params.sq_off.head);
+    _sqTail = (std::atomic<unsigned>*)(sq + params.sq_off.tail);
+    _sqMask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    _sqEntries = *(unsigned*)(sq + params.sq_off.ring_entries);
+    unsigned* array = (unsigned*)(sq + params.sq_off.array);
+    for (unsigned i = 0; i < _sqEntries; ++i) {
+        array[i] = i;  // 请求槽与提交队列一一对应，之后不再改动
+    }
+    _sqLocalTail = _sqSubmitted = _sqTail->load(std::memory_order_relaxed);
+
+    char* cq = (char*)_cqRing;
+    _cqHead = (std::atomic<unsigned>*)(cq + params.cq_off.head);
+    _cqTail = (std::atomic<unsigned>*)(cq + params.cq_off.tail);
+    _cqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    _cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+    return true;
+}
+
+bool IoUring::InitBuffers(unsigned bufferCount, size_t bufferSize, bool useRing) {
+    if (bufferCount == 0 || (bufferCount & (bufferCount - 1)) != 0 || bufferCount > 32768) {
+        return false;
+    }
+    if (useRing) {
+        // 提供缓冲区环：环本身需要按页对齐，缓冲区按需占用物理内存
+        _bufRingSize = bufferCount * sizeof(io_uring_buf);
+        void* bufRing = mmap(nullptr, _bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (bufRing == MAP_FAILED) {
+            return false;
+        }
+        _bufRing = (io_uring_buf_ring*)bufRing;
+        io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = (uint64_t)(uintptr_t)_bufRing;
+        reg.ring_entries = bufferCount;
+        reg.bgid = kBufferGroup;
+        if (SysRegister(_fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+            return false;
+        }
+    }
+    _bufMask = bufferCount - 1;
+    _bufferSize = bufferSize;
+    _buffers.reset(new char[bufferCount * bufferSize]);
+    _sendMsgs.reset(new SendMsg[bufferCount]);
+    for (unsigned i = 0; i < bufferCount; ++i) {
+        Recycle((int)i);
+    }
+    _recycled = false;
+    return true;
+}
+
+uint64_t IoUring::Register(CompletionHandler* handler) {
+    uint32_t index;
+    if (!_freeSlots.empty()) {
+        index = _freeSlots.back();
+        _freeSlots.pop_back();
+    }
+    else {
+        index = (uint32_t)_slots.size();
+        _slots.emplace_back();
+    }
+    Slot& slot = _slots[index];
+    slot.handler = handler;
+    return ((uint64_t)slot.generation << kGenerationShift) | ((uint64_t)index << kSlotShift);
+}
+
+void IoUring::Unregister(uint64_t& token) {
+    if (token == 0) {
+        return;
+    }
+    uint32_t index = (uint32_t)((token >> kSlotShift) & kSlotMask);
+    Slot& slot = _slots[index];
+    slot.handler = nullptr;
+    slot.generation = (slot.generation + 1) & kGenerationMask;
+    if (slot.generation == 0) slot.generation = 1;  // 令牌不能为0
+    _freeSlots.push_back(index);
+    token = 0;
+}
+
+io_uring_sqe* IoUring::GetSqe() {
+    if (_sqLocalTail - _sqHead->load(std::memory_order_acquire) >= _sqEntries) {
+        Submit();  // 提交队列已满，先把已准备的请求交给内核
+    }
+    io_uring_sqe* sqe = &_sqes[_sqLocalTail & _sqMask];
+    ++_sqLocalTail;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+io_uring_sqe* IoUring::Prepare(uint8_t opcode, int fd, uint64_t token, uint8_t op, int buffer) {
+    io_uring_sqe* sqe = GetSqe();
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = token == 0 ? 0 : MakeUserData(token, op, buffer);
+    return sqe;
+}
+
+void IoUring::AcceptMultishot(int fd, uint64_t token, uint8_t op) {
+    io_uring_sqe* sqe = Prepare(IORING_OP_ACCEPT, fd, token, op, kNoBuffer);
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+}
+
+void IoUring::RecvMultishot(int fd, uint64_t token, uint8_t op) {
+    FlushBuffers();  // 待归还的缓冲区要排在接收请求之前
+    io_uring_sqe* sqe = Prepare(IORING_OP_RECV, fd, token, op, kNoBuffer);
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufferGroup;
+}
+
+void IoUring::Recv(int fd, uint64_t token, uint8_t op) {
+    FlushBuffers();
+    io_uring_sqe* sqe = Prepare(IORING_OP_RECV, fd, token, op, kNoBuffer);
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufferGroup;
+}
+
+void IoUring::RecvMsgMultishot(int fd, const msghdr* hdr, uint64_t token, uint8_t op) {
+    FlushBuffers();
+    io_uring_sqe* sqe = Prepare(IORING_OP_RECVMSG, fd, token, op, kNoBuffer);
+    sqe->addr = (uint64_t)(uintptr_t)hdr;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufferGroup;
+}
+
+void IoUring::PollMultishot(int fd, uint64_t token, uint8_t op) {
+    io_uring_sqe* sqe = Prepare(IORING_OP_POLL_ADD, fd, token, op, kNoBuffer);
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+}
+
+void IoUring::Send(int fd, int buffer, size_t offset, size_t len, uint64_t token, uint8_t op, bool link) {
+    io_uring_sqe* sqe = Prepare(IORING_OP_SEND, fd, token, op, buffer);
+    sqe->addr = (uint64_t)(uintptr_t)(Buffer(buffer) + offset);
+    sqe->len = (uint32_t)len;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;  // 流套接字上内核会重试直到全部发出，部分发送会中断后续的链接请求
+    if (link) {
+        sqe->flags = IOSQE_IO_LINK;
+    }
+}
+
+void IoUring::SendTo(int fd, int buffer, size_t len, const sockaddr_storage& addr, socklen_t addrLen, uint64_t token, uint8_t op) {
+    SendMsg& msg = _sendMsgs[(size_t)buffer];
+    memcpy(&msg.addr, &addr, addrLen);  // 复制地址，发起发送的对象在提交之前就可能被释放
+    msg.iov.iov_base = Buffer(buffer);
+    msg.iov.iov_len = len;
+    memset(&msg.hdr, 0, sizeof(msg.hdr));
+    msg.hdr.msg_name = &msg.addr;
+    msg.hdr.msg_namelen = addrLen;
+    msg.hdr.msg_iov = &msg.iov;
+    msg.hdr.msg_iovlen = 1;
+    io_uring_sqe* sqe = Prepare(IORING_OP_SENDMSG, fd, token, op, buffer);
+    sqe->addr = (uint64_t)(uintptr_t)&msg.hdr;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+}
+
+void IoUring::CancelOp(uint64_t token, uint8_t op) {
+    io_uring_sqe* sqe = Prepare(IORING_OP_ASYNC_CANCEL, -1, 0, 0, kNoBuffer);
+    sqe->addr = MakeUserData(token, op, kNoBuffer);
+}
+
+void IoUring::CancelFd(int fd) {
+    io_uring_sqe* sqe = Prepare(IORING_OP_ASYNC_CANCEL, fd, 0, 0, kNoBuffer);
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+}
+
+int IoUring::Enter(unsigned toSubmit, unsigned minComplete, unsigned flags, const void* arg, size_t argSize) {
+    return (int)syscall(__NR_io_uring_enter, _fd, toSubmit, minComplete, flags, arg, argSize);
+}
+
+int IoUring::Submit() {
+    return Wait(0);
+}
+
+int IoUring::Wait(int timeoutMs) {
+    FlushBuffers();
+    _sqTail->store(_sqLocalTail, std::memory_order_release);
+    unsigned toSubmit = _sqLocalTail - _sqSubmitted;
+    bool ready = _cqHead->load(std::memory_order_relaxed) != _cqTail->load(std::memory_order_acquire);
+    if (timeoutMs == 0 || ready) {
+        if (toSubmit == 0) {
+            return 0;
+        }
+        int submitted = Enter(toSubmit, 0, 0, nullptr, 0);
+        if (submitted < 0) {
+            return errno == EINTR || errno == EAGAIN || errno == EBUSY ? 0 : -1;
+        }
+        _sqSubmitted += (unsigned)submitted;
+        return 0;
+    }
+
+    timespec ts{};
+    io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    if (timeoutMs > 0) {
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = (long)(timeoutMs % 1000) * 1000000;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+    int submitted = Enter(toSubmit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    if (submitted < 0) {
+        // 超时或被信号打断时当作无事件返回；提交过程中出错的请求会以完成事件的形式报告
+        return errno == ETIME || errno == EINTR || errno == EAGAIN || errno == EBUSY ? 0 : -1;
+    }
+    _sqSubmitted += (unsigned)submitted;
+    return 0;
+}
+
+unsigned IoUring::Dispatch() {
+    unsigned handled = 0;
+    unsigned head = _cqHead->load(std::memory_order_relaxed);
+    while (handled < kMaxDispatch) {
+        unsigned tail = _cqTail->load(std::memory_order_acquire);
+        if (head == tail) {
+            break;
+        }
+        for (; head != tail && handled < kMaxDispatch; ++head, ++handled) {
+            io_uring_cqe cqe = _cqes[head & _cqMask];
+            _cqHead->store(head + 1, std::memory_order_release);  // 回调中可能提交新请求并再次进入内核，先释放这一项
+            if (cqe.user_data == 0) {
+                continue;  // 取消请求自身的结果
+            }
+            UringCompletion completion;
+            completion.op = (uint8_t)(cqe.user_data >> 16);
+            completion.result = cqe.res;
+            completion.flags = cqe.flags;
+            completion.more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+            uint16_t sendBuffer = (uint16_t)cqe.user_data;
+            if (cqe.flags & IORING_CQE_F_BUFFER) {
+                completion.buffer = (int)(cqe.flags >> IORING_CQE_BUFFER_SHIFT);  // 接收：内核挑选的缓冲区
+            }
+            else {
+                completion.buffer = sendBuffer == kNoBufferBits ? kNoBuffer : (int)sendBuffer;  // 发送：提交时指定的缓冲区
+            }
+
+            uint32_t index = (uint32_t)((cqe.user_data >> kSlotShift) & kSlotMask);
+            uint32_t generation = (uint32_t)((cqe.user_data >> kGenerationShift) & kGenerationMask);
+            if (index < _slots.size() && _slots[index].generation == generation && _slots[index].handler != nullptr) {
+                _slots[index].handler->HandleCompletion(completion);
+            }
+            else if (completion.buffer >= 0) {
+                Recycle(completion.buffer);  // 处理对象已注销，归还它的缓冲区
+            }
+        }
+    }
+    if (_recycled && !_bufferWaiters.empty()) {
+        NotifyBufferWaiters();
+    }
+    _recycled = false;
+    return handled;
+}
+
+void IoUring::Recycle(int buffer) {
+    _recycled = true;
+    if (_bufRing == nullptr) {
+        _pendingBuffers.push_back((uint16_t)buffer);
+        return;
+    }
+    io_uring_buf* entry = &_bufRing->bufs[_bufTail & _bufMask];
+    entry->addr = (uint64_t)(uintptr_t)Buffer(buffer);
+    entry->len = (uint32_t)_bufferSize;
+    entry->bid = (uint16_t)buffer;
+    ++_bufTail;
+    std::atomic_ref<uint16_t>(_bufRing->tail).store(_bufTail, std::memory_order_release);
+}
+
+void IoUring::FlushBuffers() {
+    if (_pendingBuffers.empty()) {
+        return;
+    }
+    // 编号连续的缓冲区在内存中也相邻，合并成一个请求归还
+    std::sort(_pendingBuffers.begin(), _pendingBuffers.end());
+    std::vector<uint16_t> pending;
+    pending.swap(_pendingBuffers);  // GetSqe可能因提交队列满而递归进入Wait
+    for (size_t i = 0; i < pending.size();) {
+        size_t j = i + 1;
+        while (j < pending.size() && pending[j] == pending[j - 1] + 1) {
+            ++j;
+        }
+        io_uring_sqe* sqe = Prepare(IORING_OP_PROVIDE_BUFFERS, (int)(j - i), 0, 0, kNoBuffer);
+        sqe->addr = (uint64_t)(uintptr_t)Buffer(pending[i]);
+        sqe->len = (uint32_t)_bufferSize;
+        sqe->off = pending[i];
+        sqe->buf_group = kBufferGroup;
+        i = j;
+    }
+}
+
+void IoUring::WaitForBuffers(uint64_t token) {
+    _bufferWaiters.push_back(token);
+}
+
+void IoUring::NotifyBufferWaiters() {
+    std::vector<uint64_t> waiters;
+    waiters.swap(_bufferWaiters);
+    for (uint64_t token : waiters) {
+        uint32_t index = (uint32_t)((token >> kSlotShift) & kSlotMask);
+        uint32_t generation = (uint32_t)((token >> kGenerationShift) & kGenerationMask);
+        if (index < _slots.size() && _slots[index].generation == generation && _slots[index].handler != nullptr) {
+            _slots[index].handler->OnBuffersAvailable();  // 对象可能已注销，只通知仍然存活的
+        }
+    }
+}
+#endif
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+
+// io_uring请求的完成事件
+struct UringCompletion {
+    uint8_t op;        // 提交请求时由处理对象指定的操作编号
+    int32_t result;    // 与对应系统调用的返回值相同，出错时为负的错误码
+    uint32_t flags;    // IORING_CQE_F_*
+    int buffer;        // 请求使用的提供缓冲区编号，没有时为-1
+    bool more;         // 多发请求仍然有效，之后还会有完成事件
+};
+
+// io_uring请求完成时的回调对象
+class CompletionHandler {
+public:
+    virtual ~CompletionHandler() = default;
+    virtual void HandleCompletion(const UringCompletion& completion) = 0;
+    virtual void OnBuffersAvailable() {}  // 曾因缓冲区耗尽而停止接收，现在有缓冲区归还了
+};
+
+#ifdef __linux__
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <linux/io_uring.h>
+#include "netcompat.h"
+
+// io_uring的最小封装：直接使用系统调用，不依赖liburing。只能在创建它的工作线程中使用。
+// 接收使用内核挑选的提供缓冲区，优先用缓冲区环（provided buffer ring），
+// 环注册成功但实际取不到缓冲区的内核上改用IORING_OP_PROVIDE_BUFFERS逐批归还。
+// 多发accept/recv提交一次后持续产生完成事件。
+// user_data中编码了处理对象在句柄表中的位置和代数、操作编号和缓冲区编号：
+// 处理对象注销后迟到的完成事件会被丢弃，它们占用的缓冲区自动归还
+class IoUring {
+public:
+    static constexpr int kNoBuffer = -1;
+
+    IoUring() = default;
+    ~IoUring();
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // 内核支持多发accept/recv、提供缓冲区环和带超时的等待时返回true，结果在进程内缓存
+    static bool Supported();
+
+    // bufferCount必须是2的幂且不超过32768
+    bool Init(unsigned entries, unsigned bufferCount, size_t bufferSize);
+    int Fd() const { return _fd; }
+
+    uint64_t Register(CompletionHandler* handler);  // 返回的令牌用于提交请求
+    void Unregister(uint64_t& token);  // 之后该对象的完成事件都被丢弃，令牌清零
+
+    // 以下方法准备一个请求，下一次Submit或Wait时才交给内核
+    void AcceptMultishot(int fd, uint64_t token, uint8_t op);  // 接受的套接字是非阻塞的
+    void RecvMultishot(int fd, uint64_t token, uint8_t op);
+    void Recv(int fd, uint64_t token, uint8_t op);  // 单次接收，用于需要逐次决定是否继续读取的连接
+    void RecvMsgMultishot(int fd, const msghdr* hdr, uint64_t token, uint8_t op);  // hdr只需给出地址长度
+    void PollMultishot(int fd, uint64_t token, uint8_t op);
+    // 发送提供缓冲区中的数据，完成后由处理对象（或处理对象已注销时由IoUring）归还缓冲区；
+    // link为true时下一个请求要等这一个完成后才开始，用于保证同一连接上的发送顺序
+    void Send(int fd, int buffer, size_t offset, size_t len, uint64_t token, uint8_t op, bool link);
+    void SendTo(int fd, int buffer, size_t len, const sockaddr_storage& addr, socklen_t addrLen, uint64_t token, uint8_t op);
+    void CancelOp(uint64_t token, uint8_t op);  // 取消一个多发接收
+    void CancelFd(int fd);  // 取消该文件描述符上的所有请求，之后应立即Submit再关闭它
+
+    int Submit();
+    // 提交并等待至少一个完成事件，timeoutMs为-1时无限等待，为0时只提交不等待；超时返回0
+    int Wait(int timeoutMs);
+    // 处理所有已完成的事件，返回处理的数量
+    unsigned Dispatch();
+
+    char* Buffer(int buffer) { return _buffers.get() + (size_t)buffer * _bufferSize; }
+    size_t BufferSize() const { return _bufferSize; }
+    void Recycle(int buffer);  // 归还一个缓冲区，内核可以立即再次使用
+    void WaitForBuffers(uint64_t token);  // 缓冲区耗尽时登记，有缓冲区归还后回调OnBuffersAvailable
+
+private:
+    struct Slot {
+        CompletionHandler* handler = nullptr;
+        uint32_t generation = 1;
+    };
+    // 按sendmsg发送时每个缓冲区专用的消息头，在请求交给内核之前必须保持有效
+    struct SendMsg {
+        msghdr hdr;
+        iovec iov;
+        sockaddr_storage addr;
+    };
+
+    // 在一对套接字上试用多发recv，确认内核真正支持这些特性
+    static bool ProbeMultishotRecv(bool useRing);
+    bool InitRing(unsigned entries);
+    bool InitBuffers(unsigned bufferCount, size_t bufferSize, bool useRing);
+    void FlushBuffers();
+    io_uring_sqe* GetSqe();
+    io_uring_sqe* Prepare(uint8_t opcode, int fd, uint64_t token, uint8_t op, int buffer);
+    int Enter(unsigned toSubmit, unsigned minComplete, unsigned flags, const void* arg, size_t argSize);
+    void NotifyBufferWaiters();
+
+    int _fd = -1;
+    // 提交队列
+    void* _sqRing = nullptr;
+    size_t _sqRingSize = 0;
+    void* _cqRing = nullptr;
+    size_t _cqRingSize = 0;
+    io_uring_sqe* _sqes = nullptr;
+    size_t _sqesSize = 0;
+    std::atomic<unsigned>* _sqHead = nullptr;
+    std::atomic<unsigned>* _sqTail = nullptr;
+    unsigned _sqMask = 0;
+    unsigned _sqEntries = 0;
+    unsigned _sqLocalTail = 0;   // 已准备的请求
+    unsigned _sqSubmitted = 0;   // 已交给内核的请求
+    // 完成队列
+    std::atomic<unsigned>* _cqHead = nullptr;
+    std::atomic<unsigned>* _cqTail = nullptr;
+    unsigned _cqMask = 0;
+    io_uring_cqe* _cqes = nullptr;
+    // 提供缓冲区环
+    io_uring_buf_ring* _bufRing = nullptr;
+    size_t _bufRingSize = 0;
+    unsigned _bufMask = 0;
+    uint16_t _bufTail = 0;
+    std::vector<uint16_t> _pendingBuffers;  // 不使用缓冲区环时，等待下次提交时归还的缓冲区
+    std::unique_ptr<char[]> _buffers;
+    size_t _bufferSize = 0;
+    std::unique_ptr<SendMsg[]> _sendMsgs;
+    bool _recycled = false;  // 本轮是否有缓冲区归还
+    // 处理对象句柄表
+    std::vector<Slot> _slots;
+    std::vector<uint32_t> _freeSlots;
+    std::vector<uint64_t> _bufferWaiters;
+};
+#endif
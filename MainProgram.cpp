@@ -1,235 +1,361 @@
-#include <winsock2.h>  // 包含Windows套接字库的头文件
-#include <ws2tcpip.h>  // 包含Windows套接字库的扩展功能头文件
+#include "netcompat.h"  // 包含套接字平台兼容层（Windows上为Winsock）
 #include <iostream>     // 包含标准输入输出流库
 #include <thread>       // 包含多线程支持库
 #include <vector>       // 包含向量容器库
 #include <fstream>      // 包含文件流库
+#include <cstring>      // 包含内存操作函数库
 #include <nlohmann/json.hpp>  // 包含nlohmann的JSON库
 #include <filesystem>         // 包含C++17文件系统库
+#include <map>                // 包含有序映射容器库
+#include <mutex>              // 包含互斥锁
+#ifndef _WIN32
+#include <csignal>            // 包含信号处理（退出信号）
+#include <pthread.h>          // 包含线程信号屏蔽字
+#include <sys/resource.h>     // 包含打开文件数限制
+#endif
 #include "conlog.h"           // 包含自定义的日志处理库
+#include "RelayEngine.h"      // 包含基于事件循环的中继引擎
+#include "MetricsServer.h"    // 包含统计接口和汇总日志
+#include "ConfigWatcher.h"    // 包含配置文件变化监视
+#include "PortRoutes.h"       // 包含端口范围和编译后的路由表
+#include "ProxyProtocol.h"    // 包含PROXY协议的版本选项
+#include "ForwardRule.h"      // 包含转发规则的配置和热加载的比较
 
 using json = nlohmann::json;  // 使用nlohmann的json命名空间
 namespace fs = std::filesystem;  // 使用C++17的filesystem命名空间
 using std::cout;  // 使用标准输出流
 using std::cin;   // 使用标准输入流
 
-// 定义转发规则结构体，包含规则名称、监听地址、目标地址和协议类型
-struct ForwardRule {
-    std::string name;  // 转发规则的名称
-    std::string listen;  // 监听地址和端口，格式为 "IP:Port"
-    std::string target;  // 目标地址和端口，格式为 "IP:Port"
-    std::string protocol;  // 协议类型，目前支持 "tcp" 和 "udp"
-};
-
-// 定义日志队列和日志工作线程运行标志
-SemaphoreQueue<std::string> logQueue;  // 用于存储日志消息的队列
-bool logWorkerRunning = true;  // 日志工作线程的运行标志
-
-// 日志工作线程，从队列中取出日志消息并打印
-void LogWorker() {
-    while (logWorkerRunning) {
-        std::string logMessage = logQueue.Dequeue();  // 从队列中获取一条日志消息
-        std::cout << logMessage << std::endl;  // 打印日志消息
-    }
-}
-
-// 将日志消息加入队列
-void Log(const std::string& message) {
-    logQueue.Enqueue(message);  // 将日志消息加入队列
-}
+RelayEngine relayEngine;  // 所有TCP连接共享的事件循环中继引擎
+UpstreamResolver upstreamResolver;  // 定期重新解析各规则目标域名的后台线程
+MetricsRegistry metricsRegistry;  // 所有规则的计数器和延迟直方图
+MetricsServer metricsServer(metricsRegistry);  // 提供Prometheus接口并定期输出汇总日志
+ConfigWatcher configWatcher;  // 配置文件变化时热加载转发规则
+std::mutex rulesMutex;  // 保护runningRules，热加载在监视线程中进行
+std::map<std::string, RunningRule> runningRules;  // 按规则名称索引的正在运行的规则
+
+// 创建套接字并进行一些初始化设置，如地址重用和绑定；reusePort为true时设置SO_REUSEPORT，
+// 多个套接字可以绑定同一地址，由内核把新连接（或UDP客户端）分散到它们上。
+// error不为空时失败的错误码存入其中、不记录日志，由调用者汇总（端口范围中可能有大量端口被占用）
+SOCKET CreateSocket(const sockaddr_storage& addr, int socktype, bool reusePort = false, int* error = nullptr) {
+    auto fail = [error](SOCKET sock) {
+        int code = GetLastSocketError();
+        if (error != nullptr) {
+            *error = code;
+        }
+        else {
+            LogSocketError(code);  // 记录创建、设置或绑定套接字失败的错误信息
+        }
+        if (sock != INVALID_SOCKET) {
+            closesocket(sock);  // 关闭套接字
+        }
+        return INVALID_SOCKET;  // 返回无效套接字
+    };
 
-// 创建套接字并进行一些初始化设置，如地址重用和绑定
-SOCKET CreateSocket(const addrinfo* info) {
-    SOCKET sock = socket(info->ai_family, info->ai_socktype, info->ai_protocol);  // 创建套接字
+    SOCKET sock = socket(addr.ss_family, socktype, 0);  // 创建套接字
     if (sock == INVALID_SOCKET) {
-        LogSocketError(WSAGetLastError());  // 记录套接字创建失败的错误信息
-        return INVALID_SOCKET;  // 返回无效套接字
+        return fail(sock);
     }
 
     int optval = 1;
     if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char*)&optval, sizeof(optval)) == SOCKET_ERROR) {
-        LogSocketError(WSAGetLastError());  // 记录设置套接字选项失败的错误信息
-        closesocket(sock);  // 关闭套接字
-        return INVALID_SOCKET;  // 返回无效套接字
+        return fail(sock);
     }
 
-    if (bind(sock, info->ai_addr, (int)info->ai_addrlen) == SOCKET_ERROR) {
-        LogSocketError(WSAGetLastError());  // 记录绑定套接字失败的错误信息
-        closesocket(sock);  // 关闭套接字
-        return INVALID_SOCKET;  // 返回无效套接字
+#ifdef SO_REUSEPORT
+    if (reusePort && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, (const char*)&optval, sizeof(optval)) == SOCKET_ERROR) {
+        return fail(sock);
+    }
+#endif
+
+    if (bind(sock, (const sockaddr*)&addr, (int)SockaddrLength(addr)) == SOCKET_ERROR) {
+        return fail(sock);
     }
 
     return sock;  // 返回创建并成功初始化的套接字
 }
 
-// 转发TCP连接的数据，创建两个线程分别处理客户端到服务器和服务器到客户端的数据转发
-void ForwardTCP(SOCKET client, const sockaddr_storage& targetAddr) {
-    SOCKET server = socket(targetAddr.ss_family, SOCK_STREAM, IPPROTO_TCP);  // 创建目标服务器的套接字
-    if (server == INVALID_SOCKET) {
-        LogSocketError(WSAGetLastError());  // 记录套接字创建失败的错误信息
-        closesocket(client);  // 关闭客户端套接字
-        return;
+// 端口范围规则的目标端口：每个目标都写成与监听范围同样长度的端口范围时按偏移一一映射，
+// 改写为范围的起始端口交给目标池解析；都是单个端口时所有监听端口转发到同一个目标端口。返回false表示配置有误
+bool ParseTargetPorts(const ForwardRule& rule, const PortRange& listenPorts, std::vector<std::string>& targets, bool& mapPorts) {
+    size_t ranged = 0;
+    for (std::string& target : targets) {
+        std::string host;
+        PortRange ports;
+        if (!SplitHostPorts(target, host, ports) || ports.Count() == 1) {
+            continue;  // 单个端口，格式错误由解析时报告
+        }
+        if (ports.Count() != listenPorts.Count()) {
+            LOG_ERROR("Target %s of rule %s does not match the size of its listen port range.", target.c_str(), rule.name.c_str());
+            return false;
+        }
+        target = host + ":" + std::to_string(ports.first);
+        ++ranged;
     }
+    if (ranged != 0 && ranged != targets.size()) {
+        LOG_ERROR("Targets of rule %s must be either all port ranges or all single ports.", rule.name.c_str());
+        return false;
+    }
+    mapPorts = ranged > 0;
+    return true;
+}
 
-    if (connect(server, (sockaddr*)&targetAddr, sizeof(targetAddr)) == SOCKET_ERROR) {
-        LogSocketError(WSAGetLastError());  // 记录连接目标服务器失败的错误信息
-        closesocket(client);  // 关闭客户端套接字
-        closesocket(server);  // 关闭服务器套接字
-        return;
+// 为规则创建目标池和中继引擎中的运行时对象；目标地址一个也解析不出来且不会重试时返回空
+std::shared_ptr<RelayRule> CreateRelayRule(const ForwardRule& rule, const RouteTable::Route& route) {
+    // 目标可以是逗号分隔的多个 "主机:端口"，每个主机名可能解析出多个地址，全部放入目标池
+    std::vector<std::string> targets = UpstreamPool::SplitTargets(rule.target);
+    bool mapPorts = false;
+    if (!ParseTargetPorts(rule, route.listen, targets, mapPorts)) {
+        return nullptr;
     }
+    UpstreamOptions upstreamOptions;
+    upstreamOptions.mode = rule.balance;
+    upstreamOptions.resolveIntervalMs = rule.resolveInterval * 1000;
+    upstreamOptions.maxFails = rule.maxFails;
+    upstreamOptions.failTimeoutMs = rule.failTimeout * 1000;
+    upstreamOptions.socktype = SockType(rule.protocol);
+    // 预连接只能连到基准端口，端口映射规则不使用预连接
+    upstreamOptions.prewarm = rule.protocol == Protocol::Tcp && !mapPorts ? rule.prewarm : 0;
+    upstreamOptions.prewarmMaxAgeMs = rule.prewarmMaxAge * 1000;
+    auto upstream = std::make_shared<UpstreamPool>(targets, upstreamOptions);
 
-    // 定义一个lambda函数用于数据转发
-    auto forward = [](SOCKET from, SOCKET to) {
-        char buffer[4096];  // 缓冲区用于存储接收的数据
-        while (true) {
-            int len = recv(from, buffer, sizeof(buffer), 0);  // 从from套接字接收数据
-            if (len <= 0) {
-                if (len == 0) {
-                    Log("Connection closed by peer.");  // 如果len为0，表示连接已关闭
-                }
-                else {
-                    LogSocketError(WSAGetLastError());  // 记录接收数据失败的错误信息
-                }
-                break;  // 退出循环
-            }
-            if (send(to, buffer, len, 0) == SOCKET_ERROR) {
-                LogSocketError(WSAGetLastError());  // 记录发送数据失败的错误信息
-                break;  // 退出循环
-            }
+    // 解析目标地址
+    Log("Resolving target address: " + rule.target);  // 记录正在解析目标地址的信息
+    if (upstream->Resolve() == 0) {
+        if (upstreamOptions.resolveIntervalMs == 0) {
+            LOG_ERROR("No target address resolved for rule %s.", rule.name.c_str());  // 记录解析目标地址失败的错误信息
+            return nullptr;
         }
-        closesocket(from);  // 关闭from套接字
-        closesocket(to);    // 关闭to套接字
-        };
-
-    std::thread(forward, client, server).detach();  // 启动一个线程从客户端转发数据到服务器
-    std::thread(forward, server, client).detach();  // 启动一个线程从服务器转发数据到客户端
+        LOG_WARN("No target address resolved for rule %s, retrying in background.", rule.name.c_str());  // 首次解析失败时由后台线程继续重试
+    }
+    upstreamResolver.Add(upstream);  // 定期重新解析，DNS变化后自动生效
+
+    auto relayRule = std::make_shared<RelayRule>(rule.name, upstream, relayEngine.WorkerCount());
+    relayRule->mapPorts = mapPorts;  // 目标端口随监听端口偏移，目标的健康状态按基准端口统计
+    relayRule->udp.idleTimeoutMs = rule.udpIdleTimeout * 1000;  // UDP会话空闲超时
+    relayRule->udp.batchSize = rule.udpBatch > 0 ? rule.udpBatch : 1;  // 批量收发的数量
+    relayRule->udp.gso = rule.udpGso;  // GSO/GRO
+    relayRule->tcp = rule.tcp;  // TCP超时和keepalive
+    if (rule.limits.Any() || rule.clientLimits.Any()) {
+        relayRule->limiter = std::make_shared<RateLimiter>(rule.limits, rule.clientLimits);  // 连接数和速率限制
+    }
+    // 该规则的统计出现在 /metrics 和汇总日志中；热加载后的同名规则沿用原有的计数器
+    relayRule->metrics = metricsRegistry.Add(relayRule->metrics);
+    return relayRule;
 }
 
-// 处理UDP数据包的接收和转发
-void HandleUDP(SOCKET sock, const sockaddr_storage& targetAddr) {
-    char buffer[4096];  // 缓冲区用于存储接收的数据
-    sockaddr_storage clientAddr;  // 存储客户端地址信息
-    int addrLen = sizeof(clientAddr);  // 客户端地址信息的长度
-
-    while (true) {
-        int len = recvfrom(sock, buffer, sizeof(buffer), 0, (sockaddr*)&clientAddr, &addrLen);  // 接收UDP数据包
-        if (len <= 0) {
-            if (len == 0) {
-                Log("Client disconnected.");  // 如果len为0，表示客户端已断开连接
+// 创建规则的监听套接字并交给中继引擎，返回成功创建的监听套接字数量。
+// 端口范围中的每个端口各有一个监听套接字，全部注册在工作线程共享的事件循环中
+size_t BindListeners(const ForwardRule& rule, const RouteTable::Route& route, const std::shared_ptr<RelayRule>& relayRule) {
+    // 监听分片数：0表示每个工作线程一个；多于一个时使用SO_REUSEPORT，由内核把新连接分散到各个线程
+    size_t shards = rule.listenShards > 0 ? rule.listenShards : relayEngine.WorkerCount();
+#ifndef SO_REUSEPORT
+    if (shards > 1) {
+        LOG_WARN("SO_REUSEPORT is not supported on this platform, rule %s uses a single listener.", rule.name.c_str());
+        shards = 1;
+    }
+#endif
+
+    // 端口范围规则只汇总记录一次绑定失败，单个端口的规则照常逐个记录
+    int bindError = 0;
+    int* error = route.listen.Count() > 1 ? &bindError : nullptr;
+    size_t bound = 0;
+    for (size_t i = 0; i < shards; ++i) {
+        std::vector<ListenSocket> listenSockets;
+        listenSockets.reserve(route.listen.Count());
+        for (uint32_t port = route.listen.first; port <= route.listen.last; ++port) {
+            // 创建监听套接字
+            sockaddr_storage listenAddr = route.listenAddr;
+            SetPort(listenAddr, (uint16_t)port);
+            SOCKET listenSocket = CreateSocket(listenAddr, SockType(rule.protocol), shards > 1, error);
+            if (listenSocket == INVALID_SOCKET) {
+                continue;  // 范围中被占用的端口跳过，其余端口照常转发
             }
-            else {
-                LogSocketError(WSAGetLastError());  // 记录接收数据失败的错误信息
+            // TCP套接字需要开始监听；UDP套接字绑定后即可接收数据包，按客户端地址建立会话
+            if (rule.protocol == Protocol::Tcp && listen(listenSocket, SOMAXCONN) == SOCKET_ERROR) {
+                LOG_ERROR("Failed to listen on socket: %d", GetLastSocketError());  // 记录监听失败的错误信息
+                closesocket(listenSocket);  // 关闭监听套接字
+                continue;
             }
-            break;  // 退出循环
+            listenSockets.push_back({ listenSocket, (uint16_t)(port - route.listen.first) });
         }
-
-        char clientIP[NI_MAXHOST];  // 存储客户端IP地址的数组
-        getnameinfo((sockaddr*)&clientAddr, addrLen, clientIP, sizeof(clientIP), nullptr, 0, NI_NUMERICHOST);  // 获取客户端IP地址
-        Log("接收到来自 " + std::string(clientIP) + " 的 UDP 连接");  // 记录接收到来自客户端的UDP数据包
-
-        if (sendto(sock, buffer, len, 0, (sockaddr*)&targetAddr, sizeof(targetAddr)) == SOCKET_ERROR) {
-            LogSocketError(WSAGetLastError());  // 记录发送数据失败的错误信息
-            break;  // 退出循环
+        if (listenSockets.empty()) {
+            break;
         }
+        bound += listenSockets.size();
 
-        // 接收并转发客户端的响应数据包
-        len = recvfrom(sock, buffer, sizeof(buffer), 0, nullptr, nullptr);
-        if (len > 0) {
-            if (sendto(sock, buffer, len, 0, (sockaddr*)&clientAddr, addrLen) == SOCKET_ERROR) {
-                LogSocketError(WSAGetLastError());  // 记录发送数据失败的错误信息
-                break;  // 退出循环
-            }
+        // 由中继引擎的事件循环接受客户端连接（或UDP数据包）并转发；分片固定在各自的工作线程上
+        int workerIndex = shards > 1 ? (int)i : -1;
+        if (rule.protocol == Protocol::Tcp) {
+            relayEngine.AddTCPListeners(listenSockets, relayRule, workerIndex);
+        }
+        else {
+            relayEngine.AddUDPListeners(listenSockets, relayRule, workerIndex);
         }
     }
-    closesocket(sock);  // 关闭套接字
+    if (bindError != 0) {
+        LOG_WARN("Rule %s is listening on %zu of %zu sockets, the others failed to bind.", rule.name.c_str(), bound,
+            (size_t)route.listen.Count() * shards);
+        LogSocketError(bindError);  // 记录其中一个端口绑定失败的原因
+    }
+    return bound;
 }
 
-// 根据配置规则启动转发服务
-void StartForwarding(const ForwardRule& rule) {
-    addrinfo hints{}, * listenInfo = nullptr, * targetInfo = nullptr;  // 定义addrinfo结构体变量
-
-    // 分离监听地址和端口
-    std::string listen_Address, listen_Port;
-    SeparateIpAndPort_listen(rule.listen, listen_Address, listen_Port);
-
-    ZeroMemory(&hints, sizeof(hints));  // 清空hints结构体
-    hints.ai_flags = AI_PASSIVE;  // 设置AI_PASSIVE标志，用于绑定套接字
-    hints.ai_family = AF_UNSPEC;  // 设置地址族为未指定，自动选择IPv4或IPv6
-    hints.ai_socktype = (rule.protocol == "tcp") ? SOCK_STREAM : SOCK_DGRAM;  // 根据协议类型设置套接字类型
-
-    // 解析监听地址
-    Log("Resolving listen address: " + listen_Address + ":" + listen_Port);  // 记录正在解析监听地址的信息
-    if (getaddrinfo(listen_Address.c_str(), listen_Port.c_str(), &hints, &listenInfo) != 0) {
-        LogSocketError(WSAGetLastError());  // 记录解析地址失败的错误信息
-        return;
+// 让正在运行的规则不再接受新连接，已有连接在drainTimeout内继续转发
+void RetireRule(const RouteTable& routes, const std::string& name, uint32_t drainTimeout) {
+    auto it = runningRules.find(name);
+    // UDP会话只能经原来的监听套接字回复客户端，新配置要绑定其中的端口时只能立即关闭
+    bool keepUdpListeners = true;
+    const PortRange& oldPorts = it->second.listenPorts;
+    for (uint32_t port = oldPorts.first; port <= oldPorts.last && keepUdpListeners; ++port) {
+        keepUdpListeners = routes.Find(Protocol::Udp, (uint16_t)port) == nullptr;
     }
+    relayEngine.RemoveRule(it->second.relayRule, drainTimeout * 1000, keepUdpListeners);
+    runningRules.erase(it);
+}
 
-    // 分离目标地址和端口
-    std::string target_Address, target_Port;
-    SeparateIpAndPort_target(rule.target, target_Address, target_Port);
-
-    ZeroMemory(&hints, sizeof(hints));  // 再次清空hints结构体
-    hints.ai_family = AF_UNSPEC;  // 设置地址族为未指定，自动选择IPv4或IPv6
-    hints.ai_socktype = (rule.protocol == "tcp") ? SOCK_STREAM : SOCK_DGRAM;  // 根据协议类型设置套接字类型
-
-    // 解析目标地址
-    Log("Resolving target address: " + target_Address + ":" + target_Port);  // 记录正在解析目标地址的信息
-    if (getaddrinfo(target_Address.c_str(), target_Port.c_str(), &hints, &targetInfo) != 0) {
-        LogSocketError(WSAGetLastError());  // 记录解析地址失败的错误信息
-        freeaddrinfo(listenInfo);  // 释放监听地址信息
-        return;
+// 让正在运行的规则与配置一致：只处理新增、删除和修改过的规则，未变化的规则及其连接不受影响。
+// 被删除或修改的规则不再接受新连接，已有连接在drain_timeout内继续转发。
+// 修改过的规则先创建新的运行时对象（解析目标）、能绑定新监听时再删除旧规则，任何一步失败都保留旧规则
+void ApplyRules(const std::vector<ForwardRule>& rules) {
+    std::lock_guard<std::mutex> lock(rulesMutex);
+    RulePlan plan = PlanRules(rules, runningRules);
+    const std::vector<RouteTable::Route>& routes = plan.routes.Routes();
+
+    std::vector<std::shared_ptr<RelayRule>> created(plan.steps.size());
+    for (size_t i = 0; i < plan.steps.size(); ++i) {
+        const RulePlan::Step& step = plan.steps[i];
+        if (step.action == RuleAction::Keep || step.action == RuleAction::Remove) {
+            continue;
+        }
+        const RouteTable::Route& route = routes[step.route];
+        created[i] = CreateRelayRule(rules[route.rule], route);
+        if (created[i] == nullptr && step.action != RuleAction::Start) {
+            LOG_WARN("Keeping previous settings for rule %s.", step.name.c_str());  // 新目标不可用时保留原来的规则
+        }
     }
 
-    // 创建监听套接字
-    SOCKET listenSocket = CreateSocket(listenInfo);
-    if (listenSocket == INVALID_SOCKET) {
-        freeaddrinfo(listenInfo);  // 释放监听地址信息
-        freeaddrinfo(targetInfo);  // 释放目标地址信息
-        return;  // 返回
+    // 先删除不再存在的规则和必须让出端口的规则，释放出的端口才能被新规则使用
+    for (size_t i = 0; i < plan.steps.size(); ++i) {
+        const RulePlan::Step& step = plan.steps[i];
+        if (step.action == RuleAction::Remove) {
+            Log("Removing rule " + step.name + ", draining existing connections.");
+            RetireRule(plan.routes, step.name, runningRules.at(step.name).config.drainTimeout);
+        }
+        else if (step.action == RuleAction::Replace && created[i] != nullptr) {
+            Log("Rebinding rule " + step.name + ", draining existing connections.");
+            RetireRule(plan.routes, step.name, rules[routes[step.route].rule].drainTimeout);
+        }
     }
 
-    // 如果协议是TCP
-    if (rule.protocol == "tcp") {
-        if (listen(listenSocket, SOMAXCONN) == SOCKET_ERROR) {
-            Log("Failed to listen on socket: " + std::to_string(WSAGetLastError()));  // 记录监听失败的错误信息
-            closesocket(listenSocket);  // 关闭监听套接字
-            freeaddrinfo(listenInfo);  // 释放监听地址信息
-            freeaddrinfo(targetInfo);  // 释放目标地址信息
-            return;
+    for (size_t i = 0; i < plan.steps.size(); ++i) {
+        const RulePlan::Step& step = plan.steps[i];
+        if (created[i] == nullptr) {
+            continue;
+        }
+        const RouteTable::Route& route = routes[step.route];
+        const ForwardRule& rule = rules[route.rule];
+        switch (step.action) {
+        case RuleAction::Update: {
+            // 监听不变的修改：新连接改用新的目标和选项，旧连接继续按原来的规则转发直到排空
+            Log("Updating rule " + step.name + ".");
+            RunningRule& running = runningRules.at(step.name);
+            relayEngine.RetargetRule(running.relayRule, created[i], rule.drainTimeout * 1000);
+            running = { rule, std::move(created[i]), running.listenPorts };
+            break;
         }
+        case RuleAction::Rebind:
+            if (BindListeners(rule, route, created[i]) == 0) {
+                LOG_WARN("Keeping rule %s on its previous listen address, the new one failed to bind.", step.name.c_str());
+                break;
+            }
+            Log("Rebinding rule " + step.name + ", draining existing connections.");
+            RetireRule(plan.routes, step.name, rule.drainTimeout);
+            runningRules[step.name] = { rule, std::move(created[i]), route.listen };
+            break;
+        case RuleAction::Replace:
+        case RuleAction::Start:
+            if (BindListeners(rule, route, created[i]) > 0) {
+                runningRules[step.name] = { rule, std::move(created[i]), route.listen };
+            }
+            else if (step.action == RuleAction::Replace) {
+                LOG_ERROR("Rule %s stopped, its new listen address failed to bind.", step.name.c_str());
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
 
-        // 启动一个线程接受客户端连接
-        std::thread([=] {
-            while (true) {
-                sockaddr_storage clientAddr;  // 存储客户端地址信息
-                int addrLen = sizeof(clientAddr);  // 客户端地址信息的长度
-                SOCKET client = accept(listenSocket, (sockaddr*)&clientAddr, &addrLen);  // 接受客户端连接
-                if (client == INVALID_SOCKET) {
-                    Log("Failed to accept client connection: " + std::to_string(WSAGetLastError()));  // 记录接受连接失败的错误信息
-                    continue;  // 继续循环
-                }
-                char clientIP[NI_MAXHOST];  // 存储客户端IP地址的数组
-                getnameinfo((sockaddr*)&clientAddr, addrLen, clientIP, sizeof(clientIP), nullptr, 0, NI_NUMERICHOST);  // 获取客户端IP地址
-                Log("接收到来自 " + std::string(clientIP) + " 的 TCP 连接");  // 记录接收到来自客户端的TCP连接
+// 以秒为单位的选项换算为毫秒后要放进uint32_t，超过约49.7天会回绕成很短的超时
+constexpr uint32_t kMaxSeconds = UINT32_MAX / 1000;
 
-                // 启动一个线程进行TCP数据转发
-                if (targetInfo != nullptr && targetInfo->ai_addr != nullptr) {
-                    std::thread(ForwardTCP, client, *(sockaddr_storage*)targetInfo->ai_addr).detach();
-                }
-                else {
-                    Log("targetInfo 或 targetInfo->ai_addr 是空指针");  // 记录目标地址信息为空指针的情况
-                }
+// 读取以秒为单位的选项，缺少时保持seconds中的默认值；超出范围（或为负数）时记录错误、保持默认值并返回false
+bool ReadSeconds(const json& object, const char* key, uint32_t& seconds) {
+    uint64_t value = object.value(key, (uint64_t)seconds);
+    if (value > kMaxSeconds) {
+        LOG_ERROR("%s is out of range, the maximum is %u seconds.", key, kMaxSeconds);
+        return false;
+    }
+    seconds = (uint32_t)value;
+    return true;
+}
+
+// 启动统计输出：顶层配置 "metrics_listen"（如 "127.0.0.1:9100"，为空时不提供HTTP接口）
+// 和 "metrics_log_interval"（汇总日志的间隔秒数，0表示不输出）
+void StartMetrics(const json& config) {
+    std::string metricsListen = config.value("metrics_listen", std::string());
+    uint32_t logInterval = 60;
+    ReadSeconds(config, "metrics_log_interval", logInterval);  // 超出范围时使用默认值
+    SOCKET listenSocket = INVALID_SOCKET;
+    if (!metricsListen.empty()) {
+        std::string address;
+        PortRange port;
+        addrinfo hints{}, * info = nullptr;
+        hints.ai_flags = AI_PASSIVE;
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        int resolveError = 0;
+        if (!SplitListenAddress(metricsListen, address, port) || port.Count() != 1) {
+            LOG_ERROR("Invalid metrics_listen address %s, expected IP:port.", metricsListen.c_str());
+        }
+        else if ((resolveError = getaddrinfo(address.empty() ? nullptr : address.c_str(), std::to_string(port.first).c_str(), &hints, &info)) != 0) {
+#ifdef _WIN32
+            LogSocketError(GetLastSocketError());  // 记录解析统计接口地址失败的错误信息
+#else
+            LOG_ERROR("Failed to resolve metrics address %s: %s", metricsListen.c_str(), gai_strerror(resolveError));  // getaddrinfo的错误码不是errno
+#endif
+        }
+        else {
+            sockaddr_storage addr{};
+            memcpy(&addr, info->ai_addr, info->ai_addrlen);
+            freeaddrinfo(info);
+            listenSocket = CreateSocket(addr, SOCK_STREAM);
+            if (listenSocket != INVALID_SOCKET && listen(listenSocket, SOMAXCONN) == SOCKET_ERROR) {
+                LogSocketError(GetLastSocketError());  // 记录监听失败的错误信息
+                closesocket(listenSocket);
+                listenSocket = INVALID_SOCKET;
+            }
+            if (listenSocket != INVALID_SOCKET) {
+                Log("Metrics available at http://" + metricsListen + "/metrics");
             }
-            closesocket(listenSocket);  // 关闭监听套接字
-            }).detach();  // 启动线程并分离
+        }
     }
-    else {  // 如果协议是UDP
-        // 启动一个线程处理UDP数据包的接收和转发
-        std::thread(HandleUDP, listenSocket, *(sockaddr_storage*)targetInfo->ai_addr).detach();
+    if (listenSocket != INVALID_SOCKET) {
+        // 会话表与统计共用同一个HTTP端口，只应监听在可信的地址上；
+        // 强制关闭会话没有认证，需要 "session_control": true 单独开启
+        SessionControl control;
+        control.list = [] { return RelayEngine::FormatSessions(relayEngine.ListSessions()); };
+        if (config.value("session_control", false)) {
+            control.close = [](uint64_t id) { return relayEngine.CloseSession(id); };
+        }
+        metricsServer.SetSessionControl(std::move(control));
+        Log("Sessions available at http://" + metricsListen + "/sessions");
+    }
+    if (!metricsServer.Start(listenSocket, logInterval * 1000)) {
+        LOG_ERROR("Failed to start metrics server.");  // 记录统计线程启动失败的错误信息
     }
-
-    freeaddrinfo(listenInfo);  // 释放监听地址信息
-    freeaddrinfo(targetInfo);  // 释放目标地址信息
 }
 
 // 创建默认配置文件，包含两个示例转发规则
@@ -253,34 +379,243 @@ void CreateDefaultConfig(const std::string& filePath) {
 
     std::ofstream configFile(filePath);  // 创建文件流用于写入配置文件
     if (!configFile.is_open()) {
-        Log("Failed to create default config file.");  // 记录创建默认配置文件失败的错误信息
+        LOG_ERROR("Failed to create default config file.");  // 记录创建默认配置文件失败的错误信息
         return;
     }
     configFile << defaultConfig.dump(4);  // 将默认配置写入文件，格式化输出，缩进为4个空格
     configFile.close();  // 关闭文件流
 }
 
+// 读取日志配置："log_level"（debug/info/warn/error/off）、"log_file" 和 "log_rate_limit"（每秒条数）
+LoggerOptions ParseLoggerOptions(const json& config) {
+    LoggerOptions options;
+    std::string level = config.value("log_level", std::string("info"));
+    if (level == "debug") options.level = LogLevel::Debug;
+    else if (level == "warn") options.level = LogLevel::Warn;
+    else if (level == "error") options.level = LogLevel::Error;
+    else if (level == "off") options.level = LogLevel::Off;
+    else options.level = LogLevel::Info;
+    options.filePath = config.value("log_file", std::string());
+    options.rateLimit = config.value("log_rate_limit", options.rateLimit);
+    return options;
+}
+
+// 读取规则的目标："target" 可以是 "主机:端口" 字符串（多个目标用逗号分隔），也可以是字符串数组
+std::string ParseTarget(const json& target) {
+    if (!target.is_array()) {
+        return target.get<std::string>();
+    }
+    std::string joined;
+    for (const auto& item : target) {
+        if (!joined.empty()) {
+            joined.append(1, ',');
+        }
+        joined.append(item.get<std::string>());
+    }
+    return joined;
+}
+
+// 读取负载均衡策略："round_robin"、"least_conn" 或 "hash"（按客户端IP的一致性哈希）
+BalanceMode ParseBalanceMode(const std::string& name) {
+    if (name == "least_conn") return BalanceMode::LeastConnections;
+    if (name == "hash") return BalanceMode::ConsistentHash;
+    return BalanceMode::RoundRobin;
+}
+
+// 读取一组限制，如 {"max_connections": 100, "connections_per_sec": 20, "bytes_per_sec": 1048576, "packets_per_sec": 1000}，
+// 缺少的项为0（不限制）
+RateLimits ParseLimits(const json& limits) {
+    RateLimits result;
+    if (limits.is_object()) {
+        result.maxConnections = limits.value("max_connections", 0u);
+        result.connectionsPerSec = limits.value("connections_per_sec", 0u);
+        result.bytesPerSec = limits.value("bytes_per_sec", (uint64_t)0);
+        result.packetsPerSec = limits.value("packets_per_sec", 0u);
+    }
+    return result;
+}
+
+// 读取TCP规则的超时（秒，0表示不限）和keepalive设置，缺少的项使用默认值；取值无效时返回false
+bool ParseTcpOptions(const json& rule, TcpOptions& options) {
+    uint32_t connectTimeout = options.connectTimeoutMs / 1000, idleTimeout = options.idleTimeoutMs / 1000;
+    uint32_t readTimeout = 0, writeTimeout = 0;
+    if (!ReadSeconds(rule, "connect_timeout", connectTimeout) || !ReadSeconds(rule, "idle_timeout", idleTimeout) ||
+        !ReadSeconds(rule, "read_timeout", readTimeout) || !ReadSeconds(rule, "write_timeout", writeTimeout)) {
+        return false;
+    }
+    options.connectTimeoutMs = connectTimeout * 1000;
+    options.idleTimeoutMs = idleTimeout * 1000;
+    options.readTimeoutMs = readTimeout * 1000;
+    options.writeTimeoutMs = writeTimeout * 1000;
+    options.keepAliveIdleSec = rule.value("keepalive", 0u);
+    options.keepAliveIntervalSec = rule.value("keepalive_interval", 0u);
+    options.keepAliveCount = rule.value("keepalive_count", 0u);
+    options.acceptProxy = rule.value("accept_proxy_protocol", false);
+    options.holdProxyHeader = rule.value("proxy_protocol_hold", false);
+    std::string proxy = rule.value("proxy_protocol", std::string("none"));
+    if (!ParseProxyVersion(proxy, options.sendProxy)) {
+        // 不能退回到不发送：热加载时会悄悄停止向依赖协议头的目标发送客户端地址
+        LOG_ERROR("Unknown proxy_protocol \"%s\", expected v1/v2/none.", proxy.c_str());
+        return false;
+    }
+    return true;
+}
+
+// 读取配置文件中的转发规则数组 "forward_rules"，格式不完整的规则被跳过；
+// 选项的取值无效时返回false，整个配置不被使用（热加载时保持正在运行的配置）
+bool ParseRules(const json& config, std::vector<ForwardRule>& rules) {
+    if (config.contains("forward_rules") && config["forward_rules"].is_array()) {  // 检查配置文件中是否存在转发规则数组
+        for (const auto& rule : config["forward_rules"]) {  // 遍历转发规则数组
+            Protocol protocol;
+            if (rule.contains("name") && rule.contains("listen") && rule.contains("target") && rule.contains("protocol") &&  // 检查每个规则是否包含必要字段
+                ParseProtocol(rule["protocol"].get<std::string>(), protocol)) {  // 协议只支持 "tcp" 和 "udp"
+                TcpOptions tcp;
+                uint32_t udpIdleTimeout = 60, resolveInterval = 30, failTimeout = 10, prewarmMaxAge = 30, drainTimeout = 60;
+                if (!ParseTcpOptions(rule, tcp) || !ReadSeconds(rule, "udp_idle_timeout", udpIdleTimeout) ||
+                    !ReadSeconds(rule, "resolve_interval", resolveInterval) || !ReadSeconds(rule, "fail_timeout", failTimeout) ||
+                    !ReadSeconds(rule, "prewarm_max_age", prewarmMaxAge) || !ReadSeconds(rule, "drain_timeout", drainTimeout)) {
+                    LOG_ERROR("Invalid options in rule %s.", rule["name"].get<std::string>().c_str());
+                    return false;
+                }
+                rules.push_back({  // 将规则添加到向量中
+                    rule["name"].get<std::string>(),  // 规则名称
+                    rule["listen"].get<std::string>(),  // 监听地址和端口（或端口范围）
+                    ParseTarget(rule["target"]),  // 目标地址和端口，可以是多个
+                    protocol,  // 协议类型
+                    udpIdleTimeout,  // UDP会话空闲超时（秒），可选
+                    rule.value("udp_batch", 32u),  // UDP批量收发数量，可选
+                    rule.value("udp_gso", false),  // 是否启用UDP GSO/GRO，可选
+                    rule.value("listen_shards", 1u),  // SO_REUSEPORT监听分片数，可选
+                    ParseBalanceMode(rule.value("balance", std::string("round_robin"))),  // 负载均衡策略，可选
+                    resolveInterval,  // 重新解析目标域名的间隔（秒），可选
+                    rule.value("max_fails", 3u),  // 摘除目标前允许的连续失败次数，可选
+                    failTimeout,  // 目标被摘除的时长（秒），可选
+                    rule.value("prewarm", 0u),  // 每个工作线程的预连接数，可选
+                    prewarmMaxAge,  // 预连接的最长空闲时间（秒），可选
+                    drainTimeout,  // 热加载后旧连接的最长排空时间（秒），可选
+                    ParseLimits(rule.value("limits", json::object())),  // 整条规则的限制，可选
+                    ParseLimits(rule.value("client_limits", json::object())),  // 每个客户端IP的限制，可选
+                    tcp  // TCP超时和keepalive，可选
+                    });
+            }
+            else {
+                LOG_ERROR("Invalid rule format in config file--配置文件读取错误.");  // 记录规则格式错误的情况
+            }
+        }
+    }
+    else {
+        LOG_WARN("No valid forward_rules found in config file.");  // 记录配置文件中没有找到有效转发规则的情况
+    }
+    return true;
+}
+
+// 读取并解析配置文件，失败时记录原因并返回false
+bool LoadConfig(const std::string& filePath, json& config) {
+    std::ifstream configFile(filePath);  // 创建文件流用于读取配置文件
+    if (!configFile.is_open()) {
+        LOG_ERROR("Failed to open config file.");  // 记录打开配置文件失败的错误信息
+        return false;
+    }
+    try {
+        config = json::parse(configFile);  // 解析配置文件内容
+    }
+    catch (const json::parse_error& e) {
+        LOG_ERROR("Failed to parse config file: %s", e.what());  // 记录解析配置文件失败的错误信息
+        return false;
+    }
+    return true;
+}
+
+// 读取日志设置和转发规则。合法的JSON中字段类型不对（如 "prewarm": "4"）时nlohmann_json抛出json::exception，
+// 在这里捕获并返回false，不能让异常终止进程
+bool ParseConfig(const json& config, LoggerOptions& loggerOptions, std::vector<ForwardRule>& rules) {
+    try {
+        loggerOptions = ParseLoggerOptions(config);
+        if (!ParseRules(config, rules)) {
+            return false;
+        }
+    }
+    catch (const json::exception& e) {
+        LOG_ERROR("Invalid value in config file: %s", e.what());
+        return false;
+    }
+    return true;
+}
+
+// 配置文件变化后重新加载日志设置和转发规则；工作线程数等引擎参数需要重启才能生效
+void ReloadConfig(const std::string& filePath) {
+    json config;
+    if (!LoadConfig(filePath, config)) {
+        LOG_WARN("Config reload failed, keeping the running configuration.");  // 文件有误时保持现有规则不变
+        return;
+    }
+    // 先完成全部解析再应用，字段类型有误时保持现有的日志设置和规则
+    LoggerOptions loggerOptions;
+    std::vector<ForwardRule> rules;
+    if (!ParseConfig(config, loggerOptions, rules)) {
+        LOG_WARN("Config reload failed, keeping the running configuration.");
+        return;
+    }
+    Log("Config file changed, reloading forward rules.");
+    ConfigureLogger(loggerOptions);
+    ApplyRules(rules);
+}
+
 // 获取可执行文件的路径
 std::string GetExecutablePath() {
+#ifdef _WIN32
     char buffer[MAX_PATH];  // 定义一个数组用于存储路径
     GetModuleFileNameA(NULL, buffer, MAX_PATH);  // 获取可执行文件的路径
-    std::string::size_type pos = std::string(buffer).find_last_of("\\/");  // 找到最后一个分隔符的位置
-    return std::string(buffer).substr(0, pos);  // 返回可执行文件所在的目录路径
+    std::string path(buffer);
+#else
+    std::error_code error;
+    std::string path = fs::read_symlink("/proc/self/exe", error).string();  // Linux上通过/proc获取可执行文件的路径
+    if (error) {
+        return fs::current_path().string();  // 无法获取时保持当前工作目录
+    }
+#endif
+    std::string::size_type pos = path.find_last_of("\\/");  // 找到最后一个分隔符的位置
+    return path.substr(0, pos);  // 返回可执行文件所在的目录路径
+}
+
+#ifndef _WIN32
+// 屏蔽SIGINT和SIGTERM，之后创建的线程继承该屏蔽字，退出信号只由主线程的sigwait接收
+static sigset_t BlockExitSignals() {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    return signals;
 }
 
-// 主函数，初始化Winsock库，读取配置文件并启动相应的转发服务
+// 端口范围规则每个端口占用一个监听套接字，每个连接还要两个套接字，把打开文件数的软限制提高到硬限制
+static void RaiseFileLimit() {
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);  // 失败时保持原来的限制
+    }
+}
+#endif
+
+// 主函数，初始化套接字库，读取配置文件并启动相应的转发服务
 int main() {
+#ifdef _WIN32
     SetConsoleOutputCP(CP_UTF8);  // 设置控制台输出为UTF-8编码，支持中文
+#else
+    sigset_t exitSignals = BlockExitSignals();  // 必须在创建任何线程之前调用
+    RaiseFileLimit();
+#endif
 
-    std::thread logThread(LogWorker);  // 启动日志工作线程
-    logThread.detach();  // 分离线程，使其独立运行
+    StartLogger();  // 启动日志写出线程
 
     std::string exePath = GetExecutablePath();  // 获取可执行文件的路径
     fs::current_path(exePath);  // 设置当前工作目录为可执行文件所在的目录
 
-    WSADATA wsa;
-    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {  // 初始化Winsock库
-        Log("WSAStartup failed.");  // 记录初始化失败的错误信息
+    if (!NetStartup()) {  // 初始化套接字库（Windows上为Winsock）
+        LOG_ERROR("Failed to initialize socket library.");  // 记录初始化失败的错误信息
+        StopLogger();  // 写出剩余日志
         return 1;  // 返回错误码
     }
 
@@ -290,52 +625,63 @@ int main() {
         CreateDefaultConfig(configFilePath);  // 创建默认配置文件
     }
 
-    std::ifstream configFile(configFilePath);  // 创建文件流用于读取配置文件
-    if (!configFile.is_open()) {
-        Log("Failed to open config file.");  // 记录打开配置文件失败的错误信息
-        WSACleanup();  // 清理Winsock库
-        return 1;  // 返回错误码
-    }
-
     json config;
-    try {
-        config = json::parse(configFile);  // 解析配置文件内容
-    }
-    catch (const json::parse_error& e) {
-        Log("Failed to parse config file: " + std::string(e.what()));  // 记录解析配置文件失败的错误信息
-        WSACleanup();  // 清理Winsock库
+    LoggerOptions loggerOptions;
+    std::vector<ForwardRule> rules;
+    if (!LoadConfig(configFilePath, config) || !ParseConfig(config, loggerOptions, rules)) {  // 读取并解析配置文件
+        NetCleanup();  // 清理套接字库
+        StopLogger();  // 写出剩余日志
         return 1;  // 返回错误码
     }
 
-    std::vector<ForwardRule> rules;  // 定义一个向量用于存储转发规则
-    if (config.contains("forward_rules") && config["forward_rules"].is_array()) {  // 检查配置文件中是否存在转发规则数组
-        for (const auto& rule : config["forward_rules"]) {  // 遍历转发规则数组
-            if (rule.contains("name") && rule.contains("listen") && rule.contains("target") && rule.contains("protocol")) {  // 检查每个规则是否包含必要字段
-                rules.push_back({  // 将规则添加到向量中
-                    rule["name"].get<std::string>(),  // 规则名称
-                    rule["listen"].get<std::string>(),  // 监听地址和端口
-                    rule["target"].get<std::string>(),  // 目标地址和端口
-                    rule["protocol"].get<std::string>()  // 协议类型
-                    });
-            }
-            else {
-                Log("Invalid rule format in config file--配置文件读取错误.");  // 记录规则格式错误的情况
-            }
-        }
-    }
-    else {
-        Log("No valid forward_rules found in config file.");  // 记录配置文件中没有找到有效转发规则的情况
+    ConfigureLogger(loggerOptions);  // 应用配置文件中的日志设置
+
+    // 启动中继引擎，工作线程数量可通过配置项 "workers" 指定，默认等于CPU核心数
+    // Linux上默认使用splice零拷贝转发TCP数据，可通过配置项 "splice": false 关闭
+    size_t workerCount = config.value("workers", (size_t)0);
+    RelayOptions relayOptions;
+    relayOptions.useSplice = config.value("splice", true);
+    // 中继缓冲区按读取量在最小和最大尺寸之间自适应，可通过 "relay_buffer_min"/"relay_buffer_max"（字节）调整
+    relayOptions.bufferMinSize = config.value("relay_buffer_min", relayOptions.bufferMinSize);
+    relayOptions.bufferMaxSize = config.value("relay_buffer_max", relayOptions.bufferMaxSize);
+    relayOptions.cpuAffinity = config.value("cpu_affinity", false);  // 是否把工作线程绑定到CPU核心
+    // Linux上可选的io_uring后端，内核不支持时回退到epoll；"io_uring_buffers" 是每个工作线程的接收缓冲区数量
+    relayOptions.useIoUring = config.value("io_uring", false);
+    relayOptions.uringBuffers = config.value("io_uring_buffers", relayOptions.uringBuffers);
+    if (!relayEngine.Start(workerCount, relayOptions)) {
+        LOG_ERROR("Failed to start relay engine.");  // 记录中继引擎启动失败的错误信息
+        NetCleanup();  // 清理套接字库
+        StopLogger();  // 写出剩余日志
+        return 1;  // 返回错误码
     }
 
     // 根据读取的转发规则启动相应的转发服务
-    for (const auto& rule : rules) {
-        StartForwarding(rule);
+    upstreamResolver.Start();  // 启动目标域名的后台解析线程
+    ApplyRules(rules);  // 启动配置文件中的全部规则
+    StartMetrics(config);  // 启动统计接口和汇总日志
+
+    // 默认监视配置文件，修改后自动热加载转发规则，可通过顶层配置 "watch_config": false 关闭
+    if (config.value("watch_config", true) &&
+        !configWatcher.Start(configFilePath, [configFilePath] { ReloadConfig(configFilePath); })) {
+        LOG_WARN("Failed to watch config file, hot reload is disabled.");  // 记录启动配置监视失败的错误信息
     }
 
+#ifdef _WIN32
     Log("Port forwarder running. Press Enter to exit...");  // 记录端口转发器正在运行
     std::cin.get();  // 等待用户输入以退出程序
-
-    logWorkerRunning = false;  // 设置日志工作线程的运行标志为false
-    WSACleanup();  // 清理Winsock库
+#else
+    // 作为服务运行时标准输入通常是/dev/null，改为等待SIGINT或SIGTERM
+    Log("Port forwarder running. Press Ctrl+C to exit...");  // 记录端口转发器正在运行
+    int signal = 0;
+    sigwait(&exitSignals, &signal);
+    Log("Received signal " + std::to_string(signal) + ", shutting down.");
+#endif
+
+    configWatcher.Stop();  // 先停止热加载，之后不再有规则变化
+    metricsServer.Stop();  // 停止统计线程
+    relayEngine.Stop();  // 停止中继引擎并关闭所有连接
+    upstreamResolver.Stop();  // 停止后台解析线程
+    NetCleanup();  // 清理套接字库
+    StopLogger();  // 写出剩余日志并停止日志线程
     return 0;  // 返回成功码
 }
@@ -0,0 +1,303 @@
+#include "Metrics.h"
+#include <bit>
+#include <chrono>
+#include <cstdio>
+
+uint64_t MetricsNowUs() {
+    using namespace std::chrono;
+    return (uint64_t)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+int LatencyHistogram::BucketIndex(uint64_t value) {
+    if (value > kMaxValue) value = kMaxValue;
+    // 值的最高kSubBucketBits+1位决定桶：高位所在的2的幂区间乘子桶数，再加上其余几位
+    int width = std::bit_width(value);
+    int shift = width > kSubBucketBits + 1 ? width - (kSubBucketBits + 1) : 0;
+    return shift * kSubBuckets + (int)(value >> shift);
+}
+
+uint64_t LatencyHistogram::BucketUpperBound(int index) {
+    if (index < 2 * kSubBuckets) {
+        return (uint64_t)index;  // 小于2*kSubBuckets的值各占一个桶，是精确的
+    }
+    int shift = index / kSubBuckets - 1;
+    uint64_t mantissa = (uint64_t)(index - shift * kSubBuckets);
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(uint64_t valueUs) {
+    MetricAdd(_counts[BucketIndex(valueUs)], 1);
+    MetricAdd(_sum, valueUs);
+}
+
+void LatencyHistogram::AddTo(HistogramSnapshot& snapshot) const {
+    if (snapshot.counts.empty()) {
+        snapshot.counts.assign(kBucketCount, 0);
+    }
+    for (int i = 0; i < kBucketCount; ++i) {
+        uint64_t count = _counts[i].load(std::memory_order_relaxed);
+        snapshot.counts[i] += count;
+        snapshot.count += count;
+    }
+    snapshot.sum += _sum.load(std::memory_order_relaxed);
+}
+
+HistogramSnapshot& HistogramSnapshot::operator+=(const HistogramSnapshot& other) {
+    if (counts.size() < other.counts.size()) {
+        counts.resize(other.counts.size(), 0);
+    }
+    for (size_t i = 0; i < other.counts.size(); ++i) {
+        counts[i] += other.counts[i];
+    }
+    count += other.count;
+    sum += other.sum;
+    return *this;
+}
+
+HistogramSnapshot& HistogramSnapshot::operator-=(const HistogramSnapshot& other) {
+    for (size_t i = 0; i < counts.size() && i < other.counts.size(); ++i) {
+        counts[i] -= other.counts[i];
+    }
+    count -= other.count;
+    sum -= other.sum;
+    return *this;
+}
+
+uint64_t HistogramSnapshot::Percentile(double quantile) const {
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t target = (uint64_t)(quantile * (double)count);
+    if (target == 0) target = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen >= target) {
+            return LatencyHistogram::BucketUpperBound((int)i);
+        }
+    }
+    return LatencyHistogram::kMaxValue;
+}
+
+uint64_t HistogramSnapshot::CountAtOrBelow(uint64_t value) const {
+    uint64_t total = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        if (LatencyHistogram::BucketUpperBound((int)i) > value) {
+            break;  // 桶的上界单调递增
+        }
+        total += counts[i];
+    }
+    return total;
+}
+
+RuleMetricsSnapshot& RuleMetricsSnapshot::operator-=(const RuleMetricsSnapshot& other) {
+    bytesUp -= other.bytesUp;
+    bytesDown -= other.bytesDown;
+    packetsUp -= other.packetsUp;
+    packetsDown -= other.packetsDown;
+    opened -= other.opened;
+    closed -= other.closed;
+    connectErrors -= other.connectErrors;
+    errors -= other.errors;
+    rejected -= other.rejected;
+    dropped -= other.dropped;
+    throttled -= other.throttled;
+    timeouts -= other.timeouts;
+    connectTime -= other.connectTime;
+    firstByteTime -= other.firstByteTime;
+    duration -= other.duration;
+    return *this;
+}
+
+RuleMetrics::RuleMetrics(std::string rule, size_t shardCount)
+    : _rule(std::move(rule)) {
+    if (shardCount == 0) shardCount = 1;
+    for (size_t i = 0; i < shardCount; ++i) {
+        _shards.push_back(std::make_unique<MetricsShard>());  // 每个分片单独分配，按缓存行对齐
+    }
+}
+
+RuleMetricsSnapshot RuleMetrics::Snapshot() const {
+    RuleMetricsSnapshot snapshot;
+    snapshot.rule = _rule;
+    for (const auto& shard : _shards) {
+        snapshot.bytesUp += shard->bytesUp.load(std::memory_order_relaxed);
+        snapshot.bytesDown += shard->bytesDown.load(std::memory_order_relaxed);
+        snapshot.packetsUp += shard->packetsUp.load(std::memory_order_relaxed);
+        snapshot.packetsDown += shard->packetsDown.load(std::memory_order_relaxed);
+        snapshot.opened += shard->opened.load(std::memory_order_relaxed);
+        snapshot.closed += shard->closed.load(std::memory_order_relaxed);
+        snapshot.connectErrors += shard->connectErrors.load(std::memory_order_relaxed);
+        snapshot.errors += shard->errors.load(std::memory_order_relaxed);
+        snapshot.rejected += shard->rejected.load(std::memory_order_relaxed);
+        snapshot.dropped += shard->dropped.load(std::memory_order_relaxed);
+        snapshot.throttled += shard->throttled.load(std::memory_order_relaxed);
+        snapshot.timeouts += shard->timeouts.load(std::memory_order_relaxed);
+        shard->connectTime.AddTo(snapshot.connectTime);
+        shard->firstByteTime.AddTo(snapshot.firstByteTime);
+        shard->duration.AddTo(snapshot.duration);
+    }
+    return snapshot;
+}
+
+std::shared_ptr<RuleMetrics> MetricsRegistry::Add(const std::shared_ptr<RuleMetrics>& metrics) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const auto& weak : _rules) {
+        auto existing = weak.lock();
+        if (existing && existing->Rule() == metrics->Rule()) {
+            return existing;
+        }
+    }
+    _rules.push_back(metrics);
+    return metrics;
+}
+
+std::vector<RuleMetricsSnapshot> MetricsRegistry::Snapshot() {
+    std::vector<std::shared_ptr<RuleMetrics>> rules;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (size_t i = 0; i < _rules.size();) {
+            if (auto rule = _rules[i].lock()) {
+                rules.push_back(std::move(rule));
+                ++i;
+            }
+            else {
+                _rules.erase(_rules.begin() + (ptrdiff_t)i);
+            }
+        }
+    }
+    std::vector<RuleMetricsSnapshot> snapshots;
+    for (const auto& rule : rules) {
+        snapshots.push_back(rule->Snapshot());
+    }
+    return snapshots;
+}
+
+// 标签值中的反斜杠、双引号和换行需要转义
+static std::string EscapeLabel(const std::string& value) {
+    std::string escaped;
+    for (char c : value) {
+        if (c == '\\' || c == '"') escaped += '\\';
+        if (c == '\n') {
+            escaped += "\\n";
+            continue;
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+static void AppendHeader(std::string& out, const char* name, const char* type, const char* help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+static void AppendSample(std::string& out, const char* name, const std::string& labels, uint64_t value) {
+    out += name;
+    out += '{';
+    out += labels;
+    out += "} ";
+    out += std::to_string(value);
+    out += '\n';
+}
+
+// 把微秒直方图按固定的秒级边界导出为Prometheus直方图
+static void AppendHistogram(std::string& out, const char* name, const std::string& labels,
+    const HistogramSnapshot& histogram, const std::vector<double>& bounds) {
+    std::string bucketName = std::string(name) + "_bucket";
+    char le[32];
+    for (double bound : bounds) {
+        snprintf(le, sizeof(le), "%g", bound);
+        uint64_t count = histogram.CountAtOrBelow((uint64_t)(bound * 1e6));
+        AppendSample(out, bucketName.c_str(), labels + ",le=\"" + le + "\"", count);
+    }
+    AppendSample(out, bucketName.c_str(), labels + ",le=\"+Inf\"", histogram.count);
+    char sum[32];
+    snprintf(sum, sizeof(sum), "%.6f", (double)histogram.sum / 1e6);
+    out += name;
+    out += "_sum{" + labels + "} " + sum + "\n";
+    AppendSample(out, (std::string(name) + "_count").c_str(), labels, histogram.count);
+}
+
+std::string FormatPrometheus(const std::vector<RuleMetricsSnapshot>& rules) {
+    static const std::vector<double> latencyBounds = { 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10 };
+    static const std::vector<double> durationBounds = { 0.1, 1, 10, 60, 300, 1800, 3600, 21600 };
+
+    std::vector<std::string> labels;
+    for (const auto& rule : rules) {
+        labels.push_back("rule=\"" + EscapeLabel(rule.rule) + "\"");
+    }
+
+    std::string out;
+    AppendHeader(out, "forwarder_connections_total", "counter", "Accepted TCP connections or created UDP sessions.");
+    for (size_t i = 0; i < rules.size(); ++i) AppendSample(out, "forwarder_connections_total", labels[i], rules[i].opened);
+    AppendHeader(out, "forwarder_active_connections", "gauge", "Open TCP connections or UDP sessions.");
+    for (size_t i = 0; i < rules.size(); ++i) AppendSample(out, "forwarder_active_connections", labels[i], rules[i].Active());
+    AppendHeader(out, "forwarder_bytes_total", "counter", "Bytes relayed; direction is upstream (client to target) or downstream.");
+    for (size_t i = 0; i < rules.size(); ++i) {
+        AppendSample(out, "forwarder_bytes_total", labels[i] + ",direction=\"upstream\"", rules[i].bytesUp);
+        AppendSample(out, "forwarder_bytes_total", labels[i] + ",direction=\"downstream\"", rules[i].bytesDown);
+    }
+    AppendHeader(out, "forwarder_packets_total", "counter", "UDP datagrams relayed.");
+    for (size_t i = 0; i < rules.size(); ++i) {
+        AppendSample(out, "forwarder_packets_total", labels[i] + ",direction=\"upstream\"", rules[i].packetsUp);
+        AppendSample(out, "forwarder_packets_total", labels[i] + ",direction=\"downstream\"", rules[i].packetsDown);
+    }
+    AppendHeader(out, "forwarder_connect_errors_total", "counter", "Failed upstream connection attempts.");
+    for (size_t i = 0; i < rules.size(); ++i) AppendSample(out, "forwarder_connect_errors_total", labels[i], rules[i].connectErrors);
+    AppendHeader(out, "forwarder_errors_total", "counter", "Accept, send and receive errors.");
+    for (size_t i = 0; i < rules.size(); ++i) AppendSample(out, "forwarder_errors_total", labels[i], rules[i].errors);
+    AppendHeader(out, "forwarder_rejected_total", "counter", "TCP connections or UDP sessions refused by connection limits.");
+    for (size_t i = 0; i < rules.size(); ++i) AppendSample(out, "forwarder_rejected_total", labels[i], rules[i].rejected);
+    AppendHeader(out, "forwarder_dropped_packets_total", "counter", "UDP datagrams dropped by rate limits.");
+    for (size_t i = 0; i < rules.size(); ++i) AppendSample(out, "forwarder_dropped_packets_total", labels[i], rules[i].dropped);
+    AppendHeader(out, "forwarder_throttled_total", "counter", "Times a TCP connection paused reading to stay within its byte rate.");
+    for (size_t i = 0; i < rules.size(); ++i) AppendSample(out, "forwarder_throttled_total", labels[i], rules[i].throttled);
+    AppendHeader(out, "forwarder_timeouts_total", "counter", "TCP connections closed by connect, idle, read or write timeouts.");
+    for (size_t i = 0; i < rules.size(); ++i) AppendSample(out, "forwarder_timeouts_total", labels[i], rules[i].timeouts);
+
+    AppendHeader(out, "forwarder_connect_seconds", "histogram", "Time from accept to an established upstream connection.");
+    for (size_t i = 0; i < rules.size(); ++i) AppendHistogram(out, "forwarder_connect_seconds", labels[i], rules[i].connectTime, latencyBounds);
+    AppendHeader(out, "forwarder_first_byte_seconds", "histogram", "Time from accept to the first byte from the upstream.");
+    for (size_t i = 0; i < rules.size(); ++i) AppendHistogram(out, "forwarder_first_byte_seconds", labels[i], rules[i].firstByteTime, latencyBounds);
+    AppendHeader(out, "forwarder_session_seconds", "histogram", "Lifetime of closed TCP connections and UDP sessions.");
+    for (size_t i = 0; i < rules.size(); ++i) AppendHistogram(out, "forwarder_session_seconds", labels[i], rules[i].duration, durationBounds);
+    return out;
+}
+
+// 把字节数格式化为便于阅读的形式
+static std::string FormatBytes(uint64_t bytes) {
+    static const char* units[] = { "B", "KB", "MB", "GB", "TB" };
+    double value = (double)bytes;
+    int unit = 0;
+    while (value >= 1024 && unit < 4) {
+        value /= 1024;
+        ++unit;
+    }
+    char text[32];
+    snprintf(text, sizeof(text), unit == 0 ? "%.0f %s" : "%.1f %s", value, units[unit]);
+    return text;
+}
+
+std::string FormatSummary(const RuleMetricsSnapshot& snapshot, uint64_t active, uint32_t intervalSec) {
+    char text[640];
+    snprintf(text, sizeof(text),
+        "Rule %s in the last %us: %llu new, %llu active, up %s, down %s, %llu/%llu datagrams, "
+        "%llu connect error(s), %llu error(s), %llu rejected, %llu dropped, %llu throttled, %llu timeout(s), connect p50/p99 %.2f/%.2f ms, first byte p50/p99 %.2f/%.2f ms",
+        snapshot.rule.c_str(), intervalSec, (unsigned long long)snapshot.opened, (unsigned long long)active,
+        FormatBytes(snapshot.bytesUp).c_str(), FormatBytes(snapshot.bytesDown).c_str(),
+        (unsigned long long)snapshot.packetsUp, (unsigned long long)snapshot.packetsDown,
+        (unsigned long long)snapshot.connectErrors, (unsigned long long)snapshot.errors,
+        (unsigned long long)snapshot.rejected, (unsigned long long)snapshot.dropped, (unsigned long long)snapshot.throttled,
+        (unsigned long long)snapshot.timeouts,
+        snapshot.connectTime.Percentile(0.5) / 1000.0, snapshot.connectTime.Percentile(0.99) / 1000.0,
+        snapshot.firstByteTime.Percentile(0.5) / 1000.0, snapshot.firstByteTime.Percentile(0.99) / 1000.0);
+    return text;
+}
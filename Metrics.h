@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 只有所属线程写入、其他线程只读取的计数器加法，编译为普通的读-加-写，没有锁前缀指令
+inline void MetricAdd(std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+uint64_t MetricsNowUs();  // 单调时钟的微秒数
+
+// 直方图的快照，可以合并和相减（求两次快照之间的增量）
+struct HistogramSnapshot {
+    std::vector<uint64_t> counts;  // 每个桶的计数
+    uint64_t count = 0;
+    uint64_t sum = 0;  // 所有记录值之和（微秒）
+
+    HistogramSnapshot& operator+=(const HistogramSnapshot& other);
+    HistogramSnapshot& operator-=(const HistogramSnapshot& other);
+    uint64_t Percentile(double quantile) const;  // 返回所在桶的上界，没有记录时为0
+    uint64_t CountAtOrBelow(uint64_t value) const;  // 上界不超过value的桶的累计计数
+};
+
+// 对数线性分桶的延迟直方图（HDR风格）：每个2的幂区间再均分为8个子桶，相对误差不超过1/8，
+// 记录一次只需计算下标和两次加法。只能由一个线程写入，其他线程可以随时读取快照
+class LatencyHistogram {
+public:
+    static constexpr int kSubBucketBits = 3;
+    static constexpr int kSubBuckets = 1 << kSubBucketBits;
+    static constexpr int kValueBits = 36;  // 可记录的最大值约为2^36微秒（19小时），更大的值计入最后一个桶
+    static constexpr uint64_t kMaxValue = ((uint64_t)1 << kValueBits) - 1;
+    static constexpr int kBucketCount = (kValueBits - kSubBucketBits + 1) * kSubBuckets;
+
+    void Record(uint64_t valueUs);
+    void AddTo(HistogramSnapshot& snapshot) const;
+
+    static int BucketIndex(uint64_t value);
+    static uint64_t BucketUpperBound(int index);
+
+private:
+    std::atomic<uint64_t> _counts[kBucketCount] = {};
+    std::atomic<uint64_t> _sum{ 0 };
+};
+
+// 一个工作线程上某条规则的计数器，独占缓存行，只有该线程写入，没有伪共享
+struct alignas(64) MetricsShard {
+    std::atomic<uint64_t> bytesUp{ 0 };      // 客户端 -> 目标的字节数
+    std::atomic<uint64_t> bytesDown{ 0 };    // 目标 -> 客户端的字节数
+    std::atomic<uint64_t> packetsUp{ 0 };    // UDP数据报数
+    std::atomic<uint64_t> packetsDown{ 0 };
+    std::atomic<uint64_t> opened{ 0 };       // 接受的TCP连接或建立的UDP会话
+    std::atomic<uint64_t> closed{ 0 };
+    std::atomic<uint64_t> connectErrors{ 0 };  // 连接目标失败的次数（包括重试）
+    std::atomic<uint64_t> errors{ 0 };       // 收发和接受连接时的其他错误
+    std::atomic<uint64_t> rejected{ 0 };     // 超过连接数或新建速率限制而拒绝的TCP连接或UDP会话
+    std::atomic<uint64_t> dropped{ 0 };      // 超过速率限制而丢弃的UDP数据报
+    std::atomic<uint64_t> throttled{ 0 };    // 超过字节速率限制而暂停读取的次数（TCP）
+    std::atomic<uint64_t> timeouts{ 0 };     // 因连接、空闲、读或写超时而关闭的TCP连接
+    LatencyHistogram connectTime;    // 从接受连接到与目标建立连接
+    LatencyHistogram firstByteTime;  // 从接受连接（或建立UDP会话）到收到目标的第一个字节
+    LatencyHistogram duration;       // 连接或会话的存续时间
+};
+
+// 一条规则所有工作线程计数器的汇总
+struct RuleMetricsSnapshot {
+    std::string rule;
+    uint64_t bytesUp = 0;
+    uint64_t bytesDown = 0;
+    uint64_t packetsUp = 0;
+    uint64_t packetsDown = 0;
+    uint64_t opened = 0;
+    uint64_t closed = 0;
+    uint64_t connectErrors = 0;
+    uint64_t errors = 0;
+    uint64_t rejected = 0;
+    uint64_t dropped = 0;
+    uint64_t throttled = 0;
+    uint64_t timeouts = 0;
+    HistogramSnapshot connectTime;
+    HistogramSnapshot firstByteTime;
+    HistogramSnapshot duration;
+
+    uint64_t Active() const { return opened > closed ? opened - closed : 0; }
+    RuleMetricsSnapshot& operator-=(const RuleMetricsSnapshot& other);
+};
+
+// 一条规则的统计：每个工作线程一个分片，记录时只写本线程的分片，读取时才汇总
+class RuleMetrics {
+public:
+    RuleMetrics(std::string rule, size_t shardCount);  // shardCount不能少于工作线程数
+    RuleMetrics(const RuleMetrics&) = delete;
+    RuleMetrics& operator=(const RuleMetrics&) = delete;
+
+    MetricsShard& Shard(size_t workerId) { return *_shards[workerId % _shards.size()]; }
+    const std::string& Rule() const { return _rule; }
+    RuleMetricsSnapshot Snapshot() const;  // 可以从任意线程调用
+
+private:
+    std::string _rule;
+    std::vector<std::unique_ptr<MetricsShard>> _shards;
+};
+
+// 所有规则的统计，供HTTP接口和汇总日志读取
+class MetricsRegistry {
+public:
+    // 规则释放后自动从列表中移除。已有同名规则的统计时返回已有的那份，
+    // 热加载后新旧规则共用计数器，监控曲线不会中断，也不会出现重复的序列
+    std::shared_ptr<RuleMetrics> Add(const std::shared_ptr<RuleMetrics>& metrics);
+    std::vector<RuleMetricsSnapshot> Snapshot();
+
+private:
+    std::mutex _mutex;
+    std::vector<std::weak_ptr<RuleMetrics>> _rules;
+};
+
+// 生成Prometheus文本格式（version 0.0.4）的指标
+std::string FormatPrometheus(const std::vector<RuleMetricsSnapshot>& rules);
+// 生成一条规则的汇总日志，snapshot通常是两次快照之间的增量，active是当前的连接数
+std::string FormatSummary(const RuleMetricsSnapshot& snapshot, uint64_t active, uint32_t intervalSec);
@@ -0,0 +1,266 @@
+#include "MetricsServer.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include "TimerWheel.h"
+#include "conlog.h"
+
+// 请求头中是否有名为name（不区分大小写）、值不为空的一项
+static bool HasHeader(const std::string& request, const char* name) {
+    size_t nameLen = strlen(name);
+    size_t line = request.find("\r\n");
+    while (line != std::string::npos && line + 2 < request.size()) {
+        size_t start = line + 2;
+        line = request.find("\r\n", start);
+        size_t end = line == std::string::npos ? request.size() : line;
+        if (end - start > nameLen && request[start + nameLen] == ':' &&
+            std::equal(name, name + nameLen, request.begin() + (ptrdiff_t)start,
+                [](char a, char b) { return tolower((unsigned char)a) == tolower((unsigned char)b); })) {
+            size_t value = request.find_first_not_of(" \t", start + nameLen + 1);
+            return value != std::string::npos && value < end;
+        }
+    }
+    return false;
+}
+
+MetricsServer::MetricsServer(MetricsRegistry& registry)
+    : _registry(registry) {
+}
+
+MetricsServer::~MetricsServer() {
+    Stop();
+}
+
+bool MetricsServer::Start(SOCKET listenSock, uint32_t logIntervalMs) {
+    _sock = listenSock;
+    _logIntervalMs = logIntervalMs;
+    if (_sock == INVALID_SOCKET && _logIntervalMs == 0) {
+        return true;  // 两项都没有启用
+    }
+    // 事件循环在这里才创建：全局对象构造时套接字库可能还没有初始化（Windows上的唤醒套接字需要Winsock）
+    _poller = std::make_unique<Poller>();
+    if (!_poller->IsValid()) {
+        return false;
+    }
+    if (_sock != INVALID_SOCKET && (!SetNonBlocking(_sock) || !_poller->Add(_sock, PollIn, this))) {
+        LogSocketError(GetLastSocketError());
+        closesocket(_sock);
+        _sock = INVALID_SOCKET;
+        return false;
+    }
+    _running = true;
+    _thread = std::thread(&MetricsServer::Run, this);
+    return true;
+}
+
+void MetricsServer::Stop() {
+    if (_thread.joinable()) {
+        _running = false;
+        _poller->Wakeup();
+        _thread.join();
+    }
+    while (!_clients.empty()) {
+        CloseClient(_clients.back().get());
+    }
+    _retired.clear();
+    if (_sock != INVALID_SOCKET) {
+        if (_poller != nullptr) {
+            _poller->Remove(_sock);
+        }
+        closesocket(_sock);
+        _sock = INVALID_SOCKET;
+    }
+}
+
+void MetricsServer::Run() {
+    std::vector<PollResult> results;
+    uint64_t nextLogMs = TimerWheel::NowMs() + _logIntervalMs;
+    while (_running) {
+        int timeoutMs = 1000;  // 至少每秒检查一次超时的HTTP连接
+        uint64_t now = TimerWheel::NowMs();
+        if (_logIntervalMs > 0) {
+            uint64_t remaining = nextLogMs > now ? nextLogMs - now : 0;
+            if (remaining < (uint64_t)timeoutMs) timeoutMs = (int)remaining;
+        }
+        if (_poller->Wait(results, timeoutMs) < 0) {
+            LogSocketError(GetLastSocketError());  // 记录等待事件失败的错误信息
+            break;
+        }
+        for (const PollResult& result : results) {
+            result.handler->HandleEvents(result.events);
+        }
+
+        now = TimerWheel::NowMs();
+        for (size_t i = _clients.size(); i-- > 0;) {
+            if (now - _clients[i]->acceptedMs >= kClientTimeoutMs) {
+                CloseClient(_clients[i].get());  // 请求迟迟不完整或客户端不读取响应
+            }
+        }
+        _retired.clear();
+
+        if (_logIntervalMs > 0 && now >= nextLogMs) {
+            LogSummary();
+            nextLogMs = now + _logIntervalMs;
+        }
+    }
+}
+
+void MetricsServer::HandleEvents(uint32_t /*events*/) {
+    for (;;) {
+        SOCKET sock = accept(_sock, nullptr, nullptr);
+        if (sock == INVALID_SOCKET) {
+            int error = GetLastSocketError();
+            if (!IsWouldBlock(error)) {
+                LOG_WARN("Failed to accept metrics connection: %d", error);
+            }
+            return;
+        }
+        if (_clients.size() >= kMaxClients) {
+            CloseClient(_clients.front().get());  // 连接过多时放弃最早的一个
+        }
+        auto client = std::make_unique<Client>();
+        client->server = this;
+        client->sock = sock;
+        client->acceptedMs = TimerWheel::NowMs();
+        if (!SetNonBlocking(sock) || !_poller->Add(sock, PollIn, client.get())) {
+            closesocket(sock);
+            continue;
+        }
+        _clients.push_back(std::move(client));
+    }
+}
+
+void MetricsServer::OnClientEvents(Client* client, uint32_t /*events*/) {
+    if (client->sock == INVALID_SOCKET) {
+        return;
+    }
+
+    if (client->response.empty()) {
+        char buffer[2048];
+        int len = recv(client->sock, buffer, sizeof(buffer), 0);
+        if (len == SOCKET_ERROR && IsWouldBlock(GetLastSocketError())) {
+            return;
+        }
+        if (len <= 0) {
+            CloseClient(client);
+            return;
+        }
+        client->request.append(buffer, (size_t)len);
+        if (client->request.find("\r\n\r\n") == std::string::npos) {
+            if (client->request.size() > kMaxRequestSize) {
+                CloseClient(client);
+            }
+            return;  // 请求头还没有收完
+        }
+        client->response = BuildResponse(client->request);
+    }
+
+    while (client->sent < client->response.size()) {
+        int len = send(client->sock, client->response.data() + client->sent, (int)(client->response.size() - client->sent), kSendFlags);
+        if (len == SOCKET_ERROR) {
+            if (IsWouldBlock(GetLastSocketError())) {
+                _poller->Modify(client->sock, PollOut, client);  // 发送缓冲区满，等待可写
+                return;
+            }
+            break;
+        }
+        client->sent += (size_t)len;
+    }
+    CloseClient(client);  // 响应带有 Connection: close，写完即关闭
+}
+
+std::string MetricsServer::BuildResponse(const std::string& request) {
+    // 只看请求行中的方法、路径和查询参数，忽略其余请求头
+    size_t methodEnd = request.find(' ');
+    size_t pathEnd = methodEnd == std::string::npos ? std::string::npos : request.find_first_of(" ?\r", methodEnd + 1);
+    std::string method = request.substr(0, methodEnd);
+    std::string path = pathEnd == std::string::npos ? std::string() : request.substr(methodEnd + 1, pathEnd - methodEnd - 1);
+    std::string query;
+    if (pathEnd != std::string::npos && request[pathEnd] == '?') {
+        size_t queryEnd = request.find_first_of(" \r", pathEnd);
+        query = request.substr(pathEnd + 1, queryEnd == std::string::npos ? std::string::npos : queryEnd - pathEnd - 1);
+    }
+
+    std::string status = "200 OK";
+    std::string contentType = "text/plain; version=0.0.4; charset=utf-8";
+    std::string body;
+    bool listing = _sessionControl.list != nullptr && path == "/sessions";
+    bool closing = _sessionControl.close != nullptr && path == "/sessions/close";
+    std::string allowed = closing ? "POST" : "GET";
+    if (method != allowed) {
+        status = "405 Method Not Allowed";
+        contentType = "text/plain; charset=utf-8";
+        body = "Method not allowed\n";
+    }
+    else if (path == "/metrics") {
+        body = FormatPrometheus(_registry.Snapshot());
+    }
+    else if (listing) {
+        contentType = "text/plain; charset=utf-8";
+        body = _sessionControl.list();
+    }
+    else if (closing && !HasHeader(request, kControlHeader)) {
+        status = "403 Forbidden";
+        contentType = "text/plain; charset=utf-8";
+        body = std::string("Missing ") + kControlHeader + " header\n";
+    }
+    else if (closing) {
+        contentType = "text/plain; charset=utf-8";
+        // 查询参数的形式为 id=N
+        char* end = nullptr;
+        unsigned long long id = query.compare(0, 3, "id=") == 0 ? strtoull(query.c_str() + 3, &end, 10) : 0;
+        if (end == nullptr || end == query.c_str() + 3 || *end != '\0') {
+            status = "400 Bad Request";
+            body = std::string("Usage: POST /sessions/close?id=N with an ") + kControlHeader + " header\n";
+        }
+        else if (!_sessionControl.close(id)) {
+            status = "404 Not Found";
+            body = "No such session\n";
+        }
+        else {
+            body = "Closed\n";
+        }
+    }
+    else {
+        status = "404 Not Found";
+        contentType = "text/plain; charset=utf-8";
+        body = "Not found, try /metrics\n";
+    }
+    return "HTTP/1.1 " + status + "\r\nContent-Type: " + contentType + "\r\nContent-Length: " +
+        std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+}
+
+void MetricsServer::CloseClient(Client* client) {
+    if (client->sock != INVALID_SOCKET) {
+        _poller->Remove(client->sock);
+        closesocket(client->sock);
+        client->sock = INVALID_SOCKET;
+    }
+    for (size_t i = 0; i < _clients.size(); ++i) {
+        if (_clients[i].get() == client) {
+            _retired.push_back(std::move(_clients[i]));  // 同一批事件中可能还有它的回调，延迟释放
+            _clients.erase(_clients.begin() + (ptrdiff_t)i);
+            break;
+        }
+    }
+}
+
+void MetricsServer::LogSummary() {
+    for (RuleMetricsSnapshot& rule : _registry.Snapshot()) {
+        RuleMetricsSnapshot delta = rule;
+        auto it = _lastSummary.find(rule.rule);
+        // 同名规则被重新创建后计数器从零开始，此时不计算增量
+        if (it != _lastSummary.end() && it->second.opened <= rule.opened &&
+            it->second.bytesUp <= rule.bytesUp && it->second.bytesDown <= rule.bytesDown &&
+            it->second.packetsUp <= rule.packetsUp && it->second.packetsDown <= rule.packetsDown) {
+            delta -= it->second;
+        }
+        uint64_t active = rule.Active();
+        bool idle = delta.opened == 0 && delta.bytesUp == 0 && delta.bytesDown == 0 && active == 0;
+        if (!idle) {
+            Log(FormatSummary(delta, active, _logIntervalMs / 1000));  // 没有任何活动的规则不输出
+        }
+        _lastSummary[rule.rule] = std::move(rule);
+    }
+}
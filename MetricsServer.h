@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "netcompat.h"
+#include "Metrics.h"
+#include "Poller.h"
+
+// 会话管理接口，由中继引擎提供，在统计输出线程上调用
+struct SessionControl {
+    std::function<std::string()> list;    // GET /sessions 的响应正文
+    std::function<bool(uint64_t)> close;  // POST /sessions/close?id=N，返回是否找到该会话；为空时不提供关闭接口
+};
+
+// 统计输出线程：可选地在本地HTTP端口上以Prometheus文本格式提供 /metrics，
+// 并定期为每条规则输出一行汇总日志。统计在读取时才汇总，不影响转发线程。
+// 设置了会话管理接口时还提供 /sessions 列出存活的会话，以及 /sessions/close 强制关闭会话。
+// 关闭请求必须带有kControlHeader请求头：浏览器跨站发出带自定义请求头的POST之前需要预检，
+// 这里不响应预检，任意网页无法借本机的浏览器关闭会话
+class MetricsServer : public PollHandler {
+public:
+    explicit MetricsServer(MetricsRegistry& registry);
+    ~MetricsServer() override;
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    // listenSock为INVALID_SOCKET时不提供HTTP接口，logIntervalMs为0时不输出汇总日志，两者都关闭时不启动线程
+    bool Start(SOCKET listenSock, uint32_t logIntervalMs);
+    void Stop();
+    void SetSessionControl(SessionControl control) { _sessionControl = std::move(control); }  // 在Start之前调用
+
+    void HandleEvents(uint32_t events) override;  // 接受新的HTTP连接
+
+private:
+    static constexpr size_t kMaxClients = 16;         // 同时服务的HTTP连接上限
+    static constexpr size_t kMaxRequestSize = 8192;   // 请求头的最大长度
+    static constexpr uint64_t kClientTimeoutMs = 5000;  // 一个HTTP连接的最长处理时间
+    static constexpr const char* kControlHeader = "X-Session-Control";  // 关闭会话的请求必须带有该请求头（值不限）
+
+    // 一个HTTP连接：读完请求头后生成完整的响应，写完即关闭
+    struct Client : PollHandler {
+        MetricsServer* server = nullptr;
+        SOCKET sock = INVALID_SOCKET;
+        std::string request;
+        std::string response;
+        size_t sent = 0;
+        uint64_t acceptedMs = 0;
+        void HandleEvents(uint32_t events) override { server->OnClientEvents(this, events); }
+    };
+
+    void Run();
+    void OnClientEvents(Client* client, uint32_t events);
+    std::string BuildResponse(const std::string& request);
+    void CloseClient(Client* client);
+    void LogSummary();
+
+    MetricsRegistry& _registry;
+    SessionControl _sessionControl;
+    std::unique_ptr<Poller> _poller;  // 在Start中创建
+    SOCKET _sock = INVALID_SOCKET;
+    uint32_t _logIntervalMs = 0;
+    std::thread _thread;
+    std::atomic<bool> _running{ false };
+    std::vector<std::unique_ptr<Client>> _clients;
+    std::vector<std::unique_ptr<Client>> _retired;  // 本轮事件处理结束后释放
+    std::unordered_map<std::string, RuleMetricsSnapshot> _lastSummary;  // 上一次汇总时各规则的快照，用于计算增量
+};
@@ -0,0 +1,194 @@
+#include "Poller.h"
+#include "conlog.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+// 把可移植事件标志转换为epoll事件
+static uint32_t ToEpollEvents(uint32_t events) {
+    uint32_t result = 0;
+    if (events & PollIn) result |= EPOLLIN | EPOLLRDHUP;
+    if (events & PollOut) result |= EPOLLOUT;
+    return result;
+}
+
+Poller::Poller() {
+    _epollFd = epoll_create1(EPOLL_CLOEXEC);
+    _wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_epollFd == -1 || _wakeupFd == -1) {
+        LogSocketError(GetLastSocketError());  // 记录创建epoll或eventfd失败的错误信息
+        return;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;  // 空指针代表唤醒事件
+    epoll_ctl(_epollFd, EPOLL_CTL_ADD, _wakeupFd, &ev);
+}
+
+Poller::~Poller() {
+    if (_wakeupFd != -1) close(_wakeupFd);
+    if (_epollFd != -1) close(_epollFd);
+}
+
+bool Poller::IsValid() const {
+    return _epollFd != -1 && _wakeupFd != -1;
+}
+
+bool Poller::Add(SOCKET sock, uint32_t events, PollHandler* handler) {
+    epoll_event ev{};
+    ev.events = ToEpollEvents(events);
+    ev.data.ptr = handler;
+    return epoll_ctl(_epollFd, EPOLL_CTL_ADD, sock, &ev) == 0;
+}
+
+bool Poller::Modify(SOCKET sock, uint32_t events, PollHandler* handler) {
+    epoll_event ev{};
+    ev.events = ToEpollEvents(events);
+    ev.data.ptr = handler;
+    return epoll_ctl(_epollFd, EPOLL_CTL_MOD, sock, &ev) == 0;
+}
+
+void Poller::Remove(SOCKET sock) {
+    epoll_ctl(_epollFd, EPOLL_CTL_DEL, sock, nullptr);
+}
+
+int Poller::Wait(std::vector<PollResult>& results, int timeoutMs) {
+    epoll_event events[256];
+    results.clear();
+    int count = epoll_wait(_epollFd, events, 256, timeoutMs);
+    if (count < 0) {
+        return errno == EINTR ? 0 : -1;  // 被信号打断时当作无事件返回
+    }
+    for (int i = 0; i < count; ++i) {
+        if (events[i].data.ptr == nullptr) {
+            uint64_t value;
+            while (read(_wakeupFd, &value, sizeof(value)) > 0) {}  // 清空唤醒计数
+            continue;
+        }
+        uint32_t flags = 0;
+        if (events[i].events & EPOLLIN) flags |= PollIn;
+        if (events[i].events & EPOLLOUT) flags |= PollOut;
+        if (events[i].events & EPOLLERR) flags |= PollErr;
+        if (events[i].events & (EPOLLHUP | EPOLLRDHUP)) flags |= PollHup;
+        results.push_back({ (PollHandler*)events[i].data.ptr, flags });
+    }
+    return (int)results.size();
+}
+
+void Poller::Wakeup() {
+    uint64_t one = 1;
+    ssize_t ignored = write(_wakeupFd, &one, sizeof(one));
+    (void)ignored;
+}
+
+#else
+
+#ifdef _WIN32
+#define PlatformPoll WSAPoll
+#else
+#define PlatformPoll poll
+#endif
+
+// 把可移植事件标志转换为poll事件
+static short ToPollEvents(uint32_t events) {
+    short result = 0;
+    if (events & PollIn) result |= POLLIN;
+    if (events & PollOut) result |= POLLOUT;
+    return result;
+}
+
+Poller::Poller() {
+    // 创建一个连接到自身的回环UDP套接字，向它发送一个字节即可唤醒poll
+    _wakeupSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (_wakeupSocket == INVALID_SOCKET) {
+        LogSocketError(GetLastSocketError());
+        return;
+    }
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrLen = sizeof(addr);
+    if (bind(_wakeupSocket, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+        getsockname(_wakeupSocket, (sockaddr*)&addr, &addrLen) == SOCKET_ERROR ||
+        connect(_wakeupSocket, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR) {
+        LogSocketError(GetLastSocketError());
+        closesocket(_wakeupSocket);
+        _wakeupSocket = INVALID_SOCKET;
+        return;
+    }
+    SetNonBlocking(_wakeupSocket);
+    _fds.push_back({ _wakeupSocket, POLLIN, 0 });
+    _handlers.push_back(nullptr);  // 下标0固定为唤醒套接字
+}
+
+Poller::~Poller() {
+    if (_wakeupSocket != INVALID_SOCKET) closesocket(_wakeupSocket);
+}
+
+bool Poller::IsValid() const {
+    return _wakeupSocket != INVALID_SOCKET;
+}
+
+bool Poller::Add(SOCKET sock, uint32_t events, PollHandler* handler) {
+    if (_index.count(sock)) return false;
+    _index[sock] = _fds.size();
+    _fds.push_back({ sock, ToPollEvents(events), 0 });
+    _handlers.push_back(handler);
+    return true;
+}
+
+bool Poller::Modify(SOCKET sock, uint32_t events, PollHandler* handler) {
+    auto it = _index.find(sock);
+    if (it == _index.end()) return false;
+    _fds[it->second].events = ToPollEvents(events);
+    _handlers[it->second] = handler;
+    return true;
+}
+
+void Poller::Remove(SOCKET sock) {
+    auto it = _index.find(sock);
+    if (it == _index.end()) return;
+    size_t pos = it->second;
+    size_t last = _fds.size() - 1;
+    if (pos != last) {  // 用最后一个元素填补空位
+        _fds[pos] = _fds[last];
+        _handlers[pos] = _handlers[last];
+        _index[_fds[pos].fd] = pos;
+    }
+    _fds.pop_back();
+    _handlers.pop_back();
+    _index.erase(sock);
+}
+
+int Poller::Wait(std::vector<PollResult>& results, int timeoutMs) {
+    results.clear();
+    int count = PlatformPoll(_fds.data(), (unsigned long)_fds.size(), timeoutMs);
+    if (count <= 0) {
+        return count;
+    }
+    for (size_t i = 0; i < _fds.size(); ++i) {
+        short revents = _fds[i].revents;
+        if (revents == 0) continue;
+        _fds[i].revents = 0;
+        if (_handlers[i] == nullptr) {
+            char drain[64];
+            while (recv(_wakeupSocket, drain, sizeof(drain), 0) > 0) {}  // 清空唤醒数据
+            continue;
+        }
+        uint32_t flags = 0;
+        if (revents & POLLIN) flags |= PollIn;
+        if (revents & POLLOUT) flags |= PollOut;
+        if (revents & (POLLERR | POLLNVAL)) flags |= PollErr;
+        if (revents & POLLHUP) flags |= PollHup;
+        results.push_back({ _handlers[i], flags });
+    }
+    return (int)results.size();
+}
+
+void Poller::Wakeup() {
+    char one = 1;
+    send(_wakeupSocket, &one, 1, 0);
+}
+
+#endif
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include "netcompat.h"
+
+#if !defined(__linux__) && !defined(_WIN32)
+#include <poll.h>
+#endif
+
+// 就绪事件标志
+enum PollEvent : uint32_t {
+    PollIn = 1u << 0,   // 可读（或监听套接字有新连接）
+    PollOut = 1u << 1,  // 可写（或非阻塞connect已完成）
+    PollErr = 1u << 2,  // 出错
+    PollHup = 1u << 3,  // 对端挂断
+};
+
+// 由Poller回调的事件处理对象
+class PollHandler {
+public:
+    virtual ~PollHandler() = default;
+    virtual void HandleEvents(uint32_t events) = 0;
+};
+
+// 一次Wait返回的就绪事件
+struct PollResult {
+    PollHandler* handler;
+    uint32_t events;
+};
+
+// 可移植的就绪轮询器：Linux上使用epoll，Windows上使用WSAPoll，其他平台使用poll
+// 每个Poller只能被一个线程Wait，Wakeup可以在任意线程调用
+class Poller {
+public:
+    Poller();
+    ~Poller();
+    Poller(const Poller&) = delete;
+    Poller& operator=(const Poller&) = delete;
+
+    bool Add(SOCKET sock, uint32_t events, PollHandler* handler);
+    bool Modify(SOCKET sock, uint32_t events, PollHandler* handler);
+    void Remove(SOCKET sock);
+
+    // 等待就绪事件，timeoutMs为-1时无限等待；被Wakeup唤醒时可能返回0个事件
+    int Wait(std::vector<PollResult>& results, int timeoutMs);
+
+    // 从其他线程唤醒正在Wait的线程
+    void Wakeup();
+
+    bool IsValid() const;
+#ifdef __linux__
+    int Fd() const { return _epollFd; }  // 有事件就绪时epoll描述符可读，用于嵌入io_uring等其他事件源
+#endif
+
+private:
+#ifdef __linux__
+    int _epollFd = -1;
+    int _wakeupFd = -1;  // eventfd
+#else
+    std::vector<pollfd> _fds;
+    std::vector<PollHandler*> _handlers;
+    std::unordered_map<SOCKET, size_t> _index;  // 套接字到_fds下标的映射
+    SOCKET _wakeupSocket = INVALID_SOCKET;  // 连接到自身的回环UDP套接字，作为唤醒通道
+#endif
+};
@@ -0,0 +1,156 @@
+#include "PortRoutes.h"
+#include <cstring>
+
+bool ParseProtocol(const std::string& name, Protocol& protocol) {
+    if (name == "tcp") {
+        protocol = Protocol::Tcp;
+        return true;
+    }
+    if (name == "udp") {
+        protocol = Protocol::Udp;
+        return true;
+    }
+    return false;
+}
+
+const char* ProtocolName(Protocol protocol) {
+    return protocol == Protocol::Tcp ? "tcp" : "udp";
+}
+
+// 解析一个1到65535之间的十进制端口，不接受空串、符号和多余的字符
+static bool ParsePort(const std::string& text, size_t begin, size_t end, uint16_t& port) {
+    if (begin >= end || end - begin > 5) {
+        return false;
+    }
+    uint32_t value = 0;
+    for (size_t i = begin; i < end; ++i) {
+        if (text[i] < '0' || text[i] > '9') {
+            return false;
+        }
+        value = value * 10 + (uint32_t)(text[i] - '0');
+    }
+    if (value == 0 || value > 65535) {
+        return false;
+    }
+    port = (uint16_t)value;
+    return true;
+}
+
+bool ParsePortRange(const std::string& text, PortRange& range) {
+    size_t dash = text.find('-');
+    if (dash == std::string::npos) {
+        if (!ParsePort(text, 0, text.size(), range.first)) {
+            return false;
+        }
+        range.last = range.first;
+        return true;
+    }
+    return ParsePort(text, 0, dash, range.first) && ParsePort(text, dash + 1, text.size(), range.last) &&
+        range.first <= range.last;
+}
+
+bool SplitHostPorts(const std::string& address, std::string& host, PortRange& ports) {
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+    host = address.substr(0, colon);
+    return ParsePortRange(address.substr(colon + 1), ports);
+}
+
+uint16_t GetPort(const sockaddr_storage& addr) {
+    if (addr.ss_family == AF_INET6) {
+        return ntohs(((const sockaddr_in6&)addr).sin6_port);
+    }
+    return ntohs(((const sockaddr_in&)addr).sin_port);
+}
+
+void SetPort(sockaddr_storage& addr, uint16_t port) {
+    if (addr.ss_family == AF_INET6) {
+        ((sockaddr_in6&)addr).sin6_port = htons(port);
+    }
+    else {
+        ((sockaddr_in&)addr).sin_port = htons(port);
+    }
+}
+
+static bool IsWildcard(const sockaddr_storage& addr) {
+    if (addr.ss_family == AF_INET6) {
+        static const in6_addr any = IN6ADDR_ANY_INIT;
+        return memcmp(&((const sockaddr_in6&)addr).sin6_addr, &any, sizeof(any)) == 0;
+    }
+    return ((const sockaddr_in&)addr).sin_addr.s_addr == htonl(INADDR_ANY);
+}
+
+// 两个监听地址能否同时绑定同一端口：IPv6通配地址默认同时监听IPv4，与任何地址冲突；
+// 同一地址族内，相同地址或任一方为通配地址时冲突
+static bool AddressesConflict(const sockaddr_storage& a, const sockaddr_storage& b) {
+    if ((a.ss_family == AF_INET6 && IsWildcard(a)) || (b.ss_family == AF_INET6 && IsWildcard(b))) {
+        return true;
+    }
+    if (a.ss_family != b.ss_family) {
+        return false;
+    }
+    if (IsWildcard(a) || IsWildcard(b)) {
+        return true;
+    }
+    if (a.ss_family == AF_INET6) {
+        return memcmp(&((const sockaddr_in6&)a).sin6_addr, &((const sockaddr_in6&)b).sin6_addr, sizeof(in6_addr)) == 0;
+    }
+    return ((const sockaddr_in&)a).sin_addr.s_addr == ((const sockaddr_in&)b).sin_addr.s_addr;
+}
+
+bool RouteTable::Add(const Route& route, const Route** conflict) {
+    if (conflict != nullptr) {
+        *conflict = nullptr;
+    }
+    if (_routes.size() >= kMaxRoutes) {
+        return false;
+    }
+    std::vector<uint16_t>& byPort = _byPort[(size_t)route.protocol];
+    if (byPort.empty()) {
+        byPort.assign(65536, kNoRoute);
+    }
+
+    // 端口都没有被占用时不需要比较地址；有重叠时才遍历同协议的路由，找出真正冲突的一条
+    bool shared = false;
+    for (uint32_t port = route.listen.first; port <= route.listen.last && !shared; ++port) {
+        shared = byPort[port] != kNoRoute;
+    }
+    if (shared) {
+        if (const Route* found = FindConflict(route)) {
+            if (conflict != nullptr) {
+                *conflict = found;
+            }
+            return false;
+        }
+    }
+
+    uint16_t index = (uint16_t)_routes.size();
+    _routes.push_back(route);
+    for (uint32_t port = route.listen.first; port <= route.listen.last; ++port) {
+        if (byPort[port] == kNoRoute) {
+            byPort[port] = index;
+        }
+    }
+    _portCount += route.listen.Count();
+    return true;
+}
+
+const RouteTable::Route* RouteTable::FindConflict(const Route& route) const {
+    for (const Route& existing : _routes) {
+        if (existing.protocol == route.protocol && existing.listen.Overlaps(route.listen) &&
+            AddressesConflict(existing.listenAddr, route.listenAddr)) {
+            return &existing;
+        }
+    }
+    return nullptr;
+}
+
+const RouteTable::Route* RouteTable::Find(Protocol protocol, uint16_t port) const {
+    const std::vector<uint16_t>& byPort = _byPort[(size_t)protocol];
+    if (byPort.empty() || byPort[port] == kNoRoute) {
+        return nullptr;
+    }
+    return &_routes[byPort[port]];
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "netcompat.h"
+
+// 转发协议，配置中的 "tcp"/"udp" 在读取时转换为枚举，之后不再比较字符串
+enum class Protocol : uint8_t {
+    Tcp,
+    Udp,
+};
+
+bool ParseProtocol(const std::string& name, Protocol& protocol);  // 不支持的协议返回false
+const char* ProtocolName(Protocol protocol);
+inline int SockType(Protocol protocol) { return protocol == Protocol::Tcp ? SOCK_STREAM : SOCK_DGRAM; }
+
+// 连续的端口范围 [first, last]，单个端口时两者相等
+struct PortRange {
+    uint16_t first = 0;
+    uint16_t last = 0;
+
+    uint32_t Count() const { return (uint32_t)last - first + 1; }
+    bool Contains(uint16_t port) const { return port >= first && port <= last; }
+    bool Overlaps(const PortRange& other) const { return first <= other.last && other.first <= last; }
+    bool operator==(const PortRange&) const = default;
+};
+
+// 解析 "8080" 或 "20000-29999"：端口在1到65535之间，起始端口不大于结束端口
+bool ParsePortRange(const std::string& text, PortRange& range);
+// 把 "主机:端口" 或 "主机:起始-结束" 拆分为主机和端口范围，主机保留IPv6地址的方括号
+bool SplitHostPorts(const std::string& address, std::string& host, PortRange& ports);
+
+// 读取或设置地址中的端口（主机字节序）
+uint16_t GetPort(const sockaddr_storage& addr);
+void SetPort(sockaddr_storage& addr, uint16_t port);
+
+// 加载配置时编译出的路由表：每条规则的协议、监听端口范围和解析好的监听地址放在一个连续数组中，
+// 另外每种协议一张以监听端口为下标的稠密表（65536项，每项2字节，首次用到该协议时分配），
+// 端口冲突检查和按端口查找都不需要遍历规则。编译完成后只读
+class RouteTable {
+public:
+    static constexpr uint16_t kNoRoute = 0xFFFF;
+    static constexpr size_t kMaxRoutes = kNoRoute;
+
+    struct Route {
+        sockaddr_storage listenAddr{};  // 监听地址，端口为0，绑定时逐个填入范围内的端口
+        PortRange listen;
+        Protocol protocol = Protocol::Tcp;
+        uint32_t rule = 0;  // 规则在配置中的序号
+    };
+
+    // 添加一条路由。同一协议下与已有路由的端口重叠、且监听地址相同或任一方是通配地址时不添加，
+    // conflict指向冲突的路由；路由数量达到上限时同样返回false，conflict为nullptr
+    bool Add(const Route& route, const Route** conflict = nullptr);
+    // 查找监听该端口的路由，没有时返回nullptr；同一端口监听在多个地址上时返回先添加的一条
+    const Route* Find(Protocol protocol, uint16_t port) const;
+
+    const std::vector<Route>& Routes() const { return _routes; }
+    size_t PortCount() const { return _portCount; }  // 所有路由的监听端口总数
+
+private:
+    const Route* FindConflict(const Route& route) const;
+
+    std::vector<Route> _routes;
+    std::vector<uint16_t> _byPort[2];  // 按协议分开，下标为监听端口，值为_routes中的序号
+    size_t _portCount = 0;
+};
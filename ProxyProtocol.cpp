@@ -0,0 +1,317 @@
+#include "ProxyProtocol.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// v2协议头的签名
+static const char kV2Signature[12] = { '\r', '\n', '\r', '\n', '\0', '\r', '\n', 'Q', 'U', 'I', 'T', '\n' };
+static const char kV1Prefix[] = "PROXY ";
+
+bool ParseProxyVersion(const std::string& name, ProxyVersion& version) {
+    if (name == "v1") {
+        version = ProxyVersion::V1;
+        return true;
+    }
+    if (name == "v2") {
+        version = ProxyVersion::V2;
+        return true;
+    }
+    if (name == "none") {
+        version = ProxyVersion::None;
+        return true;
+    }
+    return false;
+}
+
+const char* ProxyVersionName(ProxyVersion version) {
+    switch (version) {
+    case ProxyVersion::V1:
+        return "v1";
+    case ProxyVersion::V2:
+        return "v2";
+    default:
+        return "none";
+    }
+}
+
+// IPv4映射的IPv6地址（::ffff:a.b.c.d）还原为IPv4地址，其他地址原样复制
+static sockaddr_storage Unmap(const sockaddr_storage& addr) {
+    sockaddr_storage result = addr;
+    if (addr.ss_family == AF_INET6) {
+        const sockaddr_in6& in6 = (const sockaddr_in6&)addr;
+        const uint8_t* bytes = (const uint8_t*)&in6.sin6_addr;
+        static const uint8_t kMappedPrefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF };
+        if (memcmp(bytes, kMappedPrefix, sizeof(kMappedPrefix)) == 0) {
+            result = {};
+            sockaddr_in& in4 = (sockaddr_in&)result;
+            in4.sin_family = AF_INET;
+            in4.sin_port = in6.sin6_port;
+            memcpy(&in4.sin_addr, bytes + 12, 4);
+        }
+    }
+    return result;
+}
+
+// IPv4地址转换为IPv4映射的IPv6地址
+static sockaddr_storage MapToV6(const sockaddr_storage& addr) {
+    if (addr.ss_family != AF_INET) {
+        return addr;
+    }
+    const sockaddr_in& in4 = (const sockaddr_in&)addr;
+    sockaddr_storage result{};
+    sockaddr_in6& in6 = (sockaddr_in6&)result;
+    in6.sin6_family = AF_INET6;
+    in6.sin6_port = in4.sin_port;
+    uint8_t* bytes = (uint8_t*)&in6.sin6_addr;
+    bytes[10] = 0xFF;
+    bytes[11] = 0xFF;
+    memcpy(bytes + 12, &in4.sin_addr, 4);
+    return result;
+}
+
+static const void* AddressBytes(const sockaddr_storage& addr) {
+    if (addr.ss_family == AF_INET6) {
+        return &((const sockaddr_in6&)addr).sin6_addr;
+    }
+    return &((const sockaddr_in&)addr).sin_addr;
+}
+
+static uint16_t NetworkPort(const sockaddr_storage& addr) {
+    if (addr.ss_family == AF_INET6) {
+        return ((const sockaddr_in6&)addr).sin6_port;
+    }
+    return ((const sockaddr_in&)addr).sin_port;
+}
+
+size_t BuildProxyHeader(ProxyVersion version, const sockaddr_storage& src, const sockaddr_storage& dst, char* out) {
+    sockaddr_storage from = Unmap(src);
+    sockaddr_storage to = Unmap(dst);
+    bool ip = (from.ss_family == AF_INET || from.ss_family == AF_INET6) &&
+        (to.ss_family == AF_INET || to.ss_family == AF_INET6);
+    if (ip && from.ss_family != to.ss_family) {
+        from = MapToV6(from);
+        to = MapToV6(to);
+    }
+    bool v6 = from.ss_family == AF_INET6;
+
+    if (version == ProxyVersion::V1) {
+        if (!ip) {
+            memcpy(out, "PROXY UNKNOWN\r\n", 15);
+            return 15;
+        }
+        char fromText[INET6_ADDRSTRLEN] = {};
+        char toText[INET6_ADDRSTRLEN] = {};
+        inet_ntop(from.ss_family, AddressBytes(from), fromText, sizeof(fromText));
+        inet_ntop(to.ss_family, AddressBytes(to), toText, sizeof(toText));
+        int len = snprintf(out, kProxyHeaderMaxSize, "PROXY %s %s %s %u %u\r\n", v6 ? "TCP6" : "TCP4", fromText, toText,
+            (unsigned)ntohs(NetworkPort(from)), (unsigned)ntohs(NetworkPort(to)));
+        return len > 0 ? (size_t)len : 0;
+    }
+
+    memcpy(out, kV2Signature, sizeof(kV2Signature));
+    if (!ip) {
+        out[12] = 0x20;  // 版本2，LOCAL命令：接收方使用连接本身的地址
+        out[13] = 0x00;
+        out[14] = 0;
+        out[15] = 0;
+        return 16;
+    }
+    size_t addrLen = v6 ? 16 : 4;
+    out[12] = 0x21;  // 版本2，PROXY命令
+    out[13] = v6 ? 0x21 : 0x11;  // AF_INET6或AF_INET，STREAM
+    uint16_t length = (uint16_t)(addrLen * 2 + 4);
+    out[14] = (char)(length >> 8);
+    out[15] = (char)(length & 0xFF);
+    char* p = out + 16;
+    memcpy(p, AddressBytes(from), addrLen);
+    memcpy(p + addrLen, AddressBytes(to), addrLen);
+    uint16_t fromPort = NetworkPort(from);
+    uint16_t toPort = NetworkPort(to);
+    memcpy(p + addrLen * 2, &fromPort, 2);  // 端口已经是网络字节序
+    memcpy(p + addrLen * 2 + 2, &toPort, 2);
+    return 16 + length;
+}
+
+ProxyHeaderParser::Result ProxyHeaderParser::Feed(const char* data, size_t len, size_t& consumed) {
+    consumed = 0;
+    if (len == 0) {
+        return Result::NeedMore;
+    }
+    if (_length == 0 && data[0] != kV1Prefix[0] && data[0] != kV2Signature[0]) {
+        return Result::Invalid;
+    }
+
+    bool v1 = (_length > 0 ? _buffer[0] : data[0]) == kV1Prefix[0];
+    if (v1) {
+        // v1：逐字节复制到换行符为止，前6个字节必须是 "PROXY "
+        while (consumed < len) {
+            char c = data[consumed++];
+            _buffer[_length++] = c;
+            if (_length < sizeof(kV1Prefix) && c != kV1Prefix[_length - 1]) {
+                return Result::Invalid;
+            }
+            if (c == '\n') {
+                return _length >= 2 && _buffer[_length - 2] == '\r' && ParseV1() ? Result::Done : Result::Invalid;
+            }
+            if (_length >= kV1MaxSize) {
+                return Result::Invalid;
+            }
+        }
+        return Result::NeedMore;
+    }
+
+    // v2：先收齐16字节的固定部分，得到后续长度
+    if (_length < kV2FixedSize) {
+        size_t n = std::min(kV2FixedSize - _length, len);
+        memcpy(_buffer + _length, data, n);
+        size_t signatureEnd = std::min(_length + n, sizeof(kV2Signature));
+        if (_length < signatureEnd && memcmp(_buffer + _length, kV2Signature + _length, signatureEnd - _length) != 0) {
+            return Result::Invalid;
+        }
+        _length += n;
+        consumed = n;
+        if (_length < kV2FixedSize) {
+            return Result::NeedMore;
+        }
+        uint8_t command = (uint8_t)_buffer[12];
+        if ((command >> 4) != 2 || (command & 0x0F) > 1) {
+            return Result::Invalid;
+        }
+        _v2Length = ((size_t)(uint8_t)_buffer[14] << 8) | (uint8_t)_buffer[15];
+    }
+
+    // 地址部分保存到_buffer中，放不下的TLV只计数跳过
+    size_t total = kV2FixedSize + _v2Length;
+    size_t kept = std::min(total, sizeof(_buffer));
+    if (_length < kept) {
+        size_t n = std::min(kept - _length, len - consumed);
+        memcpy(_buffer + _length, data + consumed, n);
+        _length += n;
+        consumed += n;
+    }
+    if (_length == kept && _length + _v2Skipped < total) {
+        size_t n = std::min(total - _length - _v2Skipped, len - consumed);
+        _v2Skipped += n;
+        consumed += n;
+    }
+    if (_length + _v2Skipped < total) {
+        return Result::NeedMore;
+    }
+    return ParseV2() ? Result::Done : Result::Invalid;
+}
+
+// 解析十进制端口，只接受数字
+static bool ParseV1Port(const char* text, uint16_t& port) {
+    if (*text == '\0' || strlen(text) > 5) {
+        return false;
+    }
+    uint32_t value = 0;
+    for (const char* p = text; *p != '\0'; ++p) {
+        if (*p < '0' || *p > '9') {
+            return false;
+        }
+        value = value * 10 + (uint32_t)(*p - '0');
+    }
+    if (value > 65535) {
+        return false;
+    }
+    port = (uint16_t)value;
+    return true;
+}
+
+static bool ParseV1Address(int family, const char* text, uint16_t port, sockaddr_storage& addr) {
+    addr = {};
+    if (family == AF_INET) {
+        sockaddr_in& in4 = (sockaddr_in&)addr;
+        in4.sin_family = AF_INET;
+        in4.sin_port = htons(port);
+        return inet_pton(AF_INET, text, &in4.sin_addr) == 1;
+    }
+    sockaddr_in6& in6 = (sockaddr_in6&)addr;
+    in6.sin6_family = AF_INET6;
+    in6.sin6_port = htons(port);
+    return inet_pton(AF_INET6, text, &in6.sin6_addr) == 1;
+}
+
+bool ProxyHeaderParser::ParseV1() {
+    // 复制到栈上去掉CRLF，按单个空格切分：PROXY 协议 源地址 目的地址 源端口 目的端口
+    char line[kV1MaxSize + 1];
+    size_t lineLen = _length - 2;
+    memcpy(line, _buffer, lineLen);
+    line[lineLen] = '\0';
+
+    const char* fields[6] = {};
+    size_t count = 0;
+    char* p = line;
+    while (count < 6) {
+        fields[count++] = p;
+        char* space = count < 6 ? strchr(p, ' ') : nullptr;  // 最后一个字段保留剩余的内容，多余的字段在下面检查
+        if (space == nullptr) {
+            break;
+        }
+        *space = '\0';
+        p = space + 1;
+    }
+
+    if (count >= 2 && strcmp(fields[1], "UNKNOWN") == 0) {
+        _hasAddresses = false;  // UNKNOWN之后的内容按规范忽略
+        return true;
+    }
+    if (count != 6 || strchr(fields[5], ' ') != nullptr) {
+        return false;
+    }
+    int family;
+    if (strcmp(fields[1], "TCP4") == 0) {
+        family = AF_INET;
+    }
+    else if (strcmp(fields[1], "TCP6") == 0) {
+        family = AF_INET6;
+    }
+    else {
+        return false;
+    }
+    uint16_t srcPort, dstPort;
+    if (!ParseV1Port(fields[4], srcPort) || !ParseV1Port(fields[5], dstPort) ||
+        !ParseV1Address(family, fields[2], srcPort, _source) || !ParseV1Address(family, fields[3], dstPort, _destination)) {
+        return false;
+    }
+    _hasAddresses = true;
+    return true;
+}
+
+bool ProxyHeaderParser::ParseV2() {
+    uint8_t command = (uint8_t)_buffer[12] & 0x0F;
+    uint8_t family = (uint8_t)_buffer[13] >> 4;
+    _hasAddresses = false;
+    if (command == 0 || (family != 1 && family != 2)) {
+        return true;  // LOCAL命令（负载均衡器的健康检查）或UNIX等地址族，使用连接本身的地址
+    }
+
+    size_t addrLen = family == 1 ? 4 : 16;
+    if (_v2Length < addrLen * 2 + 4) {
+        return false;
+    }
+    const char* p = _buffer + kV2FixedSize;
+    _source = {};
+    _destination = {};
+    if (family == 1) {
+        sockaddr_in& src = (sockaddr_in&)_source;
+        sockaddr_in& dst = (sockaddr_in&)_destination;
+        src.sin_family = dst.sin_family = AF_INET;
+        memcpy(&src.sin_addr, p, 4);
+        memcpy(&dst.sin_addr, p + 4, 4);
+        memcpy(&src.sin_port, p + 8, 2);
+        memcpy(&dst.sin_port, p + 10, 2);
+    }
+    else {
+        sockaddr_in6& src = (sockaddr_in6&)_source;
+        sockaddr_in6& dst = (sockaddr_in6&)_destination;
+        src.sin6_family = dst.sin6_family = AF_INET6;
+        memcpy(&src.sin6_addr, p, 16);
+        memcpy(&dst.sin6_addr, p + 16, 16);
+        memcpy(&src.sin6_port, p + 32, 2);
+        memcpy(&dst.sin6_port, p + 34, 2);
+    }
+    _hasAddresses = true;
+    return true;
+}
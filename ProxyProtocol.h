@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "netcompat.h"
+
+// HAProxy PROXY协议：负载均衡器在连接开头附带真实的客户端地址。
+// v1是一行文本 "PROXY TCP4 源地址 目的地址 源端口 目的端口\r\n"，v2是带12字节签名的二进制头
+enum class ProxyVersion : uint8_t {
+    None,
+    V1,
+    V2,
+};
+
+bool ParseProxyVersion(const std::string& name, ProxyVersion& version);  // "v1"、"v2"或"none"，其他返回false
+const char* ProxyVersionName(ProxyVersion version);
+
+// v1最长107字节（"PROXY TCP6"加两个完整的IPv6地址）；v2携带IPv6地址时为16+36字节
+constexpr size_t kProxyHeaderMaxSize = 108;
+
+// 按src（客户端）和dst（客户端连接的本机地址）生成协议头，返回长度，out至少kProxyHeaderMaxSize字节。
+// IPv4映射的IPv6地址按IPv4发送；两端地址族不同时统一按IPv6发送；不是IP地址时v1发送UNKNOWN，v2发送LOCAL
+size_t BuildProxyHeader(ProxyVersion version, const sockaddr_storage& src, const sockaddr_storage& dst, char* out);
+
+// 增量解析连接开头的PROXY协议头，自动识别v1和v2。
+// 数据可以分多次、在任意位置断开送入，解析器只使用自身的固定缓冲区，不分配内存
+class ProxyHeaderParser {
+public:
+    enum class Result {
+        NeedMore,  // 协议头还不完整，数据已全部消耗
+        Done,      // 解析完成，consumed之后的数据属于正文
+        Invalid,   // 不是合法的PROXY协议头
+    };
+
+    // 送入一段数据，consumed返回其中属于协议头的字节数。Done或Invalid之后不应再调用
+    Result Feed(const char* data, size_t len, size_t& consumed);
+
+    // 协议头携带了TCP地址时为true；v1的UNKNOWN、v2的LOCAL命令或非IP地址族时为false，此时应使用连接本身的地址
+    bool HasAddresses() const { return _hasAddresses; }
+    const sockaddr_storage& Source() const { return _source; }
+    const sockaddr_storage& Destination() const { return _destination; }
+
+private:
+    static constexpr size_t kV1MaxSize = 107;
+    static constexpr size_t kV2FixedSize = 16;
+    static constexpr size_t kV2AddressMaxSize = 216;  // AF_UNIX的两个108字节路径，更长的部分是TLV
+
+    bool ParseV1();
+    bool ParseV2();
+
+    char _buffer[kV2FixedSize + kV2AddressMaxSize];
+    size_t _length = 0;      // _buffer中已保存的字节数
+    size_t _v2Length = 0;    // v2头部声明的地址和TLV长度
+    size_t _v2Skipped = 0;   // 已跳过的、超出_buffer的TLV字节
+    bool _hasAddresses = false;
+    sockaddr_storage _source{};
+    sockaddr_storage _destination{};
+};
@@ -0,0 +1,220 @@
+#include "RateLimiter.h"
+#include <algorithm>
+#include <chrono>
+#include "UpstreamPool.h"
+
+static constexpr int kAdmitAttempts = 4;  // 插入时与其他线程冲突的最大重试次数
+static constexpr double kBurstSeconds = 0.25;  // 字节和数据报的桶容量按该时长的额度计算
+static constexpr double kMinByteBurst = 65536;  // 至少能放下一个最大的UDP数据报或一次读取
+static constexpr double kMinPacketBurst = 64;  // 至少能放下一个GRO合并的数据报
+
+// 客户端表中的一项，两项共用一个缓存行
+struct alignas(32) RateLimiter::Client {
+    std::atomic<uint64_t> state{ 0 };  // 地址标签 << kCountBits | 活动连接数，0表示空项
+    std::atomic<uint64_t> connectionTat{ 0 };
+    std::atomic<uint64_t> byteTat{ 0 };
+    std::atomic<uint64_t> packetTat{ 0 };
+};
+
+// FNV哈希的低位只由输入的低位决定，再混合一次，使分片、槽位和标签都均匀
+static uint64_t MixHash(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+TokenRate TokenRate::Make(double perSec, double burst) {
+    TokenRate rate;
+    if (perSec > 0) {
+        rate.intervalNs = 1e9 / perSec;
+        rate.toleranceNs = (uint64_t)(burst * rate.intervalNs);
+    }
+    return rate;
+}
+
+bool TokenRate::TryTake(std::atomic<uint64_t>& tat, uint64_t nowNs, uint64_t amount) const {
+    uint64_t increment = (uint64_t)((double)amount * intervalNs);
+    uint64_t current = tat.load(std::memory_order_relaxed);
+    for (;;) {
+        uint64_t next = (current > nowNs ? current : nowNs) + increment;
+        if (next - nowNs > toleranceNs) {
+            return false;  // 桶中的令牌不够
+        }
+        if (tat.compare_exchange_weak(current, next, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+}
+
+uint64_t TokenRate::Take(std::atomic<uint64_t>& tat, uint64_t nowNs, uint64_t amount) const {
+    uint64_t increment = (uint64_t)((double)amount * intervalNs);
+    uint64_t current = tat.load(std::memory_order_relaxed);
+    uint64_t next;
+    do {
+        next = (current > nowNs ? current : nowNs) + increment;
+    } while (!tat.compare_exchange_weak(current, next, std::memory_order_relaxed));
+    uint64_t ahead = next - nowNs;
+    return ahead > toleranceNs ? ahead - toleranceNs : 0;
+}
+
+RateLimiter::RateLimiter(const RateLimits& ruleLimits, const RateLimits& clientLimits, size_t clientCapacity)
+    : _clientLimits(clientLimits), _ruleMaxConnections(ruleLimits.maxConnections) {
+    auto byteBurst = [](uint64_t perSec) { return std::max((double)perSec * kBurstSeconds, kMinByteBurst); };
+    auto packetBurst = [](uint32_t perSec) { return std::max((double)perSec * kBurstSeconds, kMinPacketBurst); };
+    // 新连接的桶容量是一秒的额度
+    _ruleConnections = TokenRate::Make(ruleLimits.connectionsPerSec, std::max<double>(ruleLimits.connectionsPerSec, 1));
+    _ruleBytes = TokenRate::Make((double)ruleLimits.bytesPerSec, byteBurst(ruleLimits.bytesPerSec));
+    _rulePackets = TokenRate::Make(ruleLimits.packetsPerSec, packetBurst(ruleLimits.packetsPerSec));
+    _clientConnections = TokenRate::Make(clientLimits.connectionsPerSec, std::max<double>(clientLimits.connectionsPerSec, 1));
+    _clientBytes = TokenRate::Make((double)clientLimits.bytesPerSec, byteBurst(clientLimits.bytesPerSec));
+    _clientPackets = TokenRate::Make(clientLimits.packetsPerSec, packetBurst(clientLimits.packetsPerSec));
+    if (_clientLimits.maxConnections > kCountMask) {
+        _clientLimits.maxConnections = (uint32_t)kCountMask;
+    }
+
+    if (clientLimits.Any()) {
+        // 每个分片的项数取2的幂，不少于一次探测的长度
+        size_t perShard = kMaxProbe;
+        while (perShard * kShardCount < clientCapacity) {
+            perShard <<= 1;
+        }
+        _shardMask = perShard - 1;
+        _clients.reset(new Client[perShard * kShardCount]);
+    }
+}
+
+RateLimiter::~RateLimiter() = default;
+
+uint64_t RateLimiter::NowNs() {
+    using namespace std::chrono;
+    return (uint64_t)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+bool RateLimiter::Evictable(const Client& entry, uint64_t nowNs) const {
+    // 令牌桶都已回满时，这一项与新插入的项没有区别
+    return _clientConnections.Full(entry.connectionTat, nowNs) && _clientBytes.Full(entry.byteTat, nowNs) &&
+        _clientPackets.Full(entry.packetTat, nowNs);
+}
+
+RateLimiter::Client* RateLimiter::Pin(uint64_t hash, uint64_t nowNs, bool& rejected) {
+    uint64_t tag = hash >> kCountBits;
+    if (tag == 0) tag = 1;  // 状态字为0表示空项
+    Client* shard = &_clients[(hash % kShardCount) * (_shardMask + 1)];
+    size_t start = (size_t)(hash / kShardCount) & _shardMask;
+    uint64_t limit = _clientLimits.maxConnections != 0 ? _clientLimits.maxConnections : kCountMask;
+
+    for (int attempt = 0; attempt < kAdmitAttempts; ++attempt) {
+        Client* free = nullptr;
+        uint64_t freeState = 0;
+        bool retry = false;
+        // 已淘汰的项会在探测序列中留下空位，所以要检查完整个序列才能确定客户端不在表中
+        for (size_t i = 0; i < kMaxProbe && !retry; ++i) {
+            Client& entry = shard[(start + i) & _shardMask];
+            uint64_t state = entry.state.load(std::memory_order_acquire);
+            if ((state >> kCountBits) == tag) {
+                // 连接数和标签在同一个状态字中，标签被其他线程替换时CAS失败，不会计入错误的客户端
+                while ((state >> kCountBits) == tag) {
+                    if ((state & kCountMask) >= limit) {
+                        rejected = true;
+                        return nullptr;
+                    }
+                    if (entry.state.compare_exchange_weak(state, state + 1, std::memory_order_acq_rel)) {
+                        return &entry;
+                    }
+                }
+                retry = true;  // 这一项刚被淘汰，重新查找
+            }
+            else if (free == nullptr && (state == 0 || ((state & kCountMask) == 0 && Evictable(entry, nowNs)))) {
+                free = &entry;
+                freeState = state;
+            }
+        }
+        if (retry) {
+            continue;
+        }
+        if (free == nullptr) {
+            return nullptr;  // 探测序列中都是活跃的客户端，该客户端只受规则整体的限制
+        }
+        // 被淘汰项的TAT都不晚于当前时间，与满桶等价，不需要清零
+        if (free->state.compare_exchange_strong(freeState, (tag << kCountBits) | 1, std::memory_order_acq_rel)) {
+            return free;
+        }
+    }
+    return nullptr;
+}
+
+bool RateLimiter::Admit(const sockaddr_storage& clientAddr, Client*& client) {
+    client = nullptr;
+    if (_ruleMaxConnections != 0 && _active.fetch_add(1, std::memory_order_relaxed) >= _ruleMaxConnections) {
+        _active.fetch_sub(1, std::memory_order_relaxed);
+        return false;
+    }
+    uint64_t now = NowNs();
+    if (_clients != nullptr) {
+        bool rejected = false;
+        client = Pin(MixHash(UpstreamPool::HashClient(clientAddr)), now, rejected);
+        if (rejected) {
+            Release(nullptr);
+            return false;
+        }
+    }
+    // 先检查连接数再取令牌，被连接数拒绝的连接不消耗新建连接的额度
+    if ((client != nullptr && _clientConnections.Enabled() && !_clientConnections.TryTake(client->connectionTat, now, 1)) ||
+        (_ruleConnections.Enabled() && !_ruleConnections.TryTake(_connectionTat, now, 1))) {
+        Release(client);
+        client = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void RateLimiter::Release(Client* client) {
+    if (_ruleMaxConnections != 0) {
+        _active.fetch_sub(1, std::memory_order_relaxed);
+    }
+    if (client != nullptr) {
+        client->state.fetch_sub(1, std::memory_order_release);  // 连接数降为0后这一项才可能被淘汰
+    }
+}
+
+uint64_t RateLimiter::Charge(Client* client, uint64_t bytes) {
+    uint64_t now = NowNs();
+    uint64_t delay = 0;
+    if (client != nullptr && _clientBytes.Enabled()) {
+        delay = _clientBytes.Take(client->byteTat, now, bytes);
+    }
+    if (_ruleBytes.Enabled()) {
+        delay = std::max(delay, _ruleBytes.Take(_byteTat, now, bytes));
+    }
+    return delay;
+}
+
+bool RateLimiter::Allow(Client* client, uint64_t bytes, uint64_t packets) {
+    uint64_t now = NowNs();
+    // 先检查客户端自己的额度，超限的客户端不消耗规则整体的额度
+    if (client != nullptr) {
+        if (_clientPackets.Enabled() && !_clientPackets.TryTake(client->packetTat, now, packets)) return false;
+        if (_clientBytes.Enabled() && !_clientBytes.TryTake(client->byteTat, now, bytes)) return false;
+    }
+    if (_rulePackets.Enabled() && !_rulePackets.TryTake(_packetTat, now, packets)) return false;
+    if (_ruleBytes.Enabled() && !_ruleBytes.TryTake(_byteTat, now, bytes)) return false;
+    return true;
+}
+
+size_t RateLimiter::ClientCount() const {
+    if (_clients == nullptr) {
+        return 0;
+    }
+    uint64_t now = NowNs();
+    size_t count = 0;
+    for (size_t i = 0; i < (_shardMask + 1) * kShardCount; ++i) {
+        uint64_t state = _clients[i].state.load(std::memory_order_relaxed);
+        if (state != 0 && ((state & kCountMask) != 0 || !Evictable(_clients[i], now))) {
+            ++count;
+        }
+    }
+    return count;
+}
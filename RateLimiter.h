@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "netcompat.h"
+
+// 一组限制，0表示不限制。字节数和数据报数按两个方向合计
+struct RateLimits {
+    uint32_t maxConnections = 0;     // 同时存在的TCP连接或UDP会话数
+    uint32_t connectionsPerSec = 0;  // 每秒新建的TCP连接或UDP会话数
+    uint64_t bytesPerSec = 0;        // 每秒转发的字节数
+    uint32_t packetsPerSec = 0;      // 每秒转发的UDP数据报数
+
+    bool Any() const { return maxConnections != 0 || connectionsPerSec != 0 || bytesPerSec != 0 || packetsPerSec != 0; }
+    bool operator==(const RateLimits&) const = default;
+};
+
+// GCRA（通用信元速率算法）形式的令牌桶：桶的全部状态是一个“理论到达时间”（TAT，纳秒），
+// 由调用方放在原子变量中，用CAS更新，不需要锁，也不需要定时补充令牌。
+// TAT不晚于当前时间表示桶是满的
+struct TokenRate {
+    double intervalNs = 0;     // 每个单位的间隔，0表示不限制
+    uint64_t toleranceNs = 0;  // 桶容量对应的时间
+
+    static TokenRate Make(double perSec, double burst);
+    bool Enabled() const { return intervalNs > 0; }
+    bool Full(const std::atomic<uint64_t>& tat, uint64_t nowNs) const { return tat.load(std::memory_order_relaxed) <= nowNs; }
+    // 令牌足够时取走amount个并返回true，否则不改变状态
+    bool TryTake(std::atomic<uint64_t>& tat, uint64_t nowNs, uint64_t amount) const;
+    // 无论是否足够都取走amount个（允许透支），返回令牌恢复为非负之前需要等待的纳秒数
+    uint64_t Take(std::atomic<uint64_t>& tat, uint64_t nowNs, uint64_t amount) const;
+};
+
+// 一条规则的限流器：规则整体的限制和按客户端IP的限制，可以被所有工作线程同时使用。
+// 客户端表是固定容量的开放寻址哈希表，按哈希值分成若干分片，探测不跨出分片；
+// 每一项只有一个状态字（地址标签和活动连接数）和三个TAT，插入、计数和淘汰都用CAS完成。
+// 没有活动连接、令牌桶都已回满的项视为冷数据，插入新客户端时就地复用，淘汰不会丢失限流状态
+class RateLimiter {
+public:
+    struct Client;  // 客户端表中的一项
+    static constexpr size_t kDefaultClientCapacity = 16384;
+
+    // ruleLimits作用于整条规则，clientLimits作用于每个客户端IP
+    RateLimiter(const RateLimits& ruleLimits, const RateLimits& clientLimits, size_t clientCapacity = kDefaultClientCapacity);
+    ~RateLimiter();
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+
+    // 新TCP连接或新UDP会话的准入检查：通过时计入规则和该客户端的连接数并返回true，之后必须调用一次Release。
+    // client返回客户端表中的项，没有按客户端的限制或表中没有空位时为nullptr（只受规则整体的限制）
+    bool Admit(const sockaddr_storage& clientAddr, Client*& client);
+    void Release(Client* client);
+    // TCP：记录已收到的bytes字节（允许透支），返回该方向应暂停读取的纳秒数，0表示不需要暂停
+    uint64_t Charge(Client* client, uint64_t bytes);
+    // UDP：额度足够时记录并返回true，否则应丢弃这些数据报
+    bool Allow(Client* client, uint64_t bytes, uint64_t packets);
+
+    size_t ClientCount() const;  // 表中正在使用的项数，遍历整个表，只用于诊断
+    static uint64_t NowNs();  // 单调时钟的纳秒数
+
+private:
+    static constexpr int kCountBits = 24;  // 状态字低位是活动连接数，高位是地址标签
+    static constexpr uint64_t kCountMask = ((uint64_t)1 << kCountBits) - 1;
+    static constexpr size_t kShardCount = 16;
+    static constexpr size_t kMaxProbe = 8;  // 每次查找最多检查的项数
+
+    Client* Pin(uint64_t hash, uint64_t nowNs, bool& rejected);  // 找到或插入客户端并计入一个连接
+    bool Evictable(const Client& entry, uint64_t nowNs) const;
+
+    RateLimits _clientLimits;
+    TokenRate _ruleConnections, _ruleBytes, _rulePackets;
+    TokenRate _clientConnections, _clientBytes, _clientPackets;
+    uint32_t _ruleMaxConnections;
+    // 规则整体的状态，各占一个缓存行
+    alignas(64) std::atomic<uint32_t> _active{ 0 };
+    alignas(64) std::atomic<uint64_t> _connectionTat{ 0 };
+    alignas(64) std::atomic<uint64_t> _byteTat{ 0 };
+    alignas(64) std::atomic<uint64_t> _packetTat{ 0 };
+    alignas(64) std::unique_ptr<Client[]> _clients;  // 没有按客户端的限制时为空
+    size_t _shardMask = 0;  // 每个分片的项数减一
+};
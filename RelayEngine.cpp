@@ -0,0 +1,638 @@
+#include "RelayEngine.h"
+#include <algorithm>
+#include <cstdio>
+#include "TcpConnection.h"
+#include "conlog.h"
+
+#ifndef _WIN32
+#include <csignal>
+#endif
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+RelayWorker::RelayWorker(size_t id, const RelayOptions& options)
+    : _id(id), _options(options),
+      _bufferPool(options.bufferMinSize, options.bufferMaxSize, options.bufferCacheBytes),
+      _udpBuffer(new char[kUdpBufferSize]) {
+    _drainTimer.worker = this;
+}
+
+RelayWorker::~RelayWorker() {
+    Stop();
+}
+
+bool RelayWorker::Start() {
+    if (!_poller.IsValid()) {
+        return false;
+    }
+    _running = true;
+    _thread = std::thread(&RelayWorker::Run, this);
+    if (_options.cpuAffinity) {
+        PinToCpu();
+    }
+    return true;
+}
+
+void RelayWorker::PinToCpu() {
+    unsigned cpuCount = std::thread::hardware_concurrency();
+    if (cpuCount == 0) {
+        return;
+    }
+    unsigned cpu = (unsigned)(_id % cpuCount);
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int error = pthread_setaffinity_np(_thread.native_handle(), sizeof(set), &set);
+    if (error != 0) {
+        LOG_WARN("Failed to pin relay worker %zu to CPU %u: %d", _id, cpu, error);
+    }
+#elif defined(_WIN32)
+    if (cpu < 64 && SetThreadAffinityMask((HANDLE)_thread.native_handle(), (DWORD_PTR)1 << cpu) == 0) {
+        LOG_WARN("Failed to pin relay worker %zu to CPU %u: %lu", _id, cpu, (unsigned long)GetLastError());
+    }
+#endif
+}
+
+void RelayWorker::Stop() {
+    if (!_thread.joinable()) {
+        return;
+    }
+    _running = false;
+    _poller.Wakeup();
+    _thread.join();
+    Shutdown();  // 事件循环已退出，这里可以安全地关闭剩余连接
+}
+
+void RelayWorker::Shutdown() {
+    RunTasks();
+    DrainSubmissions();
+    for (TcpConnection* conn : std::vector<TcpConnection*>(_connections.begin(), _connections.end())) {
+        conn->Close();
+    }
+    _draining.clear();
+    _warmPools.clear();
+    _tcpListeners.clear();
+    _udpListeners.clear();
+    ReleaseRetired();
+}
+
+void RelayWorker::SubmitTCP(SOCKET client, const sockaddr_storage& clientAddr, const std::shared_ptr<RelayRule>& rule, RateLimiter::Client* limit,
+    uint16_t portIndex) {
+    {
+        std::lock_guard<std::mutex> lock(_pendingMutex);
+        _pending.push_back({ client, clientAddr, rule, limit, portIndex });
+    }
+    _poller.Wakeup();
+}
+
+void RelayWorker::Post(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(_pendingMutex);
+        _tasks.push_back(std::move(task));
+    }
+    _poller.Wakeup();
+}
+
+void RelayWorker::AcceptTCP(SOCKET client, const sockaddr_storage& clientAddr, const std::shared_ptr<RelayRule>& rule, RateLimiter::Client* limit,
+    uint16_t portIndex) {
+    TcpConnection* conn = new TcpConnection(*this, client);
+    _connections.insert(conn);
+    _connectionCount.fetch_add(1, std::memory_order_relaxed);
+    conn->Start(rule, clientAddr, limit, portIndex);  // 失败时连接会自行关闭并进入待释放列表
+}
+
+void RelayWorker::AddTCPListener(SOCKET sock, const std::shared_ptr<RelayRule>& rule, RelayEngine* engine, uint16_t portIndex) {
+    auto listener = std::make_unique<TcpListener>(*this, engine, sock, rule, portIndex);
+    if (listener->Start()) {
+        _tcpListeners.push_back(std::move(listener));
+    }
+}
+
+void RelayWorker::AddUDP(SOCKET sock, const std::shared_ptr<RelayRule>& rule, uint16_t portIndex) {
+    auto listener = std::make_unique<UdpListener>(*this, sock, rule, portIndex);
+    if (listener->Start()) {
+        _udpListeners.push_back(std::move(listener));
+    }
+}
+
+#ifdef __linux__
+UdpBatch& RelayWorker::Batch() {
+    if (!_udpBatch) {
+        _udpBatch = std::make_unique<UdpBatch>();
+    }
+    return *_udpBatch;
+}
+#endif
+
+void RelayWorker::RetireSession(std::unique_ptr<UdpSession> session) {
+    _retiredSessions.push_back(std::move(session));
+}
+
+void RelayWorker::RetireHandler(std::unique_ptr<PollHandler> handler) {
+    _retiredHandlers.push_back(std::move(handler));
+}
+
+void RelayWorker::StartWarmPool(const std::shared_ptr<UpstreamPool>& upstream) {
+    if (upstream->Options().prewarm == 0 || _warmPools.count(upstream.get()) > 0) {
+        return;
+    }
+    auto pool = std::make_unique<WarmPool>(*this, upstream);
+    pool->Start();
+    _warmPools.emplace(upstream.get(), std::move(pool));
+}
+
+void RelayWorker::StopWarmPool(UpstreamPool* upstream) {
+    _warmPools.erase(upstream);  // 析构时关闭所有空闲连接
+}
+
+void RelayWorker::RemoveRule(const std::shared_ptr<RelayRule>& rule, uint32_t drainTimeoutMs, bool keepUdpListeners) {
+    // 同一批事件中可能还有监听端的回调，关闭后延迟释放。
+    // 端口范围规则在一个线程上可能有上万个监听端，一次遍历压缩数组，不逐个erase
+    size_t kept = 0;
+    for (auto& listener : _tcpListeners) {
+        if (listener->Rule() == rule.get()) {
+            listener->Close();
+            RetireHandler(std::move(listener));
+        }
+        else {
+            _tcpListeners[kept++] = std::move(listener);
+        }
+    }
+    _tcpListeners.resize(kept);
+    kept = 0;
+    for (auto& listener : _udpListeners) {
+        if (listener->Rule() == rule.get()) {
+            if (keepUdpListeners && listener->SessionCount() > 0) {
+                listener->StartDraining();  // 会话结束后由CheckDrains关闭
+            }
+            else {
+                listener->Close();
+                RetireHandler(std::move(listener));
+                continue;
+            }
+        }
+        _udpListeners[kept++] = std::move(listener);
+    }
+    _udpListeners.resize(kept);
+    StopWarmPool(rule->upstream.get());
+    Drain(rule, drainTimeoutMs);
+}
+
+RelayWorker::ListenerKind RelayWorker::RetargetRule(const std::shared_ptr<RelayRule>& oldRule, const std::shared_ptr<RelayRule>& newRule, uint32_t drainTimeoutMs) {
+    ListenerKind kind = ListenerKind::None;
+    for (auto& listener : _tcpListeners) {
+        if (listener->Rule() == oldRule.get()) {
+            listener->SetRule(newRule);
+            kind = listener->Sharded() ? ListenerKind::Sharded : ListenerKind::Unsharded;
+        }
+    }
+    for (auto& listener : _udpListeners) {
+        if (listener->Rule() == oldRule.get()) {
+            listener->SetRule(newRule);
+        }
+    }
+    StopWarmPool(oldRule->upstream.get());  // 预连接指向旧的目标，由引擎按新规则重新建立
+    Drain(oldRule, drainTimeoutMs);
+    return kind;
+}
+
+void RelayWorker::Drain(const std::shared_ptr<RelayRule>& rule, uint32_t drainTimeoutMs) {
+    uint64_t deadline = drainTimeoutMs > 0 ? _loopTimeMs + drainTimeoutMs : 0;
+    for (DrainingRule& drain : _draining) {
+        if (drain.rule == rule) {
+            drain.deadlineMs = deadline;  // 已在排空（例如先更新后删除），以最近一次的期限为准
+            return;
+        }
+    }
+    _draining.push_back({ rule, deadline });
+    if (!_drainTimer.IsScheduled()) {
+        _timers.Schedule(&_drainTimer, kDrainCheckMs);
+    }
+}
+
+void RelayWorker::CheckDrains() {
+    for (size_t i = _draining.size(); i-- > 0;) {
+        const RelayRule* rule = _draining[i].rule.get();
+        uint64_t deadline = _draining[i].deadlineMs;
+        bool expired = deadline != 0 && _loopTimeMs >= deadline;
+
+        size_t remaining = 0;
+        for (TcpConnection* conn : _connections) {
+            if (conn->Rule() == rule) ++remaining;
+        }
+        for (const auto& listener : _udpListeners) {
+            remaining += listener->SessionCount(rule);
+        }
+        if (remaining > 0 && !expired) {
+            continue;
+        }
+
+        if (remaining > 0) {
+            LOG_WARN("Rule %s: drain timeout, closing %zu remaining connection(s) on worker %zu", _draining[i].rule->name.c_str(), remaining, _id);
+            for (TcpConnection* conn : std::vector<TcpConnection*>(_connections.begin(), _connections.end())) {
+                if (conn->Rule() == rule) conn->Close();  // Close会把连接从_connections中移除
+            }
+            for (const auto& listener : _udpListeners) {
+                listener->CloseSessions(rule);
+            }
+        }
+        for (size_t j = _udpListeners.size(); j-- > 0;) {
+            if (_udpListeners[j]->Rule() == rule && _udpListeners[j]->Draining()) {
+                _udpListeners[j]->Close();
+                RetireHandler(std::move(_udpListeners[j]));
+                _udpListeners.erase(_udpListeners.begin() + (ptrdiff_t)j);
+            }
+        }
+        _draining.erase(_draining.begin() + (ptrdiff_t)i);
+    }
+    if (!_draining.empty()) {
+        _timers.Schedule(&_drainTimer, kDrainCheckMs);
+    }
+}
+
+void RelayWorker::ListSessions(std::vector<SessionInfo>& sessions) const {
+    for (const TcpConnection* conn : _connections) {
+        if (!conn->IsClosed()) {
+            sessions.push_back(conn->Describe(_loopTimeMs));
+        }
+    }
+    for (const auto& listener : _udpListeners) {
+        listener->DescribeSessions(sessions, _loopTimeMs);
+    }
+}
+
+bool RelayWorker::CloseSession(uint64_t id) {
+    for (TcpConnection* conn : _connections) {
+        if (conn->Id() == id) {
+            LOG_INFO("Closing TCP connection %llu on request.", (unsigned long long)id);
+            conn->Close();  // Close会把连接从_connections中移除，之后不再访问迭代器
+            return true;
+        }
+    }
+    for (const auto& listener : _udpListeners) {
+        if (listener->CloseSession(id)) {
+            LOG_INFO("Closing UDP session %llu on request.", (unsigned long long)id);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool RelayWorker::TakeWarm(UpstreamPool& upstream, SOCKET& sock, UpstreamEndpoint*& endpoint) {
+    if (_warmPools.empty()) {
+        return false;
+    }
+    auto it = _warmPools.find(&upstream);
+    return it != _warmPools.end() && it->second->Take(sock, endpoint);
+}
+
+void RelayWorker::Retire(TcpConnection* conn) {
+    if (_connections.erase(conn) > 0) {
+        _connectionCount.fetch_sub(1, std::memory_order_relaxed);
+        _retired.push_back(conn);
+    }
+}
+
+void RelayWorker::Run() {
+#ifdef __linux__
+    if (_options.useIoUring && RunUring()) {
+        Shutdown();  // 在本线程上取消并关闭所有请求，io_uring只接受创建它的线程提交
+        _uring.reset();  // 之后Stop中接手的连接使用epoll
+        return;
+    }
+#endif
+    RunPoller();
+}
+
+void RelayWorker::RunPoller() {
+    std::vector<PollResult> results;
+    _loopTimeMs = TimerWheel::NowMs();
+    while (_running) {
+        if (_poller.Wait(results, _timers.NextTimeoutMs()) < 0) {
+            LogSocketError(GetLastSocketError());  // 记录等待事件失败的错误信息
+            break;
+        }
+        _loopTimeMs = TimerWheel::NowMs();
+        RunTasks();
+        DrainSubmissions();
+        for (const PollResult& result : results) {
+            result.handler->HandleEvents(result.events);
+        }
+        _timers.Advance(_loopTimeMs);
+        ReleaseRetired();
+    }
+}
+
+#ifdef __linux__
+bool RelayWorker::RunUring() {
+    _uring = std::make_unique<IoUring>();
+    if (!_uring->Init(kUringEntries, _options.uringBuffers, kUringBufferSize)) {
+        LOG_WARN("Relay worker %zu: io_uring setup failed, falling back to epoll", _id);
+        _uring.reset();
+        return false;
+    }
+    uint64_t pollToken = _uring->Register(&_pollWatch);
+    std::vector<PollResult> results;
+    _loopTimeMs = TimerWheel::NowMs();
+    while (_running) {
+        if (!_pollWatch.armed) {
+            _uring->PollMultishot(_poller.Fd(), pollToken, 0);  // 多发poll出错或完成队列溢出时会终止，需要重新提交
+            _pollWatch.armed = true;
+        }
+        // 提交本轮准备的请求并等待完成事件，所有连接的收发只需这一次系统调用
+        if (_uring->Wait(_pollWatch.ready ? 0 : _timers.NextTimeoutMs()) < 0) {
+            LogSocketError(errno);  // 记录等待事件失败的错误信息
+            break;
+        }
+        _loopTimeMs = TimerWheel::NowMs();
+        _uring->Dispatch();
+        results.clear();
+        if (_pollWatch.ready) {
+            // epoll是水平触发的：本轮取到了事件就在下一轮继续检查，直到取空后再等待poll的通知。
+            // 必须在RunTasks之前取，取事件时会清空唤醒计数，之后投递的任务会再次唤醒
+            _pollWatch.ready = _poller.Wait(results, 0) > 0;
+        }
+        RunTasks();
+        DrainSubmissions();
+        for (const PollResult& result : results) {
+            result.handler->HandleEvents(result.events);
+        }
+        _timers.Advance(_loopTimeMs);
+        ReleaseRetired();
+    }
+    return true;
+}
+#endif
+
+void RelayWorker::DrainSubmissions() {
+    std::vector<PendingTCP> pending;
+    {
+        std::lock_guard<std::mutex> lock(_pendingMutex);
+        pending.swap(_pending);
+    }
+    for (const PendingTCP& item : pending) {
+        AcceptTCP(item.client, item.clientAddr, item.rule, item.limit, item.portIndex);
+    }
+}
+
+void RelayWorker::RunTasks() {
+    std::vector<std::function<void()>> tasks;
+    {
+        std::lock_guard<std::mutex> lock(_pendingMutex);
+        tasks.swap(_tasks);
+    }
+    for (auto& task : tasks) {
+        task();
+    }
+}
+
+void RelayWorker::ReleaseRetired() {
+    for (TcpConnection* conn : _retired) {
+        delete conn;
+    }
+    _retired.clear();
+    _retiredSessions.clear();
+    _retiredHandlers.clear();
+}
+
+RelayEngine::~RelayEngine() {
+    Stop();
+}
+
+bool RelayEngine::Start(size_t workerCount, const RelayOptions& options) {
+#ifndef _WIN32
+    signal(SIGPIPE, SIG_IGN);  // splice写入已关闭的套接字时会产生SIGPIPE，统一改为返回EPIPE
+#endif
+    if (workerCount == 0) {
+        workerCount = std::thread::hardware_concurrency();
+        if (workerCount == 0) workerCount = 1;
+    }
+    RelayOptions workerOptions = options;
+    if (workerOptions.useIoUring) {
+#ifdef __linux__
+        if (!IoUring::Supported()) {
+            LOG_WARN("io_uring is not supported by this kernel, falling back to epoll.");
+            workerOptions.useIoUring = false;
+        }
+#else
+        LOG_WARN("io_uring is only available on Linux, ignoring \"io_uring\".");
+        workerOptions.useIoUring = false;
+#endif
+    }
+    for (size_t i = 0; i < workerCount; ++i) {
+        auto worker = std::make_unique<RelayWorker>(i, workerOptions);
+        if (!worker->Start()) {
+            LOG_ERROR("Failed to start relay worker %zu", i);  // 记录工作线程启动失败的错误信息
+            Stop();
+            return false;
+        }
+        _workers.push_back(std::move(worker));
+    }
+    Log("Relay engine started with " + std::to_string(workerCount) + " worker(s)" + (workerOptions.useIoUring ? " using io_uring." : "."));
+    return true;
+}
+
+void RelayEngine::Stop() {
+    if (!_workers.empty()) {
+        BufferPoolStats stats = BufferStats();
+        Log("Relay buffer pool high-water mark: " + std::to_string(stats.highWaterBytes / 1024) + " KB, " +
+            std::to_string(stats.allocations) + " allocation(s) for " + std::to_string(stats.acquires) + " acquire(s).");
+    }
+    for (auto& worker : _workers) {
+        worker->Stop();
+    }
+    _workers.clear();
+}
+
+BufferPoolStats RelayEngine::BufferStats() const {
+    BufferPoolStats total;
+    for (const auto& worker : _workers) {
+        total += worker->BufferStats();
+    }
+    return total;
+}
+
+void RelayEngine::SubmitTCP(SOCKET client, const sockaddr_storage& clientAddr, const std::shared_ptr<RelayRule>& rule, RateLimiter::Client* limit,
+    uint16_t portIndex) {
+    if (_workers.empty()) {
+        if (rule->limiter != nullptr) {
+            rule->limiter->Release(limit);
+        }
+        closesocket(client);
+        return;
+    }
+    // 轮询分配，使连接均匀分布在各个工作线程上
+    size_t index = _nextWorker.fetch_add(1, std::memory_order_relaxed) % _workers.size();
+    _workers[index]->SubmitTCP(client, clientAddr, rule, limit, portIndex);
+}
+
+RelayWorker* RelayEngine::PickWorker(int workerIndex) {
+    if (workerIndex >= 0) {
+        return _workers[(size_t)workerIndex % _workers.size()].get();
+    }
+    size_t index = _nextWorker.fetch_add(1, std::memory_order_relaxed) % _workers.size();
+    return _workers[index].get();
+}
+
+void RelayEngine::AddTCPListener(SOCKET sock, const std::shared_ptr<RelayRule>& rule, int workerIndex) {
+    AddTCPListeners({ { sock, 0 } }, rule, workerIndex);
+}
+
+std::vector<std::vector<ListenSocket>> RelayEngine::GroupByWorker(const std::vector<ListenSocket>& socks, int workerIndex) {
+    std::vector<std::vector<ListenSocket>> groups(_workers.size());
+    for (const ListenSocket& listen : socks) {
+        groups[PickWorker(workerIndex)->Id()].push_back(listen);
+    }
+    return groups;
+}
+
+void RelayEngine::AddTCPListeners(const std::vector<ListenSocket>& socks, const std::shared_ptr<RelayRule>& rule, int workerIndex) {
+    if (_workers.empty()) {
+        for (const ListenSocket& listen : socks) {
+            closesocket(listen.sock);
+        }
+        return;
+    }
+    RelayEngine* engine = workerIndex >= 0 ? nullptr : this;  // 分片监听套接字接受的连接留在所在线程
+    std::vector<std::vector<ListenSocket>> groups = GroupByWorker(socks, workerIndex);
+    for (size_t i = 0; i < groups.size(); ++i) {
+        if (groups[i].empty()) continue;
+        RelayWorker* worker = _workers[i].get();
+        worker->Post([worker, group = std::move(groups[i]), rule, engine] {
+            for (const ListenSocket& listen : group) {
+                worker->AddTCPListener(listen.sock, rule, engine, listen.portIndex);
+            }
+        });
+    }
+    // 预连接建在会接手该规则连接的线程上：分片时只有所在线程，否则是所有线程
+    StartWarmPools(rule->upstream, engine == nullptr ? PickWorker(workerIndex) : nullptr);
+}
+
+void RelayEngine::StartWarmPools(const std::shared_ptr<UpstreamPool>& upstream, RelayWorker* only) {
+    // 一致性哈希要求连接特定的目标，无法使用预连接
+    if (upstream->Options().prewarm == 0 || upstream->Options().mode == BalanceMode::ConsistentHash) {
+        return;
+    }
+    for (auto& target : _workers) {
+        if (only != nullptr && target.get() != only) continue;
+        RelayWorker* warmWorker = target.get();
+        warmWorker->Post([warmWorker, upstream] {
+            warmWorker->StartWarmPool(upstream);
+        });
+    }
+}
+
+void RelayEngine::RunOnWorkers(const std::function<void(RelayWorker&)>& task) {
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t remaining = _workers.size();
+    for (auto& target : _workers) {
+        RelayWorker* worker = target.get();
+        worker->Post([&, worker] {
+            task(*worker);
+            std::lock_guard<std::mutex> lock(mutex);
+            --remaining;
+            done.notify_one();  // 持有锁时通知，等待方返回后这些局部变量才会销毁
+        });
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return remaining == 0; });
+}
+
+void RelayEngine::RemoveRule(const std::shared_ptr<RelayRule>& rule, uint32_t drainTimeoutMs, bool keepUdpListeners) {
+    RunOnWorkers([&](RelayWorker& worker) {
+        worker.RemoveRule(rule, drainTimeoutMs, keepUdpListeners);
+    });
+}
+
+void RelayEngine::RetargetRule(const std::shared_ptr<RelayRule>& oldRule, const std::shared_ptr<RelayRule>& newRule, uint32_t drainTimeoutMs) {
+    std::vector<RelayWorker::ListenerKind> kinds(_workers.size(), RelayWorker::ListenerKind::None);
+    RunOnWorkers([&](RelayWorker& worker) {
+        kinds[worker.Id()] = worker.RetargetRule(oldRule, newRule, drainTimeoutMs);
+    });
+    // 按新规则重新建立预连接，范围与AddTCPListener相同
+    for (size_t i = 0; i < _workers.size(); ++i) {
+        if (kinds[i] == RelayWorker::ListenerKind::Unsharded) {
+            StartWarmPools(newRule->upstream, nullptr);
+            return;
+        }
+    }
+    for (size_t i = 0; i < _workers.size(); ++i) {
+        if (kinds[i] == RelayWorker::ListenerKind::Sharded) {
+            StartWarmPools(newRule->upstream, _workers[i].get());
+        }
+    }
+}
+
+void RelayEngine::AddUDP(SOCKET sock, const std::shared_ptr<RelayRule>& rule, int workerIndex) {
+    AddUDPListeners({ { sock, 0 } }, rule, workerIndex);
+}
+
+void RelayEngine::AddUDPListeners(const std::vector<ListenSocket>& socks, const std::shared_ptr<RelayRule>& rule, int workerIndex) {
+    if (_workers.empty()) {
+        for (const ListenSocket& listen : socks) {
+            closesocket(listen.sock);
+        }
+        return;
+    }
+    std::vector<std::vector<ListenSocket>> groups = GroupByWorker(socks, workerIndex);
+    for (size_t i = 0; i < groups.size(); ++i) {
+        if (groups[i].empty()) continue;
+        RelayWorker* worker = _workers[i].get();
+        worker->Post([worker, group = std::move(groups[i]), rule] {
+            for (const ListenSocket& listen : group) {
+                worker->AddUDP(listen.sock, rule, listen.portIndex);
+            }
+        });
+    }
+}
+
+std::vector<SessionInfo> RelayEngine::ListSessions() {
+    std::vector<SessionInfo> sessions;
+    std::mutex mutex;
+    RunOnWorkers([&](RelayWorker& worker) {
+        std::vector<SessionInfo> local;
+        worker.ListSessions(local);
+        std::lock_guard<std::mutex> lock(mutex);
+        for (SessionInfo& info : local) {
+            sessions.push_back(std::move(info));
+        }
+    });
+    std::sort(sessions.begin(), sessions.end(), [](const SessionInfo& a, const SessionInfo& b) { return a.id < b.id; });
+    return sessions;
+}
+
+bool RelayEngine::CloseSession(uint64_t id) {
+    size_t index = (size_t)(id & (((uint64_t)1 << RelayWorker::kSessionWorkerBits) - 1));
+    if (index >= _workers.size()) {
+        return false;
+    }
+    std::atomic<bool> found{ false };
+    RunOnWorkers([&](RelayWorker& worker) {
+        if (worker.Id() == index && worker.CloseSession(id)) {
+            found = true;
+        }
+    });
+    return found;
+}
+
+std::string RelayEngine::FormatSessions(const std::vector<SessionInfo>& sessions) {
+    std::string out;
+    for (const SessionInfo& info : sessions) {
+        char host[NI_MAXHOST] = "?";
+        char port[NI_MAXSERV] = "0";
+        getnameinfo((const sockaddr*)&info.client, SockaddrLength(info.client), host, sizeof(host), port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV);
+        bool v6 = info.client.ss_family == AF_INET6;
+        char line[256];
+        snprintf(line, sizeof(line), "id=%llu proto=%s client=%s%s%s:%s state=%s age_ms=%llu idle_ms=%llu bytes_up=%llu bytes_down=%llu",
+            (unsigned long long)info.id, info.udp ? "udp" : "tcp", v6 ? "[" : "", host, v6 ? "]" : "", port, info.state,
+            (unsigned long long)info.ageMs, (unsigned long long)info.idleMs, (unsigned long long)info.bytesUp, (unsigned long long)info.bytesDown);
+        // 规则和目标的名称来自配置，长度不定，单独追加
+        out += line;
+        out += " rule=" + info.rule + " upstream=" + (info.upstream.empty() ? "-" : info.upstream) + "\n";
+    }
+    return out;
+}
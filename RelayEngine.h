@@ -0,0 +1,227 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "netcompat.h"
+#include "BufferPool.h"
+#include "IoUring.h"
+#include "Poller.h"
+#include "RelayRule.h"
+#include "SessionInfo.h"
+#include "TcpListener.h"
+#include "TimerWheel.h"
+#include "UdpRelay.h"
+#include "UpstreamPool.h"
+#include "WarmPool.h"
+
+class TcpConnection;
+class RelayEngine;
+
+// 中继引擎的全局选项
+struct RelayOptions {
+    bool useSplice = true;  // Linux上使用splice在内核中直接转发TCP数据，不可用时自动回退到用户态缓冲区
+    size_t bufferMinSize = 2048;  // 中继缓冲区的最小尺寸，空闲后回到该尺寸
+    size_t bufferMaxSize = 262144;  // 中继缓冲区的最大尺寸，大流量连接逐步增长到该尺寸
+    size_t bufferCacheBytes = 4 << 20;  // 每个工作线程缓存的空闲缓冲区上限
+    bool cpuAffinity = false;  // 把第i个工作线程绑定到第i个CPU核心（Linux和Windows）
+    bool useIoUring = false;  // Linux上使用io_uring收发TCP和UDP数据，内核不支持时自动回退到epoll
+    unsigned uringBuffers = 256;  // 每个工作线程的io_uring提供缓冲区数量（2的幂），每个kUringBufferSize字节
+};
+
+// 一个监听套接字及其监听端口在规则端口范围内的序号
+struct ListenSocket {
+    SOCKET sock;
+    uint16_t portIndex;
+};
+
+// 事件循环工作线程：拥有一个Poller，负责驱动分配给它的所有连接
+class RelayWorker {
+public:
+    RelayWorker(size_t id, const RelayOptions& options);
+    ~RelayWorker();
+    RelayWorker(const RelayWorker&) = delete;
+    RelayWorker& operator=(const RelayWorker&) = delete;
+
+    bool Start();
+    void Stop();  // 停止事件循环并关闭所有连接
+
+    static constexpr size_t kUdpBufferSize = 65536;  // 可容纳任意UDP数据报
+    static constexpr size_t kUringBufferSize = kUdpBufferSize + 256;  // 多发recvmsg在数据之前放置消息头和来源地址
+
+    // 将已接受的客户端连接交给本线程转发，可以从任意线程调用。
+    // 规则带有限流器时连接必须已通过rule->limiter->Admit，limit是它返回的客户端项，连接关闭时归还；
+    // portIndex是接受该连接的监听端口在规则端口范围内的序号
+    void SubmitTCP(SOCKET client, const sockaddr_storage& clientAddr, const std::shared_ptr<RelayRule>& rule, RateLimiter::Client* limit = nullptr,
+        uint16_t portIndex = 0);
+    // 在本线程上执行一个任务（如添加监听套接字），可以从任意线程调用
+    void Post(std::function<void()> task);
+
+    // 以下方法只能在本工作线程内调用
+    Poller& GetPoller() { return _poller; }
+    TimerWheel& Timers() { return _timers; }
+    BufferPool& Buffers() { return _bufferPool; }
+    uint64_t LoopTimeMs() const { return _loopTimeMs; }  // 本轮事件循环开始时的时间，避免频繁读取时钟
+    char* UdpBuffer() { return _udpBuffer.get(); }  // 本线程所有UDP收发共用的缓冲区
+#ifdef __linux__
+    UdpBatch& Batch();  // 本线程批量收发UDP共用的缓冲区，首次使用时分配
+    IoUring* Uring() { return _uring.get(); }  // 本线程使用io_uring时非空
+#endif
+    // 在本线程上开始转发一个已接受的连接
+    void AcceptTCP(SOCKET client, const sockaddr_storage& clientAddr, const std::shared_ptr<RelayRule>& rule, RateLimiter::Client* limit = nullptr,
+        uint16_t portIndex = 0);
+    void AddTCPListener(SOCKET sock, const std::shared_ptr<RelayRule>& rule, RelayEngine* engine, uint16_t portIndex);
+    void AddUDP(SOCKET sock, const std::shared_ptr<RelayRule>& rule, uint16_t portIndex);  // UDP选项取自rule->udp
+    void StartWarmPool(const std::shared_ptr<UpstreamPool>& upstream);  // 为目标池建立预连接，重复调用无影响
+    void StopWarmPool(UpstreamPool* upstream);
+    // 关闭规则在本线程上的监听端和预连接，已有的连接和会话进入排空
+    void RemoveRule(const std::shared_ptr<RelayRule>& rule, uint32_t drainTimeoutMs, bool keepUdpListeners);
+    // 把本线程上属于oldRule的监听端原地切换到newRule，oldRule的连接和会话进入排空；返回本线程上该规则监听端的类型
+    enum class ListenerKind { None, Sharded, Unsharded };
+    ListenerKind RetargetRule(const std::shared_ptr<RelayRule>& oldRule, const std::shared_ptr<RelayRule>& newRule, uint32_t drainTimeoutMs);
+    bool TakeWarm(UpstreamPool& upstream, SOCKET& sock, UpstreamEndpoint*& endpoint);  // 取出一条预连接
+    void Retire(TcpConnection* conn);  // 连接关闭后延迟到本轮事件处理结束再释放
+    void RetireSession(std::unique_ptr<UdpSession> session);
+    void RetireHandler(std::unique_ptr<PollHandler> handler);
+    uint64_t NewSessionId() { return (++_sessionSeq << kSessionWorkerBits) | _id; }  // 本线程上新连接或会话的编号
+    void ListSessions(std::vector<SessionInfo>& sessions) const;  // 追加本线程上所有存活的连接和会话
+    bool CloseSession(uint64_t id);  // 强制关闭一个连接或会话，返回是否找到
+
+    static constexpr int kSessionWorkerBits = 16;  // 会话编号低位存放工作线程编号
+    size_t Id() const { return _id; }
+    const RelayOptions& Options() const { return _options; }
+    size_t ConnectionCount() const { return _connectionCount.load(std::memory_order_relaxed); }
+    BufferPoolStats BufferStats() const { return _bufferPool.Stats(); }  // 可以从任意线程调用
+
+private:
+    static constexpr uint64_t kDrainCheckMs = 1000;  // 检查排空进度的间隔
+    static constexpr unsigned kUringEntries = 1024;  // io_uring提交队列长度
+
+    struct PendingTCP {
+        SOCKET client;
+        sockaddr_storage clientAddr;
+        std::shared_ptr<RelayRule> rule;
+        RateLimiter::Client* limit;
+        uint16_t portIndex;
+    };
+
+    // 已停止或已被替换、等待其连接和会话结束的规则
+    struct DrainingRule {
+        std::shared_ptr<RelayRule> rule;
+        uint64_t deadlineMs;  // 到期后强制关闭剩余的连接，0表示一直等待
+    };
+
+    struct DrainTimer : Timer {
+        RelayWorker* worker = nullptr;
+        void OnTimer() override { worker->CheckDrains(); }
+    };
+
+#ifdef __linux__
+    // io_uring模式下监视epoll描述符：连接阶段、预连接和唤醒事件仍然由Poller处理
+    struct PollWatch : CompletionHandler {
+        bool ready = false;
+        bool armed = false;
+        void HandleCompletion(const UringCompletion& completion) override {
+            ready = true;
+            armed = completion.more;
+        }
+    };
+#endif
+
+    void Run();
+    void RunPoller();
+#ifdef __linux__
+    bool RunUring();  // 初始化失败时返回false，由调用方回退到epoll
+#endif
+    void Shutdown();  // 关闭本线程上的所有连接和监听端
+    void PinToCpu();
+    void DrainSubmissions();
+    void RunTasks();
+    void ReleaseRetired();
+    void Drain(const std::shared_ptr<RelayRule>& rule, uint32_t drainTimeoutMs);
+    void CheckDrains();
+
+    size_t _id;
+    RelayOptions _options;
+    Poller _poller;
+    TimerWheel _timers{ 100 };  // 100毫秒一个刻度
+    BufferPool _bufferPool;
+    uint64_t _loopTimeMs = 0;
+    std::unique_ptr<char[]> _udpBuffer;
+#ifdef __linux__
+    std::unique_ptr<UdpBatch> _udpBatch;
+    std::unique_ptr<IoUring> _uring;
+    PollWatch _pollWatch;
+#endif
+    std::thread _thread;
+    std::atomic<bool> _running{ false };
+
+    std::mutex _pendingMutex;
+    std::vector<PendingTCP> _pending;  // 其他线程提交、等待本线程接管的连接
+    std::vector<std::function<void()>> _tasks;  // 其他线程投递、等待本线程执行的任务
+
+    std::unordered_set<TcpConnection*> _connections;  // 本线程上存活的连接
+    std::vector<TcpConnection*> _retired;  // 已关闭、等待释放的连接
+    std::vector<std::unique_ptr<TcpListener>> _tcpListeners;
+    std::vector<std::unique_ptr<UdpListener>> _udpListeners;
+    std::vector<std::unique_ptr<UdpSession>> _retiredSessions;
+    std::vector<std::unique_ptr<PollHandler>> _retiredHandlers;
+    std::unordered_map<UpstreamPool*, std::unique_ptr<WarmPool>> _warmPools;
+    std::vector<DrainingRule> _draining;
+    DrainTimer _drainTimer;
+    std::atomic<size_t> _connectionCount{ 0 };
+    uint64_t _sessionSeq = 0;
+};
+
+// 中继引擎：固定数量的事件循环工作线程，连接按轮询方式分散到各个线程
+class RelayEngine {
+public:
+    RelayEngine() = default;
+    ~RelayEngine();
+
+    bool Start(size_t workerCount, const RelayOptions& options = {});  // workerCount为0时使用CPU核心数
+    void Stop();
+
+    void SubmitTCP(SOCKET client, const sockaddr_storage& clientAddr, const std::shared_ptr<RelayRule>& rule, RateLimiter::Client* limit = nullptr,
+        uint16_t portIndex = 0);
+    // 把TCP监听套接字交给工作线程，在事件循环中accept。workerIndex为-1时任选一个线程，
+    // 连接轮询分配给所有线程；否则它是SO_REUSEPORT分片之一，固定在该线程上，连接也留在该线程
+    void AddTCPListener(SOCKET sock, const std::shared_ptr<RelayRule>& rule, int workerIndex = -1);
+    // 把UDP监听套接字交给某个工作线程，由它维护该规则的全部会话；workerIndex为-1时任选一个线程
+    void AddUDP(SOCKET sock, const std::shared_ptr<RelayRule>& rule, int workerIndex = -1);
+    // 端口范围规则的全部监听套接字：每个工作线程只投递一次任务，workerIndex为-1时轮流分配到各个线程
+    void AddTCPListeners(const std::vector<ListenSocket>& socks, const std::shared_ptr<RelayRule>& rule, int workerIndex = -1);
+    void AddUDPListeners(const std::vector<ListenSocket>& socks, const std::shared_ptr<RelayRule>& rule, int workerIndex = -1);
+
+    // 以下两个方法等待所有工作线程处理完毕后返回，不能在工作线程内调用
+    // 停止规则：关闭它的所有监听端和预连接，已有的连接和会话继续转发直到结束，超过drainTimeoutMs后强制关闭（0表示不限）。
+    // UDP会话通过监听套接字回复客户端，keepUdpListeners为true时UDP监听端在排空期间保持打开但不再建立新会话；
+    // 需要立即在同一地址上重新绑定时传false，会话随监听端一起关闭
+    void RemoveRule(const std::shared_ptr<RelayRule>& rule, uint32_t drainTimeoutMs, bool keepUdpListeners = true);
+    // 更新规则：监听套接字保持不变、原地切换到newRule，新连接立即使用新的目标；
+    // oldRule的连接和会话继续使用原来的目标，按drainTimeoutMs排空
+    void RetargetRule(const std::shared_ptr<RelayRule>& oldRule, const std::shared_ptr<RelayRule>& newRule, uint32_t drainTimeoutMs);
+
+    // 会话表：列出或强制关闭存活的TCP连接和UDP会话，同样等待工作线程处理完毕，不能在工作线程内调用
+    std::vector<SessionInfo> ListSessions();
+    bool CloseSession(uint64_t id);  // 返回是否找到该会话
+    static std::string FormatSessions(const std::vector<SessionInfo>& sessions);  // 每个会话一行的文本表格
+
+    size_t WorkerCount() const { return _workers.size(); }
+    BufferPoolStats BufferStats() const;  // 汇总所有工作线程的缓冲池统计
+
+private:
+    RelayWorker* PickWorker(int workerIndex);
+    std::vector<std::vector<ListenSocket>> GroupByWorker(const std::vector<ListenSocket>& socks, int workerIndex);
+    void RunOnWorkers(const std::function<void(RelayWorker&)>& task);  // 在每个工作线程上执行一次并等待全部完成
+    void StartWarmPools(const std::shared_ptr<UpstreamPool>& upstream, RelayWorker* only);  // only为nullptr时在所有线程上建立
+
+    std::vector<std::unique_ptr<RelayWorker>> _workers;
+    std::atomic<size_t> _nextWorker{ 0 };
+};
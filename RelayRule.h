@@ -0,0 +1,36 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include "Metrics.h"
+#include "PortRoutes.h"
+#include "RateLimiter.h"
+#include "TcpConnection.h"
+#include "UdpRelay.h"
+#include "UpstreamPool.h"
+
+// 一条转发规则在中继引擎中的运行时对象，由该规则的监听端、连接和会话共享
+struct RelayRule {
+    RelayRule(std::string ruleName, std::shared_ptr<UpstreamPool> pool, size_t workerCount)
+        : name(std::move(ruleName)), upstream(std::move(pool)),
+          metrics(std::make_shared<RuleMetrics>(name, workerCount)) {
+    }
+
+    std::string name;
+    std::shared_ptr<UpstreamPool> upstream;  // 目标池
+    std::shared_ptr<RuleMetrics> metrics;    // 计数器和延迟直方图，每个工作线程一个分片
+    TcpOptions tcp;  // TCP规则的超时和keepalive选项，在交给中继引擎之前设置
+    UdpOptions udp;  // UDP规则的选项，在交给中继引擎之前设置
+    std::shared_ptr<RateLimiter> limiter;    // 连接数和速率限制，没有配置限制时为空
+    // 端口范围规则把监听端口一一映射到目标端口：目标端口 = 目标的基准端口 + 监听端口在范围内的序号
+    bool mapPorts = false;
+
+    // 监听端口序号为portIndex的连接或会话实际连接的目标地址
+    sockaddr_storage TargetAddress(const UpstreamEndpoint& endpoint, uint16_t portIndex) const {
+        sockaddr_storage addr = endpoint.addr;
+        if (mapPorts) {
+            SetPort(addr, (uint16_t)(GetPort(addr) + portIndex));
+        }
+        return addr;
+    }
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "netcompat.h"
+
+// 会话表中的一项：一个TCP连接或UDP会话在某一时刻的状态，由它所在的工作线程生成
+struct SessionInfo {
+    uint64_t id = 0;          // 会话编号，低位是工作线程编号，用于强制关闭
+    std::string rule;
+    bool udp = false;
+    sockaddr_storage client{};
+    std::string upstream;     // 目标地址的名称，尚未选定目标时为空
+    const char* state = "";   // connecting、relaying、half-closed（TCP）或active（UDP）
+    uint64_t ageMs = 0;       // 建立至今的时间
+    uint64_t idleMs = 0;      // 最近一次收到数据至今的时间
+    uint64_t bytesUp = 0;     // 客户端 -> 目标
+    uint64_t bytesDown = 0;   // 目标 -> 客户端
+};
@@ -0,0 +1,959 @@
+#include "TcpConnection.h"
+#include <algorithm>
+#include "RelayEngine.h"
+#include "UpstreamPool.h"
+#include "conlog.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#endif
+
+TcpConnection::TcpConnection(RelayWorker& worker, SOCKET client)
+    : _worker(worker), _id(worker.NewSessionId()) {
+    for (int i = 0; i < 2; ++i) {
+        _sides[i].conn = this;
+        _sides[i].index = i;
+    }
+    _sides[kClient].sock = client;
+    _throttleTimer.conn = this;
+    _lifeTimer.conn = this;
+}
+
+TcpConnection::~TcpConnection() {
+    Close();
+}
+
+bool TcpConnection::Start(std::shared_ptr<RelayRule> rule, const sockaddr_storage& clientAddr, RateLimiter::Client* limit, uint16_t portIndex) {
+    _rule = std::move(rule);
+    _portIndex = portIndex;
+    _upstream = _rule->upstream.get();
+    _limiter = _rule->limiter.get();
+    _limit = limit;
+    _options = &_rule->tcp;
+    _clientAddr = clientAddr;
+    _stats = &_rule->metrics->Shard(_worker.Id());
+    _startUs = MetricsNowUs();
+    _openMs = _worker.LoopTimeMs();
+    MetricAdd(_stats->opened, 1);
+    if (_upstream->Options().mode == BalanceMode::ConsistentHash) {
+        _clientHash = UpstreamPool::HashClient(clientAddr);
+    }
+    if (!SetNonBlocking(_sides[kClient].sock)) {
+        LogSocketError(GetLastSocketError());  // 记录设置非阻塞模式失败的错误信息
+        Close();
+        return false;
+    }
+
+    if (_options->acceptProxy || _options->sendProxy != ProxyVersion::None) {
+        _proxy = std::make_unique<ProxyState>();
+    }
+    if (_options->acceptProxy) {
+        // 先读取负载均衡器附带的协议头，得到真实的客户端地址后再选择目标；等待时间按连接超时计算
+        _state = State::AwaitingProxy;
+        if (_options->connectTimeoutMs != 0) {
+            ArmLifeTimer(_openMs + _options->connectTimeoutMs);
+        }
+        return ReadProxyHeader();
+    }
+    PrepareProxyHeader();
+    return StartUpstream();
+}
+
+bool TcpConnection::StartUpstream() {
+    // 有预先建立好的连接时直接配对，省去一次与目标之间的握手
+    SOCKET server;
+    UpstreamEndpoint* endpoint;
+    if (_worker.TakeWarm(*_upstream, server, endpoint)) {
+        ++_connectAttempts;
+        _endpoint = endpoint;
+        _sides[kServer].sock = server;
+        OnConnected();
+        return !IsClosed();
+    }
+    return ConnectUpstream(nullptr);
+}
+
+bool TcpConnection::ReadProxyHeader() {
+    // 协议头之后的数据直接留在这个方向的缓冲区中，连接目标后和其他数据一样转发，不再复制
+    Direction& dir = _dirs[kClient];
+    AcquireBuffer(dir);
+    int len = recv(_sides[kClient].sock, dir.buffer, (int)dir.capacity, 0);
+    if (len <= 0) {
+        ReleaseBuffer(dir);
+        int err = GetLastSocketError();
+        if (len == SOCKET_ERROR && IsWouldBlock(err)) {
+            UpdateInterest();
+            return true;
+        }
+        if (len == 0) {
+            LOG_DEBUG("Connection closed before the PROXY protocol header.");
+        }
+        else {
+            LogSocketError(err);  // 记录接收数据失败的错误信息
+            MetricAdd(_stats->errors, 1);
+        }
+        Close();
+        return false;
+    }
+
+    size_t consumed = 0;
+    ProxyHeaderParser::Result result = _proxy->parser.Feed(dir.buffer, (size_t)len, consumed);
+    if (result == ProxyHeaderParser::Result::Invalid) {
+        LOG_DEBUG("Invalid PROXY protocol header from %s.", FormatAddress(_clientAddr).c_str());
+        MetricAdd(_stats->errors, 1);
+        Close();
+        return false;
+    }
+    if (result == ProxyHeaderParser::Result::NeedMore) {
+        ReleaseBuffer(dir);  // 协议头的前半部分已保存在解析器中
+        UpdateInterest();
+        return true;
+    }
+
+    dir.begin = consumed;
+    dir.end = (size_t)len;
+    if (dir.Pending() > 0) {
+        CountReceived(kClient, dir.Pending());
+        ChargeLimiter(kClient, dir.Pending());
+    }
+    else {
+        ReleaseBuffer(dir);
+    }
+    const ProxyHeaderParser& parser = _proxy->parser;
+    if (parser.HasAddresses()) {
+        _clientAddr = parser.Source();  // 之后的哈希、日志和会话列表都使用真实的客户端地址
+        if (_upstream->Options().mode == BalanceMode::ConsistentHash) {
+            _clientHash = UpstreamPool::HashClient(_clientAddr);
+        }
+    }
+    // 连接目标期间不监视客户端一侧，连接建立后重新登记
+    Side& client = _sides[kClient];
+    if (client.registered) {
+        _worker.GetPoller().Remove(client.sock);
+        client.registered = false;
+        client.interest = 0;
+    }
+    _state = State::Connecting;
+    PrepareProxyHeader();
+    return StartUpstream();
+}
+
+void TcpConnection::PrepareProxyHeader() {
+    if (_options->sendProxy == ProxyVersion::None) {
+        _proxy.reset();
+        return;
+    }
+    // 目的地址优先使用收到的协议头中的地址，否则是客户端连接的本机地址
+    sockaddr_storage local{};
+    if (_proxy->parser.HasAddresses()) {
+        local = _proxy->parser.Destination();
+    }
+    else {
+        socklen_t len = sizeof(local);
+        getsockname(_sides[kClient].sock, (sockaddr*)&local, &len);
+    }
+    _proxy->headerLen = (uint8_t)BuildProxyHeader(_options->sendProxy, _clientAddr, local, _proxy->header);
+    _proxy->headerSent = 0;
+}
+
+size_t TcpConnection::ConsumeProxyHeader(int side, size_t sent) {
+    if (side != kServer || !HeaderPending()) {
+        return sent;
+    }
+    size_t header = std::min(sent, (size_t)(_proxy->headerLen - _proxy->headerSent));
+    _proxy->headerSent += (uint8_t)header;
+    _proxy->holdSinceMs = 0;
+    if (!HeaderPending()) {
+        _proxy.reset();
+    }
+    return sent - header;
+}
+
+bool TcpConnection::ConnectUpstream(const UpstreamEndpoint* exclude) {
+    ++_connectAttempts;
+    _endpoint = _upstream->Select(_clientHash, exclude, _worker.LoopTimeMs());
+    if (_endpoint == nullptr) {
+        MetricAdd(_stats->connectErrors, 1);
+        LOG_WARN("No upstream target available.");  // 目标池为空（例如域名尚未解析成功）
+        Close();
+        return false;
+    }
+    sockaddr_storage targetAddr = _rule->TargetAddress(*_endpoint, _portIndex);
+
+    SOCKET server = socket(targetAddr.ss_family, SOCK_STREAM, IPPROTO_TCP);  // 创建目标服务器的套接字
+    if (server == INVALID_SOCKET) {
+        LogSocketError(GetLastSocketError());  // 记录套接字创建失败的错误信息
+        Close();
+        return false;
+    }
+    _sides[kServer].sock = server;
+
+    if (!SetNonBlocking(server)) {
+        LogSocketError(GetLastSocketError());  // 记录设置非阻塞模式失败的错误信息
+        Close();
+        return false;
+    }
+
+    if (connect(server, (const sockaddr*)&targetAddr, SockaddrLength(targetAddr)) == SOCKET_ERROR) {
+        int err = GetLastSocketError();
+        if (!IsConnectInProgress(err)) {
+            return OnConnectFailed(err);
+        }
+        _connectStartMs = _worker.LoopTimeMs();
+        if (_options->connectTimeoutMs != 0) {
+            ArmLifeTimer(_connectStartMs + _options->connectTimeoutMs);
+        }
+        UpdateInterest();  // 等待连接完成（可写事件）
+        return true;
+    }
+
+    OnConnected();  // 回环地址上connect可能立即完成
+    return !IsClosed();
+}
+
+bool TcpConnection::OnConnectFailed(int err) {
+    LogSocketError(err);  // 记录连接目标服务器失败的错误信息
+    MetricAdd(_stats->connectErrors, 1);
+    UpstreamEndpoint* failed = _endpoint;
+    _upstream->ReportFailure(failed, _worker.LoopTimeMs());
+    _endpoint = nullptr;
+
+    Side& server = _sides[kServer];
+    if (server.registered) {
+        _worker.GetPoller().Remove(server.sock);
+        server.registered = false;
+        server.interest = 0;
+    }
+    closesocket(server.sock);
+    server.sock = INVALID_SOCKET;
+
+    // 目标池中还有其他地址时换一个地址重试，客户端感知不到单个后端的故障
+    if (_connectAttempts < kMaxConnectAttempts && _upstream->Size() > 1) {
+        LOG_DEBUG("Retrying connection, upstream %s failed.", failed->name.c_str());
+        _upstream->Release(failed);  // 释放后地址对象可能被回收，只用指针排除它
+        return ConnectUpstream(failed);
+    }
+    _upstream->Release(failed);
+    Close();
+    return false;
+}
+
+void TcpConnection::Close() {
+    if (_state == State::Closed) {
+        return;
+    }
+    _state = State::Closed;
+    if (_stats != nullptr) {
+        MetricAdd(_stats->closed, 1);
+        _stats->duration.Record(MetricsNowUs() - _startUs);
+    }
+    if (_endpoint != nullptr) {
+        _upstream->Release(_endpoint);
+        _endpoint = nullptr;
+    }
+    if (_limiter != nullptr) {
+        _limiter->Release(_limit);
+        _limiter = nullptr;
+    }
+    _throttleTimer.Cancel();
+    _lifeTimer.Cancel();
+#ifdef __linux__
+    if (_uringToken != 0) {
+        IoUring* uring = _worker.Uring();
+        for (Side& side : _sides) {
+            uring->CancelFd(side.sock);
+        }
+        uring->Submit();  // 取消请求交给内核之后才能关闭套接字
+        for (Direction& dir : _dirs) {
+            // 已提交发送的缓冲区在取消完成后由IoUring归还
+            for (size_t i = dir.sending; i < dir.chunks.size(); ++i) {
+                uring->Recycle(dir.chunks[i].buffer);
+            }
+            dir.chunks.clear();
+            dir.sending = 0;
+        }
+        uring->Unregister(_uringToken);
+    }
+#endif
+    for (Side& side : _sides) {
+        if (side.sock == INVALID_SOCKET) continue;
+        if (side.registered) {
+            _worker.GetPoller().Remove(side.sock);
+            side.registered = false;
+        }
+        closesocket(side.sock);
+        side.sock = INVALID_SOCKET;
+    }
+    for (Direction& dir : _dirs) {
+        ReleaseBuffer(dir);
+#ifdef __linux__
+        ClosePipe(dir);
+#endif
+    }
+    _worker.Retire(this);
+}
+
+void TcpConnection::OnConnected() {
+    _state = State::Relaying;
+    _upstream->ReportSuccess(_endpoint);
+    _stats->connectTime.Record(MetricsNowUs() - _startUs);
+    if (_options->keepAliveIdleSec != 0) {
+        for (Side& side : _sides) {
+            SetKeepAlive(side.sock, (int)_options->keepAliveIdleSec, (int)_options->keepAliveIntervalSec, (int)_options->keepAliveCount);
+        }
+    }
+    uint64_t now = _worker.LoopTimeMs();
+    for (Direction& dir : _dirs) {
+        dir.lastActiveMs = dir.progressMs = now;  // 空闲时间从连接建立时开始计算
+    }
+    if (HeaderPending() && _options->holdProxyHeader) {
+        // PROXY协议头留到客户端的第一段数据到达时由同一次系统调用发出，不单独占用一个报文；
+        // 客户端迟迟不发数据时由生命周期定时器在kProxyHeaderHoldMs后单独发出。目标先发言的协议会因此
+        // 晚这么久才开始，所以只在规则开启时等待，否则协议头连同此刻已经收到的数据立即发出
+        _proxy->holdSinceMs = now;
+    }
+    const char* reason;
+    if (uint64_t due = NextDeadline(reason)) {
+        ArmLifeTimer(due);
+    }
+    if (HeaderPending() || _dirs[kClient].Pending() > 0) {
+        // 先用缓冲区发出已经收到的数据（连同协议头）
+        if (!ReadFrom(kClient) || !FlushTo(kServer)) {
+            return;
+        }
+    }
+    if (StartUringIfDrained()) {
+        return;
+    }
+#ifdef __linux__
+    if (_worker.Uring() == nullptr && _worker.Options().useSplice) {
+        for (Direction& dir : _dirs) {
+            if (!dir.Queued()) {
+                OpenPipe(dir);  // 失败时该方向使用缓冲池中的缓冲区；还有积压数据的方向保持缓冲区模式
+            }
+        }
+    }
+#endif
+    UpdateInterest();
+}
+
+bool TcpConnection::StartUringIfDrained() {
+#ifdef __linux__
+    // 切换之前缓冲区或管道中的数据仍由Poller驱动发出，全部发完后才交给io_uring，保证数据顺序
+    if (_worker.Uring() != nullptr && _uringToken == 0 && _state == State::Relaying &&
+        !HeaderPending() && !_dirs[kClient].Queued() && !_dirs[kServer].Queued()) {
+        StartUring();
+        return true;
+    }
+#endif
+    return false;
+}
+
+#ifdef __linux__
+bool TcpConnection::OpenPipe(Direction& dir) {
+    if (pipe2(dir.pipeFds, O_NONBLOCK | O_CLOEXEC) == -1) {
+        dir.pipeFds[0] = dir.pipeFds[1] = -1;
+        return false;  // 文件描述符耗尽等情况下回退到缓冲区模式
+    }
+    // 尽量扩大管道容量，让每次splice搬运更多数据；失败时使用默认容量
+    int size = fcntl(dir.pipeFds[1], F_SETPIPE_SZ, (int)kSplicePipeSize);
+    if (size <= 0) {
+        size = fcntl(dir.pipeFds[1], F_GETPIPE_SZ);
+    }
+    dir.pipeSize = size > 0 ? (size_t)size : 65536;
+    dir.pipeBytes = 0;
+    return true;
+}
+
+void TcpConnection::ClosePipe(Direction& dir) {
+    for (int& fd : dir.pipeFds) {
+        if (fd != -1) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    dir.pipeBytes = 0;
+}
+
+void TcpConnection::StartUring() {
+    for (Side& side : _sides) {
+        if (side.registered) {
+            _worker.GetPoller().Remove(side.sock);  // 连接阶段登记的可写事件
+            side.registered = false;
+            side.interest = 0;
+        }
+    }
+    _uringToken = _worker.Uring()->Register(this);
+    UringRecv(kClient);
+    UringRecv(kServer);
+}
+
+void TcpConnection::UringRecv(int side) {
+    Direction& dir = _dirs[side];
+    if (dir.receiving || dir.recvPaused || dir.throttled || dir.eof || _state == State::Closed) {
+        return;
+    }
+    if (_limiter != nullptr) {
+        // 多发recv在取消生效之前会把套接字中的数据全部读出，有速率限制的连接改为每次接收后再决定是否继续
+        _worker.Uring()->Recv(_sides[side].sock, _uringToken, (uint8_t)(kOpRecv + side));
+    }
+    else {
+        _worker.Uring()->RecvMultishot(_sides[side].sock, _uringToken, (uint8_t)(kOpRecv + side));
+    }
+    dir.receiving = true;
+}
+
+void TcpConnection::UringSend(int side) {
+    Direction& dir = _dirs[1 - side];
+    if (dir.sending > 0 || dir.chunks.empty()) {
+        return;  // 上一串发送完成后再提交，保证数据顺序
+    }
+    IoUring* uring = _worker.Uring();
+    size_t count = dir.chunks.size();
+    for (size_t i = 0; i < count; ++i) {
+        const UringChunk& chunk = dir.chunks[i];
+        uring->Send(_sides[side].sock, chunk.buffer, chunk.offset, chunk.len, _uringToken, (uint8_t)(kOpSend + side), i + 1 < count);
+    }
+    dir.sending = count;
+}
+
+void TcpConnection::OnUringReceived(int side, const UringCompletion& completion) {
+    Direction& dir = _dirs[side];
+    if (!completion.more) {
+        dir.receiving = false;
+    }
+    if (completion.result > 0) {
+        dir.chunks.push_back({ completion.buffer, 0, (uint32_t)completion.result });
+        CountReceived(side, (size_t)completion.result);
+        ChargeLimiter(side, (size_t)completion.result);
+        UringSend(1 - side);
+        if (_options->writeTimeoutMs != 0) {
+            ArmLifeTimer(dir.progressMs + _options->writeTimeoutMs);
+        }
+        if (dir.chunks.size() >= kMaxQueuedChunks && !dir.recvPaused) {
+            // 目标一侧发得比来源一侧收得慢，停止接收，避免一个连接占满提供缓冲区（背压）
+            dir.recvPaused = true;
+        }
+        if ((dir.recvPaused || dir.throttled) && dir.receiving) {
+            _worker.Uring()->CancelOp(_uringToken, (uint8_t)(kOpRecv + side));
+        }
+    }
+    else if (completion.result == 0) {
+        LOG_DEBUG("Connection closed by peer.");
+        dir.eof = true;  // 不再接收这一侧，积压的数据发完后传递半关闭
+        PropagateEof(side);
+        return;
+    }
+    else if (completion.result == -ENOBUFS) {
+        _worker.Uring()->WaitForBuffers(_uringToken);  // 提供缓冲区暂时用完，有缓冲区归还后重新接收
+        return;
+    }
+    else if (completion.result != -ECANCELED) {
+        LogSocketError(-completion.result);  // 记录接收数据失败的错误信息
+        MetricAdd(_stats->errors, 1);
+        Close();
+        return;
+    }
+    UringRecv(side);  // 多发recv因完成队列溢出等原因终止时重新提交
+}
+
+void TcpConnection::OnUringSent(int side, const UringCompletion& completion) {
+    Direction& dir = _dirs[1 - side];
+    --dir.sending;
+    if (completion.result >= 0) {
+        // 同一串发送的完成事件按提交顺序到达，对应队首的缓冲区
+        UringChunk& chunk = dir.chunks.front();
+        chunk.offset += (uint32_t)completion.result;
+        chunk.len -= (uint32_t)completion.result;
+        dir.progressMs = _worker.LoopTimeMs();
+        if (chunk.len == 0) {
+            _worker.Uring()->Recycle(chunk.buffer);
+            dir.chunks.pop_front();
+        }
+    }
+    else if (completion.result != -ECANCELED) {  // 链中前一个发送没有完整发出，其后的请求被取消，留到下一串重新提交
+        LogSocketError(-completion.result);  // 记录发送数据失败的错误信息
+        MetricAdd(_stats->errors, 1);
+        Close();
+        return;
+    }
+    if (dir.sending == 0) {
+        UringSend(side);
+        if (dir.recvPaused && dir.chunks.size() <= kMaxQueuedChunks / 2) {
+            dir.recvPaused = false;
+            UringRecv(1 - side);
+        }
+        PropagateEof(1 - side);
+    }
+}
+#endif
+
+void TcpConnection::HandleCompletion(const UringCompletion& completion) {
+#ifdef __linux__
+    if (completion.op >= kOpSend) {
+        OnUringSent(completion.op - kOpSend, completion);
+    }
+    else {
+        OnUringReceived(completion.op - kOpRecv, completion);
+    }
+#else
+    (void)completion;
+#endif
+}
+
+void TcpConnection::OnBuffersAvailable() {
+#ifdef __linux__
+    UringRecv(kClient);
+    UringRecv(kServer);
+#endif
+}
+
+void TcpConnection::OnEvents(int side, uint32_t events) {
+    if (_state == State::Closed || _uringToken != 0) {
+        return;  // 同一批事件中连接已被关闭或已改用io_uring
+    }
+
+    if (_state == State::AwaitingProxy) {
+        ReadProxyHeader();
+        return;
+    }
+
+    if (_state == State::Connecting) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(_sides[kServer].sock, SOL_SOCKET, SO_ERROR, (char*)&err, &len);
+        if (err != 0) {
+            OnConnectFailed(err);
+            return;
+        }
+        if (events & (PollOut | PollErr | PollHup)) {
+            OnConnected();
+        }
+        return;
+    }
+
+    if ((events & PollOut) && !FlushTo(side)) {
+        return;
+    }
+    if ((events & (PollHup | PollErr)) && _dirs[side].eof) {
+        if (!_dirs[1 - side].shutdown) {
+            // 已读到EOF的一侧挂断或出错：发往它的数据无法再送达
+            LOG_DEBUG("Half-closed peer reset the connection.");
+            Close();
+            return;
+        }
+        // 两个方向在这个套接字上都已结束，挂断是预期的，不再监视它
+        _worker.GetPoller().Remove(_sides[side].sock);
+        _sides[side].registered = false;
+        _sides[side].interest = 0;
+        UpdateInterest();
+        return;
+    }
+    if ((events & (PollHup | PollErr)) && _dirs[side].throttled) {
+        _dirs[side].throttled = false;  // 对端已断开，不再等待额度，读出剩余的数据或错误
+    }
+    if ((events & (PollIn | PollHup | PollErr)) && !ReadFrom(side)) {
+        return;
+    }
+    if (StartUringIfDrained()) {
+        return;
+    }
+    UpdateInterest();
+}
+
+bool TcpConnection::ReadFrom(int side) {
+    Direction& dir = _dirs[side];
+    if (dir.eof || dir.Pending() > 0 || dir.throttled) {
+        return true;  // 上一次的数据还没发完（背压），或者超过了速率限制，先不读取
+    }
+
+#ifdef __linux__
+    if (dir.Spliced()) {
+        // 从套接字直接搬运到管道，数据不进入用户态
+        ssize_t len = splice(_sides[side].sock, nullptr, dir.pipeFds[1], nullptr, dir.pipeSize, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (len >= 0 || (errno != EINVAL && errno != ENOSYS)) {
+            if (len > 0) {
+                dir.pipeBytes = (size_t)len;
+            }
+            return HandleReadResult(side, (long)len);
+        }
+        // 内核或套接字类型不支持splice，回退到用户态缓冲区
+        ClosePipe(dir);
+    }
+#endif
+
+    AcquireBuffer(dir);
+    int len = recv(_sides[side].sock, dir.buffer, (int)dir.capacity, 0);  // 从来源一侧接收数据
+    if (len > 0) {
+        dir.begin = 0;
+        dir.end = (size_t)len;
+        AdaptBufferSize(dir, (size_t)len);
+    }
+    else {
+        ReleaseBuffer(dir);  // 没有读到数据，立即归还缓冲区
+    }
+    return HandleReadResult(side, len);
+}
+
+void TcpConnection::AcquireBuffer(Direction& dir) {
+    if (dir.buffer != nullptr) {
+        return;
+    }
+    uint64_t now = _worker.LoopTimeMs();
+    if (now - dir.lastReadMs > kIdleResetMs) {
+        dir.sizeClass = 0;  // 连接空闲过，从最小的缓冲区重新开始
+        dir.smallReads = 0;
+    }
+    dir.lastReadMs = now;
+    BufferPool& pool = _worker.Buffers();
+    dir.buffer = pool.Acquire(dir.sizeClass);
+    dir.bufferClass = dir.sizeClass;
+    dir.capacity = pool.ClassSize(dir.sizeClass);
+}
+
+void TcpConnection::ReleaseBuffer(Direction& dir) {
+    if (dir.buffer == nullptr) {
+        return;
+    }
+    _worker.Buffers().Release(dir.buffer, dir.bufferClass);
+    dir.buffer = nullptr;
+    dir.capacity = 0;
+    dir.begin = dir.end = 0;
+}
+
+void TcpConnection::AdaptBufferSize(Direction& dir, size_t len) {
+    // 读满缓冲区说明还有更多数据，下次换用更大的等级；持续的小读取则逐步降级
+    // 等级只在下一次借缓冲区时生效，当前缓冲区保持不变
+    if (len == dir.capacity) {
+        dir.smallReads = 0;
+        if (dir.sizeClass + 1 < _worker.Buffers().ClassCount()) {
+            ++dir.sizeClass;
+        }
+    }
+    else if (len <= dir.capacity / 4 && dir.sizeClass > 0) {
+        if (++dir.smallReads >= kShrinkAfterSmallReads) {
+            --dir.sizeClass;
+            dir.smallReads = 0;
+        }
+    }
+    else {
+        dir.smallReads = 0;
+    }
+}
+
+void TcpConnection::CountReceived(int side, size_t len) {
+    Direction& dir = _dirs[side];
+    uint64_t now = _worker.LoopTimeMs();
+    dir.bytes += len;
+    dir.lastActiveMs = dir.progressMs = now;
+    if (side == kClient) {
+        MetricAdd(_stats->bytesUp, (uint64_t)len);
+        if (_options->readTimeoutMs != 0) {
+            ArmLifeTimer(now + _options->readTimeoutMs);  // 等待目标回复
+        }
+    }
+    else {
+        MetricAdd(_stats->bytesDown, (uint64_t)len);
+        if (!_firstByte) {
+            _firstByte = true;
+            _stats->firstByteTime.Record(MetricsNowUs() - _startUs);
+        }
+    }
+}
+
+void TcpConnection::ChargeLimiter(int side, size_t len) {
+    if (_limiter == nullptr) {
+        return;
+    }
+    // 已经收到的数据照常转发，透支的额度通过暂停读取来偿还，未读的数据留在内核中，由TCP流量控制减慢发送方
+    uint64_t delayNs = _limiter->Charge(_limit, len);
+    if (delayNs == 0) {
+        return;
+    }
+    Direction& dir = _dirs[side];
+    if (!dir.throttled) {
+        dir.throttled = true;
+        MetricAdd(_stats->throttled, 1);
+    }
+    uint64_t now = _worker.LoopTimeMs();
+    dir.resumeMs = now + (delayNs + 999999) / 1000000;
+    uint64_t wakeMs = dir.resumeMs;
+    if (_dirs[1 - side].throttled && _dirs[1 - side].resumeMs < wakeMs) {
+        wakeMs = _dirs[1 - side].resumeMs;  // 定时器按先到期的方向调度
+    }
+    _worker.Timers().Schedule(&_throttleTimer, wakeMs > now ? wakeMs - now : 0);
+}
+
+void TcpConnection::OnThrottleTimer() {
+    if (_state == State::Closed) {
+        return;
+    }
+    // 两个方向共用一个定时器，各自到期后才恢复，否则提前恢复的方向会继续透支
+    uint64_t now = _worker.LoopTimeMs();
+    uint64_t nextMs = 0;
+    for (int i = 0; i < 2; ++i) {
+        Direction& dir = _dirs[i];
+        if (!dir.throttled) {
+            continue;
+        }
+        if (dir.resumeMs > now) {
+            uint64_t wait = dir.resumeMs - now;
+            nextMs = nextMs == 0 ? wait : std::min(nextMs, wait);
+            continue;
+        }
+        dir.throttled = false;
+#ifdef __linux__
+        if (_uringToken != 0) {
+            UringRecv(i);
+        }
+#endif
+    }
+    if (nextMs != 0) {
+        _worker.Timers().Schedule(&_throttleTimer, nextMs);
+    }
+    if (_uringToken == 0) {
+        UpdateInterest();
+    }
+}
+
+bool TcpConnection::HandleReadResult(int side, long len) {
+    if (len > 0) {
+        CountReceived(side, (size_t)len);
+        ChargeLimiter(side, (size_t)len);
+        return FlushTo(1 - side);
+    }
+    if (len == 0) {
+        LOG_DEBUG("Connection closed by peer.");  // 如果len为0，表示来源一侧已关闭发送方向
+        _dirs[side].eof = true;
+        if (side == kClient && HeaderHeld()) {
+            _proxy->holdSinceMs = 0;  // 客户端没有发数据就关闭了发送方向，协议头单独发出后再传递半关闭
+            return FlushTo(kServer);
+        }
+        return PropagateEof(side);
+    }
+
+    int err = GetLastSocketError();
+    if (IsWouldBlock(err)) {
+        return true;
+    }
+    LogSocketError(err);  // 记录接收数据失败的错误信息
+    MetricAdd(_stats->errors, 1);
+    Close();
+    return false;
+}
+
+bool TcpConnection::FlushTo(int side) {
+    Direction& dir = _dirs[1 - side];
+#ifdef __linux__
+    if (dir.Spliced()) {
+        if (side == kServer && HeaderPending()) {
+            if (HeaderHeld() && dir.pipeBytes == 0) {
+                return true;  // 等待客户端的第一段数据
+            }
+            // PROXY协议头先于管道中的数据发出，MSG_MORE让内核把它和随后splice的数据合并到同一个报文中
+            int len = send(_sides[side].sock, _proxy->header + _proxy->headerSent, _proxy->headerLen - _proxy->headerSent,
+                kSendFlags | (dir.pipeBytes > 0 ? MSG_MORE : 0));
+            if (len == SOCKET_ERROR) {
+                return OnSendError(dir, GetLastSocketError());
+            }
+            ConsumeProxyHeader(side, (size_t)len);
+            if (HeaderPending()) {
+                return true;  // 只发出了一部分，等待可写事件
+            }
+        }
+        while (dir.pipeBytes > 0) {
+            // 从管道直接搬运到目标套接字
+            ssize_t len = splice(dir.pipeFds[0], nullptr, _sides[side].sock, nullptr, dir.pipeBytes, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (len == -1) {
+                return OnSendError(dir, errno);
+            }
+            dir.pipeBytes -= (size_t)len;
+            dir.progressMs = _worker.LoopTimeMs();
+        }
+        return PropagateEof(1 - side);
+    }
+#endif
+    while (dir.Pending() > 0 || (side == kServer && HeaderPending() && !HeaderHeld())) {
+        int len;
+        if (side == kServer && HeaderPending()) {
+            // 协议头和数据一起交给内核，相当于writev，不需要把数据复制到协议头后面
+            len = SendPair(_sides[side].sock, _proxy->header + _proxy->headerSent, _proxy->headerLen - _proxy->headerSent,
+                dir.buffer + dir.begin, dir.Pending());
+        }
+        else {
+            len = send(_sides[side].sock, dir.buffer + dir.begin, (int)dir.Pending(), kSendFlags);
+        }
+        if (len == SOCKET_ERROR) {
+            return OnSendError(dir, GetLastSocketError());
+        }
+        dir.begin += ConsumeProxyHeader(side, (size_t)len);
+        dir.progressMs = _worker.LoopTimeMs();
+    }
+    ReleaseBuffer(dir);  // 数据已全部发出，归还缓冲区
+    return PropagateEof(1 - side);
+}
+
+bool TcpConnection::OnSendError(Direction& dir, int err) {
+    if (IsWouldBlock(err)) {
+        if (_options->writeTimeoutMs != 0) {
+            ArmLifeTimer(dir.progressMs + _options->writeTimeoutMs);
+        }
+        return true;  // 发送缓冲区已满，等待可写事件
+    }
+    LogSocketError(err);  // 记录发送数据失败的错误信息
+    MetricAdd(_stats->errors, 1);
+    Close();
+    return false;
+}
+
+bool TcpConnection::PropagateEof(int side) {
+    Direction& dir = _dirs[side];
+    if (!dir.eof || dir.shutdown || dir.Queued() || (side == kClient && HeaderPending()) || _state == State::Closed) {
+        return _state != State::Closed;
+    }
+    dir.shutdown = true;
+    if (_dirs[1 - side].shutdown) {
+        Close();  // 两个方向都已结束
+        return false;
+    }
+    // 只关闭发送方向：另一侧读到EOF，但仍然可以继续发送，由另一个方向转发回来
+    if (ShutdownSend(_sides[1 - side].sock) == SOCKET_ERROR) {
+        LOG_DEBUG("Failed to propagate half-close: %d", GetLastSocketError());
+        Close();  // 另一侧已经断开
+        return false;
+    }
+    return true;
+}
+
+uint64_t TcpConnection::NextDeadline(const char*& reason) const {
+    uint64_t due = 0;
+    auto consider = [&](uint32_t timeoutMs, uint64_t sinceMs, const char* name) {
+        if (timeoutMs != 0 && (due == 0 || sinceMs + timeoutMs < due)) {
+            due = sinceMs + timeoutMs;
+            reason = name;
+        }
+    };
+    if (_state == State::AwaitingProxy) {
+        consider(_options->connectTimeoutMs, _openMs, "proxy header");
+        return due;
+    }
+    if (_state == State::Connecting) {
+        consider(_options->connectTimeoutMs, _connectStartMs, "connect");
+        return due;
+    }
+    if (HeaderHeld()) {
+        consider(kProxyHeaderHoldMs, _proxy->holdSinceMs, "proxy header hold");
+    }
+    const Direction& up = _dirs[kClient];
+    const Direction& down = _dirs[kServer];
+    consider(_options->idleTimeoutMs, std::max(up.lastActiveMs, down.lastActiveMs), "idle");
+    if (up.lastActiveMs > down.lastActiveMs && !down.eof) {
+        consider(_options->readTimeoutMs, up.lastActiveMs, "read");  // 客户端的数据还没有得到回复
+    }
+    for (const Direction& dir : _dirs) {
+        if (dir.Queued()) {
+            consider(_options->writeTimeoutMs, dir.progressMs, "write");
+        }
+    }
+    return due;
+}
+
+void TcpConnection::ArmLifeTimer(uint64_t dueMs) {
+    if (_lifeTimer.IsScheduled() && _lifeDueMs <= dueMs) {
+        return;  // 已经会更早检查，到时按最新的时间戳重新计算
+    }
+    uint64_t now = _worker.LoopTimeMs();
+    _lifeDueMs = dueMs;
+    _worker.Timers().Schedule(&_lifeTimer, dueMs > now ? dueMs - now : 0);
+}
+
+void TcpConnection::OnLifeTimer() {
+    if (_state == State::Closed) {
+        return;
+    }
+    if (HeaderHeld() && _worker.LoopTimeMs() >= _proxy->holdSinceMs + kProxyHeaderHoldMs) {
+        // 客户端一直没有发数据（目标先发言的协议），协议头单独发出，之后等待可写事件或改用io_uring
+        _proxy->holdSinceMs = 0;
+        if (!FlushTo(kServer)) {
+            return;
+        }
+        if (!StartUringIfDrained()) {
+            UpdateInterest();
+        }
+    }
+    const char* reason = "";
+    uint64_t due = NextDeadline(reason);
+    if (due == 0) {
+        return;
+    }
+    if (due > _worker.LoopTimeMs()) {
+        ArmLifeTimer(due);  // 期间有活动，顺延到新的到期时间
+        return;
+    }
+    MetricAdd(_stats->timeouts, 1);
+    if (_state == State::Connecting) {
+        OnConnectFailed(kTimedOutError);  // 换一个地址重试
+        return;
+    }
+    LOG_DEBUG("Connection closed by %s timeout.", reason);
+    Close();
+}
+
+SessionInfo TcpConnection::Describe(uint64_t nowMs) const {
+    SessionInfo info;
+    info.id = _id;
+    info.rule = _rule->name;
+    info.client = _clientAddr;
+    if (_endpoint != nullptr) {
+        info.upstream = _rule->mapPorts ? FormatAddress(_rule->TargetAddress(*_endpoint, _portIndex)) : _endpoint->name;
+    }
+    if (_state == State::AwaitingProxy) {
+        info.state = "awaiting-proxy";
+    }
+    else if (_state == State::Connecting) {
+        info.state = "connecting";
+    }
+    else {
+        info.state = _dirs[kClient].eof || _dirs[kServer].eof ? "half-closed" : "relaying";
+    }
+    uint64_t lastMs = std::max({ _openMs, _dirs[kClient].lastActiveMs, _dirs[kServer].lastActiveMs });
+    info.ageMs = nowMs > _openMs ? nowMs - _openMs : 0;
+    info.idleMs = nowMs > lastMs ? nowMs - lastMs : 0;
+    info.bytesUp = _dirs[kClient].bytes;
+    info.bytesDown = _dirs[kServer].bytes;
+    return info;
+}
+
+void TcpConnection::UpdateInterest() {
+    if (_state == State::Closed) {
+        return;
+    }
+    for (int i = 0; i < 2; ++i) {
+        Side& side = _sides[i];
+        uint32_t interest = 0;
+        if (_state == State::AwaitingProxy) {
+            if (i == kClient) interest = PollIn;  // 只等待协议头
+        }
+        else if (_state == State::Connecting) {
+            if (i == kServer) interest = PollOut;  // 只关心连接是否完成
+        }
+        else {
+            if (!_dirs[i].eof && _dirs[i].Pending() == 0 && !_dirs[i].throttled) interest |= PollIn;
+            if (_dirs[1 - i].Pending() > 0 || (i == kServer && HeaderPending() && !HeaderHeld())) interest |= PollOut;
+        }
+
+        if (!side.registered) {
+            if (interest == 0) continue;
+            if (!_worker.GetPoller().Add(side.sock, interest, &side)) {
+                LogSocketError(GetLastSocketError());  // 记录登记事件失败的错误信息
+                Close();
+                return;
+            }
+            side.registered = true;
+        }
+        else if (interest != side.interest) {
+            _worker.GetPoller().Modify(side.sock, interest, &side);
+        }
+        side.interest = interest;
+    }
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include "netcompat.h"
+#include "IoUring.h"
+#include "Poller.h"
+#include "ProxyProtocol.h"
+#include "RateLimiter.h"
+#include "SessionInfo.h"
+#include "TimerWheel.h"
+
+class RelayWorker;
+class UpstreamPool;
+struct MetricsShard;
+struct RelayRule;
+struct UpstreamEndpoint;
+
+// TCP转发规则的选项，超时为0表示不限
+struct TcpOptions {
+    uint32_t connectTimeoutMs = 10000;  // 连接目标的超时，超时后换一个地址重试
+    uint32_t idleTimeoutMs = 3600000;   // 两个方向都没有数据的最长时间
+    uint32_t readTimeoutMs = 0;   // 客户端发出数据后等待目标回复的最长时间
+    uint32_t writeTimeoutMs = 0;  // 有待发送的数据、但发送没有进展的最长时间
+    uint32_t keepAliveIdleSec = 0;  // 非0时在两侧套接字上启用TCP keepalive，空闲该时长后开始探测
+    uint32_t keepAliveIntervalSec = 0;  // 探测间隔，0表示系统默认值
+    uint32_t keepAliveCount = 0;  // 连续多少次探测无响应后断开，0表示系统默认值
+    ProxyVersion sendProxy = ProxyVersion::None;  // 连接目标后先发送PROXY协议头，告知真实的客户端地址
+    bool acceptProxy = false;  // 客户端（负载均衡器）在数据前附带PROXY协议头，读取并去掉后再连接目标
+    bool holdProxyHeader = false;  // 发出的协议头等待客户端的第一段数据一起发出，只适合客户端先发言的协议
+
+    bool operator==(const TcpOptions&) const = default;
+};
+
+// 单个TCP转发会话的状态机：[AwaitingProxy ->] Connecting -> Relaying -> Closed
+// 一侧读到EOF并把积压的数据发完后，对另一侧执行shutdown(SHUT_WR)传递半关闭，另一个方向继续转发，
+// 两个方向都结束后才关闭连接。所有超时共用一个定时器，收发数据只更新时间戳，定时器到期时再按最新的时间戳重新计算。
+// 两个方向共用同一个事件循环线程，因此无需加锁。
+// 工作线程使用io_uring时，连接建立后两侧改为多发recv接收、链接的send按顺序发送，不再经过Poller
+class TcpConnection : public CompletionHandler {
+public:
+    TcpConnection(RelayWorker& worker, SOCKET client);
+    ~TcpConnection() override;
+    TcpConnection(const TcpConnection&) = delete;
+    TcpConnection& operator=(const TcpConnection&) = delete;
+
+    // 从规则的目标池中选择一个地址并发起非阻塞连接，clientAddr用于一致性哈希。
+    // limit是准入检查时得到的客户端项，连接关闭时连同规则的连接数一起归还；
+    // portIndex是接受连接的监听端口在规则端口范围内的序号，端口映射规则据此计算目标端口
+    bool Start(std::shared_ptr<RelayRule> rule, const sockaddr_storage& clientAddr, RateLimiter::Client* limit = nullptr, uint16_t portIndex = 0);
+    void Close();  // 关闭两端套接字，可重复调用
+
+    bool IsClosed() const { return _state == State::Closed; }
+    const RelayRule* Rule() const { return _rule.get(); }
+    uint64_t Id() const { return _id; }
+    SessionInfo Describe(uint64_t nowMs) const;
+
+private:
+    enum class State { AwaitingProxy, Connecting, Relaying, Closed };
+
+    static constexpr int kClient = 0;  // 客户端一侧
+    static constexpr int kServer = 1;  // 目标服务器一侧
+    static constexpr size_t kSplicePipeSize = 1 << 18;  // splice管道的期望容量
+    static constexpr uint8_t kShrinkAfterSmallReads = 8;  // 连续多少次小读取后降低缓冲区等级
+    static constexpr uint64_t kIdleResetMs = 1000;  // 空闲超过该时间后缓冲区回到最小等级
+    static constexpr uint8_t kMaxConnectAttempts = 3;  // 连接目标失败时最多尝试的地址数
+    static constexpr uint32_t kProxyHeaderHoldMs = 100;  // holdProxyHeader时协议头等待客户端第一段数据的最长时间（一个时间轮刻度）
+    static constexpr size_t kMaxQueuedChunks = 8;  // io_uring模式下每个方向最多积压的缓冲区数，超过后暂停接收
+    static constexpr uint8_t kOpRecv = 0;  // io_uring操作编号：kOpRecv + 来源一侧
+    static constexpr uint8_t kOpSend = 2;  // kOpSend + 目标一侧
+
+    // 一侧套接字及其在Poller中登记的事件
+    struct Side : PollHandler {
+        TcpConnection* conn = nullptr;
+        int index = 0;
+        SOCKET sock = INVALID_SOCKET;
+        uint32_t interest = 0;  // 当前登记的事件
+        bool registered = false;
+        void HandleEvents(uint32_t events) override { conn->OnEvents(index, events); }
+    };
+
+    // 超过字节速率限制后恢复读取的定时器
+    struct ThrottleTimer : Timer {
+        TcpConnection* conn = nullptr;
+        void OnTimer() override { conn->OnThrottleTimer(); }
+    };
+
+    // 连接、空闲、读和写超时的检查
+    struct LifeTimer : Timer {
+        TcpConnection* conn = nullptr;
+        void OnTimer() override { conn->OnLifeTimer(); }
+    };
+
+    // PROXY协议的收发状态，只为启用了该选项的规则分配，协议头发出后释放
+    struct ProxyState {
+        ProxyHeaderParser parser;
+        char header[kProxyHeaderMaxSize];  // 发往目标的协议头
+        uint8_t headerLen = 0;
+        uint8_t headerSent = 0;
+        uint64_t holdSinceMs = 0;  // 非0时协议头留着与客户端的第一段数据一起发出，从该时间开始等待
+    };
+
+#ifdef __linux__
+    // 提供缓冲区中一段已接收、尚未发出的数据
+    struct UringChunk {
+        int buffer;
+        uint32_t offset;
+        uint32_t len;
+    };
+#endif
+
+    // 从 _sides[i] 流向 _sides[1 - i] 的单向数据流
+    // splice模式下数据暂存在内核管道中，不经过用户态；否则使用从缓冲池借来的缓冲区，
+    // 缓冲区只在有积压数据时持有，数据发完就归还，空闲连接不占用缓冲区
+    struct Direction {
+        char* buffer = nullptr;
+        size_t capacity = 0;
+        size_t bufferClass = 0;  // 当前缓冲区所属的大小等级
+        size_t sizeClass = 0;    // 下一次借缓冲区时使用的大小等级，根据读取量自适应调整
+        uint8_t smallReads = 0;  // 连续读取量不足容量四分之一的次数
+        uint64_t lastReadMs = 0;
+        size_t begin = 0;  // 尚未发送数据的起始位置
+        size_t end = 0;    // 已接收数据的结束位置
+        bool eof = false;  // 来源一侧已关闭
+        bool shutdown = false;  // EOF已经传递给目标一侧，这个方向已结束
+        bool throttled = false;  // 超过字节速率限制，暂停读取来源一侧
+        uint64_t resumeMs = 0;   // 暂停读取到该时间为止
+        uint64_t bytes = 0;      // 这个方向收到的字节数
+        uint64_t lastActiveMs = 0;  // 最近一次收到数据的时间
+        uint64_t progressMs = 0;    // 最近一次收到或发出数据的时间，用于写超时
+#ifdef __linux__
+        int pipeFds[2] = { -1, -1 };  // splice使用的管道，[0]读端，[1]写端
+        size_t pipeBytes = 0;         // 管道中尚未发送的字节数
+        size_t pipeSize = 0;          // 管道实际容量
+        bool Spliced() const { return pipeFds[0] != -1; }
+        size_t Pending() const { return Spliced() ? pipeBytes : end - begin; }
+        bool Queued() const { return Pending() > 0 || !chunks.empty(); }  // 还有数据没有发出
+        // io_uring模式：内核挑选的缓冲区按接收顺序排队，队首的sending个已提交发送
+        std::deque<UringChunk> chunks;
+        size_t sending = 0;
+        bool receiving = false;   // 多发recv仍然有效
+        bool recvPaused = false;  // 积压过多，暂停接收
+#else
+        bool Spliced() const { return false; }
+        size_t Pending() const { return end - begin; }
+        bool Queued() const { return Pending() > 0; }
+#endif
+    };
+
+    void OnEvents(int side, uint32_t events);
+    bool StartUpstream();  // 取用预连接或发起连接
+    bool ReadProxyHeader();  // 读取并解析客户端的PROXY协议头，完成后开始连接目标
+    void PrepareProxyHeader();  // 生成发往目标的协议头，不需要发送时释放_proxy
+    size_t ConsumeProxyHeader(int side, size_t sent);  // 扣除一次发送中属于协议头的字节，返回属于数据的字节数
+    bool HeaderPending() const { return _proxy != nullptr && _proxy->headerSent < _proxy->headerLen; }
+    bool HeaderHeld() const { return _proxy != nullptr && _proxy->holdSinceMs != 0; }
+    bool ConnectUpstream(const UpstreamEndpoint* exclude);  // 选择地址并发起连接
+    bool OnConnectFailed(int err);  // 标记失败的地址，换一个地址重试
+    void OnConnected();
+    bool StartUringIfDrained();  // 协议头和两个方向的积压数据都已发完时改用io_uring，返回true表示已切换
+    bool ReadFrom(int side);   // 从一侧读取数据并尝试立即转发，返回false表示连接已关闭
+    bool FlushTo(int side);    // 把发往一侧的积压数据写出，返回false表示连接已关闭
+    bool OnSendError(Direction& dir, int err);  // 发送缓冲区已满时等待可写事件并返回true，其他错误关闭连接并返回false
+    bool HandleReadResult(int side, long len);  // 处理recv/splice的返回值
+    bool PropagateEof(int side);  // 来源一侧已关闭且数据已发完时半关闭另一侧，返回false表示连接已关闭
+    void CountReceived(int side, size_t len);
+    void ChargeLimiter(int side, size_t len);  // 按限流器的额度计费，透支时暂停读取来源一侧
+    void OnThrottleTimer();
+    uint64_t NextDeadline(const char*& reason) const;  // 最早的超时时间，0表示没有启用的超时
+    void ArmLifeTimer(uint64_t dueMs);  // 确保不晚于dueMs检查一次超时
+    void OnLifeTimer();
+    void UpdateInterest();
+    void AcquireBuffer(Direction& dir);
+    void ReleaseBuffer(Direction& dir);
+    void AdaptBufferSize(Direction& dir, size_t len);
+
+#ifdef __linux__
+    bool OpenPipe(Direction& dir);
+    void ClosePipe(Direction& dir);
+    void StartUring();
+    void UringRecv(int side);
+    void UringSend(int side);  // 把发往一侧的积压数据提交为一串链接的发送请求
+    void OnUringReceived(int side, const UringCompletion& completion);
+    void OnUringSent(int side, const UringCompletion& completion);
+#endif
+    void HandleCompletion(const UringCompletion& completion) override;
+    void OnBuffersAvailable() override;
+
+    RelayWorker& _worker;
+    std::shared_ptr<RelayRule> _rule;
+    UpstreamPool* _upstream = nullptr;  // 规则的目标池，由_rule保持存活
+    MetricsShard* _stats = nullptr;  // 规则在本线程上的计数器
+    RateLimiter* _limiter = nullptr;  // 规则的限流器，由_rule保持存活，连接关闭归还后置空
+    RateLimiter::Client* _limit = nullptr;
+    ThrottleTimer _throttleTimer;
+    LifeTimer _lifeTimer;
+    uint64_t _lifeDueMs = 0;  // _lifeTimer的到期时间
+    const TcpOptions* _options = nullptr;  // 规则的TCP选项，由_rule保持存活
+    uint64_t _id;
+    sockaddr_storage _clientAddr{};
+    uint64_t _openMs = 0;  // 接受连接的时间（事件循环时钟）
+    uint64_t _connectStartMs = 0;  // 本次连接目标开始的时间
+    uint64_t _startUs = 0;  // 开始转发的时间，用于连接耗时、首字节时间和存续时间
+    bool _firstByte = false;  // 是否已收到目标的第一个字节
+    UpstreamEndpoint* _endpoint = nullptr;  // 当前连接的目标地址，计入它的连接数
+    uint64_t _clientHash = 0;
+    uint8_t _connectAttempts = 0;
+    uint16_t _portIndex = 0;
+    State _state = State::Connecting;
+    uint64_t _uringToken = 0;  // 改用io_uring收发后非0
+    std::unique_ptr<ProxyState> _proxy;
+    Side _sides[2];
+    Direction _dirs[2];
+};
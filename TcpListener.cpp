@@ -0,0 +1,184 @@
+#include "TcpListener.h"
+#include "RelayEngine.h"
+#include "conlog.h"
+
+static constexpr int kMaxAcceptsPerEvent = 64;  // 每次就绪事件最多接受的连接数，避免连接风暴时饿死已有连接
+static constexpr uint64_t kAcceptBackoffMs = 100;  // 文件描述符耗尽时暂停监听的时间
+
+TcpListener::TcpListener(RelayWorker& worker, RelayEngine* engine, SOCKET sock, std::shared_ptr<RelayRule> rule, uint16_t portIndex)
+    : _worker(worker), _engine(engine), _sock(sock), _rule(std::move(rule)), _stats(&_rule->metrics->Shard(worker.Id())),
+      _portIndex(portIndex) {
+}
+
+TcpListener::~TcpListener() {
+    Close();
+}
+
+bool TcpListener::Start() {
+    if (!SetNonBlocking(_sock)) {
+        LogSocketError(GetLastSocketError());
+        return false;
+    }
+#ifdef __linux__
+    if (IoUring* uring = _worker.Uring()) {
+        _uringToken = uring->Register(this);
+        uring->AcceptMultishot(_sock, _uringToken, 0);
+        return true;
+    }
+#endif
+    if (!_worker.GetPoller().Add(_sock, PollIn, this)) {
+        LogSocketError(GetLastSocketError());
+        return false;
+    }
+    return true;
+}
+
+void TcpListener::Close() {
+    Cancel();
+    if (_sock == INVALID_SOCKET) {
+        return;
+    }
+#ifdef __linux__
+    if (_uringToken != 0) {
+        IoUring* uring = _worker.Uring();
+        uring->CancelFd(_sock);
+        uring->Submit();  // 取消请求交给内核之后才能关闭套接字
+        uring->Unregister(_uringToken);
+    }
+    else
+#endif
+    {
+        _worker.GetPoller().Remove(_sock);
+    }
+    closesocket(_sock);
+    _sock = INVALID_SOCKET;
+}
+
+void TcpListener::SetRule(std::shared_ptr<RelayRule> rule) {
+    _rule = std::move(rule);
+    _stats = &_rule->metrics->Shard(_worker.Id());
+}
+
+void TcpListener::HandleEvents(uint32_t /*events*/) {
+    if (_sock == INVALID_SOCKET) {
+        return;  // 同一批事件中规则已被移除
+    }
+    for (int i = 0; i < kMaxAcceptsPerEvent; ++i) {
+        sockaddr_storage clientAddr;  // 存储客户端地址信息
+        socklen_t addrLen = sizeof(clientAddr);  // 客户端地址信息的长度
+#ifdef __linux__
+        SOCKET client = accept4(_sock, (sockaddr*)&clientAddr, &addrLen, SOCK_NONBLOCK | SOCK_CLOEXEC);  // 省去单独设置非阻塞的系统调用
+#else
+        SOCKET client = accept(_sock, (sockaddr*)&clientAddr, &addrLen);  // 接受客户端连接
+#endif
+        if (client == INVALID_SOCKET) {
+            int error = GetLastSocketError();
+            if (IsWouldBlock(error) || !OnAcceptError(error)) {
+                return;  // 没有更多待接受的连接，或者监听已暂停
+            }
+            continue;
+        }
+        OnAccepted(client, clientAddr, addrLen);
+    }
+}
+
+void TcpListener::HandleCompletion(const UringCompletion& completion) {
+    if (_sock == INVALID_SOCKET) {
+        return;
+    }
+    if (completion.result >= 0) {
+        SOCKET client = (SOCKET)completion.result;
+        sockaddr_storage clientAddr;
+        socklen_t addrLen = sizeof(clientAddr);
+        // 多发accept的所有完成事件共用提交时给出的地址缓冲区，因此不让内核填写，需要时再查询
+        if (getpeername(client, (sockaddr*)&clientAddr, &addrLen) == SOCKET_ERROR) {
+            closesocket(client);  // 连接在被接受后立即被客户端重置
+        }
+        else {
+            OnAccepted(client, clientAddr, addrLen);
+        }
+    }
+    else if (completion.result != -ECANCELED) {
+        OnAcceptError(-completion.result);
+    }
+#ifdef __linux__
+    if (!completion.more && !_paused && _sock != INVALID_SOCKET) {
+        _worker.Uring()->AcceptMultishot(_sock, _uringToken, 0);  // 多发accept出错后会终止，重新提交
+    }
+#endif
+}
+
+void TcpListener::OnAccepted(SOCKET client, const sockaddr_storage& clientAddr, socklen_t addrLen) {
+    // 超过连接数或新建速率限制的连接在这里立即关闭，不创建连接对象，也不交给其他线程
+    RateLimiter::Client* limit = nullptr;
+    if (_rule->limiter != nullptr && !_rule->limiter->Admit(clientAddr, limit)) {
+        MetricAdd(_stats->rejected, 1);
+        LOG_DEBUG("TCP connection rejected by rate limits.");
+        closesocket(client);
+        return;
+    }
+
+    if (LogEnabled(LogLevel::Info)) {
+        char clientIP[NI_MAXHOST];  // 存储客户端IP地址的数组
+        getnameinfo((const sockaddr*)&clientAddr, addrLen, clientIP, sizeof(clientIP), nullptr, 0, NI_NUMERICHOST);  // 获取客户端IP地址
+        LOG_INFO("接收到来自 %s 的 TCP 连接", clientIP);  // 记录接收到来自客户端的TCP连接
+    }
+
+    if (_engine != nullptr) {
+        _engine->SubmitTCP(client, clientAddr, _rule, limit, _portIndex);  // 单个监听套接字：分散到所有工作线程
+    }
+    else {
+        _worker.AcceptTCP(client, clientAddr, _rule, limit, _portIndex);  // 分片：内核已经把连接分配到本线程，不再跨线程传递
+    }
+}
+
+bool TcpListener::OnAcceptError(int error) {
+#ifdef _WIN32
+    if (error == WSAECONNRESET) {
+        return true;  // 连接在被接受前已被客户端重置
+    }
+    if (error == WSAEMFILE || error == WSAENOBUFS) {
+#else
+    if (error == ECONNABORTED || error == EINTR || error == EPROTO) {
+        return true;  // 连接在被接受前已被客户端重置
+    }
+    if (error == EMFILE || error == ENFILE || error == ENOBUFS || error == ENOMEM) {
+#endif
+        // 资源耗尽时监听套接字会一直可读，暂停监听一段时间，避免事件循环空转
+        MetricAdd(_stats->errors, 1);
+        LOG_WARN("Failed to accept client connection: %d, pausing listener", error);
+        PauseAccept();
+        return false;
+    }
+    MetricAdd(_stats->errors, 1);
+    LOG_WARN("Failed to accept client connection: %d", error);  // 记录接受连接失败的错误信息
+    return false;
+}
+
+void TcpListener::PauseAccept() {
+    _paused = true;
+#ifdef __linux__
+    if (_uringToken != 0) {
+        _worker.Uring()->CancelOp(_uringToken, 0);
+    }
+    else
+#endif
+    {
+        _worker.GetPoller().Modify(_sock, 0, this);
+    }
+    _worker.Timers().Schedule(this, kAcceptBackoffMs);
+}
+
+void TcpListener::OnTimer() {
+    _paused = false;
+    if (_sock == INVALID_SOCKET) {
+        return;
+    }
+#ifdef __linux__
+    if (_uringToken != 0) {
+        _worker.Uring()->AcceptMultishot(_sock, _uringToken, 0);  // 恢复监听
+        return;
+    }
+#endif
+    _worker.GetPoller().Modify(_sock, PollIn, this);  // 恢复监听
+}
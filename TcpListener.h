@@ -0,0 +1,48 @@
+#pragma once
+
+#include <memory>
+#include "netcompat.h"
+#include "IoUring.h"
+#include "Poller.h"
+#include "TimerWheel.h"
+
+class RelayEngine;
+class RelayWorker;
+struct MetricsShard;
+struct RelayRule;
+
+// TCP监听端：注册在工作线程的事件循环中，以非阻塞方式accept新连接。
+// 作为SO_REUSEPORT分片时，接受的连接直接留在本线程转发；
+// 单个监听套接字时，连接按轮询分配给引擎中的所有工作线程。
+// 工作线程使用io_uring时改为提交一次多发accept，每个新连接产生一个完成事件
+class TcpListener : public PollHandler, public Timer, public CompletionHandler {
+public:
+    // engine为nullptr表示分片模式，连接留在本线程；portIndex是监听端口在规则端口范围内的序号
+    TcpListener(RelayWorker& worker, RelayEngine* engine, SOCKET sock, std::shared_ptr<RelayRule> rule, uint16_t portIndex = 0);
+    ~TcpListener() override;
+
+    bool Start();
+    void Close();
+    void SetRule(std::shared_ptr<RelayRule> rule);  // 规则更新：监听套接字不变，新连接使用新规则
+
+    const RelayRule* Rule() const { return _rule.get(); }
+    bool Sharded() const { return _engine == nullptr; }
+
+    void HandleEvents(uint32_t events) override;  // 接受新连接
+    void OnTimer() override;  // 文件描述符耗尽后恢复监听
+    void HandleCompletion(const UringCompletion& completion) override;  // 多发accept接受了一个连接
+
+private:
+    void OnAccepted(SOCKET client, const sockaddr_storage& clientAddr, socklen_t addrLen);
+    bool OnAcceptError(int error);  // 返回false表示监听已暂停
+    void PauseAccept();
+
+    RelayWorker& _worker;
+    RelayEngine* _engine;
+    SOCKET _sock;
+    std::shared_ptr<RelayRule> _rule;  // 所属的转发规则
+    MetricsShard* _stats;  // 该规则在本线程上的计数器
+    uint64_t _uringToken = 0;  // 使用io_uring时非0
+    uint16_t _portIndex;  // 随连接传递，端口范围规则据此选择目标端口
+    bool _paused = false;
+};
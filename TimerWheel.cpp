@@ -0,0 +1,120 @@
+#include "TimerWheel.h"
+#include <chrono>
+
+void Timer::Cancel() {
+    if (_wheel != nullptr) {
+        _wheel->Unlink(this);
+    }
+}
+
+TimerWheel::TimerWheel(uint32_t tickMs)
+    : _tickMs(tickMs > 0 ? tickMs : 1), _slots(kLevelSlots * kLevelCount), _startMs(NowMs()) {
+    for (TimerLink& head : _slots) {
+        head.prev = head.next = &head;  // 空链表的哨兵指向自己
+    }
+}
+
+TimerWheel::~TimerWheel() {
+    // 摘除剩余的定时器，避免它们析构时访问已释放的时间轮
+    for (TimerLink& head : _slots) {
+        while (head.next != &head) {
+            Unlink(static_cast<Timer*>(head.next));
+        }
+    }
+}
+
+uint64_t TimerWheel::NowMs() {
+    using namespace std::chrono;
+    return (uint64_t)duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void TimerWheel::Link(TimerLink* head, TimerLink* node) {
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+void TimerWheel::Unlink(Timer* timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = timer->next = nullptr;
+    timer->_wheel = nullptr;
+    --_count;
+}
+
+void TimerWheel::Place(Timer* timer) {
+    uint64_t delta = timer->_expireTick - _currentTick;
+    int level = 0;
+    while (level < kLevelCount - 1 && delta >= ((uint64_t)1 << (kLevelBits * (level + 1)))) {
+        ++level;
+    }
+    // 上层槽在到期刻度所在区间开始时级联，槽号取到期刻度在该层的对应位
+    size_t slot = (size_t)(timer->_expireTick >> (kLevelBits * level)) & (kLevelSlots - 1);
+    Link(&_slots[level * kLevelSlots + slot], timer);
+}
+
+void TimerWheel::Schedule(Timer* timer, uint64_t delayMs) {
+    timer->Cancel();
+    uint64_t ticks = (delayMs + _tickMs - 1) / _tickMs;
+    if (ticks == 0) ticks = 1;  // 至少等到下一个刻度
+    if (ticks > kMaxTicks) ticks = kMaxTicks;
+    timer->_expireTick = _currentTick + ticks;
+    timer->_wheel = this;
+    Place(timer);
+    ++_count;
+}
+
+void TimerWheel::Cascade(int level) {
+    size_t slot = (size_t)(_currentTick >> (kLevelBits * level)) & (kLevelSlots - 1);
+    TimerLink& head = _slots[level * kLevelSlots + slot];
+    TimerLink moving;
+    moving.prev = moving.next = &moving;
+    if (head.next != &head) {
+        // 整条链表接到临时哨兵上，再逐个按剩余时间放回，重新放回的定时器不会落在同一个槽
+        moving.next = head.next;
+        moving.prev = head.prev;
+        moving.next->prev = &moving;
+        moving.prev->next = &moving;
+        head.prev = head.next = &head;
+    }
+    while (moving.next != &moving) {
+        Timer* timer = static_cast<Timer*>(moving.next);
+        moving.next = timer->next;
+        moving.next->prev = &moving;
+        Place(timer);
+    }
+}
+
+void TimerWheel::Advance(uint64_t nowMs) {
+    uint64_t targetTick = nowMs > _startMs ? (nowMs - _startMs) / _tickMs : 0;
+    while (_currentTick < targetTick && _count > 0) {
+        ++_currentTick;
+        // 某一层转完一圈时，从上一层取出下一段时间内到期的定时器
+        for (int level = 1; level < kLevelCount; ++level) {
+            if ((_currentTick & (((uint64_t)1 << (kLevelBits * level)) - 1)) != 0) {
+                break;
+            }
+            Cascade(level);
+        }
+        TimerLink& head = _slots[_currentTick & (kLevelSlots - 1)];
+
+        // 先把到期的定时器移到临时链表，回调中可以安全地调度或取消任意定时器
+        TimerLink expired;
+        expired.prev = expired.next = &expired;
+        while (head.next != &head) {
+            TimerLink* node = head.next;
+            node->prev->next = node->next;
+            node->next->prev = node->prev;
+            Link(&expired, node);
+        }
+        while (expired.next != &expired) {
+            Timer* timer = static_cast<Timer*>(expired.next);
+            Unlink(timer);
+            timer->OnTimer();
+        }
+    }
+    if (_count == 0 && _currentTick < targetTick) {
+        _currentTick = targetTick;  // 没有定时器时直接跳到当前刻度
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class TimerWheel;
+
+// 侵入式双向链表节点，时间轮的槽使用它作为哨兵
+struct TimerLink {
+    TimerLink* prev = nullptr;
+    TimerLink* next = nullptr;
+};
+
+// 可挂到时间轮上的定时器，到期时回调OnTimer，析构时自动从时间轮上摘除
+class Timer : private TimerLink {
+public:
+    Timer() = default;
+    virtual ~Timer() { Cancel(); }
+    Timer(const Timer&) = delete;
+    Timer& operator=(const Timer&) = delete;
+
+    virtual void OnTimer() = 0;
+
+    bool IsScheduled() const { return _wheel != nullptr; }
+    void Cancel();
+
+private:
+    friend class TimerWheel;
+    TimerWheel* _wheel = nullptr;
+    uint64_t _expireTick = 0;
+};
+
+// 分层时间轮：每层64个槽，每个槽是一个侵入式双向链表，调度和取消都是O(1)。
+// 第0层的槽精确到刻度，上层的槽依次覆盖64倍的时长，第0层转完一圈时把上层一个槽里的定时器
+// 按剩余时间重新挂到下层（级联）。槽里只有同一刻度到期的定时器，推进时不需要检查未到期的节点，
+// 几十万个长超时（空闲超时等）的定时器也不会让每个刻度的开销变大。只能在单个线程内使用
+class TimerWheel {
+public:
+    explicit TimerWheel(uint32_t tickMs);
+    ~TimerWheel();
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    void Schedule(Timer* timer, uint64_t delayMs);  // 已调度的定时器会被重新调度
+    void Advance(uint64_t nowMs);  // 触发所有在nowMs之前到期的定时器
+
+    // 事件循环等待的超时时间：没有定时器时返回-1
+    int NextTimeoutMs() const { return _count > 0 ? (int)_tickMs : -1; }
+    size_t Count() const { return _count; }
+
+    static uint64_t NowMs();  // 单调时钟的毫秒数
+
+private:
+    friend class Timer;
+    static constexpr int kLevelBits = 6;
+    static constexpr size_t kLevelSlots = (size_t)1 << kLevelBits;
+    static constexpr int kLevelCount = 4;  // 100毫秒一个刻度时最长约19天，更长的超时按最长处理
+    static constexpr uint64_t kMaxTicks = ((uint64_t)1 << (kLevelBits * kLevelCount)) - 1;
+
+    static void Link(TimerLink* head, TimerLink* node);
+    void Unlink(Timer* timer);
+    void Place(Timer* timer);  // 按到期刻度与当前刻度的差挂到对应层的槽
+    void Cascade(int level);  // 把上层当前槽里的定时器重新挂到下层
+
+    uint32_t _tickMs;
+    std::vector<TimerLink> _slots;  // 每层kLevelSlots个槽的哨兵节点
+    uint64_t _startMs;
+    uint64_t _currentTick = 0;
+    size_t _count = 0;
+};
@@ -0,0 +1,796 @@
+#include "UdpRelay.h"
+#include "RelayEngine.h"
+#include "UpstreamPool.h"
+#include "conlog.h"
+
+static constexpr int kMaxDatagramsPerEvent = 64;  // 每次就绪事件最多处理的数据报数量，避免单个套接字独占线程
+
+UdpClientKey UdpClientKey::From(const sockaddr_storage& addr) {
+    UdpClientKey key;
+    memset(&key, 0, sizeof(key));
+    key.family = addr.ss_family;
+    if (addr.ss_family == AF_INET6) {
+        const sockaddr_in6& in6 = (const sockaddr_in6&)addr;
+        memcpy(key.addr, &in6.sin6_addr, 16);
+        key.port = in6.sin6_port;
+    }
+    else {
+        const sockaddr_in& in4 = (const sockaddr_in&)addr;
+        memcpy(key.addr, &in4.sin_addr, 4);
+        key.port = in4.sin_port;
+    }
+    return key;
+}
+
+size_t UdpClientKeyHash::operator()(const UdpClientKey& key) const {
+    // FNV-1a
+    const uint8_t* bytes = (const uint8_t*)&key;
+    uint64_t hash = 1469598103934665603ull;
+    for (size_t i = 0; i < sizeof(key); ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return (size_t)hash;
+}
+
+// 判断UDP收发错误是否可以忽略（ICMP端口不可达等不影响其他客户端的错误）
+// 已connect的UDP套接字收到ICMP端口不可达时返回的错误
+static bool IsUpstreamRefused(int errorCode) {
+#ifdef _WIN32
+    return errorCode == WSAECONNRESET;
+#else
+    return errorCode == ECONNREFUSED;
+#endif
+}
+
+static bool IsTransientUdpError(int errorCode) {
+#ifdef _WIN32
+    return errorCode == WSAECONNRESET || errorCode == WSAEMSGSIZE;
+#else
+    return errorCode == ECONNREFUSED || errorCode == EINTR;
+#endif
+}
+
+#ifdef __linux__
+// 在套接字上启用或关闭GRO，启用后内核会把同一来源的连续数据报合并后一次交付；不支持时静默忽略
+static void SetGro(SOCKET sock, bool enable) {
+#ifdef UDP_GRO
+    int value = enable ? 1 : 0;
+    setsockopt(sock, IPPROTO_UDP, UDP_GRO, &value, sizeof(value));
+#else
+    (void)sock;
+    (void)enable;
+#endif
+}
+
+UdpBatch::UdpBatch()
+    : data(new char[kMaxBatch * kSlotSize]) {
+}
+
+void UdpBatch::PrepareReceive(int count, bool withAddr) {
+    for (int i = 0; i < count; ++i) {
+        iovs[i].iov_base = data.get() + (size_t)i * kSlotSize;
+        iovs[i].iov_len = kSlotSize;
+        msghdr& hdr = msgs[i].msg_hdr;
+        hdr.msg_name = withAddr ? &addrs[i] : nullptr;
+        hdr.msg_namelen = withAddr ? sizeof(addrs[i]) : 0;
+        hdr.msg_iov = &iovs[i];
+        hdr.msg_iovlen = 1;
+        hdr.msg_control = controls[i];
+        hdr.msg_controllen = sizeof(controls[i]);
+        hdr.msg_flags = 0;
+        msgs[i].msg_len = 0;
+    }
+}
+
+uint16_t UdpBatch::GroSegmentSize(int index) const {
+#ifdef UDP_GRO
+    msghdr* hdr = (msghdr*)&msgs[index].msg_hdr;
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+        if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int segmentSize;
+            memcpy(&segmentSize, CMSG_DATA(cmsg), sizeof(segmentSize));
+            // 只有真正合并了多个数据报时才需要在发送端重新分段
+            return segmentSize > 0 && (unsigned)segmentSize < msgs[index].msg_len ? (uint16_t)segmentSize : 0;
+        }
+    }
+#else
+    (void)index;
+#endif
+    return 0;
+}
+
+void UdpBatch::PrepareSend(int index, const sockaddr_storage* addr, socklen_t addrLen, uint16_t segmentSize) {
+    msghdr& hdr = msgs[index].msg_hdr;
+    iovs[index].iov_len = msgs[index].msg_len;
+    hdr.msg_name = (void*)addr;
+    hdr.msg_namelen = addr != nullptr ? addrLen : 0;
+    hdr.msg_flags = 0;
+    segments[index] = segmentSize;
+#ifdef UDP_SEGMENT
+    if (segmentSize > 0) {
+        // 通过UDP_SEGMENT让内核（或网卡）把一个大缓冲区按段大小切分成多个数据报发送
+        hdr.msg_control = controls[index];
+        hdr.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = IPPROTO_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof(segmentSize));
+        return;
+    }
+#endif
+    hdr.msg_control = nullptr;
+    hdr.msg_controllen = 0;
+}
+
+// 内核不支持GSO发送时，把合并的缓冲区拆成单独的数据报逐个发送
+static void SendSegments(SOCKET sock, UdpBatch& batch, int index) {
+    const msghdr& hdr = batch.msgs[index].msg_hdr;
+    const char* data = (const char*)batch.iovs[index].iov_base;
+    size_t total = batch.iovs[index].iov_len;
+    size_t segment = batch.segments[index];
+    for (size_t offset = 0; offset < total; offset += segment) {
+        size_t len = total - offset < segment ? total - offset : segment;
+        if (sendto(sock, data + offset, len, 0, (const sockaddr*)hdr.msg_name, hdr.msg_namelen) == SOCKET_ERROR) {
+            break;
+        }
+    }
+}
+
+// 用sendmmsg一次发送多条消息，发送缓冲区满时丢弃剩余的数据报
+static void SendBatch(SOCKET sock, UdpBatch& batch, int start, int count) {
+    int sent = 0;
+    while (sent < count) {
+        int result = sendmmsg(sock, &batch.msgs[start + sent], (unsigned)(count - sent), 0);
+        if (result > 0) {
+            sent += result;
+            continue;
+        }
+        int err = errno;
+        if (IsWouldBlock(err)) {
+            return;
+        }
+        // 当前这一条发送失败，跳过它继续发送后面的消息
+        if (batch.segments[start + sent] > 0 && (err == EIO || err == EINVAL || err == ENOPROTOOPT)) {
+            SendSegments(sock, batch, start + sent);
+        }
+        else if (!IsTransientUdpError(err)) {
+            LogSocketError(err);
+        }
+        ++sent;
+    }
+}
+#endif
+
+UdpSession::UdpSession(UdpListener& listener, std::shared_ptr<RelayRule> rule, const sockaddr_storage& clientAddr, socklen_t clientAddrLen,
+    RateLimiter::Client* limit)
+    : _listener(listener), _rule(std::move(rule)), _stats(&_rule->metrics->Shard(listener.Worker().Id())),
+      _limiter(_rule->limiter.get()), _limit(limit), _key(UdpClientKey::From(clientAddr)), _id(listener.Worker().NewSessionId()), _clientAddr(clientAddr), _clientAddrLen(clientAddrLen) {
+}
+
+UdpSession::~UdpSession() {
+    Close();
+}
+
+bool UdpSession::Open(UpstreamEndpoint* endpoint) {
+    _endpoint = endpoint;
+    sockaddr_storage targetAddr = _rule->TargetAddress(*endpoint, _listener.PortIndex());
+    _sock = socket(targetAddr.ss_family, SOCK_DGRAM, IPPROTO_UDP);  // 为该客户端创建独立的上游套接字
+    if (_sock == INVALID_SOCKET) {
+        LogSocketError(GetLastSocketError());
+        return false;
+    }
+    // connect后内核只接收来自目标地址的数据报，send时也不需要再指定地址
+    if (!SetNonBlocking(_sock) ||
+        connect(_sock, (const sockaddr*)&targetAddr, SockaddrLength(targetAddr)) == SOCKET_ERROR ||
+        (!_listener.UsesUring() && !_listener.Worker().GetPoller().Add(_sock, PollIn, this))) {
+        LogSocketError(GetLastSocketError());
+        closesocket(_sock);
+        _sock = INVALID_SOCKET;
+        return false;
+    }
+#ifdef __linux__
+    if (_listener.UsesUring()) {
+        _uringToken = _listener.Worker().Uring()->Register(this);
+        UringRecv();
+    }
+    // GRO在会话建立时决定，规则更新后已有会话的套接字保持原样；空闲超时则每次检查时读取监听器当前的设置。
+    // io_uring逐个接收数据报，不使用GRO
+    _gro = _listener.Options().gso && !_listener.UsesUring();
+    if (_gro) {
+        SetGro(_sock, true);
+    }
+#endif
+    _lastActiveMs = _openMs = TimerWheel::NowMs();
+    _openUs = MetricsNowUs();
+    MetricAdd(_stats->opened, 1);
+    uint32_t timeoutMs = _listener.Options().idleTimeoutMs;
+    _listener.Worker().Timers().Schedule(this, timeoutMs != 0 ? timeoutMs : kUnlimitedCheckMs);
+    return true;
+}
+
+void UdpSession::Close() {
+    Cancel();
+    if (_endpoint != nullptr) {
+        _rule->upstream->Release(_endpoint);
+        _endpoint = nullptr;
+    }
+    if (_limiter != nullptr) {
+        _limiter->Release(_limit);
+        _limiter = nullptr;
+    }
+    if (_sock != INVALID_SOCKET) {
+#ifdef __linux__
+        if (_uringToken != 0) {
+            IoUring* uring = _listener.Worker().Uring();
+            uring->CancelFd(_sock);
+            uring->Submit();  // 取消请求交给内核之后才能关闭套接字
+            uring->Unregister(_uringToken);
+        }
+        else
+#endif
+        {
+            _listener.Worker().GetPoller().Remove(_sock);
+        }
+        closesocket(_sock);
+        _sock = INVALID_SOCKET;
+        MetricAdd(_stats->closed, 1);
+        _stats->duration.Record(MetricsNowUs() - _openUs);
+    }
+}
+
+// 记录目标的回复：字节数、数据报数（GRO合并的按段数计），以及会话的首字节时间
+void UdpSession::CountDownstream(uint64_t bytes, uint64_t packets) {
+    MetricsShard& stats = *_stats;
+    MetricAdd(stats.bytesDown, bytes);
+    MetricAdd(stats.packetsDown, packets);
+    _bytesDown += bytes;
+    if (!_firstByte) {
+        _firstByte = true;
+        stats.firstByteTime.Record(MetricsNowUs() - _openUs);
+    }
+}
+
+bool UdpSession::Allow(uint64_t bytes, uint64_t packets) {
+    if (_limiter == nullptr || _limiter->Allow(_limit, bytes, packets)) {
+        return true;
+    }
+    MetricAdd(_stats->dropped, packets);
+    return false;
+}
+
+void UdpSession::SendUpstream(const char* data, size_t len, uint64_t nowMs) {
+    _lastActiveMs = nowMs;
+    _bytesUp += len;
+    if (send(_sock, data, (int)len, 0) == SOCKET_ERROR) {
+        int err = GetLastSocketError();
+        if (!IsWouldBlock(err) && !IsTransientUdpError(err)) {
+            LogSocketError(err);  // 发送缓冲区满时直接丢弃，与UDP语义一致
+            MetricAdd(_stats->errors, 1);
+        }
+    }
+}
+
+#ifdef __linux__
+void UdpSession::SendUpstreamBatch(UdpBatch& batch, int start, int count, uint64_t nowMs) {
+    _lastActiveMs = nowMs;
+    for (int i = start; i < start + count; ++i) {
+        _bytesUp += batch.iovs[i].iov_len;
+    }
+    SendBatch(_sock, batch, start, count);  // 已connect的套接字，消息中不需要目标地址
+}
+
+void UdpSession::ReceiveBatched() {
+    UdpBatch& batch = _listener.Worker().Batch();
+    int batchSize = (int)_listener.Options().batchSize;
+    if (batchSize > UdpBatch::kMaxBatch) batchSize = UdpBatch::kMaxBatch;
+    bool gso = _gro;
+
+    for (int received = 0; received < kMaxDatagramsPerEvent;) {
+        batch.PrepareReceive(batchSize, false);
+        int count = recvmmsg(_sock, batch.msgs, (unsigned)batchSize, MSG_DONTWAIT, nullptr);  // 一次接收多条目标的回复
+        if (count <= 0) {
+            int err = errno;
+            if (count < 0 && IsUpstreamRefused(err)) {
+                OnUpstreamRefused();
+            }
+            else if (count < 0 && !IsWouldBlock(err) && !IsTransientUdpError(err)) {
+                LogSocketError(err);
+                MetricAdd(_stats->errors, 1);
+            }
+            return;
+        }
+        _lastActiveMs = TimerWheel::NowMs();
+        uint64_t bytes = 0, packets = 0;
+        int runStart = 0;  // 超过速率限制的数据报被跳过，其余的按连续区间发送
+        for (int i = 0; i < count; ++i) {
+            uint16_t segment = gso ? batch.GroSegmentSize(i) : 0;
+            uint64_t segments = segment > 0 ? (batch.msgs[i].msg_len + segment - 1) / segment : 1;
+            bytes += batch.msgs[i].msg_len;
+            packets += segments;
+            batch.PrepareSend(i, &_clientAddr, _clientAddrLen, segment);
+            if (!Allow(batch.msgs[i].msg_len, segments)) {
+                if (i > runStart) {
+                    SendBatch(_listener.Socket(), batch, runStart, i - runStart);
+                }
+                runStart = i + 1;
+            }
+        }
+        CountDownstream(bytes, packets);
+        if (count > runStart) {
+            SendBatch(_listener.Socket(), batch, runStart, count - runStart);  // 通过监听套接字一次送回客户端
+        }
+        received += count;
+        if (count < batchSize) {
+            return;  // 套接字已读空
+        }
+    }
+}
+#endif
+
+void UdpSession::HandleEvents(uint32_t /*events*/) {
+    if (IsClosed()) {
+        return;
+    }
+#ifdef __linux__
+    if (_listener.Batched() || _gro) {  // GRO合并的数据报需要按段大小重新分段，只有批量路径能处理
+        ReceiveBatched();
+        return;
+    }
+#endif
+    char* buffer = _listener.Worker().UdpBuffer();
+    for (int i = 0; i < kMaxDatagramsPerEvent; ++i) {
+        int len = recv(_sock, buffer, (int)RelayWorker::kUdpBufferSize, 0);  // 接收目标的回复
+        if (len == SOCKET_ERROR) {
+            int err = GetLastSocketError();
+            if (IsWouldBlock(err)) {
+                break;
+            }
+            if (IsUpstreamRefused(err)) {
+                OnUpstreamRefused();
+                return;
+            }
+            if (!IsTransientUdpError(err)) {
+                LogSocketError(err);
+                MetricAdd(_stats->errors, 1);
+            }
+            continue;
+        }
+        _lastActiveMs = TimerWheel::NowMs();
+        CountDownstream((uint64_t)len, 1);
+        if (!Allow((uint64_t)len, 1)) {
+            continue;
+        }
+        // 通过监听套接字把回复送回客户端，客户端看到的源地址保持不变
+        if (sendto(_listener.Socket(), buffer, len, 0, (const sockaddr*)&_clientAddr, _clientAddrLen) == SOCKET_ERROR) {
+            int err = GetLastSocketError();
+            if (!IsWouldBlock(err) && !IsTransientUdpError(err)) {
+                LogSocketError(err);
+            }
+        }
+    }
+}
+
+#ifdef __linux__
+void UdpSession::SendUpstream(int buffer, size_t offset, size_t len, uint64_t nowMs) {
+    _lastActiveMs = nowMs;
+    _bytesUp += len;
+    _listener.Worker().Uring()->Send(_sock, buffer, offset, len, _uringToken, kOpSend, false);
+}
+
+void UdpSession::UringRecv() {
+    if (!_receiving && !IsClosed()) {
+        _listener.Worker().Uring()->RecvMultishot(_sock, _uringToken, kOpRecv);
+        _receiving = true;
+    }
+}
+#endif
+
+void UdpSession::HandleCompletion(const UringCompletion& completion) {
+#ifdef __linux__
+    IoUring& uring = *_listener.Worker().Uring();
+    int err = completion.result < 0 ? -completion.result : 0;
+    if (completion.op != kOpRecv) {
+        uring.Recycle(completion.buffer);  // 发送完成，缓冲区可以再次用于接收
+        if (err != 0 && !IsWouldBlock(err) && !IsTransientUdpError(err)) {
+            LogSocketError(err);
+            MetricAdd(_stats->errors, 1);
+        }
+        return;
+    }
+
+    if (!completion.more) {
+        _receiving = false;
+    }
+    if (completion.result >= 0 && completion.buffer >= 0) {
+        _lastActiveMs = TimerWheel::NowMs();
+        CountDownstream((uint64_t)completion.result, 1);
+        if (!Allow((uint64_t)completion.result, 1)) {
+            uring.Recycle(completion.buffer);
+        }
+        else {
+            // 通过监听套接字把回复送回客户端，缓冲区在发送完成后归还
+            uring.SendTo(_listener.Socket(), completion.buffer, (size_t)completion.result, _clientAddr, _clientAddrLen, _uringToken, kOpReply);
+        }
+    }
+    else if (err == ENOBUFS) {
+        uring.WaitForBuffers(_uringToken);
+        return;
+    }
+    else if (IsUpstreamRefused(err)) {
+        OnUpstreamRefused();  // 可能关闭会话
+    }
+    else if (err != 0 && err != ECANCELED && !IsTransientUdpError(err)) {
+        LogSocketError(err);
+        MetricAdd(_stats->errors, 1);
+    }
+    UringRecv();
+#else
+    (void)completion;
+#endif
+}
+
+void UdpSession::OnBuffersAvailable() {
+#ifdef __linux__
+    UringRecv();
+#endif
+}
+
+void UdpSession::OnUpstreamRefused() {
+    uint64_t now = TimerWheel::NowMs();
+    UpstreamPool& upstream = *_rule->upstream;
+    upstream.ReportFailure(_endpoint, now);
+    MetricAdd(_stats->connectErrors, 1);
+    if (!_endpoint->Healthy(now) && upstream.Size() > 1) {
+        // 目标已被标记为不可用，关闭会话，客户端的下一个数据报会选择其他目标
+        _listener.RemoveSession(this);
+    }
+}
+
+void UdpSession::OnTimer() {
+    uint64_t now = TimerWheel::NowMs();
+    uint64_t idleMs = now - _lastActiveMs;
+    uint32_t timeoutMs = _listener.Options().idleTimeoutMs;  // 热加载改变的超时对已有会话在下一次检查时生效
+    if (timeoutMs == 0) {
+        _listener.Worker().Timers().Schedule(this, kUnlimitedCheckMs);  // 不回收
+        return;
+    }
+    if (idleMs < timeoutMs) {
+        _listener.Worker().Timers().Schedule(this, timeoutMs - idleMs);  // 期间有活动，顺延到新的到期时间
+        return;
+    }
+    _listener.RemoveSession(this);
+}
+
+SessionInfo UdpSession::Describe(uint64_t nowMs) const {
+    SessionInfo info;
+    info.id = _id;
+    info.rule = _rule->name;
+    info.udp = true;
+    info.client = _clientAddr;
+    if (_endpoint != nullptr) {
+        info.upstream = _rule->mapPorts ? FormatAddress(_rule->TargetAddress(*_endpoint, _listener.PortIndex())) : _endpoint->name;
+    }
+    info.state = "active";
+    info.ageMs = nowMs > _openMs ? nowMs - _openMs : 0;
+    info.idleMs = nowMs > _lastActiveMs ? nowMs - _lastActiveMs : 0;
+    info.bytesUp = _bytesUp;
+    info.bytesDown = _bytesDown;
+    return info;
+}
+
+UdpListener::UdpListener(RelayWorker& worker, SOCKET sock, std::shared_ptr<RelayRule> rule, uint16_t portIndex)
+    : _worker(worker), _sock(sock), _rule(std::move(rule)), _stats(&_rule->metrics->Shard(worker.Id())), _options(_rule->udp),
+      _portIndex(portIndex) {
+}
+
+UdpListener::~UdpListener() {
+    Close();
+}
+
+bool UdpListener::Start() {
+    if (!SetNonBlocking(_sock)) {
+        LogSocketError(GetLastSocketError());
+        return false;
+    }
+#ifdef __linux__
+    if (IoUring* uring = _worker.Uring()) {
+        memset(&_recvHdr, 0, sizeof(_recvHdr));
+        _recvHdr.msg_namelen = sizeof(sockaddr_storage);
+        _uringToken = uring->Register(this);
+        UringRecv();
+        return true;  // 逐个接收数据报，不使用GRO
+    }
+#endif
+    if (!_worker.GetPoller().Add(_sock, PollIn, this)) {
+        LogSocketError(GetLastSocketError());
+        return false;
+    }
+#ifdef __linux__
+    if (_options.gso) {
+        SetGro(_sock, true);
+    }
+#endif
+    return true;
+}
+
+bool UdpListener::Batched() const {
+#ifdef __linux__
+    return _options.batchSize > 1;
+#else
+    return false;
+#endif
+}
+
+void UdpListener::Close() {
+    for (auto& entry : _sessions) {
+        entry.second->Close();
+        _worker.RetireSession(std::move(entry.second));  // 同一批事件中可能还有会话的回调，延迟释放
+    }
+    _sessions.clear();
+    if (_sock != INVALID_SOCKET) {
+#ifdef __linux__
+        if (_uringToken != 0) {
+            IoUring* uring = _worker.Uring();
+            uring->CancelFd(_sock);
+            uring->Submit();  // 取消请求交给内核之后才能关闭套接字
+            uring->Unregister(_uringToken);
+        }
+        else
+#endif
+        {
+            _worker.GetPoller().Remove(_sock);
+        }
+        closesocket(_sock);
+        _sock = INVALID_SOCKET;
+    }
+}
+
+#ifdef __linux__
+void UdpListener::ReceiveBatched() {
+    UdpBatch& batch = _worker.Batch();
+    int batchSize = (int)_options.batchSize;
+    if (batchSize > UdpBatch::kMaxBatch) batchSize = UdpBatch::kMaxBatch;
+
+    for (int received = 0; received < kMaxDatagramsPerEvent;) {
+        batch.PrepareReceive(batchSize, true);
+        int count = recvmmsg(_sock, batch.msgs, (unsigned)batchSize, MSG_DONTWAIT, nullptr);  // 一次接收多个UDP数据包
+        if (count <= 0) {
+            int err = errno;
+            if (count < 0 && !IsWouldBlock(err) && !IsTransientUdpError(err)) {
+                LogSocketError(err);  // 记录接收数据失败的错误信息
+                MetricAdd(_stats->errors, 1);
+            }
+            return;
+        }
+
+        // 相邻且属于同一客户端的数据报合并为一次sendmmsg
+        uint64_t now = TimerWheel::NowMs();
+        UdpSession* runSession = nullptr;
+        int runStart = 0;
+        uint64_t bytes = 0, packets = 0;
+        for (int i = 0; i < count; ++i) {
+            UdpSession* session = FindOrCreateSession(batch.addrs[i], batch.msgs[i].msg_hdr.msg_namelen);
+            LOG_DEBUG("UDP datagram: %u bytes from client port %u", batch.msgs[i].msg_len, (unsigned)ntohs(((sockaddr_in&)batch.addrs[i]).sin_port));  // 逐包日志，级别关闭时几乎没有开销
+            uint16_t segment = _options.gso ? batch.GroSegmentSize(i) : 0;
+            uint64_t segments = segment > 0 ? (batch.msgs[i].msg_len + segment - 1) / segment : 1;
+            bytes += batch.msgs[i].msg_len;
+            packets += segments;
+            batch.PrepareSend(i, nullptr, 0, segment);
+            if (session != nullptr && !session->Allow(batch.msgs[i].msg_len, segments)) {
+                session = nullptr;  // 超过速率限制，丢弃这个数据报
+            }
+            if (session != runSession) {
+                if (runSession != nullptr) {
+                    runSession->SendUpstreamBatch(batch, runStart, i - runStart, now);
+                }
+                runSession = session;
+                runStart = i;
+            }
+        }
+        if (runSession != nullptr) {
+            runSession->SendUpstreamBatch(batch, runStart, count - runStart, now);
+        }
+        MetricAdd(_stats->bytesUp, bytes);  // 每批只写一次计数器
+        MetricAdd(_stats->packetsUp, packets);
+
+        received += count;
+        if (count < batchSize) {
+            return;  // 套接字已读空
+        }
+    }
+}
+#endif
+
+void UdpListener::HandleEvents(uint32_t /*events*/) {
+    if (_sock == INVALID_SOCKET) {
+        return;  // 同一批事件中规则已被移除
+    }
+#ifdef __linux__
+    if (Batched() || _options.gso) {  // GRO合并的数据报需要按段大小重新分段，只有批量路径能处理
+        ReceiveBatched();
+        return;
+    }
+#endif
+    char* buffer = _worker.UdpBuffer();
+    uint64_t now = TimerWheel::NowMs();
+    for (int i = 0; i < kMaxDatagramsPerEvent; ++i) {
+        sockaddr_storage clientAddr;  // 存储客户端地址信息
+        socklen_t addrLen = sizeof(clientAddr);  // 客户端地址信息的长度
+        int len = recvfrom(_sock, buffer, (int)RelayWorker::kUdpBufferSize, 0, (sockaddr*)&clientAddr, &addrLen);  // 接收UDP数据包
+        if (len == SOCKET_ERROR) {
+            int err = GetLastSocketError();
+            if (IsWouldBlock(err)) {
+                break;
+            }
+            if (!IsTransientUdpError(err)) {
+                LogSocketError(err);  // 记录接收数据失败的错误信息
+                MetricAdd(_stats->errors, 1);
+            }
+            continue;
+        }
+        MetricAdd(_stats->bytesUp, (uint64_t)len);
+        MetricAdd(_stats->packetsUp, 1);
+
+        UdpSession* session = FindOrCreateSession(clientAddr, addrLen);
+        LOG_DEBUG("UDP datagram: %d bytes from client port %u", len, (unsigned)ntohs(((sockaddr_in&)clientAddr).sin_port));  // 逐包日志，级别关闭时几乎没有开销
+        if (session != nullptr && session->Allow((uint64_t)len, 1)) {
+            session->SendUpstream(buffer, (size_t)len, now);
+        }
+    }
+}
+
+#ifdef __linux__
+void UdpListener::UringRecv() {
+    if (!_receiving && _sock != INVALID_SOCKET) {
+        _worker.Uring()->RecvMsgMultishot(_sock, &_recvHdr, _uringToken, 0);
+        _receiving = true;
+    }
+}
+#endif
+
+void UdpListener::HandleCompletion(const UringCompletion& completion) {
+#ifdef __linux__
+    IoUring& uring = *_worker.Uring();
+    if (!completion.more) {
+        _receiving = false;
+    }
+    int err = completion.result < 0 ? -completion.result : 0;
+    if (completion.result >= 0 && completion.buffer >= 0) {
+        // 缓冲区中依次是io_uring_recvmsg_out、来源地址（按_recvHdr中的长度预留）和数据
+        char* data = uring.Buffer(completion.buffer);
+        io_uring_recvmsg_out out;
+        memcpy(&out, data, sizeof(out));
+        size_t offset = sizeof(out) + _recvHdr.msg_namelen;
+        sockaddr_storage clientAddr;
+        socklen_t addrLen = out.namelen < sizeof(clientAddr) ? out.namelen : (socklen_t)sizeof(clientAddr);
+        memcpy(&clientAddr, data + sizeof(out), addrLen);
+        MetricAdd(_stats->bytesUp, out.payloadlen);
+        MetricAdd(_stats->packetsUp, 1);
+
+        UdpSession* session = (out.flags & MSG_TRUNC) ? nullptr : FindOrCreateSession(clientAddr, addrLen);
+        LOG_DEBUG("UDP datagram: %u bytes from client port %u", out.payloadlen, (unsigned)ntohs(((sockaddr_in&)clientAddr).sin_port));  // 逐包日志，级别关闭时几乎没有开销
+        if (session != nullptr && session->Allow(out.payloadlen, 1)) {
+            session->SendUpstream(completion.buffer, offset, out.payloadlen, _worker.LoopTimeMs());
+        }
+        else {
+            uring.Recycle(completion.buffer);  // 丢弃数据报
+        }
+    }
+    else if (err == ENOBUFS) {
+        uring.WaitForBuffers(_uringToken);
+        return;
+    }
+    else if (err != 0 && err != ECANCELED && !IsTransientUdpError(err)) {
+        LogSocketError(err);  // 记录接收数据失败的错误信息
+        MetricAdd(_stats->errors, 1);
+    }
+    UringRecv();
+#else
+    (void)completion;
+#endif
+}
+
+void UdpListener::OnBuffersAvailable() {
+#ifdef __linux__
+    UringRecv();
+#endif
+}
+
+UdpSession* UdpListener::FindOrCreateSession(const sockaddr_storage& clientAddr, socklen_t addrLen) {
+    UdpClientKey key = UdpClientKey::From(clientAddr);
+    auto it = _sessions.find(key);
+    if (it != _sessions.end()) {
+        return it->second.get();
+    }
+
+    if (_draining) {
+        return nullptr;  // 规则已停止，丢弃新客户端的数据报
+    }
+    RateLimiter::Client* limit = nullptr;
+    if (_rule->limiter != nullptr && !_rule->limiter->Admit(clientAddr, limit)) {
+        MetricAdd(_stats->rejected, 1);
+        return nullptr;  // 超过会话数或新建速率限制，丢弃数据报，之后的数据报会再次检查
+    }
+    UpstreamPool& upstream = *_rule->upstream;
+    uint64_t clientHash = upstream.Options().mode == BalanceMode::ConsistentHash ? UpstreamPool::HashClient(clientAddr) : 0;
+    UpstreamEndpoint* endpoint = upstream.Select(clientHash, nullptr, _worker.LoopTimeMs());
+    if (endpoint == nullptr) {
+        if (_rule->limiter != nullptr) {
+            _rule->limiter->Release(limit);
+        }
+        return nullptr;  // 目标池为空，丢弃数据报
+    }
+    auto session = std::make_unique<UdpSession>(*this, _rule, clientAddr, addrLen, limit);  // 之后由会话归还限流器的计数
+    if (!session->Open(endpoint)) {
+        return nullptr;  // Open失败时会话析构会归还连接计数
+    }
+
+    if (LogEnabled(LogLevel::Info)) {
+        char clientIP[NI_MAXHOST];  // 存储客户端IP地址的数组
+        getnameinfo((const sockaddr*)&clientAddr, addrLen, clientIP, sizeof(clientIP), nullptr, 0, NI_NUMERICHOST);  // 获取客户端IP地址
+        LOG_INFO("接收到来自 %s 的 UDP 连接", clientIP);  // 只在建立新会话时记录
+    }
+
+    UdpSession* raw = session.get();
+    _sessions.emplace(key, std::move(session));
+    return raw;
+}
+
+void UdpListener::RemoveSession(UdpSession* session) {
+    auto it = _sessions.find(session->Key());
+    if (it == _sessions.end() || it->second.get() != session) {
+        return;
+    }
+    session->Close();
+    _worker.RetireSession(std::move(it->second));  // 同一批事件中可能还有它的回调，延迟释放
+    _sessions.erase(it);
+}
+
+size_t UdpListener::SessionCount(const RelayRule* rule) const {
+    size_t count = 0;
+    for (const auto& entry : _sessions) {
+        if (entry.second->Rule() == rule) ++count;
+    }
+    return count;
+}
+
+size_t UdpListener::CloseSessions(const RelayRule* rule) {
+    std::vector<UdpSession*> matched;
+    for (const auto& entry : _sessions) {
+        if (entry.second->Rule() == rule) matched.push_back(entry.second.get());
+    }
+    for (UdpSession* session : matched) {
+        RemoveSession(session);
+    }
+    return matched.size();
+}
+
+void UdpListener::DescribeSessions(std::vector<SessionInfo>& sessions, uint64_t nowMs) const {
+    for (const auto& entry : _sessions) {
+        if (!entry.second->IsClosed()) {
+            sessions.push_back(entry.second->Describe(nowMs));
+        }
+    }
+}
+
+bool UdpListener::CloseSession(uint64_t id) {
+    for (const auto& entry : _sessions) {
+        if (entry.second->Id() == id) {
+            RemoveSession(entry.second.get());  // 会从_sessions中删除，之后不再访问迭代器
+            return true;
+        }
+    }
+    return false;
+}
+
+void UdpListener::SetRule(std::shared_ptr<RelayRule> rule) {
+    _rule = std::move(rule);
+    _stats = &_rule->metrics->Shard(_worker.Id());
+#ifdef __linux__
+    if (_rule->udp.gso != _options.gso && _uringToken == 0) {
+        SetGro(_sock, _rule->udp.gso);
+    }
+#endif
+    _options = _rule->udp;
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "netcompat.h"
+#include "IoUring.h"
+#include "Poller.h"
+#include "RateLimiter.h"
+#include "SessionInfo.h"
+#include "TimerWheel.h"
+
+#ifdef __linux__
+#include <netinet/udp.h>
+#endif
+
+class RelayWorker;
+class UdpListener;
+class UpstreamPool;
+struct MetricsShard;
+struct RelayRule;
+struct UpstreamEndpoint;
+
+// UDP转发规则的选项
+struct UdpOptions {
+    uint32_t idleTimeoutMs = 60000;  // 会话空闲多久后回收，0表示不回收
+    uint32_t batchSize = 32;  // Linux上每次recvmmsg/sendmmsg处理的数据报数量，1表示逐包收发
+    bool gso = false;  // Linux上启用UDP GRO接收合并与GSO发送分段
+};
+
+#ifdef __linux__
+// 一个工作线程内批量收发UDP数据报共用的消息头和数据区，
+// 接收后原地改写为发送形式，数据不需要再复制
+struct UdpBatch {
+    static constexpr int kMaxBatch = 64;
+    static constexpr size_t kSlotSize = 65536;  // 每条消息独占一个槽，GRO合并后的数据报也能放下
+
+    UdpBatch();
+    void PrepareReceive(int count, bool withAddr);
+    uint16_t GroSegmentSize(int index) const;  // 接收时内核合并的段大小，未合并时为0
+    void PrepareSend(int index, const sockaddr_storage* addr, socklen_t addrLen, uint16_t segmentSize);
+
+    mmsghdr msgs[kMaxBatch];
+    iovec iovs[kMaxBatch];
+    sockaddr_storage addrs[kMaxBatch];
+    uint16_t segments[kMaxBatch];  // 发送时使用的GSO段大小
+    alignas(cmsghdr) char controls[kMaxBatch][CMSG_SPACE(sizeof(int))];
+    std::unique_ptr<char[]> data;  // kMaxBatch个槽，只有实际写入的页面才占用物理内存
+};
+#endif
+
+// 用于查找会话的客户端地址键（地址族 + 端口 + IP）
+struct UdpClientKey {
+    uint8_t addr[16];
+    uint16_t port;
+    uint16_t family;
+
+    static UdpClientKey From(const sockaddr_storage& addr);
+    bool operator==(const UdpClientKey& other) const { return memcmp(this, &other, sizeof(*this)) == 0; }
+};
+
+struct UdpClientKeyHash {
+    size_t operator()(const UdpClientKey& key) const;
+};
+
+// 一个客户端的UDP会话：拥有独立的上游套接字（已connect到目标），
+// 因此目标的回复可以准确地送回对应的客户端
+class UdpSession : public PollHandler, public Timer, public CompletionHandler {
+public:
+    // 规则带有限流器时会话必须已通过准入检查，limit是得到的客户端项，会话关闭时归还
+    UdpSession(UdpListener& listener, std::shared_ptr<RelayRule> rule, const sockaddr_storage& clientAddr, socklen_t clientAddrLen,
+        RateLimiter::Client* limit = nullptr);
+    ~UdpSession() override;
+
+    bool Open(UpstreamEndpoint* endpoint);  // 会话持有endpoint的一个连接计数，关闭时归还
+    void Close();
+    bool Allow(uint64_t bytes, uint64_t packets);  // 速率限制：返回false时应丢弃这些数据报
+    void SendUpstream(const char* data, size_t len, uint64_t nowMs);  // 客户端 -> 目标
+#ifdef __linux__
+    void SendUpstreamBatch(UdpBatch& batch, int start, int count, uint64_t nowMs);
+    void SendUpstream(int buffer, size_t offset, size_t len, uint64_t nowMs);  // io_uring：发送提供缓冲区中的数据，发完后归还
+#endif
+
+    void HandleEvents(uint32_t events) override;  // 目标 -> 客户端
+    void OnTimer() override;  // 空闲检查
+    void HandleCompletion(const UringCompletion& completion) override;  // io_uring：目标的回复或上行发送完成
+    void OnBuffersAvailable() override;
+
+    bool IsClosed() const { return _sock == INVALID_SOCKET; }
+    const UdpClientKey& Key() const { return _key; }
+    const RelayRule* Rule() const { return _rule.get(); }
+    uint64_t Id() const { return _id; }
+    SessionInfo Describe(uint64_t nowMs) const;
+
+private:
+    static constexpr uint8_t kOpRecv = 0;   // io_uring操作编号：接收目标的回复
+    static constexpr uint8_t kOpSend = 1;   // 发往目标
+    static constexpr uint8_t kOpReply = 2;  // 通过监听套接字送回客户端
+    // 不限空闲时间时检查设置的间隔，热加载改为有限的超时后已有会话在下一次检查时开始计时
+    static constexpr uint32_t kUnlimitedCheckMs = 60000;
+
+#ifdef __linux__
+    void ReceiveBatched();
+    void UringRecv();
+#endif
+    void OnUpstreamRefused();  // 目标端口不可达（ICMP）
+    void CountDownstream(uint64_t bytes, uint64_t packets);
+
+    UdpListener& _listener;
+    std::shared_ptr<RelayRule> _rule;  // 建立会话时监听端所属的规则，规则更新后会话继续使用原来的目标
+    MetricsShard* _stats;
+    RateLimiter* _limiter;  // 规则的限流器，归还后置空
+    RateLimiter::Client* _limit;
+    UdpClientKey _key;
+    uint64_t _id;
+    UpstreamEndpoint* _endpoint = nullptr;
+    SOCKET _sock = INVALID_SOCKET;  // 上游套接字
+    sockaddr_storage _clientAddr;
+    socklen_t _clientAddrLen;
+    uint64_t _lastActiveMs = 0;  // 最近一次收发数据的时间，空闲判断采用惰性检查
+    uint64_t _openUs = 0;  // 会话建立的时间，用于首字节时间和存续时间
+    uint64_t _openMs = 0;
+    uint64_t _bytesUp = 0;
+    uint64_t _bytesDown = 0;
+    bool _gro = false;  // 上游套接字是否启用了GRO
+    bool _firstByte = false;  // 是否已收到目标的第一个数据报
+    uint64_t _uringToken = 0;  // 使用io_uring时非0
+    bool _receiving = false;  // 多发recv仍然有效
+};
+
+// UDP监听端：按客户端地址维护NAT式会话表，所有会话都运行在同一个工作线程上。
+// 工作线程使用io_uring时用多发recvmsg接收，每个数据报连同来源地址放在一个提供缓冲区中
+class UdpListener : public PollHandler, public CompletionHandler {
+public:
+    // portIndex是监听端口在规则端口范围内的序号，端口映射规则的会话据此计算目标端口
+    UdpListener(RelayWorker& worker, SOCKET sock, std::shared_ptr<RelayRule> rule, uint16_t portIndex = 0);
+    ~UdpListener() override;
+
+    bool Start();
+    void Close();
+    void SetRule(std::shared_ptr<RelayRule> rule);  // 规则更新：新会话使用新规则，已有会话不受影响
+    void StartDraining() { _draining = true; }  // 不再建立新会话，已有会话继续转发
+
+    void HandleEvents(uint32_t events) override;
+    void HandleCompletion(const UringCompletion& completion) override;
+    void OnBuffersAvailable() override;
+
+    void RemoveSession(UdpSession* session);  // 会话关闭时调用
+    size_t SessionCount(const RelayRule* rule) const;  // 属于某个规则的会话数量
+    size_t CloseSessions(const RelayRule* rule);  // 关闭属于某个规则的会话，返回关闭的数量
+    void DescribeSessions(std::vector<SessionInfo>& sessions, uint64_t nowMs) const;
+    bool CloseSession(uint64_t id);  // 按编号关闭一个会话，返回是否找到
+
+    RelayWorker& Worker() { return _worker; }
+    SOCKET Socket() const { return _sock; }
+    const UdpOptions& Options() const { return _options; }
+    const RelayRule* Rule() const { return _rule.get(); }
+    uint16_t PortIndex() const { return _portIndex; }
+    size_t SessionCount() const { return _sessions.size(); }
+    bool Draining() const { return _draining; }
+    bool UsesUring() const { return _uringToken != 0; }
+
+    bool Batched() const;  // 是否使用recvmmsg/sendmmsg批量收发
+
+private:
+#ifdef __linux__
+    void ReceiveBatched();
+    void UringRecv();
+#endif
+    UdpSession* FindOrCreateSession(const sockaddr_storage& clientAddr, socklen_t addrLen);
+
+    RelayWorker& _worker;
+    SOCKET _sock;
+    std::shared_ptr<RelayRule> _rule;  // 新会话从规则的目标池中选择目标地址
+    MetricsShard* _stats;  // 规则在本线程上的计数器
+    UdpOptions _options;
+    uint16_t _portIndex;
+    bool _draining = false;
+    std::unordered_map<UdpClientKey, std::unique_ptr<UdpSession>, UdpClientKeyHash> _sessions;
+    uint64_t _uringToken = 0;  // 使用io_uring时非0
+    bool _receiving = false;
+#ifdef __linux__
+    msghdr _recvHdr;  // 多发recvmsg的模板，只给出地址长度
+#endif
+};
@@ -0,0 +1,382 @@
+#include "UpstreamPool.h"
+#include <algorithm>
+#include <cstring>
+#include "TimerWheel.h"
+#include "conlog.h"
+
+// 64位整数混合函数（splitmix64的最终步骤），让相近的输入得到分散的哈希值
+static uint64_t Mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// FNV-1a哈希
+static uint64_t HashBytes(const void* data, size_t len, uint64_t hash = 14695981039346656037ULL) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// 读取快照期间保持EnterReader登记的计数，见WaitForReaders
+namespace {
+struct ReaderScope {
+    explicit ReaderScope(std::atomic<uint32_t>& count) : count(count) {}
+    ~ReaderScope() { count.fetch_sub(1, std::memory_order_release); }
+    std::atomic<uint32_t>& count;
+};
+}
+
+std::string FormatAddress(const sockaddr_storage& addr) {
+    char host[NI_MAXHOST] = "";
+    char port[NI_MAXSERV] = "";
+    getnameinfo((const sockaddr*)&addr, SockaddrLength(addr), host, sizeof(host), port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV);
+    // 用append逐段拼接：GCC 12对临时字符串的operator+链会误报-Wrestrict
+    std::string text;
+    text.reserve(strlen(host) + strlen(port) + 3);
+    bool v6 = addr.ss_family == AF_INET6;
+    if (v6) text.append(1, '[');
+    text.append(host);
+    if (v6) text.append(1, ']');
+    text.append(1, ':').append(port);
+    return text;
+}
+
+UpstreamPool::UpstreamPool(const std::vector<std::string>& targets, const UpstreamOptions& options)
+    : _targets(targets), _options(options), _resolved(targets.size()) {
+}
+
+std::shared_ptr<UpstreamPool> UpstreamPool::FromAddress(const sockaddr_storage& addr, const UpstreamOptions& options) {
+    auto pool = std::make_shared<UpstreamPool>(std::vector<std::string>(), options);  // 没有需要解析的目标
+    pool->Publish({ addr }, TimerWheel::NowMs());
+    return pool;
+}
+
+std::vector<std::string> UpstreamPool::SplitTargets(const std::string& targets) {
+    std::vector<std::string> result;
+    size_t start = 0;
+    while (start <= targets.size()) {
+        size_t comma = targets.find(',', start);
+        if (comma == std::string::npos) comma = targets.size();
+        std::string item = targets.substr(start, comma - start);
+        size_t first = item.find_first_not_of(" \t");
+        size_t last = item.find_last_not_of(" \t");
+        if (first != std::string::npos) {
+            result.push_back(item.substr(first, last - first + 1));
+        }
+        start = comma + 1;
+    }
+    return result;
+}
+
+uint64_t UpstreamPool::HashClient(const sockaddr_storage& clientAddr) {
+    if (clientAddr.ss_family == AF_INET6) {
+        const sockaddr_in6& in6 = (const sockaddr_in6&)clientAddr;
+        return HashBytes(&in6.sin6_addr, sizeof(in6.sin6_addr));
+    }
+    const sockaddr_in& in4 = (const sockaddr_in&)clientAddr;
+    return HashBytes(&in4.sin_addr, sizeof(in4.sin_addr));
+}
+
+size_t UpstreamPool::Resolve() {
+    uint64_t now = TimerWheel::NowMs();
+    _nextResolveMs.store(now + _options.resolveIntervalMs, std::memory_order_relaxed);
+
+    std::vector<sockaddr_storage> addrs;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (size_t i = 0; i < _targets.size(); ++i) {
+            size_t colonPos = _targets[i].rfind(':');
+            if (colonPos == std::string::npos) {
+                LOG_ERROR("Invalid target address format: %s", _targets[i].c_str());
+                continue;
+            }
+            std::string host = _targets[i].substr(0, colonPos);
+            std::string port = _targets[i].substr(colonPos + 1);
+            if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+                host = host.substr(1, host.size() - 2);  // IPv6地址的方括号
+            }
+
+            addrinfo hints{}, * info = nullptr;
+            hints.ai_family = AF_UNSPEC;  // 同时接受IPv4和IPv6地址
+            hints.ai_socktype = _options.socktype;
+            int error = getaddrinfo(host.c_str(), port.c_str(), &hints, &info);
+            if (error != 0) {
+                // 解析失败时沿用上一次的结果，DNS暂时不可用不会让规则失去目标
+                LOG_WARN("Failed to resolve target %s: %d, keeping %zu previous address(es)", _targets[i].c_str(), error, _resolved[i].size());
+            }
+            else {
+                _resolved[i].clear();
+                for (addrinfo* p = info; p != nullptr; p = p->ai_next) {
+                    sockaddr_storage addr{};
+                    memcpy(&addr, p->ai_addr, p->ai_addrlen);
+                    _resolved[i].push_back(addr);
+                }
+                freeaddrinfo(info);
+            }
+            addrs.insert(addrs.end(), _resolved[i].begin(), _resolved[i].end());
+        }
+    }
+    Publish(addrs, now);
+    return Size();
+}
+
+bool UpstreamPool::ResolveDue(uint64_t nowMs) const {
+    return _options.resolveIntervalMs > 0 && !_targets.empty() && nowMs >= _nextResolveMs.load(std::memory_order_relaxed);
+}
+
+void UpstreamPool::Publish(const std::vector<sockaddr_storage>& addrs, uint64_t nowMs) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    const Snapshot* current = _snapshot.get();
+    if (addrs.empty() && current != nullptr) {
+        Reclaim(nowMs);
+        return;  // 全部解析失败时保留原有地址
+    }
+
+    auto snapshot = std::make_unique<Snapshot>();
+    for (const sockaddr_storage& addr : addrs) {
+        std::string name = FormatAddress(addr);
+        EndpointEntry& entry = _endpoints[name];
+        if (!entry.endpoint) {
+            // 新地址；已有地址沿用原来的对象，连接计数和健康状态不会因重新解析而丢失
+            entry.endpoint = std::make_unique<UpstreamEndpoint>();
+            entry.endpoint->addr = addr;
+            entry.endpoint->name = name;
+            entry.endpoint->hash = Mix64(HashBytes(name.data(), name.size()));
+        }
+        snapshot->endpoints.push_back(entry.endpoint.get());
+    }
+    // 按名称排序并去重：DNS轮换返回顺序时快照保持不变，轮询顺序也不随解析结果抖动
+    std::vector<UpstreamEndpoint*>& endpoints = snapshot->endpoints;
+    std::sort(endpoints.begin(), endpoints.end(), [](const UpstreamEndpoint* a, const UpstreamEndpoint* b) { return a->name < b->name; });
+    endpoints.erase(std::unique(endpoints.begin(), endpoints.end()), endpoints.end());
+
+    if (current == nullptr || current->endpoints != endpoints) {
+        std::string names;
+        for (UpstreamEndpoint* endpoint : endpoints) {
+            if (!names.empty()) names.append(", ");
+            names.append(endpoint->name);
+        }
+        LOG_INFO("Upstream targets: %s", names.empty() ? "(none)" : names.c_str());
+
+        for (auto& item : _endpoints) {
+            bool present = std::binary_search(endpoints.begin(), endpoints.end(), item.second.endpoint.get(),
+                [](const UpstreamEndpoint* a, const UpstreamEndpoint* b) { return a->name < b->name; });
+            if (present) {
+                item.second.absentSinceMs = 0;
+            }
+            else if (item.second.absentSinceMs == 0) {
+                item.second.absentSinceMs = nowMs;
+            }
+        }
+        _current.store(snapshot.get(), std::memory_order_seq_cst);
+        WaitForReaders();
+        _snapshot = std::move(snapshot);  // 旧快照已没有读者
+        _version.fetch_add(1, std::memory_order_relaxed);
+    }
+    Reclaim(nowMs);
+}
+
+std::atomic<uint32_t>& UpstreamPool::EnterReader() const {
+    static std::atomic<size_t> nextThread{ 0 };
+    thread_local size_t slot = nextThread.fetch_add(1, std::memory_order_relaxed) % kReaderSlots;
+    std::atomic<uint32_t>& count = _readers[slot].count[_readerPhase.load(std::memory_order_relaxed) & 1];
+    count.fetch_add(1, std::memory_order_seq_cst);
+    return count;
+}
+
+void UpstreamPool::WaitForReaders() {
+    // 读者先登记再读取_current，发布者先替换_current再检查计数（两边都是seq_cst）：读到旧快照的读者
+    // 在检查之前已经登记，登记在哪一组都会被下面两轮中的一轮等到。每轮先切换组再等待，
+    // 切换之后的新读者登记在不被等待的一组，读者只在Select期间持有计数，等待很快结束
+    for (int round = 0; round < 2; ++round) {
+        uint32_t phase = _readerPhase.fetch_add(1, std::memory_order_seq_cst) & 1;
+        for (ReaderSlot& slot : _readers) {
+            while (slot.count[phase].load(std::memory_order_seq_cst) != 0) {
+                std::this_thread::yield();
+            }
+        }
+    }
+}
+
+void UpstreamPool::Reclaim(uint64_t nowMs) {
+    // 旧快照都已释放，不在当前快照中的地址只可能被连接持有，连接计数为0时不会再有人访问
+    for (auto it = _endpoints.begin(); it != _endpoints.end();) {
+        const EndpointEntry& entry = it->second;
+        if (entry.absentSinceMs != 0 && nowMs - entry.absentSinceMs >= kEndpointRetainMs &&
+            entry.endpoint->active.load(std::memory_order_acquire) == 0) {
+            LOG_DEBUG("Upstream %s removed after %llu ms absent", entry.endpoint->name.c_str(), (unsigned long long)(nowMs - entry.absentSinceMs));
+            it = _endpoints.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+size_t UpstreamPool::Size() const {
+    ReaderScope reader(EnterReader());
+    const Snapshot* snapshot = _current.load(std::memory_order_seq_cst);
+    return snapshot != nullptr ? snapshot->endpoints.size() : 0;
+}
+
+UpstreamEndpoint* UpstreamPool::Select(uint64_t clientHash, const UpstreamEndpoint* exclude, uint64_t nowMs) {
+    ReaderScope reader(EnterReader());
+    const Snapshot* snapshot = _current.load(std::memory_order_seq_cst);
+    if (snapshot == nullptr || snapshot->endpoints.empty()) {
+        return nullptr;
+    }
+    const std::vector<UpstreamEndpoint*>& endpoints = snapshot->endpoints;
+    size_t count = endpoints.size();
+    UpstreamEndpoint* chosen = nullptr;
+
+    // 第一轮只考虑健康的地址，第二轮在全部不可用时放宽条件，仍然尝试连接
+    for (int pass = 0; pass < 2 && chosen == nullptr; ++pass) {
+        bool anyHealth = pass == 1;
+        switch (_options.mode) {
+        case BalanceMode::ConsistentHash: {
+            // rendezvous hashing：得分最高的地址胜出，地址增减时只有少数客户端会换到别的地址
+            uint64_t bestScore = 0;
+            for (UpstreamEndpoint* endpoint : endpoints) {
+                if (endpoint == exclude || (!anyHealth && !endpoint->Healthy(nowMs))) continue;
+                uint64_t score = Mix64(clientHash ^ endpoint->hash);
+                if (chosen == nullptr || score > bestScore) {
+                    chosen = endpoint;
+                    bestScore = score;
+                }
+            }
+            break;
+        }
+        case BalanceMode::LeastConnections: {
+            // 从轮询位置开始扫描，连接数相同时也能分散到不同地址
+            size_t start = _next.fetch_add(1, std::memory_order_relaxed);
+            uint32_t bestActive = 0;
+            for (size_t i = 0; i < count; ++i) {
+                UpstreamEndpoint* endpoint = endpoints[(start + i) % count];
+                if (endpoint == exclude || (!anyHealth && !endpoint->Healthy(nowMs))) continue;
+                uint32_t active = endpoint->active.load(std::memory_order_relaxed);
+                if (chosen == nullptr || active < bestActive) {
+                    chosen = endpoint;
+                    bestActive = active;
+                }
+            }
+            break;
+        }
+        default: {
+            // 在可用的地址中按序号轮询，而不是跳到不可用地址的下一个，避免下一个地址承担双倍负载
+            size_t usable = 0;
+            for (UpstreamEndpoint* endpoint : endpoints) {
+                if (endpoint != exclude && (anyHealth || endpoint->Healthy(nowMs))) ++usable;
+            }
+            if (usable == 0) break;
+            size_t target = _next.fetch_add(1, std::memory_order_relaxed) % usable;
+            for (UpstreamEndpoint* endpoint : endpoints) {
+                if (endpoint == exclude || (!anyHealth && !endpoint->Healthy(nowMs))) continue;
+                if (target-- == 0) {
+                    chosen = endpoint;
+                    break;
+                }
+            }
+            break;
+        }
+        }
+    }
+    if (chosen == nullptr) {
+        chosen = endpoints[0];  // 只有一个地址且刚刚失败，仍然重试它
+    }
+    chosen->active.fetch_add(1, std::memory_order_relaxed);
+    return chosen;
+}
+
+size_t UpstreamPool::EndpointCount() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _endpoints.size();
+}
+
+void UpstreamPool::Release(UpstreamEndpoint* endpoint) {
+    endpoint->active.fetch_sub(1, std::memory_order_release);  // 计数归0后地址对象可能被解析线程释放
+}
+
+void UpstreamPool::ReportSuccess(UpstreamEndpoint* endpoint) {
+    if (endpoint->failures.load(std::memory_order_relaxed) != 0) {
+        endpoint->failures.store(0, std::memory_order_relaxed);
+    }
+}
+
+void UpstreamPool::ReportFailure(UpstreamEndpoint* endpoint, uint64_t nowMs) {
+    uint32_t failures = endpoint->failures.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (_options.maxFails > 0 && failures >= _options.maxFails) {
+        if (endpoint->Healthy(nowMs)) {
+            LOG_WARN("Upstream %s marked down for %u ms after %u failure(s)", endpoint->name.c_str(), _options.failTimeoutMs, failures);
+        }
+        // 暂停一段时间后允许再次尝试；再次失败会立即重新标记
+        endpoint->downUntilMs.store(nowMs + _options.failTimeoutMs, std::memory_order_relaxed);
+        endpoint->failures.store(_options.maxFails - 1, std::memory_order_relaxed);
+    }
+}
+
+UpstreamResolver::~UpstreamResolver() {
+    Stop();
+}
+
+void UpstreamResolver::Start() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_running) {
+        return;
+    }
+    _running = true;
+    _thread = std::thread(&UpstreamResolver::Run, this);
+}
+
+void UpstreamResolver::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_running) {
+            return;
+        }
+        _running = false;
+    }
+    _condition.notify_one();
+    _thread.join();
+}
+
+void UpstreamResolver::Add(const std::shared_ptr<UpstreamPool>& pool) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _pools.push_back(pool);
+}
+
+void UpstreamResolver::Run() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (_running) {
+        _condition.wait_for(lock, std::chrono::seconds(1));
+        if (!_running) {
+            break;
+        }
+        // 复制出到期的目标池，解析期间不持有锁
+        std::vector<std::shared_ptr<UpstreamPool>> due;
+        uint64_t now = TimerWheel::NowMs();
+        for (size_t i = 0; i < _pools.size();) {
+            std::shared_ptr<UpstreamPool> pool = _pools[i].lock();
+            if (!pool) {
+                _pools[i] = _pools.back();  // 规则已被删除
+                _pools.pop_back();
+                continue;
+            }
+            if (pool->ResolveDue(now)) {
+                due.push_back(pool);
+            }
+            ++i;
+        }
+        lock.unlock();
+        for (auto& pool : due) {
+            pool->Resolve();
+        }
+        lock.lock();
+    }
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "netcompat.h"
+
+// 上游目标的选择策略
+enum class BalanceMode {
+    RoundRobin,        // 轮询
+    LeastConnections,  // 当前连接数最少
+    ConsistentHash,    // 按客户端IP做一致性哈希（rendezvous hashing），同一客户端总是落到同一目标
+};
+
+// 上游目标池的选项
+struct UpstreamOptions {
+    BalanceMode mode = BalanceMode::RoundRobin;
+    uint32_t resolveIntervalMs = 30000;  // 重新解析域名的间隔，0表示只在启动时解析一次
+    uint32_t maxFails = 3;               // 连续失败多少次后暂时标记为不可用
+    uint32_t failTimeoutMs = 10000;      // 标记为不可用的时长，之后重新尝试
+    int socktype = SOCK_STREAM;          // 解析时使用的套接字类型
+    uint32_t prewarm = 0;                // 每个工作线程预先建立的空闲TCP连接数，0表示不预连接
+    uint32_t prewarmMaxAgeMs = 30000;    // 预连接的最长空闲时间，超过后替换为新连接
+};
+
+// 数字形式的 "IP:端口"，IPv6地址加方括号
+std::string FormatAddress(const sockaddr_storage& addr);
+
+// 一个解析后的上游地址及其运行状态，可以被多个工作线程同时读写
+struct UpstreamEndpoint {
+    sockaddr_storage addr{};
+    std::string name;  // 数字形式的 "IP:端口"
+    uint64_t hash = 0;  // 地址的哈希值，一致性哈希时使用
+    std::atomic<uint32_t> active{ 0 };  // 当前使用该地址的连接（或UDP会话）数量，不为0时地址对象不会被释放
+    std::atomic<uint32_t> failures{ 0 };  // 连续失败次数
+    std::atomic<uint64_t> downUntilMs{ 0 };  // 在此之前不参与选择
+
+    bool Healthy(uint64_t nowMs) const { return downUntilMs.load(std::memory_order_relaxed) <= nowMs; }
+};
+
+// 一条转发规则的上游目标池：目标可以是多个 "主机:端口"，每个主机名可以解析出多个地址。
+// 解析结果以不可变快照的形式发布，工作线程选择目标时不加锁。
+// 连接在Select和Release之间可以一直持有地址对象的指针；从解析结果中消失一段时间、
+// 且没有连接使用的地址才会被释放
+class UpstreamPool {
+public:
+    UpstreamPool(const std::vector<std::string>& targets, const UpstreamOptions& options);
+    UpstreamPool(const UpstreamPool&) = delete;
+    UpstreamPool& operator=(const UpstreamPool&) = delete;
+
+    // 使用固定地址、不解析域名的目标池
+    static std::shared_ptr<UpstreamPool> FromAddress(const sockaddr_storage& addr, const UpstreamOptions& options = {});
+    // 把 "a:1,b:2" 形式的目标列表拆分为单个目标
+    static std::vector<std::string> SplitTargets(const std::string& targets);
+    static uint64_t HashClient(const sockaddr_storage& clientAddr);  // 只对客户端IP求哈希，不含端口
+
+    // 同步解析所有目标（阻塞），解析失败的目标保留上一次的结果；返回当前可用的地址数量
+    size_t Resolve();
+    bool ResolveDue(uint64_t nowMs) const;  // 是否到了重新解析的时间
+
+    // 为新连接选择一个地址并增加其连接计数；exclude用于重试时避开刚失败的地址。
+    // 所有地址都不可用时仍然返回其中一个，没有任何地址时返回nullptr
+    UpstreamEndpoint* Select(uint64_t clientHash, const UpstreamEndpoint* exclude, uint64_t nowMs);
+    void Release(UpstreamEndpoint* endpoint);  // 连接结束时减少连接计数
+    void ReportSuccess(UpstreamEndpoint* endpoint);
+    void ReportFailure(UpstreamEndpoint* endpoint, uint64_t nowMs);
+
+    // 发布一组已解析的地址，地址集合（不计顺序和重复）没有变化时保留当前快照；Resolve和FromAddress使用
+    void Publish(const std::vector<sockaddr_storage>& addrs, uint64_t nowMs);
+
+    size_t Size() const;  // 当前快照中的地址数量
+    uint64_t Version() const { return _version.load(std::memory_order_relaxed); }  // 发布过的快照数量
+    size_t EndpointCount() const;  // 保留的地址对象数量，包括已不在快照中、尚未释放的地址
+    const UpstreamOptions& Options() const { return _options; }
+
+private:
+    struct Snapshot {
+        std::vector<UpstreamEndpoint*> endpoints;
+    };
+
+    // 地址从解析结果中消失后保留的时长，DNS短暂抖动时连接计数和健康状态不会丢失
+    static constexpr uint64_t kEndpointRetainMs = 300000;
+
+    struct EndpointEntry {
+        std::unique_ptr<UpstreamEndpoint> endpoint;
+        uint64_t absentSinceMs = 0;  // 不在当前快照中的起始时间，0表示在当前快照中
+    };
+
+    // 读者计数的分片数：线程按首次读取的顺序分到各分片，工作线程不多于分片数时互不共享缓存行
+    static constexpr size_t kReaderSlots = 16;
+
+    // 一个分片上正在读取快照的线程数。两组计数轮流使用：发布者把新读者引到另一组，
+    // 再等待这一组归零，持续的新连接不会让等待无法结束
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint32_t> count[2]{};
+    };
+
+    std::atomic<uint32_t>& EnterReader() const;  // 在本线程的分片上登记读者，返回读取结束后要减1的计数
+    void WaitForReaders();  // 等待替换快照之前进入的读者全部离开，调用时持有_mutex
+    void Reclaim(uint64_t nowMs);  // 释放过期的地址，调用时持有_mutex
+
+    std::vector<std::string> _targets;
+    UpstreamOptions _options;
+    std::atomic<size_t> _next{ 0 };  // 轮询位置
+    std::atomic<const Snapshot*> _current{ nullptr };
+    mutable ReaderSlot _readers[kReaderSlots];
+    std::atomic<uint32_t> _readerPhase{ 0 };  // 新读者登记在 _readerPhase & 1 这一组计数上
+    std::atomic<uint64_t> _version{ 0 };
+    std::atomic<uint64_t> _nextResolveMs{ 0 };
+
+    mutable std::mutex _mutex;  // 保护以下成员，只有解析时才会获取
+    std::vector<std::vector<sockaddr_storage>> _resolved;  // 每个目标上一次的解析结果
+    std::unordered_map<std::string, EndpointEntry> _endpoints;  // 按名称索引
+    std::unique_ptr<Snapshot> _snapshot;  // 当前快照，读者离开后替换下来的旧快照立即释放
+};
+
+// 后台解析线程：定期重新解析所有目标池，getaddrinfo的阻塞不会影响事件循环
+class UpstreamResolver {
+public:
+    UpstreamResolver() = default;
+    ~UpstreamResolver();
+
+    void Start();
+    void Stop();
+    void Add(const std::shared_ptr<UpstreamPool>& pool);  // 目标池释放后自动从列表中移除
+
+private:
+    void Run();
+
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::vector<std::weak_ptr<UpstreamPool>> _pools;
+    bool _running = false;
+    std::thread _thread;
+};
@@ -0,0 +1,183 @@
+#include "WarmPool.h"
+#include "RelayEngine.h"
+#include "UpstreamPool.h"
+#include "conlog.h"
+
+WarmPool::WarmPool(RelayWorker& worker, std::shared_ptr<UpstreamPool> upstream)
+    : _worker(worker), _upstream(std::move(upstream)) {
+}
+
+WarmPool::~WarmPool() {
+    Close();
+}
+
+void WarmPool::Start() {
+    Refill();
+    _worker.Timers().Schedule(this, kCheckIntervalMs);
+}
+
+void WarmPool::Close() {
+    _closed = true;
+    Cancel();
+    while (!_entries.empty()) {
+        Discard(_entries.back().get(), false);
+    }
+}
+
+size_t WarmPool::IdleCount() const {
+    size_t count = 0;
+    for (const auto& entry : _entries) {
+        if (entry->connected) ++count;
+    }
+    return count;
+}
+
+bool WarmPool::Take(SOCKET& sock, UpstreamEndpoint*& endpoint) {
+    // 优先取最早建立的连接，越新的连接离超龄越远
+    for (size_t i = 0; i < _entries.size(); ++i) {
+        Entry* entry = _entries[i].get();
+        if (!entry->connected) {
+            continue;
+        }
+        _worker.GetPoller().Remove(entry->sock);
+        sock = entry->sock;
+        endpoint = entry->endpoint;
+        entry->sock = INVALID_SOCKET;
+        entry->endpoint = nullptr;
+        _worker.RetireHandler(std::move(_entries[i]));  // 同一批事件中可能还有它的回调，延迟释放
+        _entries.erase(_entries.begin() + (ptrdiff_t)i);
+        Refill();  // 立即补充，为下一个客户端做准备
+        return true;
+    }
+    return false;
+}
+
+void WarmPool::Refill() {
+    uint32_t target = _upstream->Options().prewarm;
+    if (_closed || _worker.LoopTimeMs() < _retryAtMs) {
+        return;
+    }
+    while (_entries.size() < target && Open()) {
+    }
+}
+
+bool WarmPool::Open() {
+    UpstreamEndpoint* endpoint = _upstream->Select(0, nullptr, _worker.LoopTimeMs());
+    if (endpoint == nullptr) {
+        return false;  // 目标池为空，等待下一次检查
+    }
+    auto entry = std::make_unique<Entry>();
+    entry->pool = this;
+    entry->endpoint = endpoint;
+    entry->createdMs = _worker.LoopTimeMs();
+    entry->sock = socket(endpoint->addr.ss_family, SOCK_STREAM, IPPROTO_TCP);
+    if (entry->sock == INVALID_SOCKET || !SetNonBlocking(entry->sock)) {
+        LogSocketError(GetLastSocketError());
+        _entries.push_back(std::move(entry));
+        Discard(_entries.back().get(), false);
+        return false;
+    }
+
+    Entry* raw = entry.get();
+    _entries.push_back(std::move(entry));
+    if (connect(raw->sock, (const sockaddr*)&endpoint->addr, SockaddrLength(endpoint->addr)) == SOCKET_ERROR) {
+        int err = GetLastSocketError();
+        if (!IsConnectInProgress(err)) {
+            LogSocketError(err);
+            Discard(raw, true);
+            return false;
+        }
+        if (!_worker.GetPoller().Add(raw->sock, PollOut, raw)) {  // 等待连接完成
+            Discard(raw, false);
+            return false;
+        }
+        return true;
+    }
+    // 回环地址上connect可能立即完成
+    raw->connected = true;
+    _upstream->ReportSuccess(endpoint);
+    if (!_worker.GetPoller().Add(raw->sock, PollIn, raw)) {
+        Discard(raw, false);
+        return false;
+    }
+    return true;
+}
+
+void WarmPool::OnEntryEvents(Entry* entry, uint32_t events) {
+    if (entry->sock == INVALID_SOCKET) {
+        return;  // 同一批事件中已被取走或关闭
+    }
+
+    if (!entry->connected) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(entry->sock, SOL_SOCKET, SO_ERROR, (char*)&err, &len);
+        if (err != 0) {
+            LogSocketError(err);  // 记录连接目标服务器失败的错误信息
+            Discard(entry, true);
+            return;
+        }
+        if (events & (PollOut | PollErr | PollHup)) {
+            entry->connected = true;
+            _failures = 0;
+            _upstream->ReportSuccess(entry->endpoint);
+            _worker.GetPoller().Modify(entry->sock, PollIn, entry);  // 空闲期间只关心对端是否关闭
+        }
+        return;
+    }
+
+    // 空闲连接可读：要么目标关闭了连接，要么是先发数据的协议（如SMTP的欢迎信息）
+    char byte;
+    int len = recv(entry->sock, &byte, 1, MSG_PEEK);
+    if (len > 0 && !(events & (PollErr | PollHup))) {
+        // 数据留在套接字中，配对后会转发给客户端；不再监听可读，避免水平触发反复通知
+        _worker.GetPoller().Modify(entry->sock, 0, entry);
+        return;
+    }
+    if (len == SOCKET_ERROR && IsWouldBlock(GetLastSocketError())) {
+        return;
+    }
+    LOG_DEBUG("Idle upstream connection to %s closed by peer.", entry->endpoint->name.c_str());
+    Discard(entry, false);
+    Refill();
+}
+
+void WarmPool::Discard(Entry* entry, bool failed) {
+    if (entry->sock != INVALID_SOCKET) {
+        _worker.GetPoller().Remove(entry->sock);
+        closesocket(entry->sock);
+        entry->sock = INVALID_SOCKET;
+    }
+    if (entry->endpoint != nullptr) {
+        if (failed) {
+            _upstream->ReportFailure(entry->endpoint, _worker.LoopTimeMs());
+            // 连续失败时逐步延长补充间隔，避免目标不可用时反复连接
+            uint64_t backoff = (uint64_t)100 << (_failures < 6 ? _failures : 6);
+            _retryAtMs = _worker.LoopTimeMs() + (backoff < kMaxBackoffMs ? backoff : kMaxBackoffMs);
+            ++_failures;
+        }
+        _upstream->Release(entry->endpoint);
+        entry->endpoint = nullptr;
+    }
+    for (size_t i = 0; i < _entries.size(); ++i) {
+        if (_entries[i].get() == entry) {
+            _worker.RetireHandler(std::move(_entries[i]));
+            _entries.erase(_entries.begin() + (ptrdiff_t)i);
+            break;
+        }
+    }
+}
+
+void WarmPool::OnTimer() {
+    uint64_t now = _worker.LoopTimeMs();
+    uint32_t maxAgeMs = _upstream->Options().prewarmMaxAgeMs;
+    // 目标服务器通常会关闭长时间空闲的连接，超龄的连接主动替换掉
+    for (size_t i = _entries.size(); i-- > 0;) {
+        Entry* entry = _entries[i].get();
+        if (entry->connected && maxAgeMs > 0 && now - entry->createdMs >= maxAgeMs) {
+            Discard(entry, false);
+        }
+    }
+    Refill();
+    _worker.Timers().Schedule(this, kCheckIntervalMs);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "netcompat.h"
+#include "Poller.h"
+#include "TimerWheel.h"
+
+class RelayWorker;
+class UpstreamPool;
+struct UpstreamEndpoint;
+
+// 一个工作线程上某条规则的预连接池：提前建立到目标的空闲TCP连接，
+// 新客户端到达时直接取用，省去一次与目标之间的握手。只能在所属工作线程内使用
+class WarmPool : public Timer {
+public:
+    WarmPool(RelayWorker& worker, std::shared_ptr<UpstreamPool> upstream);
+    ~WarmPool() override;
+    WarmPool(const WarmPool&) = delete;
+    WarmPool& operator=(const WarmPool&) = delete;
+
+    void Start();
+    void Close();  // 关闭所有空闲连接
+
+    // 取出一个已经建立好的连接，套接字已从Poller中移除，连接计数随之转移给调用者；没有时返回false
+    bool Take(SOCKET& sock, UpstreamEndpoint*& endpoint);
+
+    void OnTimer() override;  // 淘汰超龄连接并补足数量
+
+    size_t IdleCount() const;
+
+private:
+    static constexpr uint64_t kCheckIntervalMs = 1000;  // 检查超龄连接的间隔
+    static constexpr uint64_t kMaxBackoffMs = 5000;     // 连续连接失败后补充连接的最长等待时间
+
+    // 一条预连接
+    struct Entry : PollHandler {
+        WarmPool* pool = nullptr;
+        SOCKET sock = INVALID_SOCKET;
+        UpstreamEndpoint* endpoint = nullptr;
+        uint64_t createdMs = 0;
+        bool connected = false;
+        void HandleEvents(uint32_t events) override { pool->OnEntryEvents(this, events); }
+    };
+
+    void Refill();
+    bool Open();
+    void OnEntryEvents(Entry* entry, uint32_t events);
+    void Discard(Entry* entry, bool failed);  // 关闭并移除一条连接，failed表示连接目标失败
+
+    RelayWorker& _worker;
+    std::shared_ptr<UpstreamPool> _upstream;
+    std::vector<std::unique_ptr<Entry>> _entries;  // 正在连接和空闲的连接，数量很少，线性查找即可
+    uint32_t _failures = 0;  // 连续连接失败的次数
+    uint64_t _retryAtMs = 0;  // 连续失败后，在此之前不补充连接
+    bool _closed = false;
+};
@@ -0,0 +1,690 @@
+// 转发程序的负载基准测试：在进程内启动中继引擎和生成的转发规则，在回环地址上运行回显/丢弃服务器和多线程负载客户端，
+// 依次测量每千个空闲连接的内存（RSS）、每秒新建连接数、小消息往返延迟（p50/p99/p999）、TCP大流量吞吐量和UDP每秒数据报数，
+// 结果输出为表格，并可以写成JSON文件，用于在同一台机器上比较不同构建的结果：
+//   ./LoadBench --json before.json --label before
+//   ./LoadBench --mode buffer --workers 4 --duration 3000 --cases rr,bulk
+// 仅支持Linux，构建示例（也可以用仓库根目录的CMake构建bench目标）：
+//   g++ -std=c++20 -O2 -I.. LoadBench.cpp ../IoUring.cpp ../Poller.cpp ../RateLimiter.cpp ../RelayEngine.cpp ../TcpConnection.cpp ../TcpListener.cpp ../UdpRelay.cpp ../UpstreamPool.cpp ../WarmPool.cpp ../PortRoutes.cpp ../ProxyProtocol.cpp ../TimerWheel.cpp ../BufferPool.cpp ../Metrics.cpp ../conlog.cpp ../errlog.cpp -pthread -o load_bench
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/utsname.h>
+#include "../RelayEngine.h"
+#include "../conlog.h"
+
+static constexpr size_t kRrMessageSize = 64;    // 往返测试的消息大小
+static constexpr size_t kBulkChunk = 65536;     // 吞吐量测试每次发送的字节数
+static constexpr size_t kUdpPayload = 64;       // UDP测试的数据报大小
+static constexpr int kUdpBatch = 32;            // UDP发送端和接收端每次sendmmsg/recvmmsg的数据报数量
+static constexpr int kFdsPerConnection = 8;     // 空闲连接测试中每个连接占用的描述符：客户端、服务端、转发两端和两个管道
+static constexpr int kWarmupMs = 100;           // 每组测试开始计时前的预热时间
+
+struct BenchConfig {
+    std::string mode = "splice";  // splice、buffer或io_uring
+    size_t workers = 2;
+    int rules = 4;            // 每组测试生成的转发规则数量，客户端轮流连接各条规则
+    int clients = 16;         // 新建连接、往返和UDP测试的客户端线程数
+    int bulkConnections = 4;
+    int idleConnections = 2000;
+    int durationMs = 2000;
+    int serverThreads = 2;    // 回显/丢弃服务器的事件循环线程数
+    std::string cases = "idle,connect,rr,bulk,udp";
+    std::string jsonPath;     // 为空时不写JSON
+    std::string label;        // 写入JSON，用于区分不同的构建
+};
+
+// 一组测试的结果：按顺序排列的字段，同时用于表格和JSON
+struct CaseResult {
+    std::string name;
+    std::vector<std::pair<std::string, double>> fields;
+};
+
+static sockaddr_storage LoopbackAddr(uint16_t port) {
+    sockaddr_storage addr{};
+    sockaddr_in& in4 = (sockaddr_in&)addr;
+    in4.sin_family = AF_INET;
+    in4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    in4.sin_port = htons(port);
+    return addr;
+}
+
+// 创建绑定到回环地址的套接字，port为0时随机选择端口并写回；reusePort用于多个服务线程共享同一端口
+static SOCKET BindLoopback(int type, uint16_t& port, bool reusePort = false) {
+    SOCKET sock = socket(AF_INET, type, 0);
+    int one = 1;
+    if (reusePort) {
+        setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    }
+    sockaddr_storage addr = LoopbackAddr(port);
+    if (bind(sock, (sockaddr*)&addr, sizeof(sockaddr_in)) == SOCKET_ERROR) {
+        fprintf(stderr, "bind failed: %s\n", strerror(errno));
+        exit(1);
+    }
+    socklen_t len = sizeof(sockaddr_in);
+    getsockname(sock, (sockaddr*)&addr, &len);
+    port = ntohs(((sockaddr_in&)addr).sin_port);
+    if (type == SOCK_STREAM) {
+        listen(sock, 4096);
+    }
+    return sock;
+}
+
+static SOCKET ConnectTcp(uint16_t port) {
+    SOCKET sock = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_storage addr = LoopbackAddr(port);
+    if (connect(sock, (sockaddr*)&addr, sizeof(sockaddr_in)) == SOCKET_ERROR) {
+        closesocket(sock);
+        return INVALID_SOCKET;
+    }
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return sock;
+}
+
+static bool RecvExactly(SOCKET sock, char* data, size_t size) {
+    for (size_t got = 0; got < size;) {
+        ssize_t len = recv(sock, data + got, size - got, 0);
+        if (len <= 0) {
+            return false;
+        }
+        got += (size_t)len;
+    }
+    return true;
+}
+
+static uint64_t ReadRssKb() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) {
+            return strtoull(line.c_str() + 6, nullptr, 10);
+        }
+    }
+    return 0;
+}
+
+static double Percentile(std::vector<uint32_t>& samples, double fraction) {
+    if (samples.empty()) {
+        return 0;
+    }
+    size_t index = (size_t)(fraction * (double)(samples.size() - 1));
+    std::nth_element(samples.begin(), samples.begin() + (ptrdiff_t)index, samples.end());
+    return samples[index];
+}
+
+// 回环上的目标服务器：多个事件循环线程，各自持有一个SO_REUSEPORT监听套接字，由内核分配连接。
+// 连接对象只有几十字节、没有线程，空闲连接测试测得的内存基本都来自转发端
+class LoopbackServer {
+public:
+    enum class Kind { Echo, Sink };
+
+    LoopbackServer(Kind kind, int threads) : _kind(kind) {
+        for (int i = 0; i < threads; ++i) {
+            _loops.push_back(std::make_unique<Loop>(this));
+            _loops.back()->listener.sock = BindLoopback(SOCK_STREAM, _port, true);
+        }
+        for (auto& loop : _loops) {
+            SetNonBlocking(loop->listener.sock);
+            loop->poller.Add(loop->listener.sock, PollIn, &loop->listener);
+            loop->thread = std::thread(&Loop::Run, loop.get());
+        }
+    }
+
+    ~LoopbackServer() {
+        _running = false;
+        for (auto& loop : _loops) {
+            loop->poller.Wakeup();
+            loop->thread.join();
+        }
+    }
+
+    uint16_t Port() const { return _port; }
+    uint64_t Accepted() const { return _accepted.load(std::memory_order_relaxed); }
+    uint64_t Bytes() const { return _bytes.load(std::memory_order_relaxed); }
+
+private:
+    struct Loop;
+
+    struct Connection : PollHandler {
+        Loop* loop = nullptr;
+        SOCKET sock = INVALID_SOCKET;
+        void HandleEvents(uint32_t /*events*/) override { loop->OnReadable(this); }
+    };
+
+    struct Listener : PollHandler {
+        Loop* loop = nullptr;
+        SOCKET sock = INVALID_SOCKET;
+        void HandleEvents(uint32_t /*events*/) override { loop->OnAccept(); }
+    };
+
+    struct Loop {
+        explicit Loop(LoopbackServer* owner) : server(owner) { listener.loop = this; }
+        ~Loop() {
+            for (auto& connection : connections) {
+                closesocket(connection->sock);
+            }
+            closesocket(listener.sock);
+        }
+
+        void Run() {
+            std::vector<PollResult> results;
+            while (server->_running) {
+                poller.Wait(results, 100);
+                for (const PollResult& result : results) {
+                    result.handler->HandleEvents(result.events);
+                }
+                retired.clear();
+            }
+        }
+
+        void OnAccept() {
+            for (;;) {
+                SOCKET sock = accept4(listener.sock, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (sock == INVALID_SOCKET) {
+                    return;
+                }
+                int one = 1;
+                setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                auto connection = std::make_unique<Connection>();
+                connection->loop = this;
+                connection->sock = sock;
+                poller.Add(sock, PollIn, connection.get());
+                connections.push_back(std::move(connection));
+                server->_accepted.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        void OnReadable(Connection* connection) {
+            ssize_t len;
+            while ((len = recv(connection->sock, buffer, sizeof(buffer), 0)) > 0) {
+                server->_bytes.fetch_add((uint64_t)len, std::memory_order_relaxed);
+                // 回显的都是小消息，发送缓冲区不会满；写不完时按出错处理
+                if (server->_kind == Kind::Echo && send(connection->sock, buffer, (size_t)len, MSG_NOSIGNAL) != len) {
+                    break;
+                }
+            }
+            if (len < 0 && IsWouldBlock(errno)) {
+                return;
+            }
+            poller.Remove(connection->sock);
+            closesocket(connection->sock);
+            auto it = std::find_if(connections.begin(), connections.end(), [&](const auto& c) { return c.get() == connection; });
+            std::swap(*it, connections.back());
+            retired.push_back(std::move(connections.back()));  // 同一批事件中可能还有它的事件
+            connections.pop_back();
+        }
+
+        LoopbackServer* server;
+        Poller poller;
+        Listener listener;
+        std::thread thread;
+        std::vector<std::unique_ptr<Connection>> connections;
+        std::vector<std::unique_ptr<Connection>> retired;
+        char buffer[kBulkChunk];
+    };
+
+    Kind _kind;
+    uint16_t _port = 0;
+    std::atomic<bool> _running{ true };
+    std::atomic<uint64_t> _accepted{ 0 };
+    std::atomic<uint64_t> _bytes{ 0 };
+    std::vector<std::unique_ptr<Loop>> _loops;
+};
+
+// UDP丢弃服务器：多个线程各自持有一个SO_REUSEPORT套接字，批量接收并计数
+class UdpSinkServer {
+public:
+    explicit UdpSinkServer(int threads) {
+        for (int i = 0; i < threads; ++i) {
+            SOCKET sock = BindLoopback(SOCK_DGRAM, _port, true);
+            timeval timeout{ 0, 100000 };
+            setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            _threads.emplace_back([this, sock] {
+                char buffers[kUdpBatch][2048];
+                iovec iov[kUdpBatch];
+                mmsghdr messages[kUdpBatch] = {};
+                for (int j = 0; j < kUdpBatch; ++j) {
+                    iov[j] = { buffers[j], sizeof(buffers[j]) };
+                    messages[j].msg_hdr.msg_iov = &iov[j];
+                    messages[j].msg_hdr.msg_iovlen = 1;
+                }
+                while (_running) {
+                    int count = recvmmsg(sock, messages, kUdpBatch, MSG_WAITFORONE, nullptr);
+                    if (count > 0) {
+                        _packets.fetch_add((uint64_t)count, std::memory_order_relaxed);
+                    }
+                }
+                closesocket(sock);
+            });
+        }
+    }
+
+    ~UdpSinkServer() {
+        _running = false;
+        for (std::thread& thread : _threads) {
+            thread.join();
+        }
+    }
+
+    uint16_t Port() const { return _port; }
+    uint64_t Packets() const { return _packets.load(std::memory_order_relaxed); }
+
+private:
+    uint16_t _port = 0;
+    std::atomic<bool> _running{ true };
+    std::atomic<uint64_t> _packets{ 0 };
+    std::vector<std::thread> _threads;
+};
+
+class LoadBench {
+public:
+    explicit LoadBench(const BenchConfig& config) : _config(config) {}
+
+    bool Start() {
+        RelayOptions options;
+        options.useSplice = _config.mode == "splice";
+        options.useIoUring = _config.mode == "io_uring";
+        if (options.useIoUring && !IoUring::Supported()) {
+            printf("io_uring is not supported by this kernel, the engine falls back to epoll\n");
+        }
+        return _engine.Start(_config.workers, options);
+    }
+
+    void Stop() { _engine.Stop(); }
+
+    // 打开idleConnections个经过转发的空闲连接，比较打开前后的RSS
+    CaseResult RunIdle() {
+        LoopbackServer server(LoopbackServer::Kind::Echo, _config.serverThreads);
+        std::vector<uint16_t> ports;
+        auto rules = AddTcpRules(server.Port(), ports);
+        std::this_thread::sleep_for(std::chrono::milliseconds(kWarmupMs));
+        uint64_t rssBefore = ReadRssKb();
+
+        std::vector<SOCKET> clients;
+        clients.reserve((size_t)_config.idleConnections);
+        for (int i = 0; i < _config.idleConnections; ++i) {
+            SOCKET sock = ConnectTcp(ports[(size_t)i % ports.size()]);
+            if (sock == INVALID_SOCKET) {
+                break;
+            }
+            clients.push_back(sock);
+        }
+        // 目标服务器接受了全部连接时，转发端的两侧都已建立
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (server.Accepted() < clients.size() && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(kWarmupMs));
+        uint64_t rssAfter = ReadRssKb();
+        size_t established = (size_t)server.Accepted();
+
+        for (SOCKET sock : clients) {
+            closesocket(sock);
+        }
+        RemoveRules(rules);
+
+        CaseResult result{ "idle", {} };
+        result.fields.push_back({ "connections", (double)established });
+        result.fields.push_back({ "rss_before_kb", (double)rssBefore });
+        result.fields.push_back({ "rss_after_kb", (double)rssAfter });
+        double perThousand = established > 0 && rssAfter > rssBefore ? (double)(rssAfter - rssBefore) * 1000.0 / (double)established : 0;
+        result.fields.push_back({ "rss_kb_per_1k_connections", perThousand });
+        return result;
+    }
+
+    // 每个客户端线程循环：连接、发送一个字节、等待回显、以RST关闭（客户端不留下TIME_WAIT）
+    CaseResult RunConnect() {
+        LoopbackServer server(LoopbackServer::Kind::Echo, _config.serverThreads);
+        std::vector<uint16_t> ports;
+        auto rules = AddTcpRules(server.Port(), ports);
+        std::atomic<bool> measuring{ false }, running{ true };
+        std::atomic<uint64_t> completed{ 0 }, failed{ 0 };
+        std::vector<std::thread> threads;
+        for (int i = 0; i < _config.clients; ++i) {
+            threads.emplace_back([&, i] {
+                size_t next = (size_t)i;
+                while (running) {
+                    SOCKET sock = ConnectTcp(ports[next++ % ports.size()]);
+                    char byte = 'c';
+                    bool ok = sock != INVALID_SOCKET && send(sock, &byte, 1, MSG_NOSIGNAL) == 1 && RecvExactly(sock, &byte, 1);
+                    if (sock != INVALID_SOCKET) {
+                        linger abort{ 1, 0 };
+                        setsockopt(sock, SOL_SOCKET, SO_LINGER, &abort, sizeof(abort));
+                        closesocket(sock);
+                    }
+                    if (measuring) {
+                        (ok ? completed : failed).fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+            });
+        }
+        double seconds = Measure(measuring);
+        running = false;
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        RemoveRules(rules);
+
+        CaseResult result{ "connect", {} };
+        result.fields.push_back({ "connections_per_sec", (double)completed / seconds });
+        result.fields.push_back({ "failed", (double)failed });
+        return result;
+    }
+
+    // 每个客户端一个长连接，循环发送一条小消息并等待完整的回显，记录每次往返的耗时
+    CaseResult RunRoundTrip() {
+        LoopbackServer server(LoopbackServer::Kind::Echo, _config.serverThreads);
+        std::vector<uint16_t> ports;
+        auto rules = AddTcpRules(server.Port(), ports);
+        std::atomic<bool> measuring{ false }, running{ true };
+        std::vector<std::vector<uint32_t>> samples((size_t)_config.clients);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < _config.clients; ++i) {
+            threads.emplace_back([&, i] {
+                SOCKET sock = ConnectTcp(ports[(size_t)i % ports.size()]);
+                char message[kRrMessageSize] = {};
+                while (running && sock != INVALID_SOCKET) {
+                    auto start = std::chrono::steady_clock::now();
+                    if (send(sock, message, sizeof(message), MSG_NOSIGNAL) != (ssize_t)sizeof(message) ||
+                        !RecvExactly(sock, message, sizeof(message))) {
+                        break;
+                    }
+                    if (measuring) {
+                        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+                        samples[(size_t)i].push_back((uint32_t)elapsed.count());
+                    }
+                }
+                closesocket(sock);
+            });
+        }
+        double seconds = Measure(measuring);
+        running = false;
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        RemoveRules(rules);
+
+        std::vector<uint32_t> all;
+        for (auto& clientSamples : samples) {
+            all.insert(all.end(), clientSamples.begin(), clientSamples.end());
+        }
+        CaseResult result{ "rr", {} };
+        result.fields.push_back({ "requests_per_sec", (double)all.size() / seconds });
+        result.fields.push_back({ "p50_us", Percentile(all, 0.50) });
+        result.fields.push_back({ "p99_us", Percentile(all, 0.99) });
+        result.fields.push_back({ "p999_us", Percentile(all, 0.999) });
+        return result;
+    }
+
+    // 多个连接持续向丢弃服务器发送数据，按服务器收到的字节数计算吞吐量
+    CaseResult RunBulk() {
+        LoopbackServer server(LoopbackServer::Kind::Sink, _config.serverThreads);
+        std::vector<uint16_t> ports;
+        auto rules = AddTcpRules(server.Port(), ports);
+        std::atomic<bool> running{ true };
+        std::vector<std::thread> threads;
+        for (int i = 0; i < _config.bulkConnections; ++i) {
+            threads.emplace_back([&, i] {
+                SOCKET sock = ConnectTcp(ports[(size_t)i % ports.size()]);
+                std::vector<char> chunk(kBulkChunk, 'x');
+                while (running && sock != INVALID_SOCKET && send(sock, chunk.data(), chunk.size(), MSG_NOSIGNAL) > 0) {}
+                closesocket(sock);
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(kWarmupMs));
+        uint64_t startBytes = server.Bytes();
+        auto start = std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(_config.durationMs));
+        double bytes = (double)(server.Bytes() - startBytes);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        running = false;
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        RemoveRules(rules);
+
+        CaseResult result{ "bulk", {} };
+        result.fields.push_back({ "mb_per_sec", bytes / seconds / (1024 * 1024) });
+        return result;
+    }
+
+    // 每个客户端一个UDP会话，用sendmmsg尽量快地发送，按丢弃服务器收到的数据报计算转发速率
+    CaseResult RunUdp() {
+        UdpSinkServer server(_config.serverThreads);
+        std::vector<std::shared_ptr<RelayRule>> rules;
+        std::vector<uint16_t> ports;
+        for (int i = 0; i < _config.rules; ++i) {
+            uint16_t port = 0;
+            SOCKET sock = BindLoopback(SOCK_DGRAM, port);
+            auto rule = std::make_shared<RelayRule>("udp-" + std::to_string(i), UpstreamPool::FromAddress(LoopbackAddr(server.Port())), _engine.WorkerCount());
+            _engine.AddUDP(sock, rule);
+            rules.push_back(rule);
+            ports.push_back(port);
+        }
+        std::atomic<bool> measuring{ false }, running{ true };
+        std::atomic<uint64_t> sent{ 0 };
+        std::vector<std::thread> threads;
+        for (int i = 0; i < _config.clients; ++i) {
+            threads.emplace_back([&, i] {
+                SOCKET sock = socket(AF_INET, SOCK_DGRAM, 0);
+                sockaddr_storage addr = LoopbackAddr(ports[(size_t)i % ports.size()]);
+                connect(sock, (sockaddr*)&addr, sizeof(sockaddr_in));
+                char payload[kUdpPayload] = {};
+                iovec iov{ payload, sizeof(payload) };
+                mmsghdr messages[kUdpBatch] = {};
+                for (mmsghdr& message : messages) {
+                    message.msg_hdr.msg_iov = &iov;
+                    message.msg_hdr.msg_iovlen = 1;
+                }
+                while (running) {
+                    int count = sendmmsg(sock, messages, kUdpBatch, 0);
+                    if (count > 0 && measuring) {
+                        sent.fetch_add((uint64_t)count, std::memory_order_relaxed);
+                    }
+                }
+                closesocket(sock);
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(kWarmupMs));
+        uint64_t startPackets = server.Packets();
+        double seconds = Measure(measuring);
+        double packets = (double)(server.Packets() - startPackets);
+        running = false;
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        for (auto& rule : rules) {
+            _engine.RemoveRule(rule, 0, false);
+        }
+
+        CaseResult result{ "udp", {} };
+        result.fields.push_back({ "packets_per_sec", packets / seconds });
+        result.fields.push_back({ "sent_per_sec", (double)sent / seconds });
+        result.fields.push_back({ "delivered_ratio", sent > 0 ? packets / (double)sent : 0 });
+        return result;
+    }
+
+private:
+    std::vector<std::shared_ptr<RelayRule>> AddTcpRules(uint16_t targetPort, std::vector<uint16_t>& ports) {
+        std::vector<std::shared_ptr<RelayRule>> rules;
+        for (int i = 0; i < _config.rules; ++i) {
+            uint16_t port = 0;
+            SOCKET sock = BindLoopback(SOCK_STREAM, port);
+            auto rule = std::make_shared<RelayRule>("tcp-" + std::to_string(i), UpstreamPool::FromAddress(LoopbackAddr(targetPort)), _engine.WorkerCount());
+            _engine.AddTCPListener(sock, rule);
+            rules.push_back(rule);
+            ports.push_back(port);
+        }
+        return rules;
+    }
+
+    void RemoveRules(const std::vector<std::shared_ptr<RelayRule>>& rules) {
+        for (auto& rule : rules) {
+            _engine.RemoveRule(rule, 0, false);
+        }
+    }
+
+    // 预热后打开计数开关，持续durationMs，返回实际经过的秒数
+    double Measure(std::atomic<bool>& measuring) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(kWarmupMs));
+        measuring = true;
+        auto start = std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(_config.durationMs));
+        measuring = false;
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    BenchConfig _config;
+    RelayEngine _engine;
+};
+
+static std::string JsonString(const std::string& value) {
+    std::string out = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') out += '\\';
+        if ((unsigned char)c < 0x20) continue;
+        out += c;
+    }
+    return out + "\"";
+}
+
+static std::string FormatJson(const BenchConfig& config, const std::vector<CaseResult>& results) {
+    char time[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(time, sizeof(time), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+    utsname host{};
+    uname(&host);
+
+    std::string out = "{\n";
+    out += "  \"benchmark\": \"LoadBench\",\n";
+    out += "  \"label\": " + JsonString(config.label) + ",\n";
+    out += "  \"time\": " + JsonString(time) + ",\n";
+    out += "  \"host\": { \"kernel\": " + JsonString(host.release) + ", \"cpus\": " + std::to_string(std::thread::hardware_concurrency()) + " },\n";
+    out += "  \"config\": { \"mode\": " + JsonString(config.mode) + ", \"workers\": " + std::to_string(config.workers) +
+        ", \"rules\": " + std::to_string(config.rules) + ", \"clients\": " + std::to_string(config.clients) +
+        ", \"bulk_connections\": " + std::to_string(config.bulkConnections) + ", \"idle_connections\": " + std::to_string(config.idleConnections) +
+        ", \"duration_ms\": " + std::to_string(config.durationMs) + " },\n";
+    out += "  \"results\": {";
+    for (size_t i = 0; i < results.size(); ++i) {
+        out += i == 0 ? "\n" : ",\n";
+        out += "    " + JsonString(results[i].name) + ": {";
+        for (size_t j = 0; j < results[i].fields.size(); ++j) {
+            char value[64];
+            snprintf(value, sizeof(value), "%.6g", results[i].fields[j].second);
+            out += (j == 0 ? " " : ", ") + JsonString(results[i].fields[j].first) + ": " + value;
+        }
+        out += " }";
+    }
+    out += "\n  }\n}\n";
+    return out;
+}
+
+static void PrintUsage() {
+    printf("usage: LoadBench [--mode splice|buffer|io_uring] [--workers N] [--rules N] [--clients N]\n"
+        "                 [--bulk-connections N] [--idle N] [--duration MS] [--server-threads N]\n"
+        "                 [--cases idle,connect,rr,bulk,udp] [--json FILE] [--label TEXT]\n");
+}
+
+static bool ParseArgs(int argc, char* argv[], BenchConfig& config) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        const char* value = argv[++i];
+        if (arg == "--mode") config.mode = value;
+        else if (arg == "--workers") config.workers = (size_t)atoi(value);
+        else if (arg == "--rules") config.rules = std::max(1, atoi(value));
+        else if (arg == "--clients") config.clients = std::max(1, atoi(value));
+        else if (arg == "--bulk-connections") config.bulkConnections = std::max(1, atoi(value));
+        else if (arg == "--idle") config.idleConnections = std::max(0, atoi(value));
+        else if (arg == "--duration") config.durationMs = std::max(100, atoi(value));
+        else if (arg == "--server-threads") config.serverThreads = std::max(1, atoi(value));
+        else if (arg == "--cases") config.cases = value;
+        else if (arg == "--json") config.jsonPath = value;
+        else if (arg == "--label") config.label = value;
+        else return false;
+    }
+    return config.mode == "splice" || config.mode == "buffer" || config.mode == "io_uring";
+}
+
+static bool HasCase(const std::string& cases, const char* name) {
+    return ("," + cases + ",").find("," + std::string(name) + ",") != std::string::npos;
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    if (!ParseArgs(argc, argv, config)) {
+        PrintUsage();
+        return 2;
+    }
+
+    // 空闲连接测试需要大量描述符，提高到硬限制，仍然不够时减少连接数
+    rlimit limit{};
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    getrlimit(RLIMIT_NOFILE, &limit);
+    int maxIdle = (int)std::min<rlim_t>(limit.rlim_cur / kFdsPerConnection, 1 << 20) - 128;
+    if (config.idleConnections > maxIdle) {
+        printf("file descriptor limit %llu allows only %d idle connections\n", (unsigned long long)limit.rlim_cur, std::max(maxIdle, 0));
+        config.idleConnections = std::max(maxIdle, 0);
+    }
+
+    StartLogger();
+    LoggerOptions logOptions;
+    logOptions.level = LogLevel::Error;
+    logOptions.console = false;
+    ConfigureLogger(logOptions);
+
+    LoadBench bench(config);
+    if (!bench.Start()) {
+        fprintf(stderr, "failed to start relay engine\n");
+        StopLogger();
+        return 1;
+    }
+    printf("mode=%s workers=%zu rules=%d clients=%d duration=%dms\n", config.mode.c_str(), config.workers, config.rules, config.clients, config.durationMs);
+
+    // 空闲连接测试最先运行，此时缓冲池和分配器中还没有其他测试留下的空闲内存
+    std::vector<CaseResult> results;
+    if (HasCase(config.cases, "idle") && config.idleConnections > 0) results.push_back(bench.RunIdle());
+    if (HasCase(config.cases, "connect")) results.push_back(bench.RunConnect());
+    if (HasCase(config.cases, "rr")) results.push_back(bench.RunRoundTrip());
+    if (HasCase(config.cases, "bulk")) results.push_back(bench.RunBulk());
+    if (HasCase(config.cases, "udp")) results.push_back(bench.RunUdp());
+    bench.Stop();
+    StopLogger();
+
+    for (const CaseResult& result : results) {
+        printf("%-8s", result.name.c_str());
+        for (const auto& field : result.fields) {
+            printf("  %s=%.6g", field.first.c_str(), field.second);
+        }
+        printf("\n");
+    }
+    if (!config.jsonPath.empty()) {
+        std::string json = FormatJson(config, results);
+        if (config.jsonPath == "-") {
+            fputs(json.c_str(), stdout);
+        }
+        else {
+            std::ofstream file(config.jsonPath);
+            file << json;
+            if (!file) {
+                fprintf(stderr, "failed to write %s\n", config.jsonPath.c_str());
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
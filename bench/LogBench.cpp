@@ -0,0 +1,120 @@
+// 日志基准测试：比较关闭级别的日志宏、无锁环形队列日志和旧的互斥锁队列（逐行std::endl）每条日志的开销
+// 构建示例（也可以用仓库根目录的CMake构建bench目标）：
+//   g++ -std=c++20 -O2 -I.. LogBench.cpp ../conlog.cpp -pthread -o log_bench
+// 转发路径上的对比见 UdpBatchBench --log-debug
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../conlog.h"
+
+static constexpr int kRecordsPerThread = 200000;
+
+// 旧实现：互斥锁+条件变量保护的std::queue<std::string>，写出线程每行std::endl
+class LegacyLogger {
+public:
+    explicit LegacyLogger(const char* path) : _out(path), _worker([this] { Run(); }) {}
+    ~LegacyLogger() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _cond.notify_one();
+        _worker.join();
+    }
+
+    void Log(const std::string& message) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _queue.push(message);
+        }
+        _cond.notify_one();
+    }
+
+private:
+    void Run() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        for (;;) {
+            _cond.wait(lock, [this] { return _stop || !_queue.empty(); });
+            if (_queue.empty()) {
+                return;
+            }
+            std::string message = std::move(_queue.front());
+            _queue.pop();
+            lock.unlock();
+            _out << message << std::endl;
+            lock.lock();
+        }
+    }
+
+    std::ofstream _out;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::queue<std::string> _queue;
+    bool _stop = false;
+    std::thread _worker;
+};
+
+// 用threads个线程各执行kRecordsPerThread次body，返回每条日志的平均纳秒数
+template <typename Body>
+static double Measure(int threads, Body body) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&body, t] {
+            for (int i = 0; i < kRecordsPerThread; ++i) {
+                body(t, i);
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return ns / ((double)threads * kRecordsPerThread);
+}
+
+int main() {
+    const char* sinkPath = "/dev/null";
+    StartLogger();
+    LoggerOptions options;
+    options.console = false;
+    options.filePath = sinkPath;
+    options.rateLimit = 0;
+
+    printf("%-28s %8s %12s\n", "case", "threads", "ns/record");
+    for (int threads : { 1, 4 }) {
+        options.level = LogLevel::Info;
+        ConfigureLogger(options);
+        double disabled = Measure(threads, [](int t, int i) {
+            LOG_DEBUG("UDP datagram: %d bytes from client port %u", i, (unsigned)t);
+        });
+        printf("%-28s %8d %12.2f\n", "ring, level disabled", threads, disabled);
+
+        options.level = LogLevel::Debug;
+        ConfigureLogger(options);
+        LoggerStats before = GetLoggerStats();
+        double enabled = Measure(threads, [](int t, int i) {
+            LOG_DEBUG("UDP datagram: %d bytes from client port %u", i, (unsigned)t);
+        });
+        LoggerStats after = GetLoggerStats();
+        printf("%-28s %8d %12.2f  (dropped %llu)\n", "ring, level enabled", threads, enabled,
+            (unsigned long long)(after.droppedFull - before.droppedFull));
+
+        double legacy;
+        {
+            LegacyLogger legacyLogger(sinkPath);
+            legacy = Measure(threads, [&legacyLogger](int t, int i) {
+                legacyLogger.Log("UDP datagram: " + std::to_string(i) + " bytes from client port " + std::to_string(t));
+            });
+        }
+        printf("%-28s %8d %12.2f\n", "mutex queue + std::endl", threads, legacy);
+    }
+    StopLogger();
+    return 0;
+}
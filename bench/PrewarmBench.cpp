@@ -0,0 +1,102 @@
+// 预连接基准测试：在回环地址上测量新客户端的首字节时间（TTFB），比较关闭与开启预连接两种情况
+// 目标服务器在接受每个连接后等待一段时间才开始处理，模拟跨地域目标的握手延迟
+// 构建示例（也可以用仓库根目录的CMake构建bench目标）：
+//   g++ -std=c++20 -O2 -I.. PrewarmBench.cpp ../IoUring.cpp ../Poller.cpp ../RateLimiter.cpp ../RelayEngine.cpp ../TcpConnection.cpp ../TcpListener.cpp ../UdpRelay.cpp ../UpstreamPool.cpp ../WarmPool.cpp ../PortRoutes.cpp ../ProxyProtocol.cpp ../TimerWheel.cpp ../BufferPool.cpp ../Metrics.cpp ../conlog.cpp ../errlog.cpp -pthread -o prewarm_bench
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "../RelayEngine.h"
+
+static constexpr int kConnectDelayMs = 50;  // 注入的握手延迟
+static constexpr int kRequests = 100;       // 每组测试的客户端数量
+static constexpr int kGapMs = 20;           // 相邻客户端之间的间隔
+
+// 创建监听在回环地址随机端口上的TCP套接字
+static SOCKET ListenLoopback(sockaddr_storage& addr) {
+    SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sockaddr_in& in4 = (sockaddr_in&)addr;
+    memset(&addr, 0, sizeof(addr));
+    in4.sin_family = AF_INET;
+    in4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(sock, (sockaddr*)&in4, sizeof(in4));
+    listen(sock, SOMAXCONN);
+    socklen_t len = sizeof(in4);
+    getsockname(sock, (sockaddr*)&in4, &len);
+    return sock;
+}
+
+// 目标服务器：每个连接在接受后等待kConnectDelayMs，然后对每个请求回复一个字节
+static void RunUpstream(SOCKET listener) {
+    for (;;) {
+        SOCKET client = accept(listener, nullptr, nullptr);
+        if (client == INVALID_SOCKET) {
+            return;
+        }
+        auto readyAt = std::chrono::steady_clock::now() + std::chrono::milliseconds(kConnectDelayMs);
+        std::thread([client, readyAt] {
+            std::this_thread::sleep_until(readyAt);
+            char buffer[64];
+            while (recv(client, buffer, sizeof(buffer), 0) > 0) {
+                send(client, "!", 1, kSendFlags);
+            }
+            closesocket(client);
+        }).detach();
+    }
+}
+
+// 返回每个客户端从connect到收到第一个字节的时间（微秒）
+static std::vector<double> RunCase(const sockaddr_storage& upstreamAddr, uint32_t prewarm) {
+    RelayEngine engine;
+    engine.Start(1);
+    UpstreamOptions options;
+    options.prewarm = prewarm;
+    auto upstream = UpstreamPool::FromAddress(upstreamAddr, options);
+
+    sockaddr_storage forwardAddr;
+    SOCKET listener = ListenLoopback(forwardAddr);
+    engine.AddTCPListener(listener, std::make_shared<RelayRule>("bench", upstream, engine.WorkerCount()));
+    std::this_thread::sleep_for(std::chrono::milliseconds(kConnectDelayMs * 2));  // 等待预连接就绪
+
+    std::vector<double> samples;
+    for (int i = 0; i < kRequests; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        SOCKET client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        char byte;
+        if (connect(client, (sockaddr*)&forwardAddr, sizeof(sockaddr_in)) == 0 &&
+            send(client, "?", 1, kSendFlags) == 1 && recv(client, &byte, 1, 0) == 1) {
+            samples.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        }
+        closesocket(client);
+        std::this_thread::sleep_for(std::chrono::milliseconds(kGapMs));
+    }
+    engine.Stop();
+    return samples;
+}
+
+static void Report(const char* name, std::vector<double> samples) {
+    if (samples.empty()) {
+        printf("%-14s no samples\n", name);
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (double sample : samples) sum += sample;
+    printf("%-14s %6zu %12.0f %12.0f %12.0f\n", name, samples.size(), sum / samples.size(),
+        samples[samples.size() / 2], samples[samples.size() * 99 / 100]);
+}
+
+int main() {
+    sockaddr_storage upstreamAddr;
+    SOCKET upstreamListener = ListenLoopback(upstreamAddr);
+    std::thread(RunUpstream, upstreamListener).detach();
+
+    printf("injected connect delay: %d ms\n", kConnectDelayMs);
+    printf("%-14s %6s %12s %12s %12s\n", "mode", "count", "mean(us)", "p50(us)", "p99(us)");
+    Report("cold connect", RunCase(upstreamAddr, 0));
+    Report("prewarm=4", RunCase(upstreamAddr, 4));
+    return 0;
+}
@@ -0,0 +1,162 @@
+// UDP批量收发基准测试：在回环地址上比较逐包收发与recvmmsg/sendmmsg批量收发（以及GSO/GRO）的转发速率
+// 仅支持Linux，构建示例（也可以用仓库根目录的CMake构建bench目标）：
+//   g++ -std=c++20 -O2 -I.. UdpBatchBench.cpp ../IoUring.cpp ../Poller.cpp ../RateLimiter.cpp ../RelayEngine.cpp ../TcpConnection.cpp ../TcpListener.cpp ../UdpRelay.cpp ../UpstreamPool.cpp ../WarmPool.cpp ../PortRoutes.cpp ../ProxyProtocol.cpp ../TimerWheel.cpp ../BufferPool.cpp ../Metrics.cpp ../conlog.cpp ../errlog.cpp -pthread -o udp_batch_bench
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../RelayEngine.h"
+#include "../conlog.h"
+
+static constexpr int kSendBatch = 64;  // 发送端每次sendmmsg的消息数量
+static constexpr int kDurationMs = 1000;  // 每组测试的持续时间
+
+struct BenchMode {
+    const char* name;
+    uint32_t batchSize;
+    bool gso;
+};
+
+// 创建绑定到回环地址随机端口的UDP套接字
+static SOCKET BindLoopback(sockaddr_storage& addr) {
+    SOCKET sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    sockaddr_in& in4 = (sockaddr_in&)addr;
+    memset(&addr, 0, sizeof(addr));
+    in4.sin_family = AF_INET;
+    in4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(sock, (sockaddr*)&in4, sizeof(in4));
+    socklen_t len = sizeof(in4);
+    getsockname(sock, (sockaddr*)&in4, &len);
+    int bufferSize = 8 << 20;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+    return sock;
+}
+
+// 运行一组测试，返回接收端每秒收到的数据报数量
+static double RunCase(size_t payload, const BenchMode& mode) {
+    sockaddr_storage sinkAddr, listenAddr;
+    SOCKET sink = BindLoopback(sinkAddr);
+    SOCKET listener = BindLoopback(listenAddr);
+    timeval timeout{ 0, 100000 };
+    setsockopt(sink, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+#ifdef UDP_GRO
+    int one = 1;
+    setsockopt(sink, IPPROTO_UDP, UDP_GRO, &one, sizeof(one));  // 接收端也启用GRO，避免成为瓶颈
+#endif
+
+    RelayEngine engine;
+    RelayOptions relayOptions;
+    engine.Start(1, relayOptions);
+    auto rule = std::make_shared<RelayRule>("bench", UpstreamPool::FromAddress(sinkAddr), engine.WorkerCount());
+    rule->udp.batchSize = mode.batchSize;
+    rule->udp.gso = mode.gso;
+    engine.AddUDP(listener, rule);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    std::atomic<bool> running{ true };
+    std::atomic<uint64_t> receivedBytes{ 0 };
+    std::thread sinkThread([&] {
+        std::vector<char> buffer(kSendBatch * 65536);
+        mmsghdr msgs[kSendBatch];
+        iovec iovs[kSendBatch];
+        while (running) {
+            for (int i = 0; i < kSendBatch; ++i) {
+                iovs[i] = { buffer.data() + (size_t)i * 65536, 65536 };
+                memset(&msgs[i], 0, sizeof(msgs[i]));
+                msgs[i].msg_hdr.msg_iov = &iovs[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+            int count = recvmmsg(sink, msgs, kSendBatch, MSG_WAITFORONE, nullptr);
+            for (int i = 0; i < count; ++i) {
+                receivedBytes += msgs[i].msg_len;
+            }
+        }
+    });
+
+    SOCKET sender = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    connect(sender, (sockaddr*)&listenAddr, sizeof(sockaddr_in));
+    std::vector<char> payloadData(payload * kSendBatch, 'x');
+
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::milliseconds(kDurationMs);
+    while (std::chrono::steady_clock::now() < deadline) {
+#ifdef UDP_SEGMENT
+        if (mode.gso) {
+            // GSO模式下发送端也用UDP_SEGMENT一次提交多个数据报，使转发端的GRO能够合并
+            size_t segments = 65000 / payload < (size_t)kSendBatch ? 65000 / payload : (size_t)kSendBatch;
+            iovec iov{ payloadData.data(), payload * segments };
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof(uint16_t))] = {};
+            msghdr hdr{};
+            hdr.msg_iov = &iov;
+            hdr.msg_iovlen = 1;
+            hdr.msg_control = control;
+            hdr.msg_controllen = sizeof(control);
+            cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
+            cmsg->cmsg_level = IPPROTO_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t segmentSize = (uint16_t)payload;
+            memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof(segmentSize));
+            sendmsg(sender, &hdr, MSG_DONTWAIT);
+            std::this_thread::yield();
+            continue;
+        }
+#endif
+        mmsghdr msgs[kSendBatch];
+        iovec iovs[kSendBatch];
+        for (int i = 0; i < kSendBatch; ++i) {
+            iovs[i] = { payloadData.data() + (size_t)i * payload, payload };
+            memset(&msgs[i], 0, sizeof(msgs[i]));
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        sendmmsg(sender, msgs, kSendBatch, MSG_DONTWAIT);
+        std::this_thread::yield();  // 单核机器上给转发线程和接收线程留出时间
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));  // 等待在途数据报
+    running = false;
+    sinkThread.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    engine.Stop();
+    closesocket(sender);
+    closesocket(sink);
+    return (double)(receivedBytes.load() / payload) / seconds;
+}
+
+int main(int argc, char** argv) {
+    // --log-debug：打开逐包的调试日志（写到/dev/null），用来确认日志不再限制转发速率
+    bool logDebug = argc > 1 && strcmp(argv[1], "--log-debug") == 0;
+    StartLogger();
+    LoggerOptions logOptions;
+    logOptions.level = logDebug ? LogLevel::Debug : LogLevel::Warn;
+    logOptions.console = false;
+    logOptions.filePath = "/dev/null";
+    ConfigureLogger(logOptions);
+
+    const size_t payloads[] = { 64, 512, 1400 };
+    const BenchMode modes[] = {
+        { "per-packet", 1, false },
+        { "batched", 32, false },
+        { "batched+gso", 32, true },
+    };
+
+    printf("%-8s %-12s %14s\n", "payload", "mode", "packets/sec");
+    for (size_t payload : payloads) {
+        for (const BenchMode& mode : modes) {
+            double pps = RunCase(payload, mode);
+            printf("%-8zu %-12s %14.0f\n", payload, mode.name, pps);
+        }
+    }
+    if (logDebug) {
+        LoggerStats stats = GetLoggerStats();
+        printf("log records written=%llu dropped(full)=%llu dropped(rate)=%llu\n", (unsigned long long)stats.written,
+            (unsigned long long)stats.droppedFull, (unsigned long long)stats.droppedRate);
+    }
+    StopLogger();
+    return 0;
+}
@@ -0,0 +1,292 @@
+// io_uring后端基准测试：在回环地址上比较epoll（splice与缓冲区两种TCP转发方式）与io_uring后端
+// 分别测量小消息请求/响应的往返延迟（p50/p99）和TCP大流量吞吐量，转发端只使用一个工作线程
+// 仅支持Linux，构建示例（也可以用仓库根目录的CMake构建bench目标）：
+//   g++ -std=c++20 -O2 -I.. UringBench.cpp ../IoUring.cpp ../Poller.cpp ../RateLimiter.cpp ../RelayEngine.cpp ../TcpConnection.cpp ../TcpListener.cpp ../UdpRelay.cpp ../UpstreamPool.cpp ../WarmPool.cpp ../PortRoutes.cpp ../ProxyProtocol.cpp ../TimerWheel.cpp ../BufferPool.cpp ../Metrics.cpp ../conlog.cpp ../errlog.cpp -pthread -o uring_bench
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "../RelayEngine.h"
+#include "../conlog.h"
+
+static constexpr int kDurationMs = 1000;      // 每组测试的持续时间
+static constexpr int kRrClients = 16;         // 请求/响应测试的并发连接（或UDP客户端）数量
+static constexpr size_t kRrMessageSize = 64;  // 请求/响应的消息大小
+static constexpr int kBulkClients = 4;        // 吞吐量测试的并发连接数量
+static constexpr size_t kBulkChunk = 65536;   // 吞吐量测试每次发送的字节数
+
+static std::atomic<uint64_t> serverBytes{ 0 };  // 目标服务器收到的字节数，服务线程在测试结束后才退出，因此不放在栈上
+
+struct BenchMode {
+    const char* name;
+    bool useIoUring;
+    bool useSplice;
+};
+
+struct RrResult {
+    double requestsPerSec;
+    double p50Us;
+    double p99Us;
+};
+
+static sockaddr_storage LoopbackAddr() {
+    sockaddr_storage addr;
+    memset(&addr, 0, sizeof(addr));
+    sockaddr_in& in4 = (sockaddr_in&)addr;
+    in4.sin_family = AF_INET;
+    in4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return addr;
+}
+
+// 创建绑定到回环地址随机端口的套接字，TCP套接字同时开始监听
+static SOCKET BindLoopback(int type, sockaddr_storage& addr) {
+    addr = LoopbackAddr();
+    SOCKET sock = socket(AF_INET, type, 0);
+    bind(sock, (sockaddr*)&addr, sizeof(sockaddr_in));
+    socklen_t len = sizeof(sockaddr_in);
+    getsockname(sock, (sockaddr*)&addr, &len);
+    if (type == SOCK_STREAM) {
+        listen(sock, SOMAXCONN);
+    }
+    return sock;
+}
+
+static SOCKET ConnectTcp(const sockaddr_storage& addr) {
+    SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    connect(sock, (const sockaddr*)&addr, sizeof(sockaddr_in));
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return sock;
+}
+
+// TCP目标服务器：每个连接一个线程，echo为true时原样返回，否则丢弃并计数
+static void ServeTcp(SOCKET listener, bool echo) {
+    for (;;) {
+        SOCKET client = accept(listener, nullptr, nullptr);
+        if (client == INVALID_SOCKET) {
+            return;  // 监听套接字已关闭
+        }
+        int one = 1;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        std::thread([client, echo] {
+            std::vector<char> buffer(kBulkChunk);
+            ssize_t len;
+            while ((len = recv(client, buffer.data(), buffer.size(), 0)) > 0) {
+                serverBytes += (uint64_t)len;
+                if (echo && send(client, buffer.data(), (size_t)len, MSG_NOSIGNAL) != len) {
+                    break;
+                }
+            }
+            closesocket(client);
+        }).detach();
+    }
+}
+
+static double Percentile(std::vector<uint32_t>& samples, double fraction) {
+    if (samples.empty()) {
+        return 0;
+    }
+    size_t index = (size_t)(fraction * (double)(samples.size() - 1));
+    std::nth_element(samples.begin(), samples.begin() + (ptrdiff_t)index, samples.end());
+    return samples[index];
+}
+
+// 每个客户端线程循环发送一条消息并等待完整的回复，记录每次往返的耗时（微秒）
+template <typename RoundTrip>
+static RrResult MeasureRoundTrips(int clients, RoundTrip roundTrip) {
+    std::vector<std::vector<uint32_t>> samples((size_t)clients);
+    std::vector<std::thread> threads;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(kDurationMs);
+    for (int i = 0; i < clients; ++i) {
+        threads.emplace_back([&, i] {
+            while (std::chrono::steady_clock::now() < deadline) {
+                auto start = std::chrono::steady_clock::now();
+                if (!roundTrip(i)) {
+                    return;
+                }
+                samples[(size_t)i].push_back((uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    std::vector<uint32_t> all;
+    for (auto& clientSamples : samples) {
+        all.insert(all.end(), clientSamples.begin(), clientSamples.end());
+    }
+    RrResult result;
+    result.requestsPerSec = (double)all.size() * 1000.0 / kDurationMs;
+    result.p50Us = Percentile(all, 0.50);
+    result.p99Us = Percentile(all, 0.99);
+    return result;
+}
+
+static RrResult RunTcpRoundTrip(const BenchMode& mode) {
+    sockaddr_storage echoAddr, listenAddr;
+    SOCKET echoListener = BindLoopback(SOCK_STREAM, echoAddr);
+    SOCKET listener = BindLoopback(SOCK_STREAM, listenAddr);
+    std::thread server(ServeTcp, echoListener, true);
+
+    RelayEngine engine;
+    RelayOptions relayOptions;
+    relayOptions.useIoUring = mode.useIoUring;
+    relayOptions.useSplice = mode.useSplice;
+    engine.Start(1, relayOptions);
+    engine.AddTCPListener(listener, std::make_shared<RelayRule>("bench", UpstreamPool::FromAddress(echoAddr), engine.WorkerCount()));
+
+    std::vector<SOCKET> clients;
+    for (int i = 0; i < kRrClients; ++i) {
+        clients.push_back(ConnectTcp(listenAddr));
+    }
+    RrResult result = MeasureRoundTrips(kRrClients, [&](int i) {
+        char message[kRrMessageSize] = {};
+        if (send(clients[(size_t)i], message, sizeof(message), MSG_NOSIGNAL) != (ssize_t)sizeof(message)) {
+            return false;
+        }
+        for (size_t got = 0; got < sizeof(message);) {
+            ssize_t len = recv(clients[(size_t)i], message + got, sizeof(message) - got, 0);
+            if (len <= 0) {
+                return false;
+            }
+            got += (size_t)len;
+        }
+        return true;
+    });
+
+    for (SOCKET client : clients) {
+        closesocket(client);
+    }
+    engine.Stop();
+    shutdown(echoListener, SHUT_RDWR);  // 让accept返回
+    server.join();
+    closesocket(echoListener);
+    return result;
+}
+
+static RrResult RunUdpRoundTrip(const BenchMode& mode) {
+    sockaddr_storage echoAddr, listenAddr;
+    SOCKET echo = BindLoopback(SOCK_DGRAM, echoAddr);
+    SOCKET listener = BindLoopback(SOCK_DGRAM, listenAddr);
+    timeval timeout{ 0, 100000 };
+    setsockopt(echo, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    std::atomic<bool> running{ true };
+    std::thread server([&] {
+        char buffer[2048];
+        while (running) {
+            sockaddr_storage from;
+            socklen_t fromLen = sizeof(from);
+            ssize_t len = recvfrom(echo, buffer, sizeof(buffer), 0, (sockaddr*)&from, &fromLen);
+            if (len > 0) {
+                sendto(echo, buffer, (size_t)len, 0, (sockaddr*)&from, fromLen);
+            }
+        }
+    });
+
+    RelayEngine engine;
+    RelayOptions relayOptions;
+    relayOptions.useIoUring = mode.useIoUring;
+    engine.Start(1, relayOptions);
+    auto rule = std::make_shared<RelayRule>("bench", UpstreamPool::FromAddress(echoAddr), engine.WorkerCount());
+    rule->udp.batchSize = 1;  // 请求/响应模式下每次只有一个数据报可读，批量收发没有意义
+    engine.AddUDP(listener, rule);
+
+    std::vector<SOCKET> clients;
+    for (int i = 0; i < kRrClients; ++i) {
+        SOCKET client = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        connect(client, (sockaddr*)&listenAddr, sizeof(sockaddr_in));
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        clients.push_back(client);
+    }
+    RrResult result = MeasureRoundTrips(kRrClients, [&](int i) {
+        char message[kRrMessageSize] = {};
+        send(clients[(size_t)i], message, sizeof(message), 0);
+        return recv(clients[(size_t)i], message, sizeof(message), 0) > 0 || errno == EAGAIN;  // 丢包时超时后继续
+    });
+
+    for (SOCKET client : clients) {
+        closesocket(client);
+    }
+    engine.Stop();
+    running = false;
+    server.join();
+    closesocket(echo);
+    return result;
+}
+
+// 多个连接持续向丢弃服务器发送数据，返回服务器每秒收到的字节数
+static double RunTcpBulk(const BenchMode& mode) {
+    sockaddr_storage sinkAddr, listenAddr;
+    SOCKET sinkListener = BindLoopback(SOCK_STREAM, sinkAddr);
+    SOCKET listener = BindLoopback(SOCK_STREAM, listenAddr);
+    std::thread server(ServeTcp, sinkListener, false);
+
+    RelayEngine engine;
+    RelayOptions relayOptions;
+    relayOptions.useIoUring = mode.useIoUring;
+    relayOptions.useSplice = mode.useSplice;
+    engine.Start(1, relayOptions);
+    engine.AddTCPListener(listener, std::make_shared<RelayRule>("bench", UpstreamPool::FromAddress(sinkAddr), engine.WorkerCount()));
+
+    std::atomic<bool> running{ true };
+    std::vector<std::thread> senders;
+    for (int i = 0; i < kBulkClients; ++i) {
+        senders.emplace_back([&] {
+            SOCKET client = ConnectTcp(listenAddr);
+            std::vector<char> chunk(kBulkChunk, 'x');
+            while (running && send(client, chunk.data(), chunk.size(), MSG_NOSIGNAL) > 0) {}
+            closesocket(client);
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));  // 跳过连接建立阶段
+    uint64_t startBytes = serverBytes.load();
+    auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(kDurationMs));
+    double bytes = (double)(serverBytes.load() - startBytes);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    running = false;
+
+    engine.Stop();  // 关闭转发的连接，阻塞在send中的发送线程随之返回
+    for (std::thread& sender : senders) {
+        sender.join();
+    }
+    shutdown(sinkListener, SHUT_RDWR);
+    server.join();
+    closesocket(sinkListener);
+    return bytes / seconds;
+}
+
+int main() {
+    StartLogger();
+    LoggerOptions logOptions;
+    logOptions.level = LogLevel::Warn;
+    logOptions.console = false;
+    logOptions.filePath = "/dev/null";
+    ConfigureLogger(logOptions);
+
+    std::vector<BenchMode> modes = {
+        { "epoll+splice", false, true },
+        { "epoll", false, false },
+    };
+    if (IoUring::Supported()) {
+        modes.push_back({ "io_uring", true, false });
+    }
+    else {
+        printf("io_uring is not supported by this kernel, only epoll modes are measured\n");
+    }
+
+    printf("%-14s %-10s %12s %10s %10s %12s\n", "mode", "case", "req/sec", "p50(us)", "p99(us)", "MB/sec");
+    for (const BenchMode& mode : modes) {
+        RrResult tcp = RunTcpRoundTrip(mode);
+        printf("%-14s %-10s %12.0f %10.0f %10.0f %12s\n", mode.name, "tcp-rr", tcp.requestsPerSec, tcp.p50Us, tcp.p99Us, "-");
+        RrResult udp = RunUdpRoundTrip(mode);
+        printf("%-14s %-10s %12.0f %10.0f %10.0f %12s\n", mode.name, "udp-rr", udp.requestsPerSec, udp.p50Us, udp.p99Us, "-");
+        double bulk = RunTcpBulk(mode);
+        printf("%-14s %-10s %12s %10s %10s %12.1f\n", mode.name, "tcp-bulk", "-", "-", "-", bulk / (1024 * 1024));
+    }
+    StopLogger();
+    return 0;
+}
@@ -0,0 +1,309 @@
+#include "conlog.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+std::atomic<uint8_t> logLevel{ (uint8_t)LogLevel::Info };
+
+namespace {
+
+constexpr size_t kRecordCount = 8192;  // 环形队列容量，必须是2的幂
+constexpr size_t kRecordTextSize = 232;  // 每条记录的正文上限，超出部分被截断
+constexpr size_t kWriteBufferSize = 1 << 16;  // 写出线程每批拼接的字节数上限
+
+// 预先分配的固定大小日志记录，sequence用于生产者和消费者之间的同步（Vyukov有界队列）
+struct alignas(64) LogRecord {
+    std::atomic<size_t> sequence;
+    uint64_t timeMs;
+    uint16_t length;
+    LogLevel level;
+    char text[kRecordTextSize];
+};
+
+// 多生产者单消费者的无锁环形队列
+class LogRing {
+public:
+    LogRing() {
+        for (size_t i = 0; i < kRecordCount; ++i) {
+            _records[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // 占用一个空槽，队列已满时返回nullptr
+    LogRecord* Claim(size_t& position) {
+        size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            LogRecord& record = _records[pos & (kRecordCount - 1)];
+            size_t sequence = record.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0) {
+                if (_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    position = pos;
+                    return &record;
+                }
+            }
+            else if (diff < 0) {
+                return nullptr;
+            }
+            else {
+                pos = _enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void Publish(LogRecord* record, size_t position) {
+        record->sequence.store(position + 1, std::memory_order_release);
+    }
+
+    // 只由写出线程调用
+    LogRecord* Peek() {
+        LogRecord& record = _records[_dequeuePos & (kRecordCount - 1)];
+        if (record.sequence.load(std::memory_order_acquire) != _dequeuePos + 1) {
+            return nullptr;
+        }
+        return &record;
+    }
+
+    void Pop(LogRecord* record) {
+        record->sequence.store(_dequeuePos + kRecordCount, std::memory_order_release);
+        ++_dequeuePos;
+    }
+
+private:
+    LogRecord _records[kRecordCount];
+    alignas(64) std::atomic<size_t> _enqueuePos{ 0 };
+    alignas(64) size_t _dequeuePos = 0;
+};
+
+LogRing logRing;
+
+std::atomic<uint64_t> writtenCount{ 0 };
+std::atomic<uint64_t> droppedFullCount{ 0 };
+std::atomic<uint64_t> droppedRateCount{ 0 };
+
+// 按秒计数的速率限制窗口
+std::atomic<uint32_t> rateLimit{ 2000 };
+std::atomic<uint64_t> rateWindow{ 0 };
+std::atomic<uint32_t> rateCount{ 0 };
+
+std::mutex writerMutex;  // 保护写出目标与唤醒条件
+std::condition_variable writerCondition;
+std::thread writerThread;
+std::atomic<bool> writerRunning{ false };
+std::atomic<bool> writerSleeping{ false };
+bool consoleOutput = true;
+FILE* logFile = nullptr;
+
+uint64_t WallClockMs() {
+    using namespace std::chrono;
+    return (uint64_t)duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+// 检查速率限制，超过限制时返回false
+bool AdmitRecord(LogLevel level, uint64_t nowMs) {
+    uint32_t limit = rateLimit.load(std::memory_order_relaxed);
+    if (limit == 0 || level >= LogLevel::Error) {
+        return true;
+    }
+    uint64_t second = nowMs / 1000;
+    uint64_t window = rateWindow.load(std::memory_order_relaxed);
+    if (window != second && rateWindow.compare_exchange_strong(window, second, std::memory_order_relaxed)) {
+        rateCount.store(0, std::memory_order_relaxed);  // 进入新的一秒，重新计数
+    }
+    return rateCount.fetch_add(1, std::memory_order_relaxed) < limit;
+}
+
+void Enqueue(LogLevel level, const char* format, va_list args) {
+    uint64_t now = WallClockMs();
+    if (!AdmitRecord(level, now)) {
+        droppedRateCount.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    size_t position;
+    LogRecord* record = logRing.Claim(position);
+    if (record == nullptr) {
+        droppedFullCount.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    int len = vsnprintf(record->text, kRecordTextSize, format, args);
+    record->length = (uint16_t)(len < 0 ? 0 : (len >= (int)kRecordTextSize ? kRecordTextSize - 1 : len));
+    record->level = level;
+    record->timeMs = now;
+    logRing.Publish(record, position);
+
+    if (writerSleeping.load(std::memory_order_relaxed)) {
+        writerCondition.notify_one();  // 写出线程空闲时才需要唤醒
+    }
+}
+
+const char* LevelName(LogLevel level) {
+    switch (level) {
+    case LogLevel::Debug: return "DEBUG";
+    case LogLevel::Info: return "INFO";
+    case LogLevel::Warn: return "WARN";
+    case LogLevel::Error: return "ERROR";
+    default: return "";
+    }
+}
+
+// 把一条记录格式化为 "[时间] [级别] 正文\n" 追加到写出缓冲区
+size_t FormatRecord(const LogRecord& record, char* out, size_t capacity) {
+    time_t seconds = (time_t)(record.timeMs / 1000);
+    tm local{};
+#ifdef _WIN32
+    localtime_s(&local, &seconds);
+#else
+    localtime_r(&seconds, &local);
+#endif
+    int len = snprintf(out, capacity, "[%04d-%02d-%02d %02d:%02d:%02d.%03d] [%s] %.*s\n",
+        local.tm_year + 1900, local.tm_mon + 1, local.tm_mday, local.tm_hour, local.tm_min, local.tm_sec,
+        (int)(record.timeMs % 1000), LevelName(record.level), (int)record.length, record.text);
+    return len < 0 ? 0 : ((size_t)len >= capacity ? capacity - 1 : (size_t)len);
+}
+
+void WriteOut(const char* data, size_t len) {
+    std::lock_guard<std::mutex> lock(writerMutex);
+    if (consoleOutput) {
+        fwrite(data, 1, len, stdout);
+        fflush(stdout);
+    }
+    if (logFile != nullptr) {
+        fwrite(data, 1, len, logFile);
+        fflush(logFile);
+    }
+}
+
+// 把队列中当前所有记录成批写出，返回写出的条数
+size_t DrainRing(char* buffer) {
+    size_t total = 0;
+    size_t used = 0;
+    while (LogRecord* record = logRing.Peek()) {
+        if (kWriteBufferSize - used < kRecordTextSize + 64) {
+            WriteOut(buffer, used);  // 缓冲区快满了，先写出一批
+            used = 0;
+        }
+        used += FormatRecord(*record, buffer + used, kWriteBufferSize - used);
+        logRing.Pop(record);
+        ++total;
+    }
+    if (used > 0) {
+        WriteOut(buffer, used);  // 每批只刷新一次，而不是每行都刷新
+    }
+    writtenCount.fetch_add(total, std::memory_order_relaxed);
+    return total;
+}
+
+// 定期报告丢弃的日志数量
+void ReportDrops(uint64_t& lastFull, uint64_t& lastRate) {
+    uint64_t full = droppedFullCount.load(std::memory_order_relaxed);
+    uint64_t rate = droppedRateCount.load(std::memory_order_relaxed);
+    if (full != lastFull || rate != lastRate) {
+        // 队列可能正是满的，不经过队列，直接按普通记录的格式写出
+        if (LogEnabled(LogLevel::Warn)) {
+            LogRecord record;
+            int len = snprintf(record.text, kRecordTextSize, "Dropped log records: %llu (queue full), %llu (rate limited)",
+                (unsigned long long)(full - lastFull), (unsigned long long)(rate - lastRate));
+            record.length = (uint16_t)(len < 0 ? 0 : len);
+            record.level = LogLevel::Warn;
+            record.timeMs = WallClockMs();
+            char line[kRecordTextSize + 64];
+            WriteOut(line, FormatRecord(record, line, sizeof(line)));
+        }
+        lastFull = full;
+        lastRate = rate;
+    }
+}
+
+void WriterLoop() {
+    std::unique_ptr<char[]> buffer(new char[kWriteBufferSize]);
+    uint64_t lastFull = 0, lastRate = 0;
+    uint64_t lastReport = WallClockMs();
+    while (writerRunning.load(std::memory_order_acquire)) {
+        if (DrainRing(buffer.get()) == 0) {
+            std::unique_lock<std::mutex> lock(writerMutex);
+            writerSleeping.store(true, std::memory_order_relaxed);
+            // 生产者只在看到sleeping标志时才唤醒，超时兜底避免错过唤醒
+            writerCondition.wait_for(lock, std::chrono::milliseconds(50));
+            writerSleeping.store(false, std::memory_order_relaxed);
+        }
+        uint64_t now = WallClockMs();
+        if (now - lastReport >= 1000) {
+            ReportDrops(lastFull, lastRate);
+            lastReport = now;
+        }
+    }
+    DrainRing(buffer.get());
+    ReportDrops(lastFull, lastRate);
+}
+
+} // namespace
+
+void StartLogger() {
+    if (writerRunning.exchange(true)) {
+        return;
+    }
+    writerThread = std::thread(WriterLoop);
+}
+
+void ConfigureLogger(const LoggerOptions& options) {
+    logLevel.store((uint8_t)options.level, std::memory_order_relaxed);
+    rateLimit.store(options.rateLimit, std::memory_order_relaxed);
+
+    FILE* file = nullptr;
+    if (!options.filePath.empty()) {
+        file = fopen(options.filePath.c_str(), "a");
+        if (file == nullptr) {
+            LOG_ERROR("Failed to open log file: %s", options.filePath.c_str());
+        }
+    }
+    std::lock_guard<std::mutex> lock(writerMutex);
+    consoleOutput = options.console;
+    if (logFile != nullptr) {
+        fclose(logFile);
+    }
+    logFile = file;
+}
+
+void StopLogger() {
+    if (writerRunning.exchange(false)) {
+        writerCondition.notify_one();
+        writerThread.join();
+    }
+    else {
+        std::unique_ptr<char[]> buffer(new char[kWriteBufferSize]);
+        DrainRing(buffer.get());  // 写出线程从未启动时，也要把已有的日志写出
+    }
+    std::lock_guard<std::mutex> lock(writerMutex);
+    if (logFile != nullptr) {
+        fclose(logFile);
+        logFile = nullptr;
+    }
+}
+
+LoggerStats GetLoggerStats() {
+    LoggerStats stats;
+    stats.written = writtenCount.load(std::memory_order_relaxed);
+    stats.droppedFull = droppedFullCount.load(std::memory_order_relaxed);
+    stats.droppedRate = droppedRateCount.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void LogFormat(LogLevel level, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    Enqueue(level, format, args);
+    va_end(args);
+}
+
+// 将日志消息加入队列
+void Log(const std::string& message) {
+    if (LogEnabled(LogLevel::Info)) {
+        LogFormat(LogLevel::Info, "%s", message.c_str());
+    }
+}
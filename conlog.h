@@ -1,50 +1,75 @@
-#include <queue>
-#include <mutex>
-#include <condition_variable>
-#include <memory>
-#include <stdexcept>
+#pragma once
+
+#include <atomic>
+#include <cstdint>
 #include <string>
-#include <winsock2.h>
+#include "netcompat.h"
+
+// 日志级别，从低到高
+enum class LogLevel : uint8_t {
+    Debug = 0,
+    Info = 1,
+    Warn = 2,
+    Error = 3,
+    Off = 4,
+};
+
+// 编译期的最低日志级别，低于它的LOG_XXX调用连同参数求值一起被编译掉
+// 例如发布构建可以定义 LOG_COMPILE_LEVEL=1 去掉所有逐包的调试日志
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL 0
+#endif
+
+// 日志系统的配置
+struct LoggerOptions {
+    LogLevel level = LogLevel::Info;  // 运行期的最低日志级别
+    bool console = true;              // 是否输出到控制台
+    std::string filePath;             // 日志文件路径，为空时不写文件
+    uint32_t rateLimit = 2000;        // 每秒最多记录的条数（Error级别不受限制），0表示不限制
+};
+
+// 日志系统的统计信息
+struct LoggerStats {
+    uint64_t written = 0;      // 已写出的记录数
+    uint64_t droppedFull = 0;  // 因队列已满丢弃的记录数
+    uint64_t droppedRate = 0;  // 因超过速率限制丢弃的记录数
+};
+
+extern std::atomic<uint8_t> logLevel;  // 当前运行期日志级别，供宏快速判断
+
+inline bool LogEnabled(LogLevel level) {
+    return (uint8_t)level >= logLevel.load(std::memory_order_relaxed);
+}
+
+void StartLogger();  // 启动日志写出线程
+void ConfigureLogger(const LoggerOptions& options);  // 调整级别、输出目标和速率限制，可以随时调用
+void StopLogger();   // 写出队列中剩余的日志并停止写出线程
+LoggerStats GetLoggerStats();
 
-void Log(const std::string& message); //控制台日志输出函数
+// 直接格式化到无锁环形队列中的固定大小记录，不分配内存；队列满时丢弃并计数
+void LogFormat(LogLevel level, const char* format, ...)
+#if defined(__GNUC__)
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+
+#if LOG_COMPILE_LEVEL > 0
+#define LOG_AT(level, ...) \
+    do { \
+        if ((int)(level) >= LOG_COMPILE_LEVEL && LogEnabled(level)) LogFormat(level, __VA_ARGS__); \
+    } while (0)
+#else
+#define LOG_AT(level, ...) \
+    do { \
+        if (LogEnabled(level)) LogFormat(level, __VA_ARGS__); \
+    } while (0)
+#endif
+#define LOG_DEBUG(...) LOG_AT(LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LogLevel::Info, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LogLevel::Warn, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LogLevel::Error, __VA_ARGS__)
+
+void Log(const std::string& message); //控制台日志输出函数（Info级别）
 void LogSocketError(int errorCode);  //Socket错误日志函数
 void SeparateIpAndPort_listen(const std::string& input, std::string& ip, std::string& port); //IP端口分离函数
 void SeparateIpAndPort_target(const std::string& input, std::string& ip, std::string& port); //IP端口分离函数
-template <typename T>
-class SemaphoreQueue {
-public:
-    SemaphoreQueue() = default;
-    ~SemaphoreQueue() = default;
-
-    void Enqueue(T value) {
-        {
-            std::lock_guard<std::mutex> lock(_mutex);
-            _queue.push(std::move(value));
-        }
-        _condition.notify_one();
-    }
-
-    T Dequeue() {
-        std::unique_lock<std::mutex> lock(_mutex);
-        _condition.wait(lock, [this] { return !_queue.empty(); });
-        T value = std::move(_queue.front());
-        _queue.pop();
-        return value;
-    }
-
-    void Clear() {
-        std::lock_guard<std::mutex> lock(_mutex);
-        std::queue<T> empty;
-        std::swap(_queue, empty);
-    }
-
-    bool HasPendingTasks() const {
-        std::lock_guard<std::mutex> lock(_mutex);
-        return !_queue.empty();
-    }
-
-private:
-    mutable std::mutex _mutex;
-    std::queue<T> _queue;
-    std::condition_variable _condition;
-};
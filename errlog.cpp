@@ -1,43 +1,55 @@
-#include <string>
-#include <winsock2.h>
+#include <cstring>
+#include "netcompat.h"
 #include "conlog.h"
-#include <iostream>
-#include <thread> // 包含线程库
-#include <chrono> // 包含chrono库，用于处理时间
+
+// 常见套接字错误的说明，Windows上是Winsock错误码，其他平台上是errno
+struct SocketErrorText {
+    int code;
+    const char* text;
+};
+
+#ifdef _WIN32
+static const SocketErrorText kSocketErrors[] = {
+    { WSAECONNABORTED, "连接已被一方终止 (WSAECONNABORTED, 10053)" },
+    { WSAECONNRESET, "连接被对方重置 (WSAECONNRESET, 10054)" },
+    { WSAEHOSTUNREACH, "目标主机无法访问 (WSAEHOSTUNREACH, 10065)" },
+    { WSAENETDOWN, "网络子系统不可用 (WSAENETDOWN, 10050)" },
+    { WSAENETRESET, "网络连接已被重置 (WSAENETRESET, 10052)" },
+    { WSAENETUNREACH, "网络不可达 (WSAENETUNREACH, 10051)" },
+    { WSAETIMEDOUT, "连接超时 (WSAETIMEDOUT, 10060)" },
+    { WSATYPE_NOT_FOUND, "未知的地址类型 (WSATYPE_NOT_FOUND, 10109)" },
+    { WSAECONNREFUSED, "连接被拒绝 (WSAECONNREFUSED, 10061)" },
+};
+static constexpr int kAddressTypeError = WSATYPE_NOT_FOUND;
+#else
+static const SocketErrorText kSocketErrors[] = {
+    { ECONNABORTED, "连接已被一方终止 (ECONNABORTED)" },
+    { ECONNRESET, "连接被对方重置 (ECONNRESET)" },
+    { EHOSTUNREACH, "目标主机无法访问 (EHOSTUNREACH)" },
+    { ENETDOWN, "网络子系统不可用 (ENETDOWN)" },
+    { ENETRESET, "网络连接已被重置 (ENETRESET)" },
+    { ENETUNREACH, "网络不可达 (ENETUNREACH)" },
+    { ETIMEDOUT, "连接超时 (ETIMEDOUT)" },
+    { EAFNOSUPPORT, "未知的地址类型 (EAFNOSUPPORT)" },
+    { ECONNREFUSED, "连接被拒绝 (ECONNREFUSED)" },
+};
+static constexpr int kAddressTypeError = EAFNOSUPPORT;
+#endif
 
 void LogSocketError(int errorCode) {
-    switch (errorCode) {
-    case WSAECONNABORTED:
-        Log("连接已被一方终止 (WSAECONNABORTED, 10053)");
-        break;
-    case WSAECONNRESET:
-        Log("连接被对方重置 (WSAECONNRESET, 10054)");
-        break;
-    case WSAEHOSTUNREACH:
-        Log("目标主机无法访问 (WSAEHOSTUNREACH, 10065)");
-        break;
-    case WSAENETDOWN:
-        Log("网络子系统不可用 (WSAENETDOWN, 10050)");
-        break;
-    case WSAENETRESET:
-        Log("网络连接已被重置 (WSAENETRESET, 10052)");
-        break;
-    case WSAENETUNREACH:
-        Log("网络不可达 (WSAENETUNREACH, 10051)");
-        break;
-    case WSAETIMEDOUT:
-        Log("连接超时 (WSAETIMEDOUT, 10060)");
-        break;
-    case WSATYPE_NOT_FOUND:
-        Log("未知的地址类型 (WSATYPE_NOT_FOUND, 10109)");
-        Log("请检查配置文件是否正确");
-        break;
-    case WSAECONNREFUSED:
-        Log("连接被拒绝 (WSAECONNREFUSED, 10061)");
-        break;
-        // 可以在这里添加更多的错误处理
-    default:
-        Log(("出现未知错误，错误代码: " + std::to_string(errorCode)).c_str());
-        break;
+    for (const SocketErrorText& error : kSocketErrors) {
+        if (error.code == errorCode) {
+            LOG_WARN("%s", error.text);
+            if (errorCode == kAddressTypeError) {
+                LOG_WARN("请检查配置文件是否正确");
+            }
+            return;
+        }
     }
+    // 可以在上面的表中添加更多的错误说明
+#ifdef _WIN32
+    LOG_WARN("出现未知错误，错误代码: %d", errorCode);
+#else
+    LOG_WARN("出现未知错误，错误代码: %d (%s)", errorCode, strerror(errorCode));
+#endif
 }
@@ -0,0 +1,140 @@
+#pragma once
+
+// 套接字平台兼容层：在Windows上使用Winsock，在其他平台上使用POSIX套接字
+#ifdef _WIN32
+#include <winsock2.h>  // 包含Windows套接字库的头文件
+#include <ws2tcpip.h>  // 包含Windows套接字库的扩展功能头文件
+
+constexpr int kSendFlags = 0;  // Windows上send不会触发SIGPIPE
+
+// 获取最近一次套接字操作的错误码
+inline int GetLastSocketError() {
+    return WSAGetLastError();
+}
+
+// 判断错误码是否表示非阻塞操作暂时无法完成
+inline bool IsWouldBlock(int errorCode) {
+    return errorCode == WSAEWOULDBLOCK;
+}
+
+// 判断错误码是否表示非阻塞connect正在进行中
+inline bool IsConnectInProgress(int errorCode) {
+    return errorCode == WSAEWOULDBLOCK || errorCode == WSAEINPROGRESS;
+}
+
+// 将套接字设置为非阻塞模式
+inline bool SetNonBlocking(SOCKET sock) {
+    u_long mode = 1;
+    return ioctlsocket(sock, FIONBIO, &mode) == 0;
+}
+
+// 关闭发送方向（半关闭），对端读到EOF后仍然可以继续发送
+inline int ShutdownSend(SOCKET sock) {
+    return shutdown(sock, SD_SEND);
+}
+
+// 用一次系统调用依次发送两段数据（例如协议头和随后的正文），返回发送的总字节数，失败时返回SOCKET_ERROR
+inline int SendPair(SOCKET sock, const char* head, size_t headLen, const char* body, size_t bodyLen) {
+    WSABUF buffers[2] = { { (ULONG)headLen, (CHAR*)head }, { (ULONG)bodyLen, (CHAR*)body } };
+    DWORD sent = 0;
+    if (WSASend(sock, buffers, bodyLen > 0 ? 2 : 1, &sent, 0, nullptr, nullptr) == SOCKET_ERROR) {
+        return SOCKET_ERROR;
+    }
+    return (int)sent;
+}
+
+constexpr int kTimedOutError = WSAETIMEDOUT;  // 超时的套接字错误码
+
+// 初始化套接字库，必须在创建任何套接字之前调用
+inline bool NetStartup() {
+    WSADATA wsa;
+    return WSAStartup(MAKEWORD(2, 2), &wsa) == 0;
+}
+
+// 清理套接字库
+inline void NetCleanup() {
+    WSACleanup();
+}
+#else
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+
+using SOCKET = int;  // POSIX上套接字就是文件描述符
+constexpr SOCKET INVALID_SOCKET = -1;
+constexpr int SOCKET_ERROR = -1;
+constexpr int kSendFlags = MSG_NOSIGNAL;  // 对端关闭时不产生SIGPIPE信号
+
+inline int closesocket(SOCKET sock) {
+    return ::close(sock);
+}
+
+inline int GetLastSocketError() {
+    return errno;
+}
+
+inline bool IsWouldBlock(int errorCode) {
+    return errorCode == EAGAIN || errorCode == EWOULDBLOCK;
+}
+
+inline bool IsConnectInProgress(int errorCode) {
+    return errorCode == EINPROGRESS;
+}
+
+inline bool SetNonBlocking(SOCKET sock) {
+    int flags = fcntl(sock, F_GETFL, 0);
+    return flags != -1 && fcntl(sock, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+inline int ShutdownSend(SOCKET sock) {
+    return shutdown(sock, SHUT_WR);
+}
+
+inline int SendPair(SOCKET sock, const char* head, size_t headLen, const char* body, size_t bodyLen) {
+    iovec iov[2] = { { (void*)head, headLen }, { (void*)body, bodyLen } };
+    msghdr msg{};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = bodyLen > 0 ? 2 : 1;
+    return (int)sendmsg(sock, &msg, kSendFlags);
+}
+
+constexpr int kTimedOutError = ETIMEDOUT;
+
+// POSIX套接字不需要初始化
+inline bool NetStartup() {
+    return true;
+}
+
+inline void NetCleanup() {
+}
+#endif
+
+// 根据地址族返回sockaddr的实际长度，避免把整个sockaddr_storage传给connect/sendto
+inline socklen_t SockaddrLength(const sockaddr_storage& addr) {
+    return addr.ss_family == AF_INET6 ? (socklen_t)sizeof(sockaddr_in6) : (socklen_t)sizeof(sockaddr_in);
+}
+
+// 启用TCP keepalive：空闲idleSec秒后开始探测，每intervalSec秒一次，连续count次无响应后断开；
+// 参数为0时保留系统默认值，平台不支持的参数被忽略
+inline bool SetKeepAlive(SOCKET sock, int idleSec, int intervalSec, int count) {
+    int on = 1;
+    bool ok = setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, (const char*)&on, sizeof(on)) == 0;
+#if defined(TCP_KEEPIDLE)
+    if (idleSec > 0) ok = setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, (const char*)&idleSec, sizeof(idleSec)) == 0 && ok;
+#elif defined(TCP_KEEPALIVE)
+    if (idleSec > 0) ok = setsockopt(sock, IPPROTO_TCP, TCP_KEEPALIVE, (const char*)&idleSec, sizeof(idleSec)) == 0 && ok;  // macOS
+#endif
+#ifdef TCP_KEEPINTVL
+    if (intervalSec > 0) ok = setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, (const char*)&intervalSec, sizeof(intervalSec)) == 0 && ok;
+#endif
+#ifdef TCP_KEEPCNT
+    if (count > 0) ok = setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, (const char*)&count, sizeof(count)) == 0 && ok;
+#endif
+    return ok;
+}
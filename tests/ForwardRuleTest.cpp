@@ -0,0 +1,112 @@
+// 热加载比较测试：未变化、修改目标、换监听端口、让出端口和新配置无效时对正在运行的规则的处理
+#include <map>
+#include <string>
+#include <vector>
+#include "../ForwardRule.h"
+#include "TestSupport.h"
+
+static ForwardRule Rule(const std::string& name, const std::string& listen, const std::string& target = "127.0.0.1:9000") {
+    ForwardRule rule;
+    rule.name = name;
+    rule.listen = listen;
+    rule.target = target;
+    return rule;
+}
+
+// 按配置启动的规则，与ApplyRules在启动成功后记录的内容相同
+static RunningRule Running(const ForwardRule& rule) {
+    RunningRule running;
+    running.config = rule;
+    std::string host;
+    SplitListenAddress(rule.listen, host, running.listenPorts);
+    return running;
+}
+
+static const RulePlan::Step* FindStep(const RulePlan& plan, const std::string& name) {
+    for (const RulePlan::Step& step : plan.steps) {
+        if (step.name == name) {
+            return &step;
+        }
+    }
+    return nullptr;
+}
+
+static bool Planned(const RulePlan& plan, const std::string& name, RuleAction action) {
+    const RulePlan::Step* step = FindStep(plan, name);
+    return step != nullptr && step->action == action;
+}
+
+static void TestReload() {
+    std::map<std::string, RunningRule> running;
+    for (const ForwardRule& rule : { Rule("same", "127.0.0.1:21000"), Rule("retarget", "127.0.0.1:21001"),
+             Rule("rebind", "127.0.0.1:21002"), Rule("widen", "127.0.0.1:21003"), Rule("typo", "127.0.0.1:21010"),
+             Rule("clash", "127.0.0.1:21011"), Rule("gone", "127.0.0.1:21012"), Rule("udp", "127.0.0.1:21013") }) {
+        running[rule.name] = Running(rule);
+    }
+
+    ForwardRule udp = Rule("udp", "127.0.0.1:21013");
+    udp.protocol = Protocol::Udp;  // 协议改变，同一端口的TCP监听不妨碍新的UDP监听
+    std::vector<ForwardRule> rules = {
+        Rule("same", "127.0.0.1:21000"),
+        Rule("retarget", "127.0.0.1:21001", "127.0.0.1:9001"),
+        Rule("rebind", "127.0.0.1:21102"),
+        Rule("widen", "127.0.0.1:21003-21004"),
+        Rule("typo", "127.0.0.1:2101O"),
+        Rule("clash", "127.0.0.1:21000"),  // 与same的端口冲突
+        Rule("new", "127.0.0.1:21200"),
+        Rule("new", "127.0.0.1:21201"),  // 重名，只使用第一条
+        udp,
+    };
+    RulePlan plan = PlanRules(rules, running);
+
+    CHECK(Planned(plan, "same", RuleAction::Keep));
+    CHECK(Planned(plan, "retarget", RuleAction::Update));
+    CHECK(Planned(plan, "rebind", RuleAction::Rebind));  // 新端口先绑定，成功后再删除旧规则
+    CHECK(Planned(plan, "widen", RuleAction::Replace));  // 新范围包含旧端口，只能先删除旧规则
+    CHECK(Planned(plan, "typo", RuleAction::Keep));      // 笔误不会停掉正在运行的规则
+    CHECK(Planned(plan, "clash", RuleAction::Keep));
+    CHECK(Planned(plan, "gone", RuleAction::Remove));
+    CHECK(Planned(plan, "new", RuleAction::Start));
+    CHECK(Planned(plan, "udp", RuleAction::Rebind));
+    CHECK(plan.steps.size() == 9);
+
+    // 需要新运行时对象的步骤指向路由表中对应的规则
+    const std::vector<RouteTable::Route>& routes = plan.routes.Routes();
+    for (const char* name : { "retarget", "rebind", "widen", "new" }) {
+        const RulePlan::Step* step = FindStep(plan, name);
+        CHECK(step != nullptr && step->route < routes.size() && rules[routes[step->route].rule].name == name);
+    }
+    const RulePlan::Step* widen = FindStep(plan, "widen");
+    CHECK(widen != nullptr && routes[widen->route].listen == (PortRange{ 21003, 21004 }));
+    const RulePlan::Step* added = FindStep(plan, "new");
+    CHECK(added != nullptr && routes[added->route].listen.first == 21200);
+
+    // 另一条规则要接管旧端口时同样只能先删除
+    running.clear();
+    running["old"] = Running(Rule("old", "127.0.0.1:22000"));
+    plan = PlanRules({ Rule("old", "127.0.0.1:22001"), Rule("taker", "127.0.0.1:22000") }, running);
+    CHECK(Planned(plan, "old", RuleAction::Replace));
+    CHECK(Planned(plan, "taker", RuleAction::Start));
+
+    // 没有正在运行的规则时，无效的条目直接跳过
+    plan = PlanRules({ Rule("bad", "no-port"), Rule("good", "127.0.0.1:22002") }, {});
+    CHECK(plan.steps.size() == 1 && Planned(plan, "good", RuleAction::Start));
+}
+
+static void TestSplitListenAddress() {
+    std::string host;
+    PortRange ports;
+    CHECK(SplitListenAddress("[::1]:9100", host, ports) && host == "::1" && ports.first == 9100 && ports.Count() == 1);
+    CHECK(SplitListenAddress(":8080-8081", host, ports) && host.empty() && ports.Count() == 2);
+    CHECK(!SplitListenAddress("9100", host, ports));
+}
+
+int main() {
+    if (!NetStartup()) {
+        return 1;
+    }
+    TestReload();
+    TestSplitListenAddress();
+    NetCleanup();
+    return TestResult("ForwardRuleTest");
+}
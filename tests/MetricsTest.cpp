@@ -0,0 +1,138 @@
+// 统计测试：直方图分桶与分位数、分片汇总与增量、Prometheus文本格式、会话管理接口
+#include <memory>
+#include "../Metrics.h"
+#include "../MetricsServer.h"
+#include "TestSupport.h"
+
+static void TestHistogramBuckets() {
+    // 每个值都落在自己桶的上下界之间，相邻桶首尾相接
+    for (uint64_t value : { 0ull, 1ull, 15ull, 16ull, 17ull, 100ull, 1000ull, 123456ull, (unsigned long long)LatencyHistogram::kMaxValue }) {
+        int index = LatencyHistogram::BucketIndex(value);
+        uint64_t lower = index == 0 ? 0 : LatencyHistogram::BucketUpperBound(index - 1) + 1;
+        CHECK(index < LatencyHistogram::kBucketCount);
+        CHECK(lower <= value && value <= LatencyHistogram::BucketUpperBound(index));
+    }
+    int broken = 0;
+    for (int i = 1; i < LatencyHistogram::kBucketCount; ++i) {
+        if (LatencyHistogram::BucketIndex(LatencyHistogram::BucketUpperBound(i)) != i ||
+            LatencyHistogram::BucketIndex(LatencyHistogram::BucketUpperBound(i - 1) + 1) != i) {
+            ++broken;
+        }
+    }
+    CHECK(broken == 0);
+    CHECK(LatencyHistogram::BucketIndex(LatencyHistogram::kMaxValue * 4) == LatencyHistogram::kBucketCount - 1);
+
+    LatencyHistogram histogram;
+    for (uint64_t value = 1; value <= 1000; ++value) {
+        histogram.Record(value);
+    }
+    HistogramSnapshot snapshot;
+    histogram.AddTo(snapshot);
+    CHECK(snapshot.count == 1000);
+    CHECK(snapshot.sum == 500500);
+    uint64_t p50 = snapshot.Percentile(0.5);
+    uint64_t p99 = snapshot.Percentile(0.99);
+    CHECK(p50 >= 500 && p50 <= 500 + 500 / 8);  // 相对误差不超过1/8
+    CHECK(p99 >= 990 && p99 <= 990 + 990 / 8);
+    CHECK(snapshot.CountAtOrBelow(15) == 15);
+}
+
+static void TestSnapshots() {
+    RuleMetrics metrics("rule", 4);
+    for (size_t worker = 0; worker < 4; ++worker) {
+        MetricsShard& shard = metrics.Shard(worker);
+        MetricAdd(shard.bytesUp, 100);
+        MetricAdd(shard.opened, 2);
+        MetricAdd(shard.closed, 1);
+        shard.connectTime.Record(1000);
+    }
+    RuleMetricsSnapshot first = metrics.Snapshot();
+    CHECK(first.bytesUp == 400);
+    CHECK(first.Active() == 4);
+    CHECK(first.connectTime.count == 4);
+
+    MetricAdd(metrics.Shard(1).bytesUp, 50);
+    MetricAdd(metrics.Shard(2).timeouts, 1);
+    RuleMetricsSnapshot delta = metrics.Snapshot();
+    delta -= first;
+    CHECK(delta.bytesUp == 50);
+    CHECK(delta.timeouts == 1);
+    CHECK(delta.opened == 0);
+    CHECK(delta.connectTime.count == 0);
+
+    // 同名规则共用一份统计，规则释放后从列表中移除
+    MetricsRegistry registry;
+    auto original = std::make_shared<RuleMetrics>("shared", 1);
+    CHECK(registry.Add(original) == original);
+    auto reloaded = std::make_shared<RuleMetrics>("shared", 1);
+    CHECK(registry.Add(reloaded) == original);
+    CHECK(registry.Snapshot().size() == 1);
+    original.reset();
+    CHECK(registry.Snapshot().empty());
+}
+
+static void TestPrometheus() {
+    RuleMetrics metrics("web \"a\"", 1);
+    MetricAdd(metrics.Shard(0).bytesDown, 1234);
+    MetricAdd(metrics.Shard(0).opened, 3);
+    metrics.Shard(0).connectTime.Record(2000);  // 2毫秒
+    std::string text = FormatPrometheus({ metrics.Snapshot() });
+    CHECK(text.find("# TYPE forwarder_bytes_total counter\n") != std::string::npos);
+    CHECK(text.find("forwarder_bytes_total{rule=\"web \\\"a\\\"\",direction=\"downstream\"} 1234\n") != std::string::npos);
+    CHECK(text.find("forwarder_connections_total{rule=\"web \\\"a\\\"\"} 3\n") != std::string::npos);
+    CHECK(text.find("le=\"0.001\"} 0\n") != std::string::npos);
+    CHECK(text.find("le=\"0.0025\"} 1\n") != std::string::npos);
+    CHECK(text.find("forwarder_timeouts_total") != std::string::npos);
+}
+
+// 发出一个HTTP请求，返回响应的状态行
+static std::string Request(uint16_t port, const std::string& request) {
+    SOCKET sock = ConnectLoopback(SOCK_STREAM, port);
+    SetReceiveTimeout(sock, 5000);
+    SendAll(sock, request.data(), request.size());
+    std::string response = ReceiveAll(sock);
+    closesocket(sock);
+    return response.substr(0, response.find("\r\n"));
+}
+
+static void TestSessionControl() {
+    MetricsRegistry registry;
+    uint64_t closed = 0;
+    for (bool allowClose : { false, true }) {
+        MetricsServer server(registry);
+        SessionControl control;
+        control.list = [] { return std::string("sessions\n"); };
+        if (allowClose) {
+            control.close = [&closed](uint64_t id) { closed = id; return id == 7; };
+        }
+        server.SetSessionControl(control);
+        uint16_t port = 0;
+        CHECK(server.Start(BindLoopback(SOCK_STREAM, port), 0));
+
+        CHECK(Request(port, "GET /sessions HTTP/1.1\r\n\r\n") == "HTTP/1.1 200 OK");
+        std::string close = "POST /sessions/close?id=7 HTTP/1.1\r\n";
+        if (!allowClose) {
+            CHECK(Request(port, close + "X-Session-Control: 1\r\n\r\n") == "HTTP/1.1 405 Method Not Allowed");
+            continue;
+        }
+        // 浏览器可以跨站发出的简单表单请求没有自定义请求头
+        CHECK(Request(port, close + "Content-Type: application/x-www-form-urlencoded\r\n\r\n") == "HTTP/1.1 403 Forbidden");
+        CHECK(Request(port, close + "X-Session-Control:\r\n\r\n") == "HTTP/1.1 403 Forbidden");
+        CHECK(closed == 0);
+        CHECK(Request(port, close + "Host: x\r\nx-session-control: 1\r\n\r\n") == "HTTP/1.1 200 OK");
+        CHECK(closed == 7);
+        CHECK(Request(port, "POST /sessions/close?id=8 HTTP/1.1\r\nX-Session-Control: yes\r\n\r\n") == "HTTP/1.1 404 Not Found");
+    }
+}
+
+int main() {
+    if (!NetStartup()) {
+        return 1;
+    }
+    TestHistogramBuckets();
+    TestSnapshots();
+    TestPrometheus();
+    TestSessionControl();
+    NetCleanup();
+    return TestResult("MetricsTest");
+}
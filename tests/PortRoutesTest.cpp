@@ -0,0 +1,111 @@
+// 端口范围和路由表测试：范围解析、端口冲突检查、按端口查找和目标端口映射
+#include "../RelayRule.h"
+#include "TestSupport.h"
+
+static sockaddr_storage Address(int family, const char* text) {
+    sockaddr_storage addr{};
+    addr.ss_family = (decltype(addr.ss_family))family;
+    if (family == AF_INET6) {
+        inet_pton(AF_INET6, text, &((sockaddr_in6*)&addr)->sin6_addr);
+    }
+    else {
+        inet_pton(AF_INET, text, &((sockaddr_in*)&addr)->sin_addr);
+    }
+    return addr;
+}
+
+static RouteTable::Route MakeRoute(Protocol protocol, const sockaddr_storage& addr, uint16_t first, uint16_t last, uint32_t rule) {
+    RouteTable::Route route;
+    route.listenAddr = addr;
+    route.listen = { first, last };
+    route.protocol = protocol;
+    route.rule = rule;
+    return route;
+}
+
+static void TestParsing() {
+    PortRange range;
+    CHECK(ParsePortRange("8080", range) && range.first == 8080 && range.last == 8080 && range.Count() == 1);
+    CHECK(ParsePortRange("20000-29999", range) && range.first == 20000 && range.last == 29999 && range.Count() == 10000);
+    CHECK(ParsePortRange("1-65535", range) && range.Count() == 65535);
+    CHECK(!ParsePortRange("", range));
+    CHECK(!ParsePortRange("0", range));
+    CHECK(!ParsePortRange("65536", range));
+    CHECK(!ParsePortRange("300-200", range));
+    CHECK(!ParsePortRange("10-", range));
+    CHECK(!ParsePortRange("-10", range));
+    CHECK(!ParsePortRange("1x", range));
+    CHECK(!ParsePortRange("100000", range));
+
+    std::string host;
+    CHECK(SplitHostPorts("0.0.0.0:20000-20009", host, range) && host == "0.0.0.0" && range.Count() == 10);
+    CHECK(SplitHostPorts("[::1]:443", host, range) && host == "[::1]" && range.first == 443);
+    CHECK(SplitHostPorts(":80", host, range) && host.empty());
+    CHECK(!SplitHostPorts("localhost", host, range));
+
+    Protocol protocol;
+    CHECK(ParseProtocol("tcp", protocol) && protocol == Protocol::Tcp);
+    CHECK(ParseProtocol("udp", protocol) && protocol == Protocol::Udp);
+    CHECK(!ParseProtocol("sctp", protocol));
+    CHECK(std::string(ProtocolName(Protocol::Udp)) == "udp");
+}
+
+static void TestConflicts() {
+    RouteTable routes;
+    const RouteTable::Route* conflict = nullptr;
+    sockaddr_storage loopback = Address(AF_INET, "127.0.0.1");
+    sockaddr_storage other = Address(AF_INET, "127.0.0.2");
+    sockaddr_storage any = Address(AF_INET, "0.0.0.0");
+    sockaddr_storage loopback6 = Address(AF_INET6, "::1");
+    sockaddr_storage any6 = Address(AF_INET6, "::");
+
+    CHECK(routes.Add(MakeRoute(Protocol::Tcp, loopback, 20000, 29999, 0)));
+    CHECK(routes.Add(MakeRoute(Protocol::Udp, loopback, 20000, 29999, 1)));  // 不同协议互不影响
+    CHECK(!routes.Add(MakeRoute(Protocol::Tcp, loopback, 29999, 30010, 2), &conflict));
+    CHECK(conflict != nullptr && conflict->rule == 0);
+    CHECK(routes.Add(MakeRoute(Protocol::Tcp, other, 25000, 25000, 3)));  // 同一端口、不同地址
+    CHECK(routes.Add(MakeRoute(Protocol::Tcp, loopback6, 20000, 20000, 4)));  // 不同地址族
+    CHECK(!routes.Add(MakeRoute(Protocol::Tcp, any, 25000, 25001, 5), &conflict));  // 通配地址与所有IPv4地址冲突
+    CHECK(!routes.Add(MakeRoute(Protocol::Udp, any6, 1, 65535, 6), &conflict));  // IPv6通配地址同时监听IPv4
+    CHECK(conflict != nullptr && conflict->rule == 1);
+    CHECK(routes.Add(MakeRoute(Protocol::Tcp, any, 30000, 30000, 7)));
+    CHECK(routes.Routes().size() == 5);
+    CHECK(routes.PortCount() == 10000 + 10000 + 1 + 1 + 1);
+
+    CHECK(routes.Find(Protocol::Tcp, 19999) == nullptr);
+    CHECK(routes.Find(Protocol::Tcp, 20000)->rule == 0);
+    CHECK(routes.Find(Protocol::Tcp, 25000)->rule == 0);  // 同一端口有多条路由时返回先添加的一条
+    CHECK(routes.Find(Protocol::Tcp, 30000)->rule == 7);
+    CHECK(routes.Find(Protocol::Udp, 29999)->rule == 1);
+    CHECK(routes.Find(Protocol::Udp, 30000) == nullptr);
+
+    RouteTable empty;
+    CHECK(empty.Find(Protocol::Tcp, 80) == nullptr);  // 没有用到的协议不分配稠密表
+}
+
+static void TestTargetAddress() {
+    sockaddr_storage base = Address(AF_INET6, "::1");
+    SetPort(base, 30000);
+    CHECK(GetPort(base) == 30000);
+    CHECK(((sockaddr_in6*)&base)->sin6_port == htons(30000));
+
+    RelayRule rule("range", UpstreamPool::FromAddress(base), 1);
+    UpstreamEndpoint endpoint;
+    endpoint.addr = base;
+    CHECK(GetPort(rule.TargetAddress(endpoint, 7)) == 30000);  // 多对一：所有端口转发到同一目标端口
+    rule.mapPorts = true;
+    CHECK(GetPort(rule.TargetAddress(endpoint, 0)) == 30000);
+    CHECK(GetPort(rule.TargetAddress(endpoint, 9999)) == 39999);
+    CHECK(GetPort(endpoint.addr) == 30000);  // 目标池中的地址不变
+}
+
+int main() {
+    if (!NetStartup()) {
+        return 1;
+    }
+    TestParsing();
+    TestConflicts();
+    TestTargetAddress();
+    NetCleanup();
+    return TestResult("PortRoutesTest");
+}
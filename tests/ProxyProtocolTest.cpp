@@ -0,0 +1,180 @@
+// PROXY协议测试：v1/v2协议头的生成、逐字节送入的增量解析、TLV跳过和非法输入
+#include <cstring>
+#include <string>
+#include "../ProxyProtocol.h"
+#include "TestSupport.h"
+
+static sockaddr_storage Address(int family, const char* text, uint16_t port) {
+    sockaddr_storage addr{};
+    addr.ss_family = (decltype(addr.ss_family))family;
+    if (family == AF_INET6) {
+        inet_pton(AF_INET6, text, &((sockaddr_in6*)&addr)->sin6_addr);
+        ((sockaddr_in6*)&addr)->sin6_port = htons(port);
+    }
+    else {
+        inet_pton(AF_INET, text, &((sockaddr_in*)&addr)->sin_addr);
+        ((sockaddr_in*)&addr)->sin_port = htons(port);
+    }
+    return addr;
+}
+
+static std::string Text(const sockaddr_storage& addr) {
+    char text[INET6_ADDRSTRLEN] = {};
+    uint16_t port;
+    if (addr.ss_family == AF_INET6) {
+        inet_ntop(AF_INET6, &((const sockaddr_in6*)&addr)->sin6_addr, text, sizeof(text));
+        port = ntohs(((const sockaddr_in6*)&addr)->sin6_port);
+    }
+    else {
+        inet_ntop(AF_INET, &((const sockaddr_in*)&addr)->sin_addr, text, sizeof(text));
+        port = ntohs(((const sockaddr_in*)&addr)->sin_port);
+    }
+    return std::string(text) + "/" + std::to_string(port);
+}
+
+// 一次送入整个数据，返回解析结果和消耗的字节数
+static ProxyHeaderParser::Result ParseAll(ProxyHeaderParser& parser, const std::string& data, size_t& consumed) {
+    return parser.Feed(data.data(), data.size(), consumed);
+}
+
+// 逐字节送入，返回解析结果和协议头的总长度
+static ProxyHeaderParser::Result ParseBytes(ProxyHeaderParser& parser, const std::string& data, size_t& total) {
+    total = 0;
+    for (size_t i = 0; i < data.size(); ++i) {
+        size_t consumed = 0;
+        ProxyHeaderParser::Result result = parser.Feed(data.data() + i, 1, consumed);
+        total += consumed;
+        if (result != ProxyHeaderParser::Result::NeedMore) {
+            return result;
+        }
+    }
+    return ProxyHeaderParser::Result::NeedMore;
+}
+
+static void TestV1() {
+    char header[kProxyHeaderMaxSize];
+    sockaddr_storage src = Address(AF_INET, "192.0.2.10", 51000);
+    sockaddr_storage dst = Address(AF_INET, "198.51.100.1", 443);
+    size_t len = BuildProxyHeader(ProxyVersion::V1, src, dst, header);
+    CHECK(std::string(header, len) == "PROXY TCP4 192.0.2.10 198.51.100.1 51000 443\r\n");
+
+    ProxyHeaderParser parser;
+    size_t consumed = 0;
+    std::string data = std::string(header, len) + "GET /";
+    CHECK(ParseAll(parser, data, consumed) == ProxyHeaderParser::Result::Done);
+    CHECK(consumed == len);  // 协议头之后的数据不属于协议头
+    CHECK(parser.HasAddresses());
+    CHECK(Text(parser.Source()) == "192.0.2.10/51000");
+    CHECK(Text(parser.Destination()) == "198.51.100.1/443");
+
+    // 最长的v1协议头也不超过缓冲区
+    src = Address(AF_INET6, "ffff:ffff:ffff:ffff:ffff:ffff:ffff:fffe", 65535);
+    dst = Address(AF_INET6, "ffff:ffff:ffff:ffff:ffff:ffff:ffff:fffd", 65535);
+    len = BuildProxyHeader(ProxyVersion::V1, src, dst, header);
+    CHECK(len < kProxyHeaderMaxSize && memcmp(header, "PROXY TCP6 ", 11) == 0);
+    ProxyHeaderParser split;
+    size_t total = 0;
+    CHECK(ParseBytes(split, std::string(header, len), total) == ProxyHeaderParser::Result::Done);
+    CHECK(total == len);
+    CHECK(Text(split.Source()) == "ffff:ffff:ffff:ffff:ffff:ffff:ffff:fffe/65535");
+
+    // IPv4映射的IPv6地址按IPv4发送，地址族不同时统一为IPv6
+    len = BuildProxyHeader(ProxyVersion::V1, Address(AF_INET6, "::ffff:10.0.0.1", 1000), Address(AF_INET, "10.0.0.2", 80), header);
+    CHECK(std::string(header, len) == "PROXY TCP4 10.0.0.1 10.0.0.2 1000 80\r\n");
+    len = BuildProxyHeader(ProxyVersion::V1, Address(AF_INET, "10.0.0.1", 1000), Address(AF_INET6, "2001:db8::1", 80), header);
+    CHECK(std::string(header, len) == "PROXY TCP6 ::ffff:10.0.0.1 2001:db8::1 1000 80\r\n");
+
+    sockaddr_storage unknown{};
+    len = BuildProxyHeader(ProxyVersion::V1, unknown, dst, header);
+    CHECK(std::string(header, len) == "PROXY UNKNOWN\r\n");
+    ProxyHeaderParser local;
+    CHECK(ParseAll(local, "PROXY UNKNOWN ffff::1 ffff::2 1 2\r\nx", consumed) == ProxyHeaderParser::Result::Done);
+    CHECK(consumed == 35 && !local.HasAddresses());
+}
+
+static void TestV2() {
+    char header[kProxyHeaderMaxSize];
+    sockaddr_storage src = Address(AF_INET6, "2001:db8::10", 40000);
+    sockaddr_storage dst = Address(AF_INET6, "2001:db8::1", 8443);
+    size_t len = BuildProxyHeader(ProxyVersion::V2, src, dst, header);
+    CHECK(len == 16 + 36);
+    CHECK(memcmp(header, "\r\n\r\n\0\r\nQUIT\n", 12) == 0);
+    CHECK((uint8_t)header[12] == 0x21 && (uint8_t)header[13] == 0x21);
+
+    ProxyHeaderParser parser;
+    size_t total = 0;
+    CHECK(ParseBytes(parser, std::string(header, len) + "payload", total) == ProxyHeaderParser::Result::Done);
+    CHECK(total == len);
+    CHECK(Text(parser.Source()) == "2001:db8::10/40000");
+    CHECK(Text(parser.Destination()) == "2001:db8::1/8443");
+
+    len = BuildProxyHeader(ProxyVersion::V2, Address(AF_INET, "192.0.2.1", 5), Address(AF_INET, "192.0.2.2", 6), header);
+    CHECK(len == 16 + 12 && (uint8_t)header[13] == 0x11);
+
+    // 附带TLV的协议头：超出内部缓冲区的部分只计数跳过
+    std::string withTlv(header, len);
+    size_t extra = 1000;
+    uint16_t length = (uint16_t)(12 + extra);
+    withTlv[14] = (char)(length >> 8);
+    withTlv[15] = (char)(length & 0xFF);
+    withTlv += std::string(extra, '\x04');
+    ProxyHeaderParser tlv;
+    size_t consumed = 0;
+    CHECK(ParseAll(tlv, withTlv + "data", consumed) == ProxyHeaderParser::Result::Done);
+    CHECK(consumed == withTlv.size());
+    CHECK(Text(tlv.Source()) == "192.0.2.1/5");
+    ProxyHeaderParser tlvSplit;
+    CHECK(ParseBytes(tlvSplit, withTlv, total) == ProxyHeaderParser::Result::Done && total == withTlv.size());
+
+    // LOCAL命令（健康检查）没有地址
+    sockaddr_storage unknown{};
+    len = BuildProxyHeader(ProxyVersion::V2, unknown, unknown, header);
+    CHECK(len == 16 && (uint8_t)header[12] == 0x20);
+    ProxyHeaderParser local;
+    CHECK(ParseAll(local, std::string(header, len), consumed) == ProxyHeaderParser::Result::Done);
+    CHECK(consumed == 16 && !local.HasAddresses());
+}
+
+static void TestInvalid() {
+    size_t consumed = 0;
+    auto invalid = [&](const std::string& data) {
+        ProxyHeaderParser parser;
+        size_t total = 0;
+        ProxyHeaderParser whole;
+        return ParseAll(whole, data, consumed) == ProxyHeaderParser::Result::Invalid &&
+            ParseBytes(parser, data, total) == ProxyHeaderParser::Result::Invalid;
+    };
+    CHECK(invalid("GET / HTTP/1.1\r\n"));
+    CHECK(invalid("PROXY TCP4 1.2.3.4 5.6.7.8 1 2\n"));  // 缺少\r
+    CHECK(invalid("PROXY TCP4 1.2.3.4 5.6.7.8 1 65536\r\n"));
+    CHECK(invalid("PROXY TCP4 ::1 ::2 1 2\r\n"));
+    CHECK(invalid("PROXY TCP4 1.2.3.4 5.6.7.8 1\r\n"));
+    CHECK(invalid("PROXY TCP4 1.2.3.4 5.6.7.8 1 2 3\r\n"));
+    CHECK(invalid("PROXY UDP4 1.2.3.4 5.6.7.8 1 2\r\n"));
+    CHECK(invalid("PROXY " + std::string(200, '1')));  // 超过107字节仍没有换行
+    CHECK(invalid(std::string("\r\n\r\n\0\r\nQUIX\n\x21\x11\x00\x0C", 16)));  // 签名错误
+    CHECK(invalid(std::string("\r\n\r\n\0\r\nQUIT\n\x11\x11\x00\x0C", 16)));  // 版本错误
+    CHECK(invalid(std::string("\r\n\r\n\0\r\nQUIT\n\x21\x11\x00\x04" "abcd", 20)));  // 地址长度不足
+
+    ProxyHeaderParser partial;
+    CHECK(ParseAll(partial, "PROXY TCP4 1.2.3.4", consumed) == ProxyHeaderParser::Result::NeedMore && consumed == 18);
+    CHECK(ParseAll(partial, " 5.6.7.8 1 2\r\nrest", consumed) == ProxyHeaderParser::Result::Done && consumed == 14);
+    CHECK(Text(partial.Destination()) == "5.6.7.8/2");
+
+    ProxyVersion version;
+    CHECK(ParseProxyVersion("v2", version) && version == ProxyVersion::V2);
+    CHECK(ParseProxyVersion("none", version) && version == ProxyVersion::None);
+    CHECK(!ParseProxyVersion("v3", version));
+    CHECK(std::string(ProxyVersionName(ProxyVersion::V1)) == "v1");
+}
+
+int main() {
+    if (!NetStartup()) {
+        return 1;
+    }
+    TestV1();
+    TestV2();
+    TestInvalid();
+    NetCleanup();
+    return TestResult("ProxyProtocolTest");
+}
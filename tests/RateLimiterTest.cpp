@@ -0,0 +1,147 @@
+// 限流测试：连接数上限、新建速率、客户端表的淘汰、字节和数据报额度，以及多线程下的计数
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "../RateLimiter.h"
+#include "TestSupport.h"
+
+static sockaddr_storage ClientAddress(uint32_t ip) {
+    sockaddr_storage addr{};
+    sockaddr_in* in = (sockaddr_in*)&addr;
+    in->sin_family = AF_INET;
+    in->sin_addr.s_addr = htonl(ip);
+    return addr;
+}
+
+static void TestConnectionCaps() {
+    RateLimits clientLimits;
+    clientLimits.maxConnections = 2;
+    RateLimiter limiter(RateLimits{}, clientLimits);
+    RateLimiter::Client *first, *second, *third, *other;
+    CHECK(limiter.Admit(ClientAddress(1), first));
+    CHECK(limiter.Admit(ClientAddress(1), second));
+    CHECK(first != nullptr && first == second);
+    CHECK(!limiter.Admit(ClientAddress(1), third));
+    CHECK(limiter.Admit(ClientAddress(2), other));
+    CHECK(other != first);
+    limiter.Release(first);
+    CHECK(limiter.Admit(ClientAddress(1), third));
+    limiter.Release(third);
+    limiter.Release(second);
+    limiter.Release(other);
+    CHECK(limiter.ClientCount() == 0);
+
+    RateLimits ruleLimits;
+    ruleLimits.maxConnections = 3;
+    RateLimiter ruleLimiter(ruleLimits, RateLimits{});
+    int admitted = 0;
+    RateLimiter::Client* client = nullptr;
+    for (uint32_t i = 0; i < 10; ++i) {
+        admitted += ruleLimiter.Admit(ClientAddress(i), client) ? 1 : 0;
+    }
+    CHECK(admitted == 3);
+    CHECK(client == nullptr);  // 只有规则整体的限制时不使用客户端表
+}
+
+static void TestConnectionRate() {
+    RateLimits clientLimits;
+    clientLimits.connectionsPerSec = 5;
+    RateLimiter limiter(RateLimits{}, clientLimits);
+    auto burst = [&](uint32_t ip) {
+        int admitted = 0;
+        for (int i = 0; i < 20; ++i) {
+            RateLimiter::Client* client;
+            if (limiter.Admit(ClientAddress(ip), client)) {
+                ++admitted;
+                limiter.Release(client);
+            }
+        }
+        return admitted;
+    };
+    CHECK(burst(7) == 5);  // 桶容量是一秒的额度
+    CHECK(burst(8) == 5);  // 每个客户端单独计算
+    std::this_thread::sleep_for(std::chrono::milliseconds(450));
+    int refilled = burst(7);
+    CHECK(refilled >= 2 && refilled <= 3);
+}
+
+static void TestEviction() {
+    RateLimits clientLimits;
+    clientLimits.maxConnections = 1;
+    RateLimiter limiter(RateLimits{}, clientLimits, 64);
+    int admitted = 0;
+    for (uint32_t i = 0; i < 100000; ++i) {
+        RateLimiter::Client* client;
+        if (limiter.Admit(ClientAddress(1000 + i), client)) {
+            ++admitted;
+            CHECK(client != nullptr);
+            limiter.Release(client);
+        }
+    }
+    CHECK(admitted == 100000);  // 表远小于客户端数量，空闲的项被新客户端复用
+    CHECK(limiter.ClientCount() == 0);
+}
+
+static void TestByteAndPacketRates() {
+    RateLimits clientLimits;
+    clientLimits.bytesPerSec = 1000000;
+    clientLimits.packetsPerSec = 1000;
+    RateLimiter limiter(RateLimits{}, clientLimits);
+    RateLimiter::Client* client;
+    CHECK(limiter.Admit(ClientAddress(3), client));
+    CHECK(limiter.Charge(client, 200000) == 0);  // 突发额度之内
+    uint64_t delayNs = limiter.Charge(client, 200000);
+    CHECK(delayNs > 100000000 && delayNs < 200000000);
+    limiter.Release(client);
+
+    RateLimits packetLimits;
+    packetLimits.packetsPerSec = 1000;
+    RateLimiter packetLimiter(RateLimits{}, packetLimits);
+    CHECK(packetLimiter.Admit(ClientAddress(4), client));
+    int allowed = 0;
+    for (int i = 0; i < 1000; ++i) {
+        allowed += packetLimiter.Allow(client, 100, 1) ? 1 : 0;
+    }
+    CHECK(allowed >= 250 && allowed <= 251);  // 桶容量是0.25秒的额度
+    packetLimiter.Release(client);
+}
+
+static void TestConcurrentAdmit() {
+    RateLimits ruleLimits, clientLimits;
+    ruleLimits.maxConnections = 1000;
+    clientLimits.maxConnections = 4;
+    RateLimiter limiter(ruleLimits, clientLimits, 256);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&limiter, t] {
+            for (int i = 0; i < 50000; ++i) {
+                RateLimiter::Client* client;
+                if (limiter.Admit(ClientAddress((uint32_t)((i * 7 + t) % 600)), client)) {
+                    limiter.Release(client);
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    CHECK(limiter.ClientCount() == 0);  // 所有连接都已归还，计数没有泄漏
+
+    int admitted = 0;
+    RateLimiter::Client* client;
+    for (int i = 0; i < 4; ++i) {
+        admitted += limiter.Admit(ClientAddress(5), client) ? 1 : 0;
+    }
+    CHECK(admitted == 4);
+    CHECK(!limiter.Admit(ClientAddress(5), client));
+}
+
+int main() {
+    TestConnectionCaps();
+    TestConnectionRate();
+    TestEviction();
+    TestByteAndPacketRates();
+    TestConcurrentAdmit();
+    return TestResult("RateLimiterTest");
+}
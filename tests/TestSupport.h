@@ -0,0 +1,129 @@
+#pragma once
+
+// 单元测试的公共部分：检查宏和回环地址上的套接字辅助函数。
+// 每个测试是一个独立的可执行文件，返回0表示通过，由ctest运行
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "../netcompat.h"
+
+inline int& TestFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+// 条件不成立时记录失败并继续执行，便于一次看到所有失败的检查
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition); \
+            ++TestFailures(); \
+        } \
+    } while (0)
+
+// 在main的末尾返回：输出结果并给出退出码
+inline int TestResult(const char* name) {
+    std::printf("%s: %s\n", name, TestFailures() == 0 ? "PASS" : "FAILED");
+    return TestFailures() == 0 ? 0 : 1;
+}
+
+inline sockaddr_storage LoopbackAddress(uint16_t port) {
+    sockaddr_storage addr{};
+    sockaddr_in* in = (sockaddr_in*)&addr;
+    in->sin_family = AF_INET;
+    in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    in->sin_port = htons(port);
+    return addr;
+}
+
+inline uint16_t LocalPort(SOCKET sock) {
+    sockaddr_storage addr{};
+    socklen_t addrLen = sizeof(addr);
+    getsockname(sock, (sockaddr*)&addr, &addrLen);
+    return ntohs(((sockaddr_in*)&addr)->sin_port);
+}
+
+// 在回环地址的随机端口上创建套接字，TCP套接字同时开始监听
+inline SOCKET BindLoopback(int type, uint16_t& port) {
+    SOCKET sock = socket(AF_INET, type, 0);
+    sockaddr_storage addr = LoopbackAddress(0);
+    if (sock == INVALID_SOCKET || bind(sock, (sockaddr*)&addr, sizeof(sockaddr_in)) == SOCKET_ERROR ||
+        (type == SOCK_STREAM && listen(sock, SOMAXCONN) == SOCKET_ERROR)) {
+        std::printf("failed to bind loopback socket: %d\n", GetLastSocketError());
+        return INVALID_SOCKET;
+    }
+    port = LocalPort(sock);
+    return sock;
+}
+
+// 关闭另一个线程正阻塞在accept上的监听套接字，让accept返回错误。Linux上close不会唤醒accept，需要先shutdown
+inline void CloseListener(SOCKET sock) {
+#ifndef _WIN32
+    shutdown(sock, SHUT_RDWR);
+#endif
+    closesocket(sock);
+}
+
+inline SOCKET ConnectLoopback(int type, uint16_t port) {
+    SOCKET sock = socket(AF_INET, type, 0);
+    sockaddr_storage addr = LoopbackAddress(port);
+    if (connect(sock, (sockaddr*)&addr, sizeof(sockaddr_in)) == SOCKET_ERROR) {
+        std::printf("failed to connect to port %u: %d\n", port, GetLastSocketError());
+    }
+    return sock;
+}
+
+inline void SetReceiveTimeout(SOCKET sock, int timeoutMs) {
+#ifdef _WIN32
+    DWORD value = (DWORD)timeoutMs;
+#else
+    timeval value{ timeoutMs / 1000, (timeoutMs % 1000) * 1000 };
+#endif
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&value, sizeof(value));
+}
+
+inline bool SendAll(SOCKET sock, const char* data, size_t size) {
+    while (size > 0) {
+        int sent = send(sock, data, (int)size, kSendFlags);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        size -= (size_t)sent;
+    }
+    return true;
+}
+
+// 一直读到对端关闭、出错或超时，返回读到的全部数据
+inline std::string ReceiveAll(SOCKET sock) {
+    std::string data;
+    char buffer[4096];
+    for (;;) {
+        int received = recv(sock, buffer, sizeof(buffer), 0);
+        if (received > 0) {
+            data.append(buffer, (size_t)received);
+            continue;
+        }
+#ifndef _WIN32
+        if (received < 0 && GetLastSocketError() == EINTR) {
+            continue;
+        }
+#endif
+        return data;
+    }
+}
+
+// 读取恰好size个字节，对端提前关闭或超时时返回已读到的部分
+inline std::string ReceiveExactly(SOCKET sock, size_t size) {
+    std::string data;
+    char buffer[4096];
+    while (data.size() < size) {
+        size_t want = size - data.size() < sizeof(buffer) ? size - data.size() : sizeof(buffer);
+        int received = recv(sock, buffer, (int)want, 0);
+        if (received <= 0) {
+            break;
+        }
+        data.append(buffer, (size_t)received);
+    }
+    return data;
+}
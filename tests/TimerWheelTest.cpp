@@ -0,0 +1,129 @@
+// 时间轮测试：各层的到期时间、取消与重新调度、级联后的精度
+#include <memory>
+#include <random>
+#include <vector>
+#include "../TimerWheel.h"
+#include "TestSupport.h"
+
+struct CountingTimer : Timer {
+    const uint64_t* now = nullptr;
+    uint64_t firedMs = 0;
+    int fired = 0;
+    void OnTimer() override {
+        firedMs = *now;
+        ++fired;
+    }
+};
+
+// 在自己的回调里重新调度自己，模拟连接的周期性超时检查
+struct RepeatingTimer : Timer {
+    TimerWheel* wheel = nullptr;
+    int remaining = 0;
+    void OnTimer() override {
+        if (--remaining > 0) {
+            wheel->Schedule(this, 250);
+        }
+    }
+};
+
+static void TestDeadlines() {
+    uint64_t start = TimerWheel::NowMs();
+    TimerWheel wheel(10);
+    uint64_t now = start;
+    std::mt19937_64 random(1);
+    std::vector<std::unique_ptr<CountingTimer>> timers;
+    std::vector<uint64_t> delays;
+    for (int i = 0; i < 4000; ++i) {
+        // 覆盖全部四层：几百毫秒、几十秒、几十分钟和一天以上（10毫秒一个刻度时最长约46小时）
+        static const uint64_t kRanges[] = { 600, 40000, 2600000, 160000000 };
+        auto timer = std::make_unique<CountingTimer>();
+        timer->now = &now;
+        uint64_t delay = random() % kRanges[i % 4];
+        wheel.Schedule(timer.get(), delay);
+        delays.push_back(delay);
+        timers.push_back(std::move(timer));
+    }
+    for (size_t i = 0; i < timers.size(); i += 5) {
+        timers[i]->Cancel();
+    }
+    size_t scheduled = wheel.Count();
+    CHECK(scheduled == timers.size() - (timers.size() + 4) / 5);
+
+    while (wheel.Count() > 0) {
+        now += 1 + random() % 3000;  // 不规则地推进，一次可能跨过很多刻度
+        wheel.Advance(now);
+    }
+    int early = 0, wrongCount = 0;
+    for (size_t i = 0; i < timers.size(); ++i) {
+        int expected = i % 5 == 0 ? 0 : 1;
+        if (timers[i]->fired != expected) ++wrongCount;
+        if (expected == 1 && timers[i]->firedMs < start + delays[i]) ++early;
+    }
+    CHECK(wrongCount == 0);
+    CHECK(early == 0);
+}
+
+static void TestPrecision() {
+    uint64_t start = TimerWheel::NowMs();
+    TimerWheel wheel(10);
+    uint64_t now = start;
+    std::mt19937_64 random(2);
+    std::vector<std::unique_ptr<CountingTimer>> timers;
+    std::vector<uint64_t> delays;
+    for (int i = 0; i < 2000; ++i) {
+        auto timer = std::make_unique<CountingTimer>();
+        timer->now = &now;
+        uint64_t delay = random() % 700000;
+        wheel.Schedule(timer.get(), delay);
+        delays.push_back(delay);
+        timers.push_back(std::move(timer));
+    }
+    // 每个刻度推进一次时，经过级联的定时器也不应晚于到期后的下一个刻度
+    while (wheel.Count() > 0) {
+        now += 10;
+        wheel.Advance(now);
+    }
+    int late = 0;
+    for (size_t i = 0; i < timers.size(); ++i) {
+        if (timers[i]->firedMs < start + delays[i] || timers[i]->firedMs > start + delays[i] + 20) ++late;
+    }
+    CHECK(late == 0);
+}
+
+static void TestReschedule() {
+    TimerWheel wheel(10);
+    uint64_t now = TimerWheel::NowMs();
+    CountingTimer timer;
+    timer.now = &now;
+    wheel.Schedule(&timer, 1000000);
+    wheel.Schedule(&timer, 50);  // 重新调度会先从原来的槽中摘除
+    CHECK(wheel.Count() == 1);
+    wheel.Advance(now + 100);
+    CHECK(timer.fired == 1);
+    CHECK(wheel.Count() == 0);
+    CHECK(!timer.IsScheduled());
+
+    RepeatingTimer repeating;
+    repeating.wheel = &wheel;
+    repeating.remaining = 5;
+    wheel.Schedule(&repeating, 250);
+    for (uint64_t t = now; wheel.Count() > 0 && t < now + 10000; t += 100) {
+        wheel.Advance(t);
+    }
+    CHECK(repeating.remaining == 0);
+
+    {
+        CountingTimer scoped;
+        scoped.now = &now;
+        wheel.Schedule(&scoped, 500);
+        CHECK(wheel.Count() == 1);
+    }
+    CHECK(wheel.Count() == 0);  // 析构时自动摘除
+}
+
+int main() {
+    TestDeadlines();
+    TestPrecision();
+    TestReschedule();
+    return TestResult("TimerWheelTest");
+}
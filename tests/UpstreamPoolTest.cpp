@@ -0,0 +1,225 @@
+// 上游目标池测试：各选择策略、一致性哈希的稳定性、按地址集合比较的发布、地址的保留和释放，以及持续读取时的快照替换
+#include <atomic>
+#include <map>
+#include <thread>
+#include <vector>
+#include "../UpstreamPool.h"
+#include "TestSupport.h"
+
+static const uint64_t kRetainMs = 300000;  // 与UpstreamPool::kEndpointRetainMs相同
+
+static sockaddr_storage Address(uint8_t host, uint16_t port) {
+    sockaddr_storage addr{};
+    sockaddr_in* in = (sockaddr_in*)&addr;
+    in->sin_family = AF_INET;
+    in->sin_addr.s_addr = htonl(0x7f000000u | host);  // 127.0.0.host
+    in->sin_port = htons(port);
+    return addr;
+}
+
+static UpstreamOptions Mode(BalanceMode mode) {
+    UpstreamOptions options;
+    options.mode = mode;
+    return options;
+}
+
+static void TestRoundRobin() {
+    UpstreamPool pool({}, Mode(BalanceMode::RoundRobin));
+    CHECK(pool.Select(0, nullptr, 0) == nullptr);  // 还没有地址
+    pool.Publish({ Address(3, 80), Address(1, 80), Address(2, 80) }, 1000);
+    CHECK(pool.Size() == 3);
+
+    // 轮询按名称顺序，与解析结果的顺序无关
+    std::vector<std::string> order;
+    for (int i = 0; i < 6; ++i) {
+        UpstreamEndpoint* endpoint = pool.Select(0, nullptr, 1000);
+        order.push_back(endpoint->name);
+        pool.Release(endpoint);
+    }
+    CHECK(order[0] == "127.0.0.1:80" && order[1] == "127.0.0.2:80" && order[2] == "127.0.0.3:80");
+    CHECK(order[3] == order[0] && order[4] == order[1] && order[5] == order[2]);
+
+    // 标记为不可用的地址和exclude都被跳过
+    UpstreamEndpoint* down = pool.Select(0, nullptr, 1000);
+    pool.Release(down);
+    for (uint32_t i = 0; i < pool.Options().maxFails; ++i) {
+        pool.ReportFailure(down, 1000);
+    }
+    CHECK(!down->Healthy(1000) && down->Healthy(1000 + pool.Options().failTimeoutMs));
+    for (int i = 0; i < 6; ++i) {
+        UpstreamEndpoint* endpoint = pool.Select(0, nullptr, 1000);
+        CHECK(endpoint != down);
+        pool.Release(endpoint);
+    }
+
+    // 只剩一个地址且被排除时仍然返回它
+    UpstreamPool single({}, Mode(BalanceMode::RoundRobin));
+    single.Publish({ Address(1, 80) }, 1000);
+    UpstreamEndpoint* only = single.Select(0, nullptr, 1000);
+    CHECK(single.Select(0, only, 1000) == only);
+    CHECK(only->active.load() == 2);
+}
+
+static void TestLeastConnections() {
+    UpstreamPool pool({}, Mode(BalanceMode::LeastConnections));
+    pool.Publish({ Address(1, 80), Address(2, 80), Address(3, 80) }, 1000);
+    std::map<UpstreamEndpoint*, int> held;
+    for (int i = 0; i < 9; ++i) {
+        ++held[pool.Select(0, nullptr, 1000)];  // 不释放，连接数逐个增加
+    }
+    CHECK(held.size() == 3);
+    for (const auto& item : held) {
+        CHECK(item.second == 3 && item.first->active.load() == 3);
+    }
+    // 释放一个地址上的连接后，新连接落到这个地址上
+    UpstreamEndpoint* idle = held.begin()->first;
+    pool.Release(idle);
+    pool.Release(idle);
+    CHECK(pool.Select(0, nullptr, 1000) == idle);
+}
+
+static void TestConsistentHash() {
+    UpstreamPool pool({}, Mode(BalanceMode::ConsistentHash));
+    pool.Publish({ Address(1, 80), Address(2, 80), Address(3, 80), Address(4, 80) }, 1000);
+
+    const int kClients = 2000;
+    std::vector<UpstreamEndpoint*> before(kClients);
+    std::map<UpstreamEndpoint*, int> load;
+    for (int i = 0; i < kClients; ++i) {
+        sockaddr_storage client = Address(0, 0);
+        ((sockaddr_in*)&client)->sin_addr.s_addr = htonl(0x0a000000u + i);  // 10.0.x.x
+        uint64_t hash = UpstreamPool::HashClient(client);
+        before[i] = pool.Select(hash, nullptr, 1000);
+        pool.Release(before[i]);
+        CHECK(pool.Select(hash, nullptr, 1000) == before[i]);  // 同一客户端总是同一地址
+        pool.Release(before[i]);
+        ++load[before[i]];
+    }
+    CHECK(load.size() == 4);
+    for (const auto& item : load) {
+        CHECK(item.second > kClients / 8);  // 大致均匀
+    }
+
+    // 删除一个地址后，只有原来落在它上面的客户端换到别的地址
+    UpstreamEndpoint* removed = before[0];
+    std::vector<sockaddr_storage> remaining;
+    for (const auto& item : load) {
+        if (item.first != removed) remaining.push_back(item.first->addr);
+    }
+    pool.Publish(remaining, 2000);
+    CHECK(pool.Size() == 3);
+    for (int i = 0; i < kClients; ++i) {
+        sockaddr_storage client = Address(0, 0);
+        ((sockaddr_in*)&client)->sin_addr.s_addr = htonl(0x0a000000u + i);
+        UpstreamEndpoint* after = pool.Select(UpstreamPool::HashClient(client), nullptr, 2000);
+        pool.Release(after);
+        CHECK(after != removed);
+        CHECK(before[i] == removed || after == before[i]);
+    }
+}
+
+static void TestPublish() {
+    UpstreamPool pool({}, Mode(BalanceMode::RoundRobin));
+    pool.Publish({ Address(1, 80), Address(2, 80) }, 1000);
+    CHECK(pool.Version() == 1);
+    UpstreamEndpoint* first = pool.Select(0, nullptr, 1000);
+    pool.Release(first);
+
+    // DNS轮换顺序或返回重复地址时不发布新快照，地址对象也保持不变
+    pool.Publish({ Address(2, 80), Address(1, 80) }, 2000);
+    pool.Publish({ Address(1, 80), Address(2, 80), Address(1, 80) }, 3000);
+    CHECK(pool.Version() == 1 && pool.Size() == 2);
+
+    // 全部解析失败时保留原有地址
+    pool.Publish({}, 4000);
+    CHECK(pool.Version() == 1 && pool.Size() == 2);
+
+    pool.Publish({ Address(1, 80), Address(2, 80), Address(3, 80) }, 5000);
+    CHECK(pool.Version() == 2 && pool.Size() == 3);
+    pool.Publish({ Address(2, 80), Address(1, 80) }, 6000);
+    CHECK(pool.Version() == 3 && pool.Size() == 2);
+
+    // 地址回到解析结果中时沿用原来的对象，连接计数和健康状态不会丢失
+    bool found = false;
+    for (int i = 0; i < 2; ++i) {
+        UpstreamEndpoint* endpoint = pool.Select(0, nullptr, 6000);
+        found = found || endpoint == first;
+        pool.Release(endpoint);
+    }
+    CHECK(found);
+}
+
+static void TestReclaim() {
+    UpstreamPool pool({}, Mode(BalanceMode::RoundRobin));
+    pool.Publish({ Address(1, 80), Address(2, 80), Address(3, 80) }, 1000);
+    UpstreamEndpoint* held = pool.Select(0, nullptr, 1000);  // 一个连接持有第一个地址
+    CHECK(held != nullptr && held->name == "127.0.0.1:80");
+
+    // 1和2从解析结果中消失：保留一段时间，DNS短暂抖动时不会丢失状态
+    pool.Publish({ Address(3, 80) }, 2000);
+    CHECK(pool.EndpointCount() == 3 && pool.Size() == 1);
+    pool.Publish({ Address(3, 80) }, 2000 + kRetainMs - 1);
+    CHECK(pool.EndpointCount() == 3);
+
+    // 保留时间过后，没有连接使用的地址被释放，仍有连接的地址等到连接结束
+    pool.Publish({ Address(3, 80) }, 2000 + kRetainMs);
+    CHECK(pool.EndpointCount() == 2);
+    CHECK(held->name == "127.0.0.1:80");
+    pool.Release(held);
+    pool.Publish({ Address(3, 80) }, 3000 + kRetainMs);
+    CHECK(pool.EndpointCount() == 1);
+}
+
+// 工作线程持续选择地址时，解析线程的每次发布都能完成并释放旧快照
+static void TestConcurrentReaders() {
+    UpstreamPool pool({}, Mode(BalanceMode::LeastConnections));
+    pool.Publish({ Address(1, 80), Address(2, 80) }, 1000);
+    std::atomic<bool> stop{ false };
+    std::atomic<uint64_t> selected{ 0 };
+    std::atomic<int> missing{ 0 };
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i) {
+        readers.emplace_back([&]() {
+            while (!stop.load(std::memory_order_relaxed)) {
+                UpstreamEndpoint* endpoint = pool.Select(0, nullptr, 1000);
+                if (endpoint == nullptr) {
+                    ++missing;
+                    continue;
+                }
+                pool.Release(endpoint);
+                selected.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    const int kRounds = 2000;
+    for (int i = 0; i < kRounds; ++i) {
+        // 在两组地址之间切换，每次都替换快照
+        if (i % 2 == 0) {
+            pool.Publish({ Address(1, 80), Address(2, 80), Address(3, 80) }, 1000);
+        }
+        else {
+            pool.Publish({ Address(1, 80), Address(2, 80) }, 1000);
+        }
+    }
+    stop = true;
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+    CHECK(pool.Version() == 1 + kRounds);
+    CHECK(missing.load() == 0);
+    CHECK(selected.load() > 0);
+}
+
+int main() {
+    if (!NetStartup()) {
+        return 1;
+    }
+    TestRoundRobin();
+    TestLeastConnections();
+    TestConsistentHash();
+    TestPublish();
+    TestReclaim();
+    TestConcurrentReaders();
+    NetCleanup();
+    return TestResult("UpstreamPoolTest");
+}